@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/builder/diskann_index_builder.h"
+
+#include "faiss/IndexPreTransform.h"
+#include "faiss/VectorTransform.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/index.h"
+#include "tenann/index/internal/index_vamana.h"
+#include "tenann/index/parameter_serde.h"
+
+namespace tenann {
+
+DiskAnnIndexBuilder::DiskAnnIndexBuilder(const IndexMeta& meta)
+    : FaissIndexBuilderWithBuffer(meta) {
+  FetchParameters(meta, &index_params_);
+  FetchParameters(meta, &search_params_);
+  T_CHECK(common_params_.metric_type == MetricType::kL2Distance ||
+          common_params_.metric_type == MetricType::kCosineSimilarity)
+      << "got unsupported metric, only l2_distance and cosine_similarity are supported for "
+         "DiskANN";
+  T_CHECK(index_params_.pq_M == 0 || common_params_.dim % index_params_.pq_M == 0)
+      << "dim " << common_params_.dim << " should be a multiple of pq_M " << index_params_.pq_M;
+}
+
+DiskAnnIndexBuilder::~DiskAnnIndexBuilder() = default;
+
+IndexRef DiskAnnIndexBuilder::InitIndex() {
+  try {
+    int dim = common_params_.dim;
+    size_t pq_M = index_params_.pq_M;
+    if (pq_M == 0) {
+      pq_M = dim % 4 == 0 ? dim / 4 : dim;
+    }
+
+    auto index_vamana = std::make_unique<IndexVamana>(dim, index_params_.R, index_params_.L,
+                                                      index_params_.alpha, pq_M, 8);
+    // default search params
+    index_vamana->search_list_size = search_params_.search_list_size;
+
+    VLOG(VERBOSE_DEBUG) << "R: " << index_vamana->R << ", L: " << index_vamana->L
+                        << ", alpha: " << index_vamana->alpha << ", pq_M: " << pq_M;
+
+    if (common_params_.metric_type == MetricType::kCosineSimilarity &&
+        !common_params_.is_vector_normed) {
+      auto index_pt = std::make_unique<faiss::IndexPreTransform>(index_vamana.release());
+      index_pt->own_fields = true;
+      auto vector_transform = std::make_unique<faiss::NormalizationTransform>(dim, 2.0);
+      index_pt->prepend_transform(vector_transform.release());
+      return std::make_shared<Index>(
+          index_pt.release(),   //
+          IndexType::kDiskAnn,  //
+          [](void* index) { delete static_cast<faiss::IndexPreTransform*>(index); });
+    }
+
+    return std::make_shared<Index>(index_vamana.release(),  //
+                                   IndexType::kDiskAnn,     //
+                                   [](void* index) { delete static_cast<IndexVamana*>(index); });
+  }
+  CATCH_FAISS_ERROR
+}
+
+idx_t DiskAnnIndexBuilder::MaxTrainRows() const {
+  // only the 8-bit pq is trained, and faiss samples at most 256 points per centroid
+  return 256 * 256;
+}
+
+}  // namespace tenann
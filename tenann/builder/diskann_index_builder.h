@@ -0,0 +1,50 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include "tenann/builder/faiss_index_builder_with_buffer.h"
+#include "tenann/index/parameters.h"
+
+namespace tenann {
+
+/**
+ * @brief Builder of DiskANN indexes.
+ *
+ * The Vamana graph is built in memory after all vectors are buffered, and is written with the
+ * disk layout of `DiskVamana` when flushing.
+ */
+class DiskAnnIndexBuilder final : public FaissIndexBuilderWithBuffer {
+ public:
+  explicit DiskAnnIndexBuilder(const IndexMeta& meta);
+  virtual ~DiskAnnIndexBuilder();
+
+  T_FORBID_COPY_AND_ASSIGN(DiskAnnIndexBuilder);
+  T_FORBID_MOVE(DiskAnnIndexBuilder);
+
+ protected:
+  IndexRef InitIndex() override;
+
+  idx_t MaxTrainRows() const override;
+
+  DiskAnnIndexParams index_params_;
+  DiskAnnSearchParams search_params_;
+};
+
+}  // namespace tenann
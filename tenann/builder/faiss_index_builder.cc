@@ -34,6 +34,7 @@
 #include "tenann/index/parameter_serde.h"
 #include "tenann/util/runtime_profile.h"
 #include "tenann/util/runtime_profile_macros.h"
+#include "tenann/util/vector_convert.h"
 
 namespace tenann {
 
@@ -99,13 +100,13 @@ IndexBuilder& FaissIndexBuilder::Add(const std::vector<SeqView>& input_columns,
     auto input_seq_type = input_columns[0].seq_view_type;
     T_CHECK(input_seq_type == SeqViewType::kArraySeqView ||
             input_seq_type == SeqViewType::kVlArraySeqView);
-    T_CHECK(input_columns[0].seq_view.array_seq_view.elem_type == PrimitiveType::kFloatType ||
-            input_columns[0].seq_view.vl_array_seq_view.elem_type == PrimitiveType::kFloatType);
-
-    inputs_live_longer_than_this_ = inputs_live_longer_than_this;
+    auto elem_type = input_seq_type == SeqViewType::kArraySeqView
+                         ? input_columns[0].seq_view.array_seq_view.elem_type
+                         : input_columns[0].seq_view.vl_array_seq_view.elem_type;
+    T_CHECK(IsVectorElemType(elem_type)) << "unsupported vector element type: " << elem_type;
 
     // add data to index
-    AddImpl(input_columns, row_ids, null_flags);
+    AddImpl(input_columns, row_ids, null_flags, inputs_live_longer_than_this);
   }
   CATCH_FAISS_ERROR;
 
@@ -130,6 +131,9 @@ IndexBuilder& FaissIndexBuilder::Flush() {
 void FaissIndexBuilder::Close() {
   // @TODO(petri): clear buffer
   T_LOG_IF(ERROR, !is_opened_) << "index builder has not been opened";
+  // the built index is owned by the index cache or the caller from now on
+  buffer_memory_.Resize(0);
+  index_memory_.Resize(0);
   SetCloseState();
 }
 
@@ -145,37 +149,57 @@ void FaissIndexBuilder::PrepareProfile() {
 }
 
 void FaissIndexBuilder::AddImpl(const std::vector<SeqView>& input_columns, const idx_t* row_ids,
-                                const uint8_t* null_flags) {
-  auto input_seq_type = input_columns[0].seq_view_type;
-
+                                const uint8_t* null_flags, bool inputs_live_longer_than_this) {
+  T_LOG_IF(ERROR, row_ids == nullptr && null_flags != nullptr)
+      << "adding nullable data without rowids is not supported";
+  const SeqView& input_column = input_columns[0];
+  auto input_seq_type = input_column.seq_view_type;
+  auto elem_type = input_seq_type == SeqViewType::kArraySeqView
+                       ? input_column.seq_view.array_seq_view.elem_type
+                       : input_column.seq_view.vl_array_seq_view.elem_type;
+
+  // nullable and non-float batches are converted and compacted in a single pass before the lock
+  // is taken, so that they are added with a single batched add as the float ones, and loader
+  // threads prepare their batches in parallel. The add itself is serialized.
   std::unique_ptr<TypedSliceIterator<float>> input_row_iterator = nullptr;
-  if (input_seq_type == SeqViewType::kArraySeqView) {
+  std::vector<float> compacted_data;
+  std::vector<idx_t> compacted_ids;
+  if (null_flags != nullptr || elem_type != PrimitiveType::kFloatType) {
+    idx_t num_rows = ConvertAndCompactRows(input_column, common_params_.dim, row_ids, null_flags,
+                                           &compacted_data, &compacted_ids);
+    if (num_rows == 0) {
+      return;
+    }
+    ArraySeqView compacted_view{.data = reinterpret_cast<const uint8_t*>(compacted_data.data()),
+                                .dim = static_cast<uint32_t>(common_params_.dim),
+                                .size = static_cast<uint32_t>(num_rows),
+                                .elem_type = PrimitiveType::kFloatType};
+    input_row_iterator = std::make_unique<TypedSliceIterator<float>>(compacted_view);
+    if (null_flags != nullptr) {
+      row_ids = compacted_ids.data();
+    }
+    // the compacted buffers are freed on return
+    inputs_live_longer_than_this = false;
+  } else if (input_seq_type == SeqViewType::kArraySeqView) {
     input_row_iterator =
-        std::make_unique<TypedSliceIterator<float>>(input_columns[0].seq_view.array_seq_view);
-  } else if (input_seq_type == SeqViewType::kVlArraySeqView) {
-    CheckDimension(input_columns[0].seq_view.vl_array_seq_view, common_params_.dim);
+        std::make_unique<TypedSliceIterator<float>>(input_column.seq_view.array_seq_view);
+  } else {
     input_row_iterator =
-        std::make_unique<TypedSliceIterator<float>>(input_columns[0].seq_view.vl_array_seq_view);
+        std::make_unique<TypedSliceIterator<float>>(input_column.seq_view.vl_array_seq_view);
+    CheckDimension(*input_row_iterator, common_params_.dim);
   }
-  T_DCHECK_NOTNULL(input_row_iterator);
 
-  if (row_ids == nullptr && null_flags == nullptr) {
-    AddRaw(*input_row_iterator);
-    return;
+  std::unique_lock<std::mutex> lock(add_mutex_, std::defer_lock);
+  if (use_thread_safe_add_) {
+    lock.lock();
   }
-
-  if (row_ids != nullptr && null_flags == nullptr) {
+  inputs_live_longer_than_this_ = inputs_live_longer_than_this;
+  if (row_ids == nullptr) {
+    AddRaw(*input_row_iterator);
+  } else {
     AddWithRowIds(*input_row_iterator, row_ids);
   }
-
-  if (row_ids != nullptr && null_flags != nullptr) {
-    AddWithRowIdsAndNullFlags(*input_row_iterator, row_ids, null_flags);
-  }
-
-  if (row_ids == nullptr && null_flags != nullptr) {
-    T_LOG(ERROR) << "adding nullable data without rowids is not supported";
-    return;
-  }
+  TrackIndexMemory();
 }
 
 void FaissIndexBuilder::AddRaw(const TypedSliceIterator<float>& input_row_iterator) {
@@ -189,17 +213,6 @@ void FaissIndexBuilder::AddWithRowIds(const TypedSliceIterator<float>& input_row
   FaissIndexAddBatch(faiss_index, input_row_iterator.size(), input_row_iterator.data(), row_ids);
 }
 
-void FaissIndexBuilder::AddWithRowIdsAndNullFlags(
-    const TypedSliceIterator<float>& input_row_iterator, const idx_t* row_ids,
-    const uint8_t* null_flags) {
-  auto faiss_index = GetFaissIndex();
-  input_row_iterator.ForEach([=](idx_t i, const float* slice_data, idx_t slice_length) {
-    if (null_flags[i] == 0) {
-      FaissIndexAddSingle(faiss_index, slice_data, row_ids + i);
-    }
-  });
-}
-
 void FaissIndexBuilder::FaissIndexAddBatch(faiss::Index* index, idx_t num_rows, const float* data,
                                            const idx_t* rowids) {
   if (rowids != nullptr) {
@@ -209,15 +222,6 @@ void FaissIndexBuilder::FaissIndexAddBatch(faiss::Index* index, idx_t num_rows,
   }
 }
 
-void FaissIndexBuilder::FaissIndexAddSingle(faiss::Index* index, const float* data,
-                                            const idx_t* rowid) {
-  if (rowid != nullptr) {
-    index->add_with_ids(1, data, rowid);
-  } else {
-    index->add(1, data);
-  }
-}
-
 void FaissIndexBuilder::CheckDimension(const TypedSliceIterator<float>& input_column, idx_t dim) {
   // check vector sizes
   input_column.ForEach([=](idx_t i, const float* slice_data, idx_t slice_lengh) {
@@ -226,6 +230,58 @@ void FaissIndexBuilder::CheckDimension(const TypedSliceIterator<float>& input_co
   });
 }
 
+idx_t FaissIndexBuilder::ConvertAndCompactRows(const SeqView& input_column, idx_t dim,
+                                               const idx_t* row_ids, const uint8_t* null_flags,
+                                               std::vector<float>* data,
+                                               std::vector<idx_t>* compacted_ids) {
+  bool is_vl_array = input_column.seq_view_type == SeqViewType::kVlArraySeqView;
+  const auto& array_view = input_column.seq_view.array_seq_view;
+  const auto& vl_array_view = input_column.seq_view.vl_array_seq_view;
+  const uint8_t* elems = is_vl_array ? vl_array_view.data : array_view.data;
+  auto elem_type = is_vl_array ? vl_array_view.elem_type : array_view.elem_type;
+  idx_t size = is_vl_array ? vl_array_view.size : array_view.size;
+  size_t elem_size = PrimitiveTypeSize(elem_type);
+
+  idx_t num_rows = size;
+  if (null_flags != nullptr) {
+    num_rows = 0;
+    for (idx_t i = 0; i < size; i++) {
+      num_rows += null_flags[i] == 0;
+    }
+  }
+  data->resize(num_rows * dim);
+  compacted_ids->clear();
+  compacted_ids->reserve(null_flags != nullptr ? num_rows : 0);
+
+  // a run of rows adjacent in memory, converted at once when it ends, as element offsets
+  float* out = data->data();
+  size_t run_begin = 0;
+  size_t run_end = 0;
+  auto convert_run = [&]() {
+    ConvertToFloat(elem_type, elems + run_begin * elem_size, run_end - run_begin, out);
+    out += run_end - run_begin;
+  };
+  for (idx_t i = 0; i < size; i++) {
+    if (null_flags != nullptr && null_flags[i] != 0) {
+      continue;
+    }
+    size_t begin = is_vl_array ? vl_array_view.offsets[i] : i * dim;
+    size_t length = is_vl_array ? vl_array_view.offsets[i + 1] - begin : dim;
+    T_LOG_IF(ERROR, length != static_cast<size_t>(dim))
+        << "invalid size for vector " << i << " : expected " << dim << " but got " << length;
+    if (null_flags != nullptr) {
+      compacted_ids->push_back(row_ids[i]);
+    }
+    if (begin != run_end) {
+      convert_run();
+      run_begin = begin;
+    }
+    run_end = begin + length;
+  }
+  convert_run();
+  return num_rows;
+}
+
 faiss::Index* FaissIndexBuilder::GetFaissIndex() {
   return static_cast<faiss::Index*>(index_ref_->index_raw());
 }
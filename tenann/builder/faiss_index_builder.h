@@ -20,6 +20,8 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "tenann/builder/index_builder.h"
 #include "tenann/common/typed_seq_view.h"
@@ -59,23 +61,34 @@ class FaissIndexBuilder : public IndexBuilder {
 
   void PrepareProfile() override;
 
-  virtual void AddImpl(const std::vector<SeqView>& input_columns, const idx_t* row_ids = nullptr,
-                       const uint8_t* null_flags = nullptr);
+  /**
+   * @brief Check the batch, convert it to float and compact its non-null rows without holding any
+   * lock, then add the batch to the index, under `add_mutex_` if thread-safe adds are enabled.
+   */
+  virtual void AddImpl(const std::vector<SeqView>& input_columns, const idx_t* row_ids,
+                       const uint8_t* null_flags, bool inputs_live_longer_than_this);
 
   virtual void AddRaw(const TypedSliceIterator<float>& input_row_iterator);
 
   virtual void AddWithRowIds(const TypedSliceIterator<float>& input_row_iterator,
                              const idx_t* row_ids);
 
-  virtual void AddWithRowIdsAndNullFlags(const TypedSliceIterator<float>& input_row_iterator,
-                                         const idx_t* row_ids, const uint8_t* null_flags);
-
   void FaissIndexAddBatch(faiss::Index* index, idx_t num_rows, const float* data,
                           const idx_t* rowids = nullptr);
-  void FaissIndexAddSingle(faiss ::Index* index, const float* data, const idx_t* rowid = nullptr);
 
   static void CheckDimension(const TypedSliceIterator<float>& input_column, idx_t dim);
 
+  /**
+   * @brief Convert the non-null rows of a batch to float and copy them with their row ids into
+   * contiguous buffers, runs of adjacent rows are converted at once. Only the dimension of the
+   * non-null rows is checked, and [compacted_ids] is left empty without [null_flags].
+   *
+   * @return number of non-null rows
+   */
+  static idx_t ConvertAndCompactRows(const SeqView& input_column, idx_t dim, const idx_t* row_ids,
+                                     const uint8_t* null_flags, std::vector<float>* data,
+                                     std::vector<idx_t>* compacted_ids);
+
   faiss::Index* GetFaissIndex();
 
   void SetOpenState();
@@ -92,6 +105,9 @@ class FaissIndexBuilder : public IndexBuilder {
 
   bool inputs_live_longer_than_this_ = false;
 
+  // serializes the updates of the index and the buffers when thread-safe adds are enabled
+  std::mutex add_mutex_;
+
   RuntimeProfile::Counter* open_total_timer_ = nullptr;
   RuntimeProfile::Counter* add_total_timer_ = nullptr;
   RuntimeProfile::Counter* flush_total_timer_ = nullptr;
@@ -19,6 +19,9 @@
 
 #include "tenann/builder/faiss_index_builder_with_buffer.h"
 
+#include <algorithm>
+#include <cstring>
+#include <random>
 #include <sstream>
 
 #include "faiss/IndexHNSW.h"
@@ -48,27 +51,10 @@ IndexBuilder& FaissIndexBuilderWithBuffer::Flush() {
     T_LOG_IF(ERROR, index_ref_ == nullptr) << "index has not been built";
 
     if (GetFaissIndex()->is_trained == false) {
-      bool with_row_ids = row_id_ != nullptr || id_buffer_.size() > 0;
-      if (id_buffer_.size()) {
-        row_id_ = id_buffer_.data();
-      }
-
-      if (data_buffer_.size()) {
-        GetFaissIndex()->train(data_buffer_.size() / common_params_.dim, data_buffer_.data());
-        if (with_row_ids) {
-          GetFaissIndex()->add_with_ids(data_buffer_.size() / common_params_.dim,
-                                        data_buffer_.data(), row_id_);
-        } else {
-          GetFaissIndex()->add(data_buffer_.size() / common_params_.dim, data_buffer_.data());
-        }
-      } else {
-        GetFaissIndex()->train(input_row_iterator_->size(), input_row_iterator_->data());
-        if (with_row_ids) {
-          GetFaissIndex()->add_with_ids(input_row_iterator_->size(), input_row_iterator_->data(), row_id_);
-        } else {
-          GetFaissIndex()->add(input_row_iterator_->size(), input_row_iterator_->data());
-        }
-      }
+      TrainOnBufferedRows(GetFaissIndex());
+      // later batches are added to the trained index directly, the buffers are not needed anymore
+      AddBufferedRows(GetFaissIndex());
+      TrackIndexMemory();
     }
 
     index_writer_->WriteIndex(index_ref_, index_save_path_, memory_only_);
@@ -80,36 +66,131 @@ IndexBuilder& FaissIndexBuilderWithBuffer::Flush() {
 
 void FaissIndexBuilderWithBuffer::Merge(const TypedSliceIterator<float>& input_row_iterator,
                                         const idx_t* row_ids) {
-  if (inputs_live_longer_than_this_ == false) {
-    data_buffer_.insert(data_buffer_.end(), input_row_iterator.data(),
-                        input_row_iterator.data() + input_row_iterator.size() * common_params_.dim);
-    if (row_ids != nullptr) {
-      id_buffer_.insert(id_buffer_.end(), row_ids, row_ids + input_row_iterator.size());
-    }
+  if (input_row_iterator.size() == 0) {
+    return;
+  }
+  if (inputs_live_longer_than_this_) {
+    buffered_rows_.push_back(
+        {input_row_iterator.data(), row_ids, input_row_iterator.size(), kInPlace});
+    num_buffered_rows_ += input_row_iterator.size();
   } else {
-    if (input_row_iterator_ == nullptr) {
-      input_row_iterator_ = std::make_unique<TypedSliceIterator<float>>(input_row_iterator);
+    CopyToChunks(input_row_iterator.data(), row_ids, input_row_iterator.size());
+  }
+  TrackBufferMemory();
+}
+
+void FaissIndexBuilderWithBuffer::CopyToChunks(const float* data, const idx_t* row_ids,
+                                               idx_t num_rows) {
+  idx_t dim = common_params_.dim;
+  idx_t min_chunk_rows = std::max<idx_t>(1, kMinBufferChunkBytes / (dim * sizeof(float)));
+  idx_t max_chunk_rows = std::max<idx_t>(1, kMaxBufferChunkBytes / (dim * sizeof(float)));
+  while (num_rows > 0) {
+    if (buffer_chunks_.empty() || buffer_chunks_.back().size == buffer_chunks_.back().capacity) {
+      // chunks grow with the buffer, so that small builds stay small and large ones are added to
+      // the index in a few large batches
+      BufferChunk chunk;
+      chunk.capacity = std::min(max_chunk_rows,
+                                std::max({min_chunk_rows, num_rows, num_buffered_rows_}));
+      chunk.data.reset(new float[chunk.capacity * dim]);
       if (row_ids != nullptr) {
-        row_id_ = row_ids;
+        chunk.row_ids.reset(new idx_t[chunk.capacity]);
       }
+      buffer_chunks_.push_back(std::move(chunk));
+    }
+
+    size_t chunk_no = buffer_chunks_.size() - 1;
+    BufferChunk& chunk = buffer_chunks_.back();
+    idx_t n = std::min(num_rows, chunk.capacity - chunk.size);
+    float* chunk_data = chunk.data.get() + chunk.size * dim;
+    std::memcpy(chunk_data, data, n * dim * sizeof(float));
+    idx_t* chunk_row_ids = nullptr;
+    if (row_ids != nullptr) {
+      chunk_row_ids = chunk.row_ids.get() + chunk.size;
+      std::memcpy(chunk_row_ids, row_ids, n * sizeof(idx_t));
+      row_ids += n;
+    }
+    chunk.size += n;
+
+    if (!buffered_rows_.empty() && buffered_rows_.back().chunk_no == chunk_no &&
+        buffered_rows_.back().data + buffered_rows_.back().num_rows * dim == chunk_data) {
+      buffered_rows_.back().num_rows += n;
     } else {
-      if (data_buffer_.size() == 0) {
-        data_buffer_.assign(input_row_iterator_->data(), input_row_iterator_->data() + input_row_iterator_->size() * common_params_.dim);
-        data_buffer_.insert(data_buffer_.end(), input_row_iterator.data(),
-                            input_row_iterator.data() + input_row_iterator.size() * common_params_.dim);
-        if (row_ids != nullptr) {
-          id_buffer_.assign(row_id_, row_id_ + input_row_iterator_->size());
-          id_buffer_.insert(id_buffer_.end(), row_ids, row_ids + input_row_iterator.size());
-        }
-      } else {
-        data_buffer_.insert(data_buffer_.end(), input_row_iterator.data(),
-                            input_row_iterator.data() +input_row_iterator.size() * common_params_.dim);
-        if (row_ids != nullptr) {
-          id_buffer_.insert(id_buffer_.end(), row_ids, row_ids + input_row_iterator.size());
+      buffered_rows_.push_back({chunk_data, chunk_row_ids, n, chunk_no});
+    }
+    num_buffered_rows_ += n;
+    data += n * dim;
+    num_rows -= n;
+  }
+}
+
+void FaissIndexBuilderWithBuffer::TrackBufferMemory() {
+  size_t bytes = 0;
+  for (const auto& chunk : buffer_chunks_) {
+    bytes += chunk.capacity * common_params_.dim * sizeof(float);
+    bytes += chunk.row_ids != nullptr ? chunk.capacity * sizeof(idx_t) : 0;
+  }
+  buffer_memory_.Resize(bytes);
+}
+
+void FaissIndexBuilderWithBuffer::TrainOnBufferedRows(faiss::Index* index) {
+  T_LOG_IF(ERROR, num_buffered_rows_ == 0) << "no vectors to train the index with";
+  if (buffered_rows_.size() == 1) {
+    index->train(buffered_rows_[0].num_rows, buffered_rows_[0].data);
+    return;
+  }
+
+  // gather the rows into a single matrix, a uniform sample of them if there are more than
+  // needed, the trainers sample their inputs anyway
+  idx_t dim = common_params_.dim;
+  idx_t max_train_rows = MaxTrainRows();
+  idx_t num_train_rows = max_train_rows == 0 ? num_buffered_rows_
+                                             : std::min(num_buffered_rows_, max_train_rows);
+  std::vector<float> train_data(num_train_rows * dim);
+  float* out = train_data.data();
+  if (num_train_rows == num_buffered_rows_) {
+    for (const auto& rows : buffered_rows_) {
+      std::memcpy(out, rows.data, rows.num_rows * dim * sizeof(float));
+      out += rows.num_rows * dim;
+    }
+  } else {
+    // selection sampling, every row is picked with the same probability in a single pass
+    std::mt19937_64 rng(1234);
+    idx_t num_left = num_buffered_rows_;
+    idx_t num_to_pick = num_train_rows;
+    for (const auto& rows : buffered_rows_) {
+      for (idx_t i = 0; i < rows.num_rows && num_to_pick > 0; i++, num_left--) {
+        if (static_cast<idx_t>(rng() % num_left) < num_to_pick) {
+          std::memcpy(out, rows.data + i * dim, dim * sizeof(float));
+          out += dim;
+          num_to_pick--;
         }
       }
     }
   }
+  index->train(num_train_rows, train_data.data());
+}
+
+void FaissIndexBuilderWithBuffer::AddBufferedRows(faiss::Index* index) {
+  // the last buffered rows of each chunk, after which the chunk can be freed
+  std::vector<size_t> last_use(buffer_chunks_.size(), 0);
+  for (size_t i = 0; i < buffered_rows_.size(); i++) {
+    if (buffered_rows_[i].chunk_no != kInPlace) {
+      last_use[buffered_rows_[i].chunk_no] = i;
+    }
+  }
+  for (size_t i = 0; i < buffered_rows_.size(); i++) {
+    const auto& rows = buffered_rows_[i];
+    FaissIndexAddBatch(index, rows.num_rows, rows.data, rows.row_ids);
+    if (rows.chunk_no != kInPlace && last_use[rows.chunk_no] == i) {
+      buffer_chunks_[rows.chunk_no] = BufferChunk();
+      TrackBufferMemory();
+    }
+  }
+
+  std::vector<BufferedRows>().swap(buffered_rows_);
+  std::vector<BufferChunk>().swap(buffer_chunks_);
+  num_buffered_rows_ = 0;
+  buffer_memory_.Resize(0);
 }
 
 void FaissIndexBuilderWithBuffer::AddRaw(const TypedSliceIterator<float>& input_row_iterator) {
@@ -131,16 +212,4 @@ void FaissIndexBuilderWithBuffer::AddWithRowIds(const TypedSliceIterator<float>&
   }
 }
 
-void FaissIndexBuilderWithBuffer::AddWithRowIdsAndNullFlags(
-    const TypedSliceIterator<float>& input_row_iterator, const idx_t* row_ids,
-    const uint8_t* null_flags) {
-  auto faiss_index = GetFaissIndex();
-  input_row_iterator.ForEach([=](idx_t i, const float* slice_data, idx_t slice_length) {
-    if (null_flags[i] == 0) {
-      data_buffer_.insert(data_buffer_.end(), slice_data, slice_data + slice_length);
-      id_buffer_.push_back(row_ids[i]);
-    }
-  });
-}
-
 }  // namespace tenann
\ No newline at end of file
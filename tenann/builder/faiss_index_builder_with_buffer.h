@@ -19,6 +19,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 #include "tenann/builder/faiss_index_builder.h"
 
 namespace tenann {
@@ -33,17 +37,52 @@ class FaissIndexBuilderWithBuffer : public FaissIndexBuilder {
   IndexBuilder& Flush() override;
 
  protected:
+  /// Rows buffered until the index is trained, either in place or in one of `buffer_chunks_`.
+  struct BufferedRows {
+    const float* data;
+    /// nullptr if the rows are added without row ids
+    const idx_t* row_ids;
+    idx_t num_rows;
+    /// index of the chunk holding the rows, `kInPlace` for the batches that outlive the builder
+    size_t chunk_no;
+  };
+
+  /// Fixed-size storage for the copied rows, it is never reallocated once created.
+  struct BufferChunk {
+    std::unique_ptr<float[]> data;
+    std::unique_ptr<idx_t[]> row_ids;
+    idx_t capacity = 0;
+    idx_t size = 0;
+  };
+
+  static constexpr size_t kInPlace = SIZE_MAX;
+  /// Size of the vectors in a chunk, chunks grow with the buffer from the min to the max size.
+  static constexpr size_t kMinBufferChunkBytes = 1 << 20;
+  static constexpr size_t kMaxBufferChunkBytes = 64 << 20;
+
+  /// Buffer a batch, which is referenced in place if it outlives the builder and copied otherwise.
   void Merge(const TypedSliceIterator<float>& input_row_iterator, const idx_t* row_ids);
+  /// Copy rows to the end of the chunks, extending the last buffered rows if they are adjacent.
+  void CopyToChunks(const float* data, const idx_t* row_ids, idx_t num_rows);
+  /// Charge the capacity of the chunks to the memory tracker.
+  void TrackBufferMemory();
+
+  /// Max number of rows to train the index with when the buffered rows have to be gathered into a
+  /// single matrix, 0 means all the rows.
+  virtual idx_t MaxTrainRows() const { return 0; }
+  /// Train the index on the buffered rows, in place if they are contiguous, otherwise on at most
+  /// `MaxTrainRows()` rows sampled uniformly.
+  void TrainOnBufferedRows(faiss::Index* index);
+  /// Add the buffered rows to the trained index, each chunk is freed once its rows are added.
+  void AddBufferedRows(faiss::Index* index);
+
   void AddRaw(const TypedSliceIterator<float>& input_row_iterator) override;
   void AddWithRowIds(const TypedSliceIterator<float>& input_row_iterator, const idx_t* row_ids) override;
-  void AddWithRowIdsAndNullFlags(const TypedSliceIterator<float>& input_row_iterator, const idx_t* row_ids,
-                                 const uint8_t* null_flags) override;
 
  protected:
-  std::unique_ptr<TypedSliceIterator<float>> input_row_iterator_ = nullptr;
-  const int64_t* row_id_ = nullptr;
-  std::vector<float> data_buffer_;
-  std::vector<int64_t> id_buffer_;
+  std::vector<BufferedRows> buffered_rows_;
+  std::vector<BufferChunk> buffer_chunks_;
+  idx_t num_buffered_rows_ = 0;
   bool is_vl_array_ = false;
 };
 
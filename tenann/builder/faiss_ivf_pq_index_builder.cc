@@ -19,6 +19,7 @@
 
 #include "tenann/builder/faiss_ivf_pq_index_builder.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "faiss/IndexIVFPQ.h"
@@ -95,4 +96,11 @@ IndexRef FaissIvfPqIndexBuilder::InitIndex() {
   CATCH_JSON_ERROR
 }
 
-}  // namespace tenann
\ No newline at end of file
+idx_t FaissIvfPqIndexBuilder::MaxTrainRows() const {
+  // faiss samples at most 256 points per centroid, both for the coarse quantizer and the pq
+  constexpr idx_t kMaxPointsPerCentroid = 256;
+  auto ksub = idx_t(1) << std::min<size_t>(index_params_.nbits, 16);
+  return std::max<idx_t>(index_params_.nlist, ksub) * kMaxPointsPerCentroid;
+}
+
+}  // namespace tenann
@@ -39,6 +39,8 @@ class FaissIvfPqIndexBuilder final : public FaissIndexBuilderWithBuffer {
  protected:
   IndexRef InitIndex() override;
 
+  idx_t MaxTrainRows() const override;
+
   FaissIvfPqIndexParams index_params_;
   FaissIvfPqSearchParams search_params_;
 };
@@ -45,6 +45,12 @@ IndexBuilder& IndexBuilder::EnableCustomRowId() {
   return *this;
 }
 
+IndexBuilder& IndexBuilder::EnableThreadSafeAdd() {
+  T_LOG_IF(ERROR, is_opened()) << "all confuration actions must be called before index being opened";
+  use_thread_safe_add_ = true;
+  return *this;
+}
+
 IndexBuilder& IndexBuilder::EnableProfile() {
   T_LOG_IF(ERROR, is_opened()) << "all confuration actions must be called before index being opened";
   profile_ = std::make_unique<RuntimeProfile>("IndexBuilderProfile");
@@ -58,6 +64,20 @@ IndexBuilder& IndexBuilder::DisableProfile() {
   return *this;
 }
 
+IndexBuilder& IndexBuilder::SetMemoryTracker(MemoryTrackerRef tracker) {
+  T_LOG_IF(ERROR, is_opened()) << "all confuration actions must be called before index being opened";
+  memory_tracker_ = std::move(tracker);
+  buffer_memory_ = TrackedMemory(memory_tracker_);
+  index_memory_ = TrackedMemory(memory_tracker_);
+  return *this;
+}
+
+void IndexBuilder::TrackIndexMemory() {
+  if (memory_tracker_ != nullptr && index_ref_ != nullptr) {
+    index_memory_.Resize(index_ref_->EstimateMemoryUsage());
+  }
+}
+
 const IndexMeta& IndexBuilder::index_meta() const { return index_meta_; }
 
 IndexRef IndexBuilder::index_ref() const { return index_ref_; }
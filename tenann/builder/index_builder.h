@@ -23,12 +23,14 @@
 #include "tenann/index/index_reader.h"
 #include "tenann/index/index_writer.h"
 #include "tenann/store/index_meta.h"
+#include "tenann/util/memory_tracker.h"
 #include "tenann/util/runtime_profile.h"
 
 namespace tenann {
 
 /**
- * @brief Super class for all index builders. Not thread-safe.
+ * @brief Super class for all index builders. Not thread-safe, except for `Add` once
+ * `EnableThreadSafeAdd` is called.
  *
  */
 class IndexBuilder {
@@ -86,9 +88,24 @@ class IndexBuilder {
   /** Setters */
   IndexBuilder& SetBuildOptions(const json& options);
   IndexBuilder& EnableCustomRowId();
+
+  /**
+   * @brief Allow multiple loader threads to call `Add`, each with its own batches.
+   *
+   * Only the checks, conversion and compaction of the batches run in parallel, the batches are
+   * added to the index one at a time under a lock. `Flush` and `Close` must not run concurrently
+   * with `Add`.
+   */
+  IndexBuilder& EnableThreadSafeAdd();
   IndexBuilder& EnableProfile();
   IndexBuilder& DisableProfile();
 
+  /**
+   * @brief Charge the memory held by this builder to [tracker], i.e. the buffered input vectors
+   * and the index under construction, until the builder is closed or destroyed.
+   */
+  IndexBuilder& SetMemoryTracker(MemoryTrackerRef tracker);
+
   /** Getters */
   const IndexMeta& index_meta() const;
 
@@ -100,9 +117,14 @@ class IndexBuilder {
 
   RuntimeProfile* profile();
 
+  const MemoryTrackerRef& memory_tracker() const { return memory_tracker_; }
+
  protected:
   virtual void PrepareProfile() = 0;
 
+  /// Charge the memory of the index under construction, if a tracker is set.
+  void TrackIndexMemory();
+
   /* meta */
   IndexMeta index_meta_;
   /* index */
@@ -110,6 +132,7 @@ class IndexBuilder {
   /* options */
   json build_options_;
   bool use_custom_row_id_ = false;
+  bool use_thread_safe_add_ = false;
 
   /* writer */
   IndexWriterRef index_writer_ = nullptr;
@@ -117,6 +140,11 @@ class IndexBuilder {
 
   /* statistics */
   std::unique_ptr<RuntimeProfile> profile_ = nullptr;
+
+  /* memory tracking */
+  MemoryTrackerRef memory_tracker_ = nullptr;
+  TrackedMemory buffer_memory_;
+  TrackedMemory index_memory_;
 };
 
 }  // namespace tenann
\ No newline at end of file
@@ -33,7 +33,9 @@ enum PrimitiveType {
   kUInt32Type,      /* 8 */
   kUInt64Type,      /* 9 */
   kFloatType,       /* 10 */
-  kDoubleType       /* 11 */
+  kDoubleType,      /* 11 */
+  kFloat16Type,     /* 12, IEEE 754 half precision, stored as uint16_t */
+  kBFloat16Type     /* 13, bfloat16, the upper half of a float, stored as uint16_t */
 };
 
 }
\ No newline at end of file
@@ -18,9 +18,15 @@
  */
 
 #include "tenann/factory/ann_searcher_factory.h"
+
+#include <algorithm>
+#include <exception>
+
+#include "tenann/searcher/diskann_searcher.h"
 #include "tenann/searcher/faiss_hnsw_ann_searcher.h"
 #include "tenann/searcher/faiss_ivf_pq_ann_searcher.h"
 #include "tenann/common/logging.h"
+#include "tenann/util/thread_pool.h"
 
 namespace tenann {
 
@@ -29,9 +35,44 @@ std::shared_ptr<AnnSearcher> AnnSearcherFactory::CreateSearcherFromMeta(const In
     return std::make_unique<FaissHnswAnnSearcher>(meta);
   } else if(meta.index_type() == IndexType::kFaissIvfPq) {
     return std::make_unique<FaissIvfPqAnnSearcher>(meta);
+  } else if (meta.index_type() == IndexType::kDiskAnn) {
+    return std::make_unique<DiskAnnSearcher>(meta);
   } else {
     T_LOG(ERROR) << "Unsupported index type: " << static_cast<int>(meta.index_type());
   }
 }
 
-}  // namespace tenann
\ No newline at end of file
+std::vector<std::shared_ptr<AnnSearcher>> AnnSearcherFactory::CreateSearchersAndReadIndexes(
+    const IndexMeta& meta, const std::vector<std::string>& paths, int parallelism,
+    std::vector<std::string>* errors, bool enable_profile) {
+  std::vector<std::shared_ptr<AnnSearcher>> searchers(paths.size());
+  if (errors != nullptr) {
+    errors->assign(paths.size(), "");
+  }
+
+  // a pool of its own bounds the files in flight, the calling thread reads files as well and the
+  // readers may use the io pool to read each file
+  ThreadPool pool(std::max(1, std::min<int>(parallelism, paths.size()) - 1));
+  pool.ParallelFor(paths.size(), parallelism, [&](size_t i) {
+    try {
+      auto searcher = CreateSearcherFromMeta(meta);
+      if (enable_profile) {
+        searcher->index_reader()->EnableProfile();
+      }
+      searcher->ReadIndex(paths[i]);
+      searchers[i] = std::move(searcher);
+    } catch (Error& e) {
+      if (errors != nullptr) {
+        (*errors)[i] = e.message();
+      }
+    } catch (std::exception& e) {
+      // e.g. std::bad_alloc, which must not escape the pool and terminate the process
+      if (errors != nullptr) {
+        (*errors)[i] = e.what();
+      }
+    }
+  });
+  return searchers;
+}
+
+}  // namespace tenann
@@ -19,6 +19,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "tenann/searcher/ann_searcher.h"
 #include "tenann/store/index_meta.h"
 
@@ -26,6 +29,17 @@ namespace tenann {
 
 struct AnnSearcherFactory {
   static std::shared_ptr<AnnSearcher> CreateSearcherFromMeta(const IndexMeta& meta);
+
+  /**
+   * @brief Create a searcher for each index file at [paths] and read up to [parallelism] files
+   * concurrently, e.g. to reopen the indexes of many segments at startup.
+   *
+   * A searcher is nullptr if its file could not be read, [errors] receives the error message at
+   * the same position if given. The readers collect their profiles if [enable_profile].
+   */
+  static std::vector<std::shared_ptr<AnnSearcher>> CreateSearchersAndReadIndexes(
+      const IndexMeta& meta, const std::vector<std::string>& paths, int parallelism,
+      std::vector<std::string>* errors = nullptr, bool enable_profile = false);
 };
 
 }  // namespace tenann
\ No newline at end of file
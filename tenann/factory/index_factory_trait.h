@@ -19,14 +19,17 @@
 
 #include <memory>
 
+#include "tenann/builder/diskann_index_builder.h"
 #include "tenann/builder/faiss_hnsw_index_builder.h"
 #include "tenann/builder/faiss_ivf_pq_index_builder.h"
 #include "tenann/builder/index_builder.h"
 #include "tenann/common/error.h"
+#include "tenann/index/index_diskann_reader.h"
+#include "tenann/index/index_diskann_writer.h"
+#include "tenann/index/index_hnsw_reader.h"
+#include "tenann/index/index_hnsw_writer.h"
 #include "tenann/index/index_ivfpq_reader.h"
 #include "tenann/index/index_ivfpq_writer.h"
-#include "tenann/index/faiss_index_reader.h"
-#include "tenann/index/faiss_index_writer.h"
 #include "tenann/index/index_reader.h"
 #include "tenann/index/index_writer.h"
 #include "tenann/store/index_meta.h"
@@ -43,6 +46,10 @@ namespace tenann {
     CASE_FN(kFaissIvfPq);                                            \
     break;                                                           \
   }                                                                  \
+  case kDiskAnn: {                                                   \
+    CASE_FN(kDiskAnn);                                               \
+    break;                                                           \
+  }                                                                  \
   default: {                                                         \
     throw Error(__FILE__, __LINE__, "using unsupported index type"); \
   }
@@ -69,11 +76,11 @@ struct IndexFactoryTrait {
 template <>
 struct IndexFactoryTrait<kFaissHnsw> {
   static std::shared_ptr<IndexReader> CreateReaderFromMeta(const IndexMeta& meta) {
-    return std::make_shared<FaissIndexReader>(meta);
+    return std::make_shared<IndexHnswReader>(meta);
   };
 
   static std::shared_ptr<IndexWriter> CreateWriterFromMeta(const IndexMeta& meta) {
-    return std::make_shared<FaissIndexWriter>(meta);
+    return std::make_shared<IndexHnswWriter>(meta);
   };
 
   static std::shared_ptr<IndexBuilder> CreateBuilderFromMeta(const IndexMeta& meta) {
@@ -96,4 +103,19 @@ struct IndexFactoryTrait<kFaissIvfPq> {
   };
 };
 
+template <>
+struct IndexFactoryTrait<kDiskAnn> {
+  static std::shared_ptr<IndexReader> CreateReaderFromMeta(const IndexMeta& meta) {
+    return std::make_shared<IndexDiskAnnReader>(meta);
+  };
+
+  static std::shared_ptr<IndexWriter> CreateWriterFromMeta(const IndexMeta& meta) {
+    return std::make_shared<IndexDiskAnnWriter>(meta);
+  };
+
+  static std::shared_ptr<IndexBuilder> CreateBuilderFromMeta(const IndexMeta& meta) {
+    return std::make_shared<DiskAnnIndexBuilder>(meta);
+  };
+};
+
 }  // namespace tenann
\ No newline at end of file
@@ -40,4 +40,16 @@ IndexRef FaissIndexReader::ReadIndexFile(const std::string& path) {
   }
 }
 
+IndexRef FaissIndexReader::ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) {
+  try {
+    SourceIOReader reader(std::move(source));
+    auto faiss_index = std::unique_ptr<faiss::Index>(faiss::read_index(&reader));
+    return std::make_shared<Index>(faiss_index.release(),  //
+                                   (IndexType)index_meta_.index_type(),
+                                   [](void* index) { delete static_cast<faiss::Index*>(index); });
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
 }  // namespace tenann
\ No newline at end of file
@@ -33,6 +33,8 @@ class FaissIndexReader : public IndexReader {
 
   // Read index file
   IndexRef ReadIndexFile(const std::string& path) override;
+
+  IndexRef ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) override;
 };
 
 }  // namespace tenann
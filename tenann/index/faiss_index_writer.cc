@@ -37,4 +37,12 @@ void FaissIndexWriter::WriteIndexFile(IndexRef index, const std::string& path) {
   }
 }
 
+void FaissIndexWriter::WriteIndexTo(IndexRef index, faiss::IOWriter* f) {
+  try {
+    faiss::write_index(static_cast<faiss::Index*>(index->index_raw()), f);
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
 }  // namespace tenann
\ No newline at end of file
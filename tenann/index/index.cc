@@ -23,8 +23,19 @@
 #include "faiss/IndexHNSW.h"
 #include "faiss/IndexIDMap.h"
 #include "faiss/IndexIVFPQ.h"
+#include "faiss/IndexFlatCodes.h"
+#include "faiss/VectorTransform.h"
+#include "faiss/invlists/InvertedLists.h"
 #include "tenann/common/logging.h"
+#include "tenann/index/index_ivfpq_reader.h"
+#include "tenann/index/internal/disk_vamana.h"
 #include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/index_vamana.h"
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+#include "tenann/index/internal/tombstone.h"
+#include "tenann/util/memory_usage.h"
 
 namespace tenann {
 
@@ -52,106 +63,210 @@ void* Index::index_raw() const { return index_raw_; }
 
 IndexType Index::index_type() const { return index_type_; }
 
-// @TODO(petri): implement it with a seperate class
-size_t Index::EstimateMemoryUsage() {
-  size_t mem_usage = 0;
-  // IndexType::kFaissHnsw
-  if (index_type_ == IndexType::kFaissHnsw) {
-    auto* faiss_index = static_cast<faiss::Index*>(index_raw_);
-    auto [index_id_map, transform, index_hnsw] = faiss_util::UnpackHnsw(faiss_index);
-
-    if (index_hnsw == nullptr) {
-      T_LOG(WARNING)
-          << "estimating memory usage for unsupported index types would always get result 1";
-      return 1;
-    }
+void Index::SetTombstone(std::unique_ptr<Tombstone> tombstone) {
+  tombstone_ = std::move(tombstone);
+}
 
-    // IndexIDMap
-    if (index_id_map != nullptr) {
-      mem_usage += sizeof(*index_id_map);
-      mem_usage += index_id_map->id_map.capacity() * sizeof(faiss::Index::idx_t);
-    }
+namespace {
 
-    // IndexPreTransform
-    if (transform != nullptr) {
-      mem_usage += sizeof(*transform);
-      // IndexPreTransform.VectorTransform
-      mem_usage += transform->chain.capacity() * sizeof(faiss::VectorTransform*);
-      for (auto chain_ptr : transform->chain) {
-        mem_usage += sizeof(*chain_ptr);
-      }
+void AddPreTransform(const faiss::IndexPreTransform* transform, MemoryUsage* usage) {
+  if (transform == nullptr) {
+    return;
+  }
+  usage->AddAllocation("transform", sizeof(*transform));
+  usage->AddVector("transform", transform->chain);
+  for (auto* vt : transform->chain) {
+    usage->AddAllocation("transform", sizeof(*vt));
+    if (auto* lt = dynamic_cast<const faiss::LinearTransform*>(vt); lt != nullptr) {
+      usage->AddVector("transform", lt->A);
+      usage->AddVector("transform", lt->b);
     }
+  }
+}
 
-    auto& hnsw = index_hnsw->hnsw;
-    // graph structure
-    mem_usage += hnsw.assign_probas.capacity() * sizeof(double) +
-                 hnsw.cum_nneighbor_per_level.capacity() * sizeof(int) +
-                 hnsw.levels.capacity() * sizeof(int) + hnsw.offsets.capacity() * sizeof(size_t) +
-                 hnsw.neighbors.capacity() * sizeof(faiss::HNSW::storage_idx_t);
+/// Flat vector storage, e.g. the storage of HNSW or the coarse quantizer of IVF.
+void AddFlatIndex(const std::string& component, const faiss::Index* index, MemoryUsage* usage) {
+  if (index == nullptr) {
+    return;
+  }
+  if (auto* flat = dynamic_cast<const faiss::IndexFlatCodes*>(index); flat != nullptr) {
+    usage->AddAllocation(component, sizeof(*flat));
+    usage->AddVector(component, flat->codes);
+  } else {
+    usage->AddAllocation(component, sizeof(*index));
+    usage->AddAllocation(component, index->ntotal * index->d * sizeof(float));
+  }
+}
 
-    // vectors
-    mem_usage += index_hnsw->storage->ntotal * index_hnsw->storage->d * sizeof(float);
+void AddProductQuantizer(const std::string& component, const faiss::ProductQuantizer& pq,
+                         MemoryUsage* usage) {
+  usage->AddVector(component, pq.centroids);
+  usage->AddVector(component, pq.transposed_centroids);
+  usage->AddVector(component, pq.centroids_sq_lengths);
+  usage->AddVector(component, pq.sdc_table);
+}
 
-    return mem_usage;
+void AddInvertedLists(const faiss::IndexIVF& ivf, MemoryUsage* usage) {
+  const faiss::InvertedLists* invlists = ivf.invlists;
+  if (invlists == nullptr) {
+    return;
   }
 
-  // IndexType::kFaissIvfPq
-  if (index_type_ == IndexType::kFaissIvfPq) {
-    auto* faiss_index = static_cast<faiss::Index*>(index_raw_);
-    auto [transform, index_ivf_pq] = faiss_util::UnpackIvfPq(faiss_index);
-    if (index_ivf_pq == nullptr) {
-      T_LOG(WARNING)
-          << "estimating memory usage for unsupported index types would always get result 1";
-      return 1;
+  if (auto* array = dynamic_cast<const faiss::ArrayInvertedLists*>(invlists); array != nullptr) {
+    usage->AddAllocation("invlists", sizeof(*array));
+    usage->AddVector("invlists", array->codes);
+    usage->AddVector("invlists", array->ids);
+    for (size_t i = 0; i < array->nlist; i++) {
+      usage->AddVector("invlists.codes", array->codes[i]);
+      usage->AddVector("invlists.ids", array->ids[i]);
     }
+    return;
+  }
 
-    // IndexPreTransform
-    if (transform != nullptr) {
-      mem_usage += sizeof(*transform);
-      // IndexPreTransform.VectorTransform
-      mem_usage += transform->chain.capacity() * sizeof(faiss::VectorTransform*);
-      for (auto chain_ptr : transform->chain) {
-        mem_usage += sizeof(*chain_ptr);
-      }
-    }
+  if (auto* block_cache = dynamic_cast<const faiss::BlockCacheInvertedLists*>(invlists);
+      block_cache != nullptr) {
+    // the blocks are charged by their own cache entries, only the bookkeeping is charged here
+    const std::string component = "invlists.block_cache_bookkeeping";
+    usage->AddAllocation(component, sizeof(*block_cache));
+    usage->AddVector(component, block_cache->lists);
+    usage->AddVector(component, block_cache->id_offsets);
+    usage->AddVector(component, block_cache->list_blocks);
+    usage->AddVector(component, block_cache->offset_difference);
+    usage->AddVector(component, block_cache->blocks);
+    usage->AddVector(component, block_cache->cache_handles);
+    usage->AddVector(component, block_cache->block_locks);
+    usage->AddVector(component, block_cache->loads);
+    usage->AddString(component, block_cache->filename);
+    return;
+  }
 
-    // IndexIvfPq
-    mem_usage += sizeof(*index_ivf_pq);
-    // IndexIvfPq.reconstruction_errors
-    for (auto reconstruction_error : index_ivf_pq->reconstruction_errors) {
-      mem_usage += sizeof(reconstruction_error);
-      mem_usage += reconstruction_error.capacity() * sizeof(float);
-    }
+  // lists held elsewhere, e.g. mapped from a file, charge their content
+  usage->AddAllocation("invlists", sizeof(*invlists));
+  usage->AddBytes("invlists",
+                  invlists->compute_ntotal() * (ivf.code_size + sizeof(faiss::Index::idx_t)));
+}
 
-    // IndexIVFPQ.PolysemousTraining
-    if (index_ivf_pq->polysemous_training != nullptr) {
-      mem_usage += sizeof(*index_ivf_pq->polysemous_training);
-    }
+void AddDirectMap(const faiss::DirectMap& direct_map, MemoryUsage* usage) {
+  usage->AddVector("direct_map", direct_map.array);
+  // a node holds the next pointer, the key-value pair and the cached hash
+  const auto& m = direct_map.hashtable;
+  using Node = std::tuple<void*, std::pair<const faiss::Index::idx_t, faiss::Index::idx_t>, size_t>;
+  usage->AddAllocation("direct_map", sizeof(Node), m.size());
+  if (!m.empty()) {
+    usage->AddAllocation("direct_map", m.bucket_count() * sizeof(void*));
+  }
+}
 
-    // IndexIVF.InvertedLists
-    if (index_ivf_pq->invlists != nullptr) {
-      mem_usage += sizeof(*index_ivf_pq->invlists);
-      mem_usage += index_ivf_pq->invlists->compute_ntotal() *
-                   (index_ivf_pq->code_size + sizeof(faiss::Index::idx_t));
-    }
+void AddHnsw(const faiss::Index* index, MemoryUsage* usage) {
+  auto [index_id_map, transform, index_hnsw] = faiss_util::UnpackHnsw(index);
+  if (index_hnsw == nullptr) {
+    T_LOG(WARNING) << "estimating memory usage for unsupported hnsw index";
+    return;
+  }
 
-    // IndexIVF.DirectMap
-    {
-      mem_usage += index_ivf_pq->direct_map.array.capacity() * sizeof(faiss::Index::idx_t);
-      // 估算 unordered_map 占用内存大小
-      auto& m = index_ivf_pq->direct_map.hashtable;
-      mem_usage += (m.size() * (sizeof(faiss::Index::idx_t) + sizeof(faiss::Index::idx_t)) +
-                    m.bucket_count() * (sizeof(void*) + sizeof(size_t))) *
-                   1.5;
+  if (index_id_map != nullptr) {
+    usage->AddAllocation("id_map", sizeof(*index_id_map));
+    usage->AddVector("id_map", index_id_map->id_map);
+  }
+  AddPreTransform(transform, usage);
+
+  usage->AddAllocation("index", sizeof(*index_hnsw));
+  const auto& hnsw = index_hnsw->hnsw;
+  usage->AddVector("graph", hnsw.assign_probas);
+  usage->AddVector("graph", hnsw.cum_nneighbor_per_level);
+  usage->AddVector("graph", hnsw.levels);
+  usage->AddVector("graph", hnsw.offsets);
+  usage->AddVector("graph", hnsw.neighbors);
+  AddFlatIndex("storage", index_hnsw->storage, usage);
+}
+
+void AddIvfPq(const faiss::Index* index, MemoryUsage* usage) {
+  auto [transform, index_ivf_pq] = faiss_util::UnpackIvfPq(index);
+  if (index_ivf_pq == nullptr) {
+    T_LOG(WARNING) << "estimating memory usage for unsupported ivf-pq index";
+    return;
+  }
+
+  AddPreTransform(transform, usage);
+  usage->AddAllocation("index", sizeof(*index_ivf_pq));
+  AddFlatIndex("quantizer", index_ivf_pq->quantizer, usage);
+  AddProductQuantizer("pq", index_ivf_pq->pq, usage);
+  if (index_ivf_pq->polysemous_training != nullptr) {
+    usage->AddAllocation("pq", sizeof(*index_ivf_pq->polysemous_training));
+  }
+
+  usage->AddVector("reconstruction_errors", index_ivf_pq->reconstruction_errors);
+  for (const auto& errors : index_ivf_pq->reconstruction_errors) {
+    usage->AddVector("reconstruction_errors", errors);
+  }
+
+  if (const auto& shared = index_ivf_pq->shared_precomputed_table; shared != nullptr) {
+    // the table is shared by every index with the same codebooks, each is charged its share
+    usage->AddBytes("precomputed_table", shared->memory_usage() / shared.use_count());
+  } else {
+    usage->AddAllocation("precomputed_table",
+                         index_ivf_pq->precomputed_table.size() * sizeof(float));
+  }
+
+  AddInvertedLists(*index_ivf_pq, usage);
+  AddDirectMap(index_ivf_pq->direct_map, usage);
+}
+
+void AddVamana(const faiss::Index* index, MemoryUsage* usage) {
+  auto [transform, index_vamana] = faiss_util::UnpackVamana(index);
+  AddPreTransform(transform, usage);
+
+  usage->AddAllocation("index", sizeof(*index_vamana));
+  AddProductQuantizer("pq", index_vamana->pq, usage);
+  usage->AddVector("codes", index_vamana->codes);
+  usage->AddVector("storage", index_vamana->xb);
+  usage->AddVector("ids", index_vamana->ids);
+  usage->AddVector("graph", index_vamana->graph);
+  for (const auto& neighbors : index_vamana->graph) {
+    usage->AddVector("graph", neighbors);
+  }
+}
+
+}  // namespace
+
+json Index::MemoryUsageBreakdown() const {
+  MemoryUsage usage;
+  switch (index_type_) {
+    case IndexType::kFaissHnsw:
+      AddHnsw(static_cast<const faiss::Index*>(index_raw_), &usage);
+      break;
+    case IndexType::kFaissHnswMmap: {
+      // the mapped file is owned by the OS page cache, only the heap part is charged
+      auto* mmap_hnsw = static_cast<const MmapHnsw*>(index_raw_);
+      usage.AddAllocation("index", sizeof(*mmap_hnsw));
+      usage.AddString("index", mmap_hnsw->path());
+      break;
     }
+    case IndexType::kFaissIvfPq:
+      AddIvfPq(static_cast<const faiss::Index*>(index_raw_), &usage);
+      break;
+    case IndexType::kDiskAnn:
+      AddVamana(static_cast<const faiss::Index*>(index_raw_), &usage);
+      break;
+    case IndexType::kDiskAnnOnDisk:
+      // node blocks are charged by the block cache
+      usage.AddBytes("index", static_cast<const DiskVamana*>(index_raw_)->memory_usage());
+      break;
+    default:
+      // blocks of the block cache are charged with their size when they are inserted
+      T_LOG(WARNING) << "estimating memory usage for index type " << index_type_
+                     << " is not implemented yet";
+  }
 
-    // TODO: Level1Quantizer.Index(quantizer)
-    // TODO: Level1Quantizer.Index(clustering_index)
-    return mem_usage;
+  usage.AddAllocation("wrapper", sizeof(*this));
+  if (tombstone_ != nullptr) {
+    usage.AddBytes("tombstone", tombstone_->memory_usage());
   }
+  return usage.ToJson();
+}
 
-  T_LOG(WARNING) << "not implemented yet";
-  return 1;
+size_t Index::EstimateMemoryUsage() {
+  return MemoryUsageBreakdown()["total"].get<size_t>();
 }
 
 }  // namespace tenann
\ No newline at end of file
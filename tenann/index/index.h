@@ -21,6 +21,8 @@
 
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <utility>
 
 #include "tenann/common/macros.h"
@@ -28,6 +30,8 @@
 
 namespace tenann {
 
+class Tombstone;
+
 class Index {
  public:
   Index(void* index_raw, IndexType index_type,
@@ -49,21 +53,44 @@ class Index {
   void* index_raw() const;
   IndexType index_type() const;
 
+  /// Length in bytes of the data at `index_raw()` of a block loaded by a block cache, 0 for other
+  /// indexes. Unlike the charge of the block in the cache, it excludes any allocator overhead.
+  size_t block_size() const { return block_size_; }
+  void SetBlockSize(size_t block_size) { block_size_ = block_size; }
+
+  /// Searches on an index that supports in-place inserts hold this lock shared,
+  /// while inserts hold it exclusively.
+  std::shared_mutex& rw_lock() const { return rw_lock_; }
+
+  /// Serializes the writers of an index that supports in-place updates, i.e. inserts, deletes and
+  /// consolidation. A writer holds `rw_lock()` exclusively only to apply its changes, and reads
+  /// the index and its tombstone holding this mutex alone, without blocking searches.
+  std::mutex& write_mutex() const { return write_mutex_; }
+
+  /// Rows deleted from the index, nullptr if there are none. Modified by the writers holding
+  /// `write_mutex()` and `rw_lock()` exclusively.
+  Tombstone* tombstone() const { return tombstone_.get(); }
+  void SetTombstone(std::unique_ptr<Tombstone> tombstone);
+
   /**
    * @brief  Get the amount of memory occupied by the index in bytes.
    *
-   * @return size_t
-   *
-   * @note Currently this function always return 1.
-   *
-   * @TODO(petri): implement it
+   * The estimation includes the allocator overhead of every heap allocation, blocks loaded by a
+   * block cache are not included since they are charged by their own cache entries.
    */
   size_t EstimateMemoryUsage();
 
+  /// Memory usage of each component of the index in bytes, plus a "total" entry.
+  json MemoryUsageBreakdown() const;
+
  private:
   void* index_raw_;
   IndexType index_type_;
   std::function<void(void* index_raw)> deleter_;
+  size_t block_size_ = 0;
+  mutable std::shared_mutex rw_lock_;
+  mutable std::mutex write_mutex_;
+  std::unique_ptr<Tombstone> tombstone_;
 };
 
 using IndexRef = std::shared_ptr<Index>;
@@ -19,13 +19,133 @@
 
 #include "tenann/index/index_cache.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <shared_mutex>
+
+#include "faiss/Index.h"
+#include "faiss/impl/io.h"
+#include "faiss/index_io.h"
 #include "tenann/common/logging.h"
+#include "tenann/index/internal/tombstone.h"
+#include "tenann/util/thread_pool.h"
 
 namespace tenann {
 
-IndexCache::IndexCache(size_t capacity) : cache_(new_lru_cache(capacity)) {}
+namespace {
+
+/// Prepended to the bytes of a spilled index.
+struct SpillHeader {
+  uint32_t index_type;
+  uint32_t reserved;
+  uint64_t charge;
+};
+
+/// Forwards the bytes written by faiss to the file of a spill cache entry.
+struct SpillIOWriter : faiss::IOWriter {
+  explicit SpillIOWriter(const SpillCache::ChunkWriter& write) : write(write) {}
+
+  size_t operator()(const void* ptr, size_t size, size_t nitems) override {
+    // faiss throws on a short write, which abandons the spill
+    return write(ptr, size * nitems) ? nitems : 0;
+  }
+
+  const SpillCache::ChunkWriter& write;
+};
+
+/// Blocks are plain bytes owned by the cache entry. Their charge includes allocator overhead, so
+/// exactly `block_size()` bytes are written.
+bool EncodeBlock(const Index& index, faiss::IOWriter* out) {
+  if (index.block_size() == 0) {
+    return false;
+  }
+  return (*out)(index.index_raw(), 1, index.block_size()) == index.block_size();
+}
+
+IndexRef DecodeBlock(IndexType type, std::string&& data) {
+  auto buffer = std::make_shared<std::string>(std::move(data));
+  auto block = std::make_shared<Index>(buffer->data(), type, [buffer](void* /* block */) {});
+  block->SetBlockSize(buffer->size());
+  return block;
+}
+
+bool EncodeFaissIndex(const Index& index, faiss::IOWriter* out) {
+  // the index may still be used, and updated in place, by a searcher that holds a reference
+  std::shared_lock<std::shared_mutex> lock(index.rw_lock());
+  // deleted rows are kept beside the index file and are not serialized by faiss
+  if (index.tombstone() != nullptr && !index.tombstone()->empty()) {
+    return false;
+  }
+  faiss::write_index(static_cast<const faiss::Index*>(index.index_raw()), out);
+  return true;
+}
+
+IndexRef DecodeFaissIndex(IndexType type, std::string&& data) {
+  faiss::VectorIOReader reader;
+  reader.data.assign(data.begin(), data.end());
+  data.clear();
+  std::unique_ptr<faiss::Index> faiss_index(faiss::read_index(&reader));
+  return std::make_shared<Index>(faiss_index.release(), type,
+                                 [](void* index) { delete static_cast<faiss::Index*>(index); });
+}
+
+constexpr const char* kDefaultNamespaceName = "default";
 
-IndexCache::~IndexCache() = default;
+/// Version of the file written by `IndexCache::SaveHotKeys`. The keys are hex encoded since the
+/// binary keys of blocks are not valid json strings.
+constexpr int kHotKeysVersion = 2;
+
+std::string HexEncode(const std::string& bytes) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex(bytes.size() * 2, '0');
+  for (size_t i = 0; i < bytes.size(); i++) {
+    auto byte = static_cast<uint8_t>(bytes[i]);
+    hex[2 * i] = kDigits[byte >> 4];
+    hex[2 * i + 1] = kDigits[byte & 0xf];
+  }
+  return hex;
+}
+
+bool HexDecode(const std::string& hex, std::string* bytes) {
+  auto digit = [](char c) {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+  };
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  bytes->resize(hex.size() / 2);
+  for (size_t i = 0; i < bytes->size(); i++) {
+    int high = digit(hex[2 * i]);
+    int low = digit(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    (*bytes)[i] = static_cast<char>(high << 4 | low);
+  }
+  return true;
+}
+
+constexpr IndexSpillCodec kBlockSpillCodec = {true, EncodeBlock, DecodeBlock};
+constexpr IndexSpillCodec kFaissIndexSpillCodec = {false, EncodeFaissIndex, DecodeFaissIndex};
+
+}  // namespace
+
+IndexCache::IndexCache(size_t capacity, CacheEvictionPolicy eviction_policy, int num_shard_bits)
+    : cache_(new_lru_cache(capacity, eviction_policy, num_shard_bits)) {
+  cache_->set_eviction_listener(&IndexCache::OnEvict);
+  GetNamespace("");
+}
+
+IndexCache::~IndexCache() {
+  // entries freed with the cache are not evicted, and must not be spilled
+  DisableSpill();
+  WaitForPendingSpills();
+  // free the entries while the namespaces their deleters update are still alive
+  cache_.reset();
+}
 
 IndexCache* IndexCache::GetGlobalInstance() {
   // The default cache capacity is 1GB
@@ -33,50 +153,466 @@ IndexCache* IndexCache::GetGlobalInstance() {
   return &instance;
 }
 
-bool IndexCache::Lookup(const CacheKey& key, IndexCacheHandle* handle) {
+bool IndexCache::Lookup(const CacheKey& key, IndexCacheHandle* handle, CacheNamespaceId ns) {
   auto* lru_handle = cache_->lookup(key);
   if (lru_handle == nullptr) {
-    return false;
+    bool found = LookupSpill(key, handle, ns);
+    GetNamespaceState(ns).hit_count += found;
+    GetNamespaceState(ns).miss_count += !found;
+    return found;
   }
   *handle = IndexCacheHandle(cache_.get(), lru_handle);
+  GetNamespaceState(ns).hit_count++;
   return true;
 }
 
 void IndexCache::Insert(const CacheKey& key, IndexRef index, IndexCacheHandle* handle,
-                        const std::function<size_t()>& estimate_memory_usage) {
+                        const std::function<size_t()>& estimate_memory_usage,
+                        CacheNamespaceId ns, CachePriority priority) {
   size_t index_size = 0;
   if (estimate_memory_usage) {
     index_size = estimate_memory_usage();
   } else {
     index_size = index->EstimateMemoryUsage();
   }
-  // create a new reference to the index and intentionally leak the reference
-  void* leaked_index = reinterpret_cast<void*>(new IndexRef(index));
+  // the inserted index supersedes the spilled one, e.g. when the cache is forcibly overwritten
+  if (auto spill = spill_cache(); spill != nullptr) {
+    spill->Erase(key);
+  }
+
+  if (!EnforceQuotas(ns, index_size)) {
+    // the caller still gets the index through [handle], which frees it once released. The cache
+    // is left untouched, so that neither other entries nor the one cached under [key] are evicted
+    *handle = IndexCacheHandle(std::move(index));
+    GetNamespaceState(ns).bypass_count++;
+    return;
+  }
+  InsertEntry(key, std::move(index), index_size, handle, ns, priority);
+}
+
+void IndexCache::InsertEntry(const CacheKey& key, IndexRef index, size_t charge,
+                             IndexCacheHandle* handle, CacheNamespaceId ns,
+                             CachePriority priority) {
+  // the entry holds a new reference to the index
+  auto* entry = new Entry{std::move(index), this, ns, charge};
+  TrackCharge(charge);
+  Namespace& state = GetNamespaceState(ns);
+  state.usage += charge;
+  state.insert_count++;
 
   // the reference will not be destroyed until we manually delete it through a custom deleter
-  auto deleter = [](const CacheKey& key, void* value) {
-    auto leaked_index = reinterpret_cast<IndexRef*>(value);
-    delete leaked_index;
+  auto deleter = [](const CacheKey& /* key */, void* value) {
+    auto* entry = reinterpret_cast<Entry*>(value);
+    size_t charge = entry->charge.load();
+    entry->owner->TrackCharge(-static_cast<int64_t>(charge));
+    Namespace& state = entry->owner->GetNamespaceState(entry->ns);
+    state.usage -= charge;
+    delete entry;
   };
 
-  CachePriority priority = CachePriority::NORMAL;
-
-  auto* lru_handle = cache_->insert(key, leaked_index, index_size, deleter, priority);
+  // the entries of a namespace form a group of the cache, so that they are evicted without
+  // visiting the entries of other namespaces
+  auto* lru_handle = cache_->insert(key, entry, charge, deleter, priority, ns);
   *handle = IndexCacheHandle(cache_.get(), lru_handle);
 }
 
+bool IndexCache::LookupSpill(const CacheKey& key, IndexCacheHandle* handle,
+                             CacheNamespaceId ns) {
+  auto spill = spill_cache();
+  std::string data;
+  if (spill == nullptr || !spill->Get(key, &data)) {
+    return false;
+  }
+
+  SpillHeader header;
+  const IndexSpillCodec* codec = nullptr;
+  if (data.size() >= sizeof(header)) {
+    memcpy(&header, data.data(), sizeof(header));
+    codec = GetSpillCodec(static_cast<IndexType>(header.index_type));
+  }
+  IndexRef index;
+  if (codec != nullptr) {
+    try {
+      data.erase(0, sizeof(header));
+      index = codec->decode(static_cast<IndexType>(header.index_type), std::move(data));
+    } catch (std::exception& e) {
+      T_LOG(WARNING) << "failed to decode spilled index " << key.to_string() << ": " << e.what();
+    }
+  }
+  if (index == nullptr) {
+    spill->Erase(key);
+    return false;
+  }
+
+  // a promoted index is cached above the hard quota rather than read again from the spill tier
+  EnforceQuotas(ns, header.charge);
+  InsertEntry(key, std::move(index), header.charge, handle, ns, CachePriority::NORMAL);
+  if (!codec->immutable) {
+    // the index may be updated in memory from now on, it is spilled again when evicted
+    spill->Erase(key);
+  }
+  return true;
+}
+
+void IndexCache::OnEvict(const CacheKey& key, void* value) {
+  auto* entry = reinterpret_cast<Entry*>(value);
+  entry->owner->GetNamespaceState(entry->ns).evict_count++;
+  entry->owner->Spill(key, *entry);
+}
+
+void IndexCache::Spill(const CacheKey& key, const Entry& entry) {
+  const auto* codec = GetSpillCodec(entry.index->index_type());
+  std::shared_ptr<SpillCache> spill;
+  {
+    std::lock_guard<std::mutex> l(spill_mutex_);
+    if (spill_ == nullptr || codec == nullptr) {
+      return;
+    }
+    spill = spill_;
+    pending_spill_count_++;
+  }
+  uint64_t ticket = spill->Reserve(key, !codec->immutable);
+  size_t charge = entry.charge.load();
+  auto done = [this]() {
+    std::lock_guard<std::mutex> l(spill_mutex_);
+    pending_spill_count_--;
+    spill_done_.notify_all();
+  };
+  if (ticket == 0) {
+    done();
+    return;
+  }
+
+  // The task keeps the evicted index alive until it is written, so its memory stays charged to
+  // the tracker meanwhile, after the entry releases it.
+  TrackCharge(charge);
+  // serialize and write out of the eviction path, streamed to the spill file so that the index is
+  // never copied in memory
+  ThreadPool::GetIoInstance()->Submit([this, spill, key = key.to_string(), ticket,
+                                       index = entry.index, charge, codec, done]() mutable {
+    spill->CommitStream(key, ticket, [&](const SpillCache::ChunkWriter& write) {
+      SpillHeader header{static_cast<uint32_t>(index->index_type()), 0, charge};
+      if (!write(&header, sizeof(header))) {
+        return false;
+      }
+      SpillIOWriter writer(write);
+      try {
+        return codec->encode(*index, &writer);
+      } catch (std::exception& e) {
+        T_LOG(WARNING) << "failed to encode index " << key << " to spill: " << e.what();
+      }
+      return false;
+    });
+    index.reset();
+    TrackCharge(-static_cast<int64_t>(charge));
+    done();
+  });
+}
+
+void IndexCache::EnableSpill(const std::string& dir, size_t capacity) {
+  auto spill = std::make_shared<SpillCache>(dir, capacity);
+  std::lock_guard<std::mutex> l(spill_mutex_);
+  spill_ = std::move(spill);
+}
+
+void IndexCache::DisableSpill() {
+  std::lock_guard<std::mutex> l(spill_mutex_);
+  spill_ = nullptr;
+}
+
+std::shared_ptr<SpillCache> IndexCache::spill_cache() const {
+  std::lock_guard<std::mutex> l(spill_mutex_);
+  return spill_;
+}
+
+json IndexCache::spill_status() const {
+  auto spill = spill_cache();
+  return spill != nullptr ? spill->status() : json();
+}
+
+void IndexCache::WaitForPendingSpills() {
+  std::unique_lock<std::mutex> l(spill_mutex_);
+  spill_done_.wait(l, [this]() { return pending_spill_count_ == 0; });
+}
+
+const IndexSpillCodec* IndexCache::GetSpillCodec(IndexType type) {
+  switch (type) {
+    case IndexType::kFaissIvfPqOneInvertedList:
+    case IndexType::kDiskAnnBlock:
+      return &kBlockSpillCodec;
+    case IndexType::kFaissHnsw:
+      return &kFaissIndexSpillCodec;
+    default:
+      // ivf-pq indexes are tenann classes unknown to faiss serialization, the mmap hnsw and
+      // DiskANN indexes are already backed by local files
+      return nullptr;
+  }
+}
+
 void IndexCache::SetCapacity(size_t capacity) { cache_->set_capacity(capacity); }
 
 bool IndexCache::AdjustCapacity(int64_t delta, size_t min_capacity) {
   return cache_->adjust_capacity(delta, min_capacity);
 }
 
+size_t IndexCache::EvictTo(size_t target_usage) { return cache_->evict_to(target_usage); }
+
+void IndexCache::SetMemoryTracker(MemoryTrackerRef tracker) {
+  std::lock_guard<std::mutex> l(tracker_mutex_);
+  if (tracker_ != nullptr) {
+    tracker_->Release(tracked_bytes_);
+  }
+  tracker_ = std::move(tracker);
+  if (tracker_ != nullptr) {
+    tracker_->Consume(tracked_bytes_);
+  }
+}
+
+MemoryTrackerRef IndexCache::memory_tracker() const {
+  std::lock_guard<std::mutex> l(tracker_mutex_);
+  return tracker_;
+}
+
+void IndexCache::TrackCharge(int64_t delta) {
+  std::lock_guard<std::mutex> l(tracker_mutex_);
+  // counted without a tracker too, so that a tracker set later takes over the cached entries
+  tracked_bytes_ += delta;
+  if (tracker_ == nullptr || delta == 0) {
+    return;
+  }
+  if (delta > 0) {
+    tracker_->Consume(delta);
+  } else {
+    tracker_->Release(-delta);
+  }
+}
+
+std::vector<std::string> IndexCache::HotKeys(size_t limit) const {
+  return cache_->get_hot_keys(limit);
+}
+
+void IndexCache::SaveHotKeys(const std::string& path, size_t limit) const {
+  json snapshot;
+  snapshot["version"] = kHotKeysVersion;
+  auto& keys = snapshot["keys"] = json::array();
+  for (const auto& key : HotKeys(limit)) {
+    keys.push_back(HexEncode(key));
+  }
+
+  // a crash while saving leaves the previous snapshot in place
+  auto tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path);
+    T_LOG_IF(ERROR, !file.is_open()) << "could not open [" << tmp_path << "] for writing";
+    file << snapshot;
+    file.close();
+    T_LOG_IF(ERROR, file.fail()) << "write error in " << tmp_path;
+  }
+  T_LOG_IF(ERROR, rename(tmp_path.c_str(), path.c_str()) != 0)
+      << "failed to rename [" << tmp_path << "] to [" << path << "]: " << strerror(errno);
+}
+
+size_t IndexCache::LoadWarmUpPlan(const std::string& path, size_t io_budget) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    T_LOG(WARNING) << "no hot keys to warm up the index cache at [" << path << "]";
+    return 0;
+  }
+
+  std::vector<std::string> keys;
+  try {
+    auto snapshot = json::parse(file);
+    // the keys of older snapshots can not match the keys built by this version
+    if (snapshot.value("version", 0) != kHotKeysVersion) {
+      T_LOG(WARNING) << "ignore the hot keys of another version in [" << path << "]";
+      return 0;
+    }
+    for (const auto& hex : snapshot.at("keys").get<std::vector<std::string>>()) {
+      std::string key;
+      T_LOG_IF(ERROR, !HexDecode(hex, &key)) << "invalid hot key in [" << path << "]: " << hex;
+      keys.push_back(std::move(key));
+    }
+  } catch (json::exception& e) {
+    T_LOG(ERROR) << "failed to parse the hot keys in [" << path << "]: " << e.what();
+  }
+  SetWarmUpPlan(keys, io_budget);
+  return keys.size();
+}
+
+void IndexCache::SetWarmUpPlan(const std::vector<std::string>& keys, size_t io_budget) {
+  std::lock_guard<std::mutex> l(warm_up_mutex_);
+  warm_up_ranks_.clear();
+  for (size_t rank = 0; rank < keys.size(); rank++) {
+    warm_up_ranks_.emplace(keys[rank], rank);
+  }
+  warm_up_budget_ = io_budget;
+}
+
+std::vector<size_t> IndexCache::TakeWarmUpKeys(const std::vector<CacheKey>& keys,
+                                               const std::vector<size_t>& sizes) {
+  T_CHECK_EQ(keys.size(), sizes.size());
+  // (rank, position) of the planned keys
+  std::vector<std::pair<size_t, size_t>> planned;
+  std::lock_guard<std::mutex> l(warm_up_mutex_);
+  if (warm_up_ranks_.empty()) {
+    return {};
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    auto it = warm_up_ranks_.find(keys[i].to_string());
+    if (it != warm_up_ranks_.end()) {
+      planned.emplace_back(it->second, i);
+      warm_up_ranks_.erase(it);
+    }
+  }
+
+  std::sort(planned.begin(), planned.end());
+  std::vector<size_t> positions;
+  for (auto [rank, i] : planned) {
+    if (sizes[i] <= warm_up_budget_) {
+      warm_up_budget_ -= sizes[i];
+      positions.push_back(i);
+    }
+  }
+  return positions;
+}
+
+json IndexCache::warm_up_status() const {
+  std::lock_guard<std::mutex> l(warm_up_mutex_);
+  json status;
+  status["pending_keys"] = warm_up_ranks_.size();
+  status["io_budget"] = warm_up_budget_;
+  return status;
+}
+
+CacheNamespaceId IndexCache::GetNamespace(const std::string& name_or_empty) {
+  std::string name = name_or_empty.empty() ? kDefaultNamespaceName : name_or_empty;
+  std::lock_guard<std::mutex> l(namespace_mutex_);
+  auto it = namespace_ids_.find(name);
+  if (it != namespace_ids_.end()) {
+    return it->second;
+  }
+  size_t id = num_namespaces_.load();
+  T_LOG_IF(ERROR, id >= kMaxNamespaces)
+      << "too many index cache namespaces, could not create [" << name << "]";
+  namespaces_[id] = std::make_unique<Namespace>();
+  namespaces_[id]->name = name;
+  namespace_ids_.emplace(name, id);
+  num_namespaces_ = id + 1;
+  return static_cast<CacheNamespaceId>(id);
+}
+
+CacheNamespaceId IndexCache::SetNamespaceOptions(const std::string& name,
+                                                 const CacheNamespaceOptions& options) {
+  T_CHECK(options.hard_quota == 0 || options.soft_quota <= options.hard_quota)
+      << "the soft quota of [" << name << "] is above its hard quota";
+  CacheNamespaceId ns = GetNamespace(name);
+  Namespace& state = GetNamespaceState(ns);
+  state.soft_quota = options.soft_quota;
+  state.hard_quota = options.hard_quota;
+  state.pin_index_structure = options.pin_index_structure;
+  return ns;
+}
+
+CacheNamespaceOptions IndexCache::namespace_options(CacheNamespaceId ns) const {
+  const Namespace& state = GetNamespaceState(ns);
+  CacheNamespaceOptions options;
+  options.soft_quota = state.soft_quota;
+  options.hard_quota = state.hard_quota;
+  options.pin_index_structure = state.pin_index_structure;
+  return options;
+}
+
+IndexCache::Namespace& IndexCache::GetNamespaceState(CacheNamespaceId ns) const {
+  T_CHECK_LT(ns, num_namespaces_.load()) << "unknown index cache namespace";
+  return *namespaces_[ns];
+}
+
+size_t IndexCache::EvictFromNamespace(CacheNamespaceId ns, size_t charge) {
+  return cache_->evict_group(ns, charge);
+}
+
+bool IndexCache::EnforceQuotas(CacheNamespaceId ns, size_t charge) {
+  Namespace& state = GetNamespaceState(ns);
+  auto usage = static_cast<size_t>(std::max<int64_t>(state.usage, 0));
+  size_t hard_quota = state.hard_quota;
+  if (hard_quota != 0 && charge > hard_quota) {
+    // never fits, the entries of [ns] are kept
+    return false;
+  }
+  if (hard_quota != 0 && usage + charge > hard_quota) {
+    usage -= std::min(usage, EvictFromNamespace(ns, usage + charge - hard_quota));
+    if (usage + charge > hard_quota) {
+      return false;
+    }
+  }
+
+  size_t total_usage = cache_->get_memory_usage();
+  size_t capacity = cache_->get_capacity();
+  if (total_usage + charge <= capacity) {
+    return true;
+  }
+  // the namespaces furthest above their soft quota give up their entries first, the cache
+  // evicts the least recently used entries of any namespace for the rest
+  std::vector<std::pair<size_t, CacheNamespaceId>> excesses;
+  for (size_t id = 0; id < num_namespaces_.load(); id++) {
+    const Namespace& other = GetNamespaceState(id);
+    auto other_usage = static_cast<size_t>(std::max<int64_t>(other.usage, 0));
+    size_t soft_quota = other.soft_quota;
+    if (soft_quota != 0 && other_usage > soft_quota) {
+      excesses.emplace_back(other_usage - soft_quota, id);
+    }
+  }
+  std::sort(excesses.begin(), excesses.end(), std::greater<>());
+  size_t needed = total_usage + charge - capacity;
+  for (auto [excess, id] : excesses) {
+    if (needed == 0) {
+      break;
+    }
+    needed -= std::min(needed, EvictFromNamespace(id, std::min(excess, needed)));
+  }
+  return true;
+}
+
+json IndexCache::namespace_status() const {
+  json doc = json::object();
+  for (size_t id = 0; id < num_namespaces_.load(); id++) {
+    const Namespace& state = GetNamespaceState(id);
+    uint64_t hit_count = state.hit_count;
+    uint64_t lookup_count = hit_count + state.miss_count;
+    json info;
+    info["usage"] = std::max<int64_t>(state.usage, 0);
+    info["soft_quota"] = state.soft_quota.load();
+    info["hard_quota"] = state.hard_quota.load();
+    info["pin_index_structure"] = state.pin_index_structure.load();
+    info["hit_count"] = hit_count;
+    info["miss_count"] = state.miss_count.load();
+    info["hit_ratio"] = lookup_count != 0 ? static_cast<float>(hit_count) / lookup_count : 0.0f;
+    info["insert_count"] = state.insert_count.load();
+    info["evict_count"] = state.evict_count.load();
+    info["bypass_count"] = state.bypass_count.load();
+    doc[state.name] = info;
+  }
+  return doc;
+}
+
 json IndexCache::status() const {
   json doc;
   cache_->get_cache_status(&doc);
   return doc;
 }
 
+void IndexCache::SetEvictionPolicy(CacheEvictionPolicy eviction_policy) {
+  cache_->set_eviction_policy(eviction_policy);
+}
+
+CacheEvictionPolicy IndexCache::eviction_policy() const { return cache_->get_eviction_policy(); }
+
+json IndexCache::policy_status() const {
+  json doc;
+  cache_->get_policy_status(&doc);
+  return doc;
+}
+
 size_t IndexCache::memory_usage() const { return cache_->get_memory_usage(); }
 
 size_t IndexCache::capacity() { return cache_->get_capacity(); }
@@ -90,6 +626,8 @@ IndexCacheHandle::IndexCacheHandle() = default;
 IndexCacheHandle::IndexCacheHandle(Cache* cache, Cache::Handle* handle)
     : cache_(cache), handle_(handle) {}
 
+IndexCacheHandle::IndexCacheHandle(IndexRef index) : index_(std::move(index)) {}
+
 IndexCacheHandle::~IndexCacheHandle() {
   if (handle_ != nullptr) {
     cache_->release(handle_);
@@ -100,11 +638,13 @@ IndexCacheHandle::IndexCacheHandle(IndexCacheHandle&& other) noexcept {
   // we can use std::exchange if we switch c++14 on
   std::swap(cache_, other.cache_);
   std::swap(handle_, other.handle_);
+  std::swap(index_, other.index_);
 }
 
 IndexCacheHandle& IndexCacheHandle::operator=(IndexCacheHandle&& other) noexcept {
   std::swap(cache_, other.cache_);
   std::swap(handle_, other.handle_);
+  std::swap(index_, other.index_);
   return *this;
 }
 
@@ -114,16 +654,47 @@ uint32_t IndexCacheHandle::cache_entry_ref_count() {
   return handle->refs;
 }
 
+void IndexCacheHandle::UpdateCharge(size_t charge) {
+  if (handle_ == nullptr) {
+    // an uncached index is not charged
+    return;
+  }
+  auto* entry = reinterpret_cast<IndexCache::Entry*>(cache_->value(handle_));
+  IndexCache* owner = entry->owner;
+  IndexCache::Namespace& state = owner->GetNamespaceState(entry->ns);
+  size_t old_charge = entry->charge.load();
+  // the entry itself is referenced, only the other entries of the namespace can make room
+  if (charge > old_charge && !owner->EnforceQuotas(entry->ns, charge - old_charge)) {
+    // keep the index uncached through this handle. Only this entry is dropped, an entry cached
+    // since under the same key is kept, and the entry is released with the charge it was cached
+    // with, so that no other entry is evicted for the growth.
+    index_ = entry->index;
+    cache_->erase(handle_);
+    cache_->release(handle_);
+    cache_ = nullptr;
+    handle_ = nullptr;
+    state.bypass_count++;
+    return;
+  }
+  entry->charge = charge;
+  cache_->update_charge(handle_, charge);
+  int64_t delta = static_cast<int64_t>(charge) - static_cast<int64_t>(old_charge);
+  owner->TrackCharge(delta);
+  state.usage += delta;
+}
+
 Cache* IndexCacheHandle::cache() const { return cache_; }
 
 IndexRef IndexCacheHandle::index_ref() const {
-  T_DCHECK(handle_ != nullptr);
+  if (handle_ == nullptr) {
+    return index_;
+  }
   auto* handle = reinterpret_cast<LRUHandle*>(handle_);
   // Ownership of the cache entry can be safely shared.
   // The index will be released if both the following conditions are satisfied:
   // 1. The cache entry is evicted from the cache.
   // 2. The reference count of the IndexRef instance becomes 0.
-  auto shared_ref = *reinterpret_cast<IndexRef*>(handle->value);
+  auto shared_ref = reinterpret_cast<IndexCache::Entry*>(handle->value)->index;
   return shared_ref;
 }
 
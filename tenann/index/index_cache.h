@@ -19,16 +19,62 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "tenann/common/macros.h"
 #include "tenann/index/index.h"
 #include "tenann/store/lru_cache.h"
+#include "tenann/store/spill_cache.h"
+#include "tenann/util/memory_tracker.h"
+
+namespace faiss {
+struct IOWriter;
+}  // namespace faiss
 
 namespace tenann {
 
 class IndexCacheHandle;
 
+/// Id of a namespace of `IndexCache`, see `IndexCache::GetNamespace`.
+using CacheNamespaceId = uint32_t;
+
+/// The namespace of the entries cached without naming one.
+static constexpr CacheNamespaceId kDefaultCacheNamespace = 0;
+
+/// Quotas of a namespace of `IndexCache`, 0 means no quota.
+struct CacheNamespaceOptions {
+  /// When the cache is full, the namespaces above their soft quota give up their own least
+  /// recently used entries before the entries of the other namespaces are evicted.
+  size_t soft_quota = 0;
+  /// The namespace never holds more: its own least recently used entries are evicted to make
+  /// room, and an index that still does not fit, or is larger than the quota, is returned without
+  /// being cached.
+  size_t hard_quota = 0;
+  /// Cache whole indexes of the namespace with `CachePriority::DURABLE`, so that the structure of
+  /// an index read with both `cache_index_file` and `cache_index_block`, e.g. the coarse quantizer
+  /// and the list directory, outlives the list blocks, which stay evictable.
+  bool pin_index_structure = false;
+};
+
+/**
+ * @brief Converts cached indexes of one type to bytes for the spill tier of `IndexCache` and back.
+ */
+struct IndexSpillCodec {
+  /// Whether the content cached under a key never changes, so that the spilled copy can be kept
+  /// when the entry is promoted back to memory instead of being written again on every eviction.
+  bool immutable;
+  /// Write the content of [index] to [out], return false if it can not be spilled.
+  bool (*encode)(const Index& index, faiss::IOWriter* out);
+  /// Rebuild an index of [type] from the bytes written by `encode`.
+  IndexRef (*decode)(IndexType type, std::string&& data);
+};
+
 /**
  * @brief  Wrapper around Cache, and used for cache indexes.
  *
@@ -37,22 +83,38 @@ class IndexCacheHandle;
  */
 class IndexCache {
  public:
-  explicit IndexCache(size_t capacity);
+  /// See `ShardedLRUCache` for [num_shard_bits].
+  explicit IndexCache(size_t capacity,
+                      CacheEvictionPolicy eviction_policy = CacheEvictionPolicy::LRU,
+                      int num_shard_bits = kDefaultNumShardBits);
   ~IndexCache();
 
   static IndexCache* GetGlobalInstance();
 
+  /// Value of a cache entry.
+  struct Entry {
+    IndexRef index;
+    IndexCache* owner;
+    CacheNamespaceId ns;
+    /// Kept in step with the charge in the cache, so that the tracker is released exactly.
+    std::atomic<size_t> charge;
+  };
+
   /**
    * @brief Lookup an index in the cache by CacheKey.
    *
    * If the index is found, the cache entry will be written into [[handle]].
+   * A miss in memory falls through to the spill tier if it is enabled, and a spilled index is
+   * promoted back to memory.
    *
    * @param key cache key
    * @param handle handle to write
+   * @param ns namespace the hit or the miss is counted in
    * @return true if index found
    * @return false if index not found
    */
-  bool Lookup(const CacheKey& key, IndexCacheHandle* handle);
+  bool Lookup(const CacheKey& key, IndexCacheHandle* handle,
+              CacheNamespaceId ns = kDefaultCacheNamespace);
 
   /**
    * @brief Insert an index with key into this cache.
@@ -64,17 +126,133 @@ class IndexCache {
    *
    * @param key cache key
    * @param index index to cache
-   * @param handle will be set to a valid reference to the cache entry
+   * @param handle will be set to a valid reference to the cache entry, or to the uncached index
+   * if it does not fit in the hard quota of [ns]
+   * @param ns namespace charged for the index, whose quotas are enforced before it is inserted
    */
   void Insert(const CacheKey& key, IndexRef index, IndexCacheHandle* handle,
-              const std::function<size_t()>& estimate_memory_usage = nullptr);
+              const std::function<size_t()>& estimate_memory_usage = nullptr,
+              CacheNamespaceId ns = kDefaultCacheNamespace,
+              CachePriority priority = CachePriority::NORMAL);
+
+  /**
+   * @brief Id of the namespace [name], e.g. a table or a tenant, created without quotas if it
+   * does not exist yet. The empty name stands for the default namespace, named "default".
+   *
+   * At most `kMaxNamespaces` namespaces can be created, namespaces are never dropped.
+   */
+  CacheNamespaceId GetNamespace(const std::string& name);
+
+  /// Create the namespace [name] if needed and set its quotas, they apply to the next inserts.
+  CacheNamespaceId SetNamespaceOptions(const std::string& name,
+                                       const CacheNamespaceOptions& options);
+
+  CacheNamespaceOptions namespace_options(CacheNamespaceId ns) const;
+
+  /// Usage, quotas and hit, miss, insert and eviction counts of each namespace by name.
+  json namespace_status() const;
+
+  static constexpr size_t kMaxNamespaces = 4096;
+
+  /**
+   * @brief Enable a second tier on a local directory, typically on an SSD, with its own capacity.
+   *
+   * Entries evicted from memory are written to [dir] in the background, and lookups go through
+   * memory, then the spill tier, before the caller reads the index from its source.
+   * Only the index types that have a `GetSpillCodec` are spilled: inverted list and DiskANN blocks,
+   * and whole faiss HNSW indexes without deleted rows.
+   * Calling it again replaces the spill tier and drops everything spilled so far.
+   */
+  void EnableSpill(const std::string& dir, size_t capacity);
+
+  void DisableSpill();
+
+  /// The spill tier, nullptr if it is not enabled.
+  std::shared_ptr<SpillCache> spill_cache() const;
+
+  /// Status of the spill tier, null if it is not enabled.
+  json spill_status() const;
+
+  /// Wait for the evicted entries being written to the spill tier.
+  void WaitForPendingSpills();
+
+  /// Codec to spill indexes of [type], nullptr if they are not spilled.
+  static const IndexSpillCodec* GetSpillCodec(IndexType type);
 
   void SetCapacity(size_t capacity);
 
   bool AdjustCapacity(int64_t delta, size_t min_capacity = 0);
 
+  /**
+   * @brief Evict unreferenced entries until the memory usage is at most [target_usage], without
+   * changing the capacity, e.g. when the host is under memory pressure.
+   *
+   * Entries referenced by handles are kept, so the usage may stay above the target.
+   *
+   * @return the bytes released by the evicted entries
+   */
+  size_t EvictTo(size_t target_usage);
+
+  /**
+   * @brief Report every charge and release of cached indexes to [tracker] from now on.
+   *
+   * The memory of the entries already cached moves from the previous tracker to the new one, so
+   * that each tracker sees balanced charges and releases. A null tracker turns tracking off.
+   */
+  void SetMemoryTracker(MemoryTrackerRef tracker);
+
+  MemoryTrackerRef memory_tracker() const;
+
+  /// Keys of up to [limit] cached indexes and blocks, hottest first, see `Cache::get_hot_keys`.
+  std::vector<std::string> HotKeys(size_t limit) const;
+
+  /**
+   * @brief Save the keys of up to [limit] hottest entries to [path], e.g. before the host shuts
+   * down, so that the cache can be warmed up from them with `LoadWarmUpPlan` after a restart.
+   */
+  void SaveHotKeys(const std::string& path, size_t limit) const;
+
+  /**
+   * @brief Warm up the cache with the keys saved by `SaveHotKeys` at [path], reading at most
+   * [io_budget] bytes in total. Return the number of keys planned, 0 if there is no such file.
+   *
+   * Only the blocks of the inverted lists read with `cache_index_block` are warmed up: as soon as
+   * an index is read, its blocks whose keys are planned are read in the background, the hottest
+   * first, instead of on the first probe. Blocks are only read for the indexes opened by the host,
+   * and the keys of the files rewritten since the snapshot no longer match.
+   */
+  size_t LoadWarmUpPlan(const std::string& path, size_t io_budget);
+
+  /// Replace the warm-up plan with [keys], hottest first, see `LoadWarmUpPlan`.
+  void SetWarmUpPlan(const std::vector<std::string>& keys, size_t io_budget);
+
+  /**
+   * @brief Remove the planned keys among [keys] from the warm-up plan and charge the [sizes] of
+   * their entries to the I/O budget. Return the positions of the keys in [keys], hottest first,
+   * skipping the keys that no longer fit in the budget.
+   */
+  std::vector<size_t> TakeWarmUpKeys(const std::vector<CacheKey>& keys,
+                                     const std::vector<size_t>& sizes);
+
+  /// Number of keys planned but not taken yet, and the I/O budget left.
+  json warm_up_status() const;
+
+  /// The status of each shard, see `namespace_status` for the namespaces.
   json status() const;
 
+  /**
+   * @brief Switch the eviction policy at runtime, the cached indexes are kept.
+   *
+   * `CacheEvictionPolicy::TINY_LFU` keeps frequently used entries, e.g. the hot inverted lists of
+   * interactive queries, from being flushed by a scan over many cold segments.
+   */
+  void SetEvictionPolicy(CacheEvictionPolicy eviction_policy);
+
+  CacheEvictionPolicy eviction_policy() const;
+
+  /// The current policy and the hit ratio observed under each one, see `get_policy_status`.
+  json policy_status() const;
+
   size_t memory_usage() const;
 
   size_t capacity();
@@ -83,8 +261,82 @@ class IndexCache {
 
   uint64_t hit_count();
 
+  /// Misses served by waiting for the in-flight load of the same entry instead of loading it again.
+  uint64_t coalesced_miss_count() const { return coalesced_miss_count_; }
+
+  void IncreaseCoalescedMissCount() { coalesced_miss_count_++; }
+
  private:
+  /// State of a namespace, updated concurrently by the entries charged to it.
+  struct Namespace {
+    std::string name;
+    std::atomic<size_t> soft_quota{0};
+    std::atomic<size_t> hard_quota{0};
+    std::atomic<bool> pin_index_structure{false};
+    std::atomic<int64_t> usage{0};
+    std::atomic<uint64_t> hit_count{0};
+    std::atomic<uint64_t> miss_count{0};
+    std::atomic<uint64_t> insert_count{0};
+    /// Entries evicted from memory, not counting the erased or replaced ones
+    std::atomic<uint64_t> evict_count{0};
+    /// Indexes returned uncached since they did not fit in the hard quota
+    std::atomic<uint64_t> bypass_count{0};
+  };
+
+  void InsertEntry(const CacheKey& key, IndexRef index, size_t charge, IndexCacheHandle* handle,
+                   CacheNamespaceId ns, CachePriority priority);
+
+  bool LookupSpill(const CacheKey& key, IndexCacheHandle* handle, CacheNamespaceId ns);
+
+  Namespace& GetNamespaceState(CacheNamespaceId ns) const;
+
+  /// Evict unreferenced entries of [ns] until [charge] bytes are released, return the bytes.
+  size_t EvictFromNamespace(CacheNamespaceId ns, size_t charge);
+
+  /**
+   * @brief Make room for [charge] bytes in [ns]: evict its own entries down to its hard quota,
+   * and if the cache is full, the entries of the namespaces above their soft quota.
+   *
+   * @return false if [ns] stays above its hard quota
+   */
+  bool EnforceQuotas(CacheNamespaceId ns, size_t charge);
+
+  /// Write [entry] evicted from memory to the spill tier in the background.
+  void Spill(const CacheKey& key, const Entry& entry);
+
+  /// Eviction listener of the cache, entries dropped otherwise, e.g. bypassed, erased or replaced,
+  /// are not spilled.
+  static void OnEvict(const CacheKey& key, void* value);
+
+  /// Report [delta] bytes charged, or released if negative, to the memory tracker.
+  void TrackCharge(int64_t delta);
+
+  friend class IndexCacheHandle;
+
   std::unique_ptr<Cache> cache_ = nullptr;
+  std::atomic<uint64_t> coalesced_miss_count_ = 0;
+
+  // guards the tracker and the bytes charged to it
+  mutable std::mutex tracker_mutex_;
+  MemoryTrackerRef tracker_;
+  int64_t tracked_bytes_ = 0;
+
+  // guards the following state
+  mutable std::mutex spill_mutex_;
+  std::shared_ptr<SpillCache> spill_;
+  size_t pending_spill_count_ = 0;
+  std::condition_variable spill_done_;
+
+  // guards the creation of namespaces, their states are created once and never move
+  mutable std::mutex namespace_mutex_;
+  std::unordered_map<std::string, CacheNamespaceId> namespace_ids_;
+  std::unique_ptr<Namespace> namespaces_[kMaxNamespaces];
+  std::atomic<size_t> num_namespaces_{0};
+
+  // guards the warm-up plan: the rank of each planned key and the bytes left to read
+  mutable std::mutex warm_up_mutex_;
+  std::unordered_map<std::string, size_t> warm_up_ranks_;
+  size_t warm_up_budget_ = 0;
 };
 
 /**
@@ -98,6 +350,8 @@ class IndexCacheHandle {
  public:
   IndexCacheHandle();
   IndexCacheHandle(Cache* cache, Cache::Handle* handle);
+  /// Handle to an index returned without being cached, e.g. above the hard quota of its namespace.
+  explicit IndexCacheHandle(IndexRef index);
   ~IndexCacheHandle();
   T_FORBID_COPY_AND_ASSIGN(IndexCacheHandle);
 
@@ -105,12 +359,24 @@ class IndexCacheHandle {
   IndexCacheHandle& operator=(IndexCacheHandle&& other) noexcept;
 
   uint32_t cache_entry_ref_count();
+
+  /**
+   * @brief Update the memory charged for the cached index after it is modified in place.
+   *
+   * A growing index is subject to the hard quota of its namespace like an insert: if it does not
+   * fit, it is dropped from the cache and freed once the handles to it are released, this handle
+   * keeps it uncached. Uncached indexes are not charged.
+   */
+  void UpdateCharge(size_t charge);
+  /// The cache of the entry, nullptr for an uncached index.
   Cache* cache() const;
   IndexRef index_ref() const;
 
  private:
   Cache* cache_ = nullptr;
   Cache::Handle* handle_ = nullptr;
+  // the index when it is not cached
+  IndexRef index_;
 };
 
 }  // namespace tenann
\ No newline at end of file
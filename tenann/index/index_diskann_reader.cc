@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/index_diskann_reader.h"
+
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/disk_vamana.h"
+
+namespace tenann {
+
+IndexDiskAnnReader::~IndexDiskAnnReader() = default;
+
+IndexRef IndexDiskAnnReader::ReadIndexFile(const std::string& path) {
+  auto* index_cache = index_cache_ != nullptr ? index_cache_ : IndexCache::GetGlobalInstance();
+  auto disk_vamana = DiskVamana::Open(
+      path, index_cache, index_cache->GetNamespace(index_reader_options_.cache_namespace));
+  return std::make_shared<Index>(disk_vamana.release(),      //
+                                 IndexType::kDiskAnnOnDisk,  //
+                                 [](void* index) { delete static_cast<DiskVamana*>(index); });
+}
+
+}  // namespace tenann
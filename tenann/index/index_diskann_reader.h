@@ -0,0 +1,45 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include "tenann/common/json.h"
+#include "tenann/index/index_reader.h"
+
+namespace tenann {
+
+/**
+ * @brief Reader for DiskANN indexes.
+ *
+ * Only the in-memory sections are loaded, graph nodes are read on demand through the index cache
+ * of this reader.
+ */
+class IndexDiskAnnReader : public IndexReader {
+ public:
+  using IndexReader::IndexReader;
+  virtual ~IndexDiskAnnReader();
+
+  T_FORBID_COPY_AND_ASSIGN(IndexDiskAnnReader);
+  T_FORBID_MOVE(IndexDiskAnnReader);
+
+  // Read index file
+  IndexRef ReadIndexFile(const std::string& path) override;
+};
+
+}  // namespace tenann
@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/index_diskann_writer.h"
+
+#include "faiss/Index.h"
+#include "faiss/impl/FaissException.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/disk_vamana.h"
+
+namespace tenann {
+
+IndexDiskAnnWriter::~IndexDiskAnnWriter() = default;
+
+void IndexDiskAnnWriter::WriteIndexFile(IndexRef index, const std::string& path) {
+  T_CHECK(index->index_type() == IndexType::kDiskAnn)
+      << "an opened DiskANN index is read-only and cannot be written again";
+
+  try {
+    DiskVamana::Write(static_cast<const faiss::Index*>(index->index_raw()), path);
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
+}  // namespace tenann
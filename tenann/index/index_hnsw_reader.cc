@@ -0,0 +1,93 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/index_hnsw_reader.h"
+
+#include "faiss/Index.h"
+#include "faiss/impl/FaissException.h"
+#include "faiss/impl/io.h"
+#include "faiss/index_io.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+#include "tenann/util/runtime_profile_macros.h"
+
+namespace tenann {
+
+IndexHnswReader::~IndexHnswReader() = default;
+
+IndexRef IndexHnswReader::ReadIndexFile(const std::string& path) {
+  if (MmapHnsw::IsMmapHnswFile(path)) {
+    T_SCOPED_TIMER(map_file_timer_);
+    auto mmap_hnsw = MmapHnsw::Open(path);
+    return std::make_shared<Index>(mmap_hnsw.release(),         //
+                                   IndexType::kFaissHnswMmap,  //
+                                   [](void* index) { delete static_cast<MmapHnsw*>(index); });
+  }
+
+  try {
+    std::unique_ptr<faiss::Index> faiss_index;
+    if (index_reader_options_.read_hnsw_file_up_front) {
+      // faiss reads the file sequentially in small pieces, fetch it with concurrent large reads
+      faiss::VectorIOReader reader;
+      {
+        T_SCOPED_TIMER(read_file_timer_);
+        reader.data = RandomAccessSource::FromFile(path)->ReadAll(
+            index_reader_options_.load_parallelism);
+      }
+      reader.name = path;
+      T_SCOPED_TIMER(deserialize_timer_);
+      faiss_index.reset(faiss::read_index(&reader));
+    } else {
+      T_SCOPED_TIMER(deserialize_timer_);
+      faiss_index.reset(faiss::read_index(path.c_str(), faiss::IO_FLAG_MMAP));
+    }
+    return std::make_shared<Index>(faiss_index.release(),  //
+                                   IndexType::kFaissHnsw,  //
+                                   [](void* index) { delete static_cast<faiss::Index*>(index); });
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
+void IndexHnswReader::PrepareProfile() {
+  map_file_timer_ = T_ADD_TIMER(profile_, "MapFileTime");
+  read_file_timer_ = T_ADD_TIMER(profile_, "ReadFileTime");
+  deserialize_timer_ = T_ADD_TIMER(profile_, "DeserializeTime");
+}
+
+IndexRef IndexHnswReader::ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) {
+  try {
+    SourceIOReader reader(std::move(source));
+    // the mmap layout is searched in place in a mapped file
+    uint32_t magic = 0;
+    reader(&magic, sizeof(magic), 1);
+    T_LOG_IF(ERROR, magic == MmapHnsw::Magic())
+        << "the mmap layout can only be read from files, could not read " << reader.name;
+    reader.Seek(0);
+
+    auto faiss_index = std::unique_ptr<faiss::Index>(faiss::read_index(&reader));
+    return std::make_shared<Index>(faiss_index.release(),  //
+                                   IndexType::kFaissHnsw,  //
+                                   [](void* index) { delete static_cast<faiss::Index*>(index); });
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
+}  // namespace tenann
@@ -0,0 +1,60 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include "tenann/common/json.h"
+#include "tenann/index/index_reader.h"
+
+namespace tenann {
+
+/**
+ * @brief Reader for faiss HNSW indexes.
+ *
+ * Files written with the tenann mmap layout (see `MmapHnsw`) are mapped and searched in place,
+ * other files are read by faiss.
+ */
+class IndexHnswReader : public IndexReader {
+ public:
+  using IndexReader::IndexReader;
+  virtual ~IndexHnswReader();
+
+  T_FORBID_COPY_AND_ASSIGN(IndexHnswReader);
+  T_FORBID_MOVE(IndexHnswReader);
+
+  // Read index file
+  IndexRef ReadIndexFile(const std::string& path) override;
+
+  IndexRef ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) override;
+
+ protected:
+  /**
+   * Phases of reading an hnsw index: mapping a file of the mmap layout, or reading the file up
+   * front with `read_hnsw_file_up_front` and deserializing it. By default faiss maps the file
+   * while deserializing, which is all counted in DeserializeTime.
+   */
+  void PrepareProfile() override;
+
+ private:
+  RuntimeProfile::Counter* map_file_timer_ = nullptr;
+  RuntimeProfile::Counter* read_file_timer_ = nullptr;
+  RuntimeProfile::Counter* deserialize_timer_ = nullptr;
+};
+
+}  // namespace tenann
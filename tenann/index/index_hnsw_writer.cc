@@ -0,0 +1,62 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/index_hnsw_writer.h"
+
+#include "faiss/Index.h"
+#include "faiss/impl/FaissException.h"
+#include "faiss/index_io.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+
+namespace tenann {
+
+IndexHnswWriter::~IndexHnswWriter() = default;
+
+void IndexHnswWriter::WriteIndexFile(IndexRef index, const std::string& path) {
+  T_CHECK(index->index_type() == IndexType::kFaissHnsw)
+      << "an index loaded with the mmap layout is read-only and cannot be written again";
+
+  try {
+    auto faiss_index = static_cast<const faiss::Index*>(index->index_raw());
+    if (index_writer_options_.use_mmap_layout) {
+      MmapHnsw::Write(faiss_index, path);
+    } else {
+      faiss::write_index(faiss_index, path.c_str());
+    }
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
+void IndexHnswWriter::WriteIndexTo(IndexRef index, faiss::IOWriter* f) {
+  T_CHECK(index->index_type() == IndexType::kFaissHnsw)
+      << "an index loaded with the mmap layout is read-only and cannot be written again";
+  // the mmap layout is mapped from a local file, so it is only written to files
+  T_LOG_IF(ERROR, index_writer_options_.use_mmap_layout)
+      << "the mmap layout can only be written to files";
+
+  try {
+    faiss::write_index(static_cast<const faiss::Index*>(index->index_raw()), f);
+  } catch (faiss::FaissException& e) {
+    T_LOG(ERROR) << e.what();
+  }
+}
+
+}  // namespace tenann
@@ -25,11 +25,17 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
 
 #include "faiss/Index.h"
 #include "faiss/IndexIVFPQR.h"
+#include "faiss/IndexPreTransform.h"
 #include "faiss/MetaIndexes.h"
 #include "faiss/impl/FaissAssert.h"
 #include "faiss/impl/FaissException.h"
@@ -40,7 +46,14 @@
 #include "faiss/utils/hamming.h"
 #include "tenann/common/logging.h"
 #include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+#include "tenann/index/internal/ivfpq_sectioned_file.h"
+#include "tenann/index/internal/split_inverted_lists.h"
 #include "tenann/util/defer.h"
+#include "tenann/util/id_codec.h"
+#include "tenann/util/memory_usage.h"
+#include "tenann/util/runtime_profile_macros.h"
+#include "tenann/util/thread_pool.h"
 
 namespace faiss {
 
@@ -79,20 +92,6 @@ static void read_direct_map(DirectMap* dm, IOReader* f) {
   }
 }
 
-static void read_ivf_header(IndexIVF* ivf, IOReader* f,
-                            std::vector<std::vector<Index::idx_t>>* ids = nullptr) {
-  read_index_header(ivf, f);
-  READ1(ivf->nlist);
-  READ1(ivf->nprobe);
-  ivf->quantizer = read_index(f);
-  ivf->own_fields = true;
-  if (ids) {  // used in legacy "Iv" formats
-    ids->resize(ivf->nlist);
-    for (size_t i = 0; i < ivf->nlist; i++) READVECTOR((*ids)[i]);
-  }
-  read_direct_map(&ivf->direct_map, f);
-}
-
 // used for legacy formats
 static ArrayInvertedLists* set_array_invlist(IndexIVF* ivf,
                                              std::vector<std::vector<Index::idx_t>>& ids) {
@@ -124,7 +123,8 @@ static void read_ArrayInvertedLists_sizes(IOReader* f, std::vector<size_t>& size
 }
 
 InvertedLists* read_InvertedLists_with_block_cache(IOReader* f, int io_flags,
-                                                   tenann::IndexCache* index_cache) {
+                                                   tenann::IndexCache* index_cache,
+                                                   size_t superblock_size) {
   uint32_t h;
   READ1(h);
   if (h == fourcc("il00")) {
@@ -138,18 +138,24 @@ InvertedLists* read_InvertedLists_with_block_cache(IOReader* f, int io_flags,
     READ1(code_size);
     std::vector<size_t> sizes(nlist);
     read_ArrayInvertedLists_sizes(f, sizes);
-    auto bc = std::make_shared<BlockCacheInvertedListsIOHook>(index_cache);
+    auto bc = std::make_shared<BlockCacheInvertedListsIOHook>(index_cache, superblock_size);
     return bc->read_ArrayInvertedLists(f, io_flags, nlist, code_size, sizes);
+  } else if (h == tenann::SplitInvertedLists::Fourcc() ||
+             h == tenann::SplitInvertedLists::CompressedIdsFourcc()) {
+    tenann::SplitInvertedLists::Header header;
+    tenann::SplitInvertedLists::ReadHeader(f, h, &header);
+    auto bc = std::make_shared<BlockCacheInvertedListsIOHook>(index_cache, superblock_size);
+    return bc->read_SplitInvertedLists(f, header);
   } else {
     return InvertedListsIOHook::lookup(h)->read(f, io_flags);
   }
 }
 
 static void read_InvertedLists(IndexIVF* ivf, IOReader* f, int io_flags, bool cache_index_block,
-                               tenann::IndexCache* index_cache) {
+                               tenann::IndexCache* index_cache, size_t superblock_size) {
   InvertedLists* ils = nullptr;
   if (cache_index_block) {
-    ils = read_InvertedLists_with_block_cache(f, io_flags, index_cache);
+    ils = read_InvertedLists_with_block_cache(f, io_flags, index_cache, superblock_size);
   } else {
     ils = read_InvertedLists(f, io_flags);
   }
@@ -174,21 +180,56 @@ static void read_ProductQuantizer(ProductQuantizer* pq, IOReader* f) {
  * Ported from faiss/impl/index_read.cpp
  **************************************************************/
 
+/// Timers of the phases of `read_ivfpq`, nullptr for the phases not timed.
+struct ReadIvfPqTimers {
+  tenann::RuntimeProfile::Counter* header = nullptr;
+  tenann::RuntimeProfile::Counter* quantizer = nullptr;
+  tenann::RuntimeProfile::Counter* codebook = nullptr;
+  tenann::RuntimeProfile::Counter* inverted_lists = nullptr;
+};
+
 static void read_ivfpq(IndexIVFPQ* ivpq, IOReader* f, uint32_t h, int io_flags,
-                       bool cache_index_block, tenann::IndexCache* index_cache) {
+                       bool cache_index_block, tenann::IndexCache* index_cache,
+                       size_t superblock_size = 0, const ReadIvfPqTimers& timers = {}) {
   bool legacy = h == fourcc("IvQR") || h == fourcc("IvPQ");
 
+  // the ivf header is read inline, so that the quantizer in the middle of it is timed apart
+  {
+    T_SCOPED_TIMER(timers.header);
+    read_index_header(ivpq, f);
+    READ1(ivpq->nlist);
+    READ1(ivpq->nprobe);
+  }
+  {
+    T_SCOPED_TIMER(timers.quantizer);
+    ivpq->quantizer = read_index(f);
+    ivpq->own_fields = true;
+  }
   std::vector<std::vector<Index::idx_t>> ids;
-  read_ivf_header(ivpq, f, legacy ? &ids : nullptr);
-  READ1(ivpq->by_residual);
-  READ1(ivpq->code_size);
-  read_ProductQuantizer(&ivpq->pq, f);
-
-  if (legacy) {
-    ArrayInvertedLists* ail = set_array_invlist(ivpq, ids);
-    for (size_t i = 0; i < ail->nlist; i++) READVECTOR(ail->codes[i]);
-  } else {
-    read_InvertedLists(ivpq, f, io_flags, cache_index_block, index_cache);
+  if (legacy) {  // used in legacy "Iv" formats
+    T_SCOPED_TIMER(timers.inverted_lists);
+    ids.resize(ivpq->nlist);
+    for (size_t i = 0; i < ivpq->nlist; i++) READVECTOR(ids[i]);
+  }
+  {
+    T_SCOPED_TIMER(timers.header);
+    read_direct_map(&ivpq->direct_map, f);
+    READ1(ivpq->by_residual);
+    READ1(ivpq->code_size);
+  }
+  {
+    T_SCOPED_TIMER(timers.codebook);
+    read_ProductQuantizer(&ivpq->pq, f);
+  }
+
+  {
+    T_SCOPED_TIMER(timers.inverted_lists);
+    if (legacy) {
+      ArrayInvertedLists* ail = set_array_invlist(ivpq, ids);
+      for (size_t i = 0; i < ail->nlist; i++) READVECTOR(ail->codes[i]);
+    } else {
+      read_InvertedLists(ivpq, f, io_flags, cache_index_block, index_cache, superblock_size);
+    }
   }
 
   if (ivpq->is_trained) {
@@ -210,13 +251,12 @@ BlockCacheInvertedLists::BlockCacheInvertedLists(size_t nlist, size_t code_size,
                                                  tenann::IndexCache* index_cache)
     : InvertedLists(nlist, code_size),
       lists(nlist),
-      cache_keys(nlist),
+      list_blocks(nlist),
       offset_difference(nlist),
-      cache_handles(nlist),
-      invlist_locks(nlist),
       filename(filename),
       totsize(0),
-      index_cache(index_cache) {
+      index_cache(index_cache),
+      io_backend(tenann::IoBackend::GetInstance()) {
   // slots starts empty
 }
 
@@ -224,80 +264,274 @@ BlockCacheInvertedLists::BlockCacheInvertedLists(tenann::IndexCache* index_cache
     : BlockCacheInvertedLists(0, 0, "", index_cache) {}
 
 BlockCacheInvertedLists::~BlockCacheInvertedLists() {
+  // wait for the prefetches that still read from the file
+  for (auto& load : loads) {
+    if (load.valid()) {
+      load.wait();
+    }
+  }
+
   // close file
   if (fd != -1) {
     close(fd);
   }
+  if (ids_fd != -1) {
+    close(ids_fd);
+  }
+}
+
+void BlockCacheInvertedLists::init_blocks() {
+  auto align_down = [this](size_t offset) { return offset / block_size * block_size; };
+  auto align_up = [this](size_t offset) {
+    return (offset + block_size - 1) / block_size * block_size;
+  };
+
+  // blocks hold the codes only if the ids are stored apart
+  size_t block_entry_size = split_ids ? code_size : one_entry_size;
+  blocks.clear();
+  for (size_t i = 0; i < nlist; i++) {
+    const List& l = lists[i];
+    size_t begin = align_down(l.offset);
+    size_t end = align_up(l.offset + l.size * block_entry_size);
+    // a list joins the current superblock if the superblock stays within the size limit
+    if (superblock_size == 0 || blocks.empty() || end - blocks.back().offset > superblock_size) {
+      blocks.push_back({begin, end - begin});
+    } else {
+      blocks.back().size = std::max(blocks.back().size, end - blocks.back().offset);
+    }
+    list_blocks[i] = blocks.size() - 1;
+    offset_difference[i] = l.offset - blocks.back().offset;
+  }
+
+  size_t nblocks = blocks.size();
+  FAISS_THROW_IF_NOT_MSG(nblocks <= std::numeric_limits<uint32_t>::max(), "too many blocks");
+  cache_handles = std::vector<tenann::IndexCacheHandle>(nblocks);
+  block_locks = std::vector<std::mutex>(nblocks);
+  loads = std::vector<std::shared_future<void>>(nblocks);
 }
 
 size_t BlockCacheInvertedLists::list_size(size_t list_no) const { return lists[list_no].size; }
 
 const uint8_t* BlockCacheInvertedLists::get_ptr(size_t list_no) const {
   T_CHECK(list_no < nlist);
-  {
-    std::lock_guard<std::mutex> guard(invlist_locks[list_no]);
-    tenann::IndexCacheHandle* cache_handle = &cache_handles[list_no];
-    auto found = index_cache->Lookup(cache_keys[list_no], cache_handle);
-    if (found) {
-      VLOG(VERBOSE_DEBUG) << "   hit cache, cache_key: " << cache_keys[list_no].c_str()
-                          << ", hit_rate: "
-                          << index_cache->hit_count() * 1.0 / index_cache->lookup_count();
-      auto start_ptr = static_cast<uint8_t*>(cache_handle->index_ref()->index_raw());
-      return start_ptr + offset_difference[list_no];
+  size_t block_no = list_blocks[list_no];
+  std::promise<void> load_done;
+  while (true) {
+    std::shared_future<void> load;
+    {
+      std::lock_guard<std::mutex> guard(block_locks[block_no]);
+      if (const uint8_t* ptr = lookup_block(block_no)) {
+        return ptr + offset_difference[list_no];
+      }
+      load = loads[block_no];
+      if (!load.valid() || load.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        // no read in flight, read the block ourselves and let the other misses wait for us
+        loads[block_no] = load_done.get_future().share();
+        break;
+      }
+    }
+
+    // the block is being read by another query or a prefetch, scan it as soon as it arrives.
+    // Look it up again afterwards since the read may fail or the block may be evicted right away.
+    index_cache->IncreaseCoalescedMissCount();
+    load.wait();
+  }
+
+  tenann::Defer notify_waiters([&load_done]() { load_done.set_value(); });
+  return load_block(block_no) + offset_difference[list_no];
+}
+
+void BlockCacheInvertedLists::prefetch_lists(const idx_t* list_nos, int n) const {
+  std::vector<size_t> block_nos;
+  for (int i = 0; i < n; i++) {
+    idx_t list_no = list_nos[i];
+    if (list_no < 0 || lists[list_no].offset == INVALID_OFFSET || lists[list_no].size == 0) {
+      continue;
+    }
+    block_nos.push_back(list_blocks[list_no]);
+  }
+  prefetch_blocks(block_nos);
+}
+
+void BlockCacheInvertedLists::prefetch_blocks(const std::vector<size_t>& block_nos) const {
+  std::vector<size_t> missing_blocks;
+  std::unordered_map<size_t, std::promise<void>> promises;
+  for (size_t block_no : block_nos) {
+    std::lock_guard<std::mutex> guard(block_locks[block_no]);
+    auto& load = loads[block_no];
+    bool in_flight =
+        load.valid() && load.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    if (in_flight || lookup_block(block_no) != nullptr) {
+      continue;
     }
+    load = promises[block_no].get_future().share();
+    missing_blocks.push_back(block_no);
   }
 
-  // read file and insert
-
-  // Calculate the offset and size for the specific list
-  size_t offset = lists[list_no].offset;
-  size_t size = lists[list_no].size * one_entry_size;
-
-  // Align the offset to the block size
-  size_t aligned_offset = (offset / block_size) * block_size;
-
-  // Adjust the size to read to include the data from the aligned offset
-  size_t aligned_size =
-      ((offset_difference[list_no] + size + block_size - 1) / block_size) * block_size;
-
-  // Allocate aligned memory
-  void* buffer;
-  int err = posix_memalign(&buffer, block_size, aligned_size);
-  FAISS_THROW_IF_NOT_FMT(err == 0, "posix_memalign error: %d", err);
-
-  // Seek to the aligned offset
-  off_t seek_result = lseek(fd, aligned_offset, SEEK_SET);
-  FAISS_THROW_IF_NOT_FMT(seek_result != -1, "lseek to aligned_offset %zu failed: %s",
-                         aligned_offset, strerror(errno));
-
-  size_t remaining_size = totsize - aligned_offset;
-  size_t expected_read_size = std::min(remaining_size, aligned_size);
-  // Perform the read operation
-  ssize_t read_bytes = read(fd, buffer, aligned_size);
-  FAISS_THROW_IF_NOT_FMT(read_bytes == expected_read_size,
-                         "read_bytes: %zd, expected_read_size: %zu", read_bytes,
-                         expected_read_size);
-
-  // auto msg = fmt::format("allocated {};\n", buffer);
-  // std::cerr << msg;
-  auto index_ref = std::make_shared<tenann::Index>(
-      buffer, tenann::IndexType::kFaissIvfPqOneInvertedList, [](void* index) {
-        // auto msg = fmt::format("freeing {};\n", index);
-        // std::cerr << msg;
-        free(index);
+  // issue the reads of all probed lists at once, failures are left to `get_ptr` to report
+  auto reads = coalesce_reads(std::move(missing_blocks));
+  size_t batch_size = std::max<size_t>(io_backend->max_batch_size(), 1);
+  for (size_t begin = 0; begin < reads.size(); begin += batch_size) {
+    size_t end = std::min(begin + batch_size, reads.size());
+    std::vector<CoalescedRead> batch(std::make_move_iterator(reads.begin() + begin),
+                                     std::make_move_iterator(reads.begin() + end));
+    auto batch_promises = std::make_shared<std::vector<std::promise<void>>>();
+    for (auto& read : batch) {
+      for (size_t block_no : read.block_nos) {
+        batch_promises->push_back(std::move(promises[block_no]));
+      }
+    }
+    tenann::ThreadPool::GetIoInstance()->Submit([this, batch = std::move(batch), batch_promises]() {
+      tenann::Defer notify_waiters([&batch_promises]() {
+        for (auto& promise : *batch_promises) {
+          promise.set_value();
+        }
       });
+      read_blocks(batch);
+    });
+  }
+}
 
-  {
-    std::lock_guard<std::mutex> guard(invlist_locks[list_no]);
-    tenann::IndexCacheHandle* cache_handle = &cache_handles[list_no];
-    index_cache->Insert(cache_keys[list_no], index_ref, cache_handle,
-                        [read_bytes]() { return read_bytes; });
+void BlockCacheInvertedLists::warm_up(size_t num_largest_lists) const {
+  std::vector<size_t> block_nos;
+  if (index_cache != nullptr) {
+    std::vector<tenann::CacheKey128> keys(blocks.size());
+    std::vector<size_t> block_sizes(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+      keys[i] = cache_key(i);
+      block_sizes[i] = blocks[i].size;
+    }
+    block_nos = index_cache->TakeWarmUpKeys({keys.begin(), keys.end()}, block_sizes);
+  }
+
+  size_t n = std::min(num_largest_lists, nlist);
+  std::vector<size_t> list_nos(nlist);
+  std::iota(list_nos.begin(), list_nos.end(), 0);
+  std::partial_sort(list_nos.begin(), list_nos.begin() + n, list_nos.end(),
+                    [this](size_t a, size_t b) { return lists[a].size > lists[b].size; });
+  for (size_t i = 0; i < n; i++) {
+    const List& l = lists[list_nos[i]];
+    if (l.offset != INVALID_OFFSET && l.size > 0) {
+      block_nos.push_back(list_blocks[list_nos[i]]);
+    }
+  }
+  // a block planned and holding one of the largest lists is only read once
+  prefetch_blocks(block_nos);
+}
 
-    VLOG(VERBOSE_DEBUG) << "insert cache, cache_key: " << cache_keys[list_no].c_str()
-                        << ", usage: " << index_cache->memory_usage();
+const uint8_t* BlockCacheInvertedLists::lookup_block(size_t block_no) const {
+  tenann::IndexCacheHandle* cache_handle = &cache_handles[block_no];
+  tenann::CacheKey128 key = cache_key(block_no);
+  auto found = index_cache->Lookup(key, cache_handle, cache_namespace);
+  if (!found) {
+    return nullptr;
   }
 
-  return static_cast<uint8_t*>(buffer) + offset_difference[list_no];
+  VLOG(VERBOSE_DEBUG) << "   hit cache, block: " << block_no << " of " << filename
+                      << ", hit_rate: "
+                      << index_cache->hit_count() * 1.0 / index_cache->lookup_count();
+  return static_cast<uint8_t*>(cache_handle->index_ref()->index_raw());
+}
+
+const uint8_t* BlockCacheInvertedLists::load_block(size_t block_no) const {
+  CoalescedRead read;
+  read.offset = blocks[block_no].offset;
+  read.size = blocks[block_no].size;
+  read.block_nos.push_back(block_no);
+  return read_blocks({read}).front();
+}
+
+std::vector<BlockCacheInvertedLists::CoalescedRead> BlockCacheInvertedLists::coalesce_reads(
+    std::vector<size_t> block_nos) const {
+  std::sort(block_nos.begin(), block_nos.end(), [this](size_t a, size_t b) {
+    return blocks[a].offset < blocks[b].offset;
+  });
+
+  std::vector<CoalescedRead> reads;
+  for (size_t block_no : block_nos) {
+    const Block& block = blocks[block_no];
+    size_t block_end = block.offset + block.size;
+    if (!reads.empty()) {
+      // blocks of consecutive lists may share a page, so they can overlap as well
+      CoalescedRead& read = reads.back();
+      size_t read_end = read.offset + read.size;
+      size_t merged_end = std::max(read_end, block_end);
+      if (block.offset <= read_end + max_read_gap && merged_end - read.offset <= max_read_size) {
+        read.size = merged_end - read.offset;
+        read.block_nos.push_back(block_no);
+        continue;
+      }
+    }
+    reads.push_back({block.offset, block.size, {block_no}});
+  }
+  return reads;
+}
+
+std::vector<const uint8_t*> BlockCacheInvertedLists::read_blocks(
+    const std::vector<CoalescedRead>& reads) const {
+  std::vector<tenann::IoRequest> requests(reads.size());
+  tenann::Defer free_buffers_on_error([&requests]() {
+    for (auto& request : requests) {
+      free(request.buf);
+    }
+  });
+  for (size_t i = 0; i < reads.size(); i++) {
+    void* buffer;
+    int err = posix_memalign(&buffer, block_size, reads[i].size);
+    FAISS_THROW_IF_NOT_FMT(err == 0, "posix_memalign error: %d", err);
+    requests[i].buf = buffer;
+    requests[i].size = reads[i].size;
+    requests[i].offset = reads[i].offset;
+  }
+  if (source != nullptr) {
+    source->Read(requests.data(), requests.size());
+  } else {
+    io_backend->Read(fd, requests.data(), requests.size());
+  }
+
+  // insert every block read successfully before reporting the first failure
+  std::vector<const uint8_t*> block_ptrs;
+  std::string first_error;
+  for (size_t i = 0; i < reads.size(); i++) {
+    const CoalescedRead& read = reads[i];
+    tenann::IoRequest& request = requests[i];
+    size_t expected_read_size = std::min(totsize - read.offset, read.size);
+    if (request.result != static_cast<int64_t>(expected_read_size)) {
+      if (first_error.empty()) {
+        first_error = "read_bytes: " + std::to_string(request.result) +
+                      ", expected_read_size: " + std::to_string(expected_read_size) + " (" +
+                      (request.result < 0 ? strerror(-request.result) : "short read") + ")";
+      }
+      continue;
+    }
+
+    // the blocks carved from the buffer share it, it is freed once all of them are evicted
+    std::shared_ptr<void> buffer(request.buf, free);
+    request.buf = nullptr;
+    auto* data = static_cast<uint8_t*>(buffer.get());
+    for (size_t block_no : read.block_nos) {
+      const Block& block = blocks[block_no];
+      auto index_ref = std::make_shared<tenann::Index>(
+          data + (block.offset - read.offset), tenann::IndexType::kFaissIvfPqOneInvertedList,
+          [buffer](void* /* block */) {});
+      index_ref->SetBlockSize(std::min(totsize - block.offset, block.size));
+      // the block shares the read buffer, plus the index wrapper allocated for it
+      size_t charge = index_ref->block_size() + tenann::AllocationSize(sizeof(tenann::Index));
+
+      std::lock_guard<std::mutex> guard(block_locks[block_no]);
+      tenann::IndexCacheHandle* cache_handle = &cache_handles[block_no];
+      tenann::CacheKey128 key = cache_key(block_no);
+      index_cache->Insert(key, index_ref, cache_handle, [charge]() { return charge; },
+                          cache_namespace);
+      block_ptrs.push_back(static_cast<uint8_t*>(index_ref->index_raw()));
+
+      VLOG(VERBOSE_DEBUG) << "insert cache, block: " << block_no << " of " << filename
+                          << ", usage: " << index_cache->memory_usage();
+    }
+  }
+  FAISS_THROW_IF_NOT_FMT(first_error.empty(), "%s", first_error.c_str());
+
+  return block_ptrs;
 }
 
 const uint8_t* BlockCacheInvertedLists::get_codes(size_t list_no) const {
@@ -314,63 +548,166 @@ const Index::idx_t* BlockCacheInvertedLists::get_ids(size_t list_no) const {
     return nullptr;
   }
 
+  if (split_ids) {
+    auto ids = std::make_unique<idx_t[]>(lists[list_no].size);
+    read_ids(list_no, 0, lists[list_no].size, ids.get());
+    return ids.release();
+  }
   const idx_t* ret = (const idx_t*)(get_ptr(list_no) + code_size * lists[list_no].capacity);
   return ret;
 }
 
-BlockCacheInvertedListsIOHook::BlockCacheInvertedListsIOHook(tenann::IndexCache* index_cache)
+void BlockCacheInvertedLists::release_ids(size_t /* list_no */, const idx_t* ids) const {
+  if (split_ids) {
+    delete[] ids;
+  }
+}
+
+Index::idx_t BlockCacheInvertedLists::get_single_id(size_t list_no, size_t offset) const {
+  if (!split_ids) {
+    return InvertedLists::get_single_id(list_no, offset);
+  }
+  FAISS_THROW_IF_NOT(offset < lists[list_no].size);
+  idx_t id;
+  read_ids(list_no, offset, 1, &id);
+  return id;
+}
+
+void BlockCacheInvertedLists::read_ids(size_t list_no, size_t offset, size_t n,
+                                       idx_t* ids) const {
+  if (!compressed_ids) {
+    read_ids_region(id_offsets[list_no] + offset * sizeof(idx_t), n * sizeof(idx_t), ids);
+    return;
+  }
+
+  // the encoded list is small, read it whole and decode the requested ids only
+  size_t list_size = lists[list_no].size;
+  std::vector<uint8_t> encoded(id_offsets[list_no + 1] - id_offsets[list_no]);
+  read_ids_region(id_offsets[list_no], encoded.size(), encoded.data());
+  if (n == 1) {
+    *ids = tenann::IdCodec::DecodeAt(encoded.data(), list_size, offset);
+  } else if (n == list_size) {
+    tenann::IdCodec::Decode(encoded.data(), list_size, ids);
+  } else {
+    std::vector<idx_t> all_ids(list_size);
+    tenann::IdCodec::Decode(encoded.data(), list_size, all_ids.data());
+    std::copy_n(all_ids.begin() + offset, n, ids);
+  }
+}
+
+void BlockCacheInvertedLists::read_ids_region(size_t offset, size_t size, void* buf) const {
+  tenann::IoRequest request;
+  request.buf = buf;
+  request.size = size;
+  request.offset = offset;
+  if (source != nullptr) {
+    source->Read(&request, 1);
+  } else {
+    io_backend->Read(ids_fd, &request, 1);
+  }
+  FAISS_THROW_IF_NOT_FMT(
+      request.result == static_cast<int64_t>(request.size),
+      "read_bytes: %ld, expected_read_size: %zu (%s)", request.result, request.size,
+      request.result < 0 ? strerror(-request.result) : "short read");
+}
+
+BlockCacheInvertedListsIOHook::BlockCacheInvertedListsIOHook(tenann::IndexCache* index_cache,
+                                                             size_t superblock_size)
     : InvertedListsIOHook("ilbc", typeid(BlockCacheInvertedLists).name()),
-      index_cache(index_cache) {}
+      index_cache(index_cache),
+      superblock_size(superblock_size) {}
 
 InvertedLists* BlockCacheInvertedListsIOHook::read_ArrayInvertedLists(
     IOReader* f, int /* io_flags */, size_t nlist, size_t code_size,
     const std::vector<size_t>& sizes) const {
+  return read_lists(f, nlist, code_size, sizes, nullptr);
+}
+
+InvertedLists* BlockCacheInvertedListsIOHook::read_SplitInvertedLists(
+    IOReader* f, const tenann::SplitInvertedLists::Header& header) const {
+  return read_lists(f, header.nlist, header.code_size, header.sizes, &header);
+}
+
+BlockCacheInvertedLists* BlockCacheInvertedListsIOHook::read_lists(
+    IOReader* f, size_t nlist, size_t code_size, const std::vector<size_t>& sizes,
+    const tenann::SplitInvertedLists::Header* split_header) const {
+  bool split_ids = split_header != nullptr;
   auto ails =
       std::make_unique<BlockCacheInvertedLists>(nlist, code_size, f->name.c_str(), index_cache);
   // ails->filename = f->name;
   // ails->nlist = nlist;
   // ails->code_size = code_size;
   ails->read_only = true;
-  // ails->lists.resize(nlist);
-  // ails->cache_keys.resize(nlist);
-  // ails->offset_difference.resize(nlist);
+  ails->superblock_size = superblock_size;
+  ails->split_ids = split_ids;
 
+  // the lists are read on demand from either the index file or the source the index is read from
   FileIOReader* reader = dynamic_cast<FileIOReader*>(f);
-  FAISS_THROW_IF_NOT_MSG(reader, "only supported for File objects");
-  FILE* fdesc = reader->f;
-  ails->start_offset = ftell(fdesc);
-  size_t o = ails->start_offset;
-
-  ails->fd = open(f->name.c_str(), O_RDONLY | O_DIRECT);
-  FAISS_THROW_IF_NOT_FMT(ails->fd != -1, "could not open file %s with O_DIRECT: %s", reader->name,
-                         strerror(errno));
-
-  struct stat buf;
-  int ret = fstat(fileno(fdesc), &buf);
-  FAISS_THROW_IF_NOT_FMT(ret == 0, "fstat failed: %s", strerror(errno));
-  ails->totsize = buf.st_size;
-  FAISS_THROW_IF_NOT(o <= ails->totsize);
+  auto* source_reader = dynamic_cast<tenann::SourceIOReader*>(f);
+  FAISS_THROW_IF_NOT_MSG(reader || source_reader, "only supported for File and source objects");
+  // the name and the layout of the lists identify the file, and its version changes the generation
+  std::string key_name = ails->filename;
+  uint32_t generation;
+  if (reader != nullptr) {
+    FILE* fdesc = reader->f;
+    ails->start_offset = ftell(fdesc);
+
+    ails->fd = open(f->name.c_str(), O_RDONLY | O_DIRECT);
+    FAISS_THROW_IF_NOT_FMT(ails->fd != -1, "could not open file %s with O_DIRECT: %s",
+                           reader->name.c_str(), strerror(errno));
+    if (split_ids) {
+      ails->ids_fd = open(f->name.c_str(), O_RDONLY);
+      FAISS_THROW_IF_NOT_FMT(ails->ids_fd != -1, "could not open file %s: %s",
+                             reader->name.c_str(), strerror(errno));
+    }
 
-  // generate cache_keys
-  // cache_key = hash(filename) + fileModificationTime + blockId
-  std::string prefix = std::to_string(std::hash<std::string>{}(ails->filename)) + "_" +
-                       std::to_string(buf.st_mtime) + "_";
-  for (size_t i = 0; i < nlist; i++) {
-    ails->cache_keys[i] = prefix + std::to_string(i);
+    struct stat buf;
+    int ret = fstat(fileno(fdesc), &buf);
+    FAISS_THROW_IF_NOT_FMT(ret == 0, "fstat failed: %s", strerror(errno));
+    ails->totsize = buf.st_size;
+    generation = static_cast<uint32_t>(buf.st_mtime);
+  } else {
+    ails->source = source_reader->source();
+    ails->start_offset = source_reader->position();
+    ails->totsize = ails->source->size();
+    // a source has no modification time, its name identifies the bytes
+    key_name += "#source";
+    generation = static_cast<uint32_t>(ails->totsize ^ (ails->totsize >> 32));
   }
+  size_t o = ails->start_offset;
+  FAISS_THROW_IF_NOT(o <= ails->totsize);
 
   ails->one_entry_size = sizeof(BlockCacheInvertedLists::idx_t) + ails->code_size;
   for (size_t i = 0; i < ails->nlist; i++) {
     BlockCacheInvertedLists::List& l = ails->lists[i];
     l.size = l.capacity = sizes[i];
     l.offset = o;
-    o += l.size * ails->one_entry_size;
+    o += l.size * (split_ids ? ails->code_size : ails->one_entry_size);
+  }
+  if (split_ids) {
+    // the ids region follows the codes region
+    ails->compressed_ids = split_header->compressed_ids;
+    ails->id_offsets.resize(nlist + 1);
+    for (size_t i = 0; i <= ails->nlist; i++) {
+      ails->id_offsets[i] = o + split_header->id_offsets[i];
+    }
+    o = ails->id_offsets[nlist];
+  }
+  FAISS_THROW_IF_NOT(o <= ails->totsize);
 
-    size_t aligned_offset = (l.offset / ails->block_size) * ails->block_size;
-    ails->offset_difference[i] = l.offset - aligned_offset;
+  // cache_key = hash(filename, layout) + fileModificationTime (or source size) + blockId
+  if (superblock_size != 0) {
+    key_name += "#sb" + std::to_string(superblock_size);
   }
+  ails->cache_key_base.file_id = std::hash<std::string>{}(key_name);
+  ails->cache_key_base.generation = generation;
+  ails->init_blocks();
   // resume normal reading of file
-  fseek(fdesc, o, SEEK_SET);
+  if (reader != nullptr) {
+    fseek(reader->f, o, SEEK_SET);
+  } else {
+    source_reader->Seek(o);
+  }
 
   return ails.release();
 }
@@ -383,9 +720,66 @@ using faiss::fourcc_inv_printable;
 
 // TODO: ignore this flag and use IndexCache
 static constexpr const int IO_FLAG = faiss::IO_FLAG_READ_ONLY;
+// the precomputed table is set up by `LoadPrecomputedTable` once the whole index is read
+static constexpr const int IVFPQ_IO_FLAG = IO_FLAG | faiss::IO_FLAG_SKIP_PRECOMPUTE_TABLE;
 
 IndexIvfPqReader::~IndexIvfPqReader() = default;
 
+// look up the ids of the results only if the block cache reads the ids on demand
+static void SetFetchIdsAfterScan(IndexIvfPq* index_ivfpq) {
+  auto* block_cache_lists = dynamic_cast<faiss::BlockCacheInvertedLists*>(index_ivfpq->invlists);
+  index_ivfpq->fetch_ids_after_scan = block_cache_lists != nullptr && block_cache_lists->split_ids;
+}
+
+// Reuse the table of an index with identical codebooks if sharing, otherwise read the table
+// persisted in [f] if any, or compute it, the rows of each list being computed on first probe
+// if lazy.
+static void LoadPrecomputedTable(IndexIvfPq* index_ivfpq, faiss::IOReader* f,
+                                 const IndexReaderOptions& options) {
+  if (!IvfPqPrecomputedTable::IsApplicable(*index_ivfpq)) {
+    // let faiss decide, as `faiss::read_index` does
+    if (index_ivfpq->is_trained && index_ivfpq->by_residual) {
+      index_ivfpq->precompute_table();
+    }
+    return;
+  }
+
+  std::shared_ptr<IvfPqPrecomputedTable> table;
+  if (options.share_precomputed_table) {
+    table = IvfPqPrecomputedTable::Lookup(*index_ivfpq);
+  }
+  if (table == nullptr) {
+    if (f != nullptr) {
+      table = IvfPqPrecomputedTable::Read(*index_ivfpq, f);
+    }
+    if (table == nullptr) {
+      table = IvfPqPrecomputedTable::Create(*index_ivfpq, options.lazy_precompute_table);
+    }
+    if (options.share_precomputed_table) {
+      table = IvfPqPrecomputedTable::Register(std::move(table));
+    }
+  }
+  index_ivfpq->SetPrecomputedTable(std::move(table));
+}
+
+// Charge the blocks of a freshly read index to [ns] and read its hot blocks in the background,
+// with `cache_index_block` only.
+static void SetUpBlockCache(const IndexRef& index, const IndexReaderOptions& options,
+                            CacheNamespaceId ns) {
+  auto* faiss_index = static_cast<faiss::Index*>(index->index_raw());
+  if (auto* index_pt = dynamic_cast<faiss::IndexPreTransform*>(faiss_index)) {
+    faiss_index = index_pt->index;
+  }
+  auto* index_ivf = dynamic_cast<faiss::IndexIVF*>(faiss_index);
+  auto* block_cache_lists =
+      index_ivf != nullptr ? dynamic_cast<faiss::BlockCacheInvertedLists*>(index_ivf->invlists)
+                           : nullptr;
+  if (block_cache_lists != nullptr) {
+    block_cache_lists->cache_namespace = ns;
+    block_cache_lists->warm_up(options.warm_up_largest_lists);
+  }
+}
+
 IndexRef IndexIvfPqReader::ReadIndexFile(const std::string& path) {
   // open the index file and close it automatically
   // when we leave the current scope through `Defer`
@@ -397,35 +791,70 @@ IndexRef IndexIvfPqReader::ReadIndexFile(const std::string& path) {
   T_LOG_IF(ERROR, file == nullptr)
       << "could not open [" << path << "] for reading: " << strerror(errno);
 
-  try {
-    // init an IOReader for index reading
-    faiss::FileIOReader reader(file);
-    reader.name = path;
+  // init an IOReader for index reading
+  faiss::FileIOReader reader(file);
+  reader.name = path;
+  auto index = ReadIndexFrom(&reader);
+  SetUpBlockCache(index, index_reader_options_, cache_namespace());
+  return index;
+}
 
-    // the name `f` is needed for faiss IO macros
-    auto* f = &reader;
+void IndexIvfPqReader::PrepareProfile() {
+  read_header_timer_ = T_ADD_TIMER(profile_, "ReadHeaderTime");
+  read_quantizer_timer_ = T_ADD_TIMER(profile_, "ReadQuantizerTime");
+  read_codebook_timer_ = T_ADD_TIMER(profile_, "ReadCodebookTime");
+  read_inverted_lists_timer_ = T_ADD_TIMER(profile_, "ReadInvertedListsTime");
+  read_reconstruction_errors_timer_ = T_ADD_TIMER(profile_, "ReadReconstructionErrorsTime");
+  load_precomputed_table_timer_ = T_ADD_TIMER(profile_, "LoadPrecomputedTableTime");
+}
+
+IndexRef IndexIvfPqReader::ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) {
+  SourceIOReader reader(std::move(source));
+  auto index = ReadIndexFrom(&reader);
+  SetUpBlockCache(index, index_reader_options_, cache_namespace());
+  return index;
+}
 
+IndexRef IndexIvfPqReader::ReadIndexFrom(faiss::IOReader* f) {
+  // read inverted lists of the split layout without block cache as well
+  SplitInvertedLists::RegisterIOHook();
+
+  faiss::ReadIvfPqTimers timers{read_header_timer_, read_quantizer_timer_, read_codebook_timer_,
+                                read_inverted_lists_timer_};
+  try {
     // read header
     uint32_t h;
     READ1(h);
-    T_LOG_IF(WARNING, h != fourcc("IwPQ") && h != fourcc("IxPT"))
-        << "tenann could not read ivfpq from file " << path << ": "
-        << "expect magic number `IwPQ` and `IxPT` but got." << fourcc_inv_printable(h);
-    if (h == fourcc("IwPQ")) {
+    T_LOG_IF(WARNING,
+             h != fourcc("IwPQ") && h != fourcc("IxPT") && h != IvfPqSectionedFile::Magic())
+        << "tenann could not read ivfpq from " << f->name << ": "
+        << "expect magic number `IwPQ`, `IxPT` or `TnPQ` but got." << fourcc_inv_printable(h);
+    if (h == IvfPqSectionedFile::Magic()) {
+      return ReadSectionedIndexFrom(f);
+    } else if (h == fourcc("IwPQ")) {
       auto index_ivfpq = std::make_unique<IndexIvfPq>();
       // read faiss IndexIVFPQ
       VLOG(VERBOSE_DEBUG) << "cache_index_block: " << index_reader_options_.cache_index_block;
-      faiss::read_ivfpq(index_ivfpq.get(), f, h, IO_FLAG, index_reader_options_.cache_index_block,
-                        index_cache());
+      faiss::read_ivfpq(index_ivfpq.get(), f, h, IVFPQ_IO_FLAG,
+                        index_reader_options_.cache_index_block, index_cache(),
+                        index_reader_options_.block_cache_superblock_size, timers);
+      SetFetchIdsAfterScan(index_ivfpq.get());
       /* read custom fields */
       // read range_search_confidence
       READ1(index_ivfpq->range_search_confidence);
       // read reconstruction_errors
-      size_t num_invlists;
-      READ1(num_invlists);
-      index_ivfpq->reconstruction_errors.resize(num_invlists);
-      for (size_t i = 0; i < num_invlists; i++) {
-        READVECTOR(index_ivfpq->reconstruction_errors[i]);
+      {
+        T_SCOPED_TIMER(read_reconstruction_errors_timer_);
+        size_t num_invlists;
+        READ1(num_invlists);
+        index_ivfpq->reconstruction_errors.resize(num_invlists);
+        for (size_t i = 0; i < num_invlists; i++) {
+          READVECTOR(index_ivfpq->reconstruction_errors[i]);
+        }
+      }
+      {
+        T_SCOPED_TIMER(load_precomputed_table_timer_);
+        LoadPrecomputedTable(index_ivfpq.get(), f, index_reader_options_);
       }
 
       return std::make_shared<Index>(index_ivfpq.release(),   //
@@ -434,26 +863,38 @@ IndexRef IndexIvfPqReader::ReadIndexFile(const std::string& path) {
     } else if (h == fourcc("IxPT")) {
       auto index_pt = std::make_unique<faiss::IndexPreTransform>();
       index_pt->own_fields = true;
-      faiss::read_index_header(index_pt.get(), f);
-      int nt;
-      READ1(nt);
-      for (int i = 0; i < nt; i++) {
-        index_pt->chain.push_back(read_VectorTransform(f));
-      }
       auto index_ivfpq = std::make_unique<IndexIvfPq>();
-      READ1(h);
+      {
+        T_SCOPED_TIMER(read_header_timer_);
+        faiss::read_index_header(index_pt.get(), f);
+        int nt;
+        READ1(nt);
+        for (int i = 0; i < nt; i++) {
+          index_pt->chain.push_back(read_VectorTransform(f));
+        }
+        READ1(h);
+      }
       VLOG(VERBOSE_DEBUG) << "cache_index_block: " << index_reader_options_.cache_index_block;
-      faiss::read_ivfpq(index_ivfpq.get(), f, h, IO_FLAG, index_reader_options_.cache_index_block,
-                        index_cache());
+      faiss::read_ivfpq(index_ivfpq.get(), f, h, IVFPQ_IO_FLAG,
+                        index_reader_options_.cache_index_block, index_cache(),
+                        index_reader_options_.block_cache_superblock_size, timers);
+      SetFetchIdsAfterScan(index_ivfpq.get());
       /* read custom fields */
       // read range_search_confidence
       READ1(index_ivfpq->range_search_confidence);
       // read reconstruction_errors
-      size_t num_invlists;
-      READ1(num_invlists);
-      index_ivfpq->reconstruction_errors.resize(num_invlists);
-      for (size_t i = 0; i < num_invlists; i++) {
-        READVECTOR(index_ivfpq->reconstruction_errors[i]);
+      {
+        T_SCOPED_TIMER(read_reconstruction_errors_timer_);
+        size_t num_invlists;
+        READ1(num_invlists);
+        index_ivfpq->reconstruction_errors.resize(num_invlists);
+        for (size_t i = 0; i < num_invlists; i++) {
+          READVECTOR(index_ivfpq->reconstruction_errors[i]);
+        }
+      }
+      {
+        T_SCOPED_TIMER(load_precomputed_table_timer_);
+        LoadPrecomputedTable(index_ivfpq.get(), f, index_reader_options_);
       }
       index_pt->index = index_ivfpq.release();
       return std::make_shared<Index>(
@@ -471,4 +912,110 @@ IndexRef IndexIvfPqReader::ReadIndexFile(const std::string& path) {
   }
 }
 
-}  // namespace tenann
\ No newline at end of file
+IndexRef IndexIvfPqReader::ReadSectionedIndexFrom(faiss::IOReader* file_reader) {
+  bool verify = index_reader_options_.verify_checksums;
+  std::unique_ptr<IvfPqSectionedFile::Reader> file;
+  std::unique_ptr<faiss::IndexPreTransform> index_pt;
+  auto index_ivfpq = std::make_unique<IndexIvfPq>();
+  index_ivfpq->own_fields = true;
+  index_ivfpq->own_invlists = true;
+
+  {
+    T_SCOPED_TIMER(read_header_timer_);
+    file = std::make_unique<IvfPqSectionedFile::Reader>(file_reader);
+    auto f = file->OpenSection(kIvfPqPreamble, verify);
+    uint8_t has_pre_transform;
+    READ1(has_pre_transform);
+    if (has_pre_transform) {
+      index_pt = std::make_unique<faiss::IndexPreTransform>();
+      index_pt->own_fields = true;
+      faiss::read_index_header(index_pt.get(), f.get());
+      int nt;
+      READ1(nt);
+      for (int i = 0; i < nt; i++) {
+        index_pt->chain.push_back(read_VectorTransform(f.get()));
+      }
+    }
+    faiss::read_index_header(index_ivfpq.get(), f.get());
+    READ1(index_ivfpq->nlist);
+    READ1(index_ivfpq->nprobe);
+    faiss::read_direct_map(&index_ivfpq->direct_map, f.get());
+    READ1(index_ivfpq->by_residual);
+    READ1(index_ivfpq->code_size);
+    READ1(index_ivfpq->range_search_confidence);
+  }
+
+  // the following sections are independent of each other, each phase reads through [handle]
+  std::vector<std::function<void(faiss::IOReader* handle)>> phases;
+  phases.emplace_back([&](faiss::IOReader* handle) {
+    T_SCOPED_TIMER(read_quantizer_timer_);
+    auto f = file->OpenSection(kIvfPqQuantizer, verify, handle);
+    index_ivfpq->quantizer = faiss::read_index(f.get(), IO_FLAG);
+  });
+  phases.emplace_back([&](faiss::IOReader* handle) {
+    T_SCOPED_TIMER(read_codebook_timer_);
+    auto f = file->OpenSection(kIvfPqCodebook, verify, handle);
+    faiss::read_ProductQuantizer(&index_ivfpq->pq, f.get());
+  });
+  phases.emplace_back([&](faiss::IOReader* handle) {
+    T_SCOPED_TIMER(read_inverted_lists_timer_);
+    SplitInvertedLists::Header header;
+    auto f = file->OpenSection(kIvfPqListDirectory, verify, handle);
+    uint32_t h;
+    READ1(h);
+    SplitInvertedLists::ReadHeader(f.get(), h, &header);
+    FAISS_THROW_IF_NOT(header.nlist == index_ivfpq->nlist &&
+                       header.code_size == index_ivfpq->code_size);
+    if (index_reader_options_.cache_index_block) {
+      // the lists stay in the file until probed, their checksum is left unverified
+      file->SeekTo(kIvfPqListData, handle);
+      faiss::BlockCacheInvertedListsIOHook hook(
+          index_cache(), index_reader_options_.block_cache_superblock_size);
+      index_ivfpq->invlists =
+          hook.read_SplitInvertedLists(handle != nullptr ? handle : file_reader, header);
+    } else {
+      f = file->OpenSection(kIvfPqListData, verify, handle);
+      index_ivfpq->invlists = SplitInvertedLists::ReadLists(f.get(), header);
+    }
+  });
+  phases.emplace_back([&](faiss::IOReader* handle) {
+    T_SCOPED_TIMER(read_reconstruction_errors_timer_);
+    auto f = file->OpenSection(kIvfPqReconstructionErrors, verify, handle);
+    size_t num_invlists;
+    READ1(num_invlists);
+    index_ivfpq->reconstruction_errors.resize(num_invlists);
+    for (size_t i = 0; i < num_invlists; i++) {
+      READVECTOR(index_ivfpq->reconstruction_errors[i]);
+    }
+  });
+
+  int parallelism = index_reader_options_.load_parallelism;
+  ThreadPool::GetIoInstance()->ParallelFor(phases.size(), parallelism, [&](size_t i) {
+    // concurrent phases read through their own handles of the file
+    auto handle = parallelism > 1 ? file->Reopen() : nullptr;
+    phases[i](handle.get());
+  });
+  SetFetchIdsAfterScan(index_ivfpq.get());
+
+  {
+    // the table is checked against the codebooks, read it last
+    T_SCOPED_TIMER(load_precomputed_table_timer_);
+    auto f = file->Has(kIvfPqPrecomputedTable)
+                 ? file->OpenSection(kIvfPqPrecomputedTable, verify)
+                 : nullptr;
+    LoadPrecomputedTable(index_ivfpq.get(), f.get(), index_reader_options_);
+  }
+
+  if (index_pt == nullptr) {
+    return std::make_shared<Index>(index_ivfpq.release(),   //
+                                   IndexType::kFaissIvfPq,  //
+                                   [](void* index) { delete static_cast<faiss::Index*>(index); });
+  }
+  index_pt->index = index_ivfpq.release();
+  return std::make_shared<Index>(
+      index_pt.release(),      //
+      IndexType::kFaissIvfPq,  //
+      [](void* index) { delete static_cast<faiss::IndexPreTransform*>(index); });
+}
+
+}  // namespace tenann
@@ -25,45 +25,124 @@
 #include <faiss/invlists/InvertedListsIOHook.h>
 #include <faiss/invlists/OnDiskInvertedLists.h>
 
+#include <future>
 #include <mutex>
+#include <string>
+#include <vector>
 
 #include "tenann/common/json.h"
 #include "tenann/index/index_cache.h"
 #include "tenann/index/index_reader.h"
+#include "tenann/index/internal/split_inverted_lists.h"
+#include "tenann/util/buffer_io.h"
+#include "tenann/util/io_backend.h"
 
 namespace faiss {
 
 Index* read_index_with_block_cache(const char* fname);
 
+/**
+ * @brief Inverted lists read from the index file on demand and cached in an `IndexCache`.
+ *
+ * The lists are cached in blocks, each block being a block-aligned range of the file holding one
+ * list, or several consecutive lists if `superblock_size` is set so that the cache holds fewer and
+ * larger entries. Missing blocks that are adjacent or nearly adjacent in the file are read with a
+ * single request and carved into their own cache entries.
+ *
+ * With the `SplitInvertedLists` layout only the codes are cached, the ids are read on demand
+ * through the page cache since a scan needs the ids of a few results only.
+ */
 struct BlockCacheInvertedLists : InvertedLists {
   using List = OnDiskOneList;
 
+  /// Block-aligned range of the file cached as a single entry
+  struct Block {
+    size_t offset;
+    size_t size;
+  };
+
+  /// A single read covering consecutive blocks
+  struct CoalescedRead {
+    size_t offset = 0;
+    size_t size = 0;
+    std::vector<size_t> block_nos;
+  };
+
   // size nlist
   std::vector<List> lists;
-  std::vector<std::string> cache_keys;
+  /// Offset of the ids of each list in the file followed by the end of the ids region, with
+  /// `split_ids` only
+  std::vector<size_t> id_offsets;
+  /// Block holding each list
+  std::vector<size_t> list_blocks;
+  /// Offset of each list within its block
   std::vector<size_t> offset_difference;
+
+  // size nblocks
+  std::vector<Block> blocks;
   /// Keep references to cache handles, otherwise the allocated memory may be clean
   mutable std::vector<tenann::IndexCacheHandle> cache_handles;
   /// Note that this class may be accessed by multiple threads,
-  /// therefore we keep a lock for every inverted list
-  mutable std::vector<std::mutex> invlist_locks;
+  /// therefore we keep a lock for every block
+  mutable std::vector<std::mutex> block_locks;
+  /// In-flight reads of the blocks issued by `get_ptr` or `prefetch_lists`, guarded by
+  /// `block_locks`, a miss on a block being read waits for the read instead of issuing another
+  mutable std::vector<std::shared_future<void>> loads;
 
   std::string filename;
+  /// Identifies the file and its version, the cache key of each block adds the block number
+  tenann::CacheKey128 cache_key_base{};
   size_t one_entry_size;
   size_t totsize;
   size_t start_offset;       // inserted lists start offset
   size_t block_size = 4096;  // block size
-  bool read_only;            /// are inverted lists mapped read-only
+  /// Group consecutive lists into blocks of up to this size, 0 for a block per list
+  size_t superblock_size = 0;
+  /// Blocks separated by at most this many bytes are read together by `prefetch_lists`
+  size_t max_read_gap = 4 * 4096;
+  /// Upper bound of a coalesced read, a single larger block is still read at once
+  size_t max_read_size = 1024 * 1024;
+  bool read_only;  /// are inverted lists mapped read-only
+  /// The lists are stored with the `SplitInvertedLists` layout, blocks hold the codes only
+  bool split_ids = false;
+  /// The ids of each list are encoded by `IdCodec`, with `split_ids` only
+  bool compressed_ids = false;
   int fd = -1;
+  /// Buffered fd for the small reads of ids, with `split_ids` only
+  int ids_fd = -1;
   tenann::IndexCache* index_cache = nullptr;
+  /// Namespace of `index_cache` the blocks are charged to
+  tenann::CacheNamespaceId cache_namespace = tenann::kDefaultCacheNamespace;
+  /// Backend reading the lists from `fd`, io_uring if available
+  tenann::IoBackend* io_backend = nullptr;
+  /// Source the lists are read from instead of `fd` if the index is read from a source
+  std::shared_ptr<tenann::RandomAccessSource> source;
 
   BlockCacheInvertedLists(size_t nlist, size_t code_size, const char* filename,
                           tenann::IndexCache* index_cache);
 
   size_t list_size(size_t list_no) const override;
+  /// Pointer to the list, read from the file on a cache miss unless the read is already in flight.
   const uint8_t* get_ptr(size_t list_no) const;
   const uint8_t* get_codes(size_t list_no) const override;
+  /// With `split_ids`, the ids are read from the file and freed by `release_ids`.
   const idx_t* get_ids(size_t list_no) const override;
+  void release_ids(size_t list_no, const idx_t* ids) const override;
+  idx_t get_single_id(size_t list_no, size_t offset) const override;
+
+  /// Read the blocks of the probed lists missing from the cache in the background, coalescing
+  /// nearby blocks and issuing `io_backend->max_batch_size()` reads at once. `get_ptr` waits for
+  /// the block being prefetched instead of reading it again.
+  void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+
+  /// Same as `prefetch_lists` for the blocks [block_nos].
+  void prefetch_blocks(const std::vector<size_t>& block_nos) const;
+
+  /**
+   * @brief Read in the background the blocks planned by `IndexCache::LoadWarmUpPlan`, and those
+   * of the [num_largest_lists] largest lists, the costliest to read on a first probe.
+   */
+  void warm_up(size_t num_largest_lists) const;
 
   size_t add_entries(size_t list_no, size_t n_entry, const idx_t* ids, const uint8_t* code) {
     T_LOG(ERROR) << "add_entries not implemented";
@@ -83,16 +162,46 @@ struct BlockCacheInvertedLists : InvertedLists {
 
   // empty constructor for the I/O functions
   BlockCacheInvertedLists(tenann::IndexCache* index_cache);
+
+  /// Group the lists into blocks once `lists` and `cache_key_base` are set.
+  void init_blocks();
+
+  tenann::CacheKey128 cache_key(size_t block_no) const {
+    return cache_key_base.with_block_id(static_cast<uint32_t>(block_no));
+  }
+
+  /// Pointer to the block if it is cached, the caller should hold `block_locks[block_no]`
+  const uint8_t* lookup_block(size_t block_no) const;
+  /// Read the block from the file and insert it into the cache
+  const uint8_t* load_block(size_t block_no) const;
+  /// Merge the blocks into as few reads as possible, in the order of their offsets
+  std::vector<CoalescedRead> coalesce_reads(std::vector<size_t> block_nos) const;
+  /// Issue the reads with a single `io_backend` call and insert the blocks into the cache,
+  /// return the pointers to the blocks in the order of the reads
+  std::vector<const uint8_t*> read_blocks(const std::vector<CoalescedRead>& reads) const;
+  /// Read [n] ids of the list starting from [offset] into [ids], with `split_ids` only.
+  /// Compressed lists are read whole and only the requested ids are decoded.
+  void read_ids(size_t list_no, size_t offset, size_t n, idx_t* ids) const;
+  /// Read [size] bytes of the ids region at [offset] through `ids_fd` or `source`
+  void read_ids_region(size_t offset, size_t size, void* buf) const;
 };
 
 struct BlockCacheInvertedListsIOHook : InvertedListsIOHook {
-  BlockCacheInvertedListsIOHook(tenann::IndexCache* index_cache);
+  BlockCacheInvertedListsIOHook(tenann::IndexCache* index_cache, size_t superblock_size = 0);
   void write(const InvertedLists* ils, IOWriter* f) const {}
   InvertedLists* read(IOReader* f, int io_flags) const { return nullptr; }
   InvertedLists* read_ArrayInvertedLists(IOReader* f, int io_flags, size_t nlist, size_t code_size,
                                          const std::vector<size_t>& sizes) const override;
+  /// Same as `read_ArrayInvertedLists` for the `SplitInvertedLists` layout.
+  InvertedLists* read_SplitInvertedLists(IOReader* f,
+                                         const tenann::SplitInvertedLists::Header& header) const;
+  /// [split_header] is nullptr for the `ArrayInvertedLists` layout
+  BlockCacheInvertedLists* read_lists(
+      IOReader* f, size_t nlist, size_t code_size, const std::vector<size_t>& sizes,
+      const tenann::SplitInvertedLists::Header* split_header) const;
 
   tenann::IndexCache* index_cache = nullptr;
+  size_t superblock_size = 0;
 };
 
 }  // namespace faiss
@@ -108,6 +217,30 @@ class IndexIvfPqReader : public IndexReader {
   T_FORBID_MOVE(IndexIvfPqReader);
 
   IndexRef ReadIndexFile(const std::string& path) override;
+
+  /// With `cache_index_block`, the inverted lists are read from [source] on demand.
+  IndexRef ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) override;
+
+ protected:
+  /**
+   * Phases of reading an ivfpq index. The sections of a sectioned file are read concurrently
+   * with `load_parallelism`, in which case the phase timers overlap. The other formats are read
+   * as one stream, whose phases are timed one after another.
+   */
+  void PrepareProfile() override;
+
+ private:
+  IndexRef ReadIndexFrom(faiss::IOReader* f);
+
+  /// Read an `IvfPqSectionedFile`, skipping the list data with `cache_index_block`.
+  IndexRef ReadSectionedIndexFrom(faiss::IOReader* f);
+
+  RuntimeProfile::Counter* read_header_timer_ = nullptr;
+  RuntimeProfile::Counter* read_quantizer_timer_ = nullptr;
+  RuntimeProfile::Counter* read_codebook_timer_ = nullptr;
+  RuntimeProfile::Counter* read_inverted_lists_timer_ = nullptr;
+  RuntimeProfile::Counter* read_reconstruction_errors_timer_ = nullptr;
+  RuntimeProfile::Counter* load_precomputed_table_timer_ = nullptr;
 };
 
 }  // namespace tenann
\ No newline at end of file
@@ -19,6 +19,11 @@
 
 #include "tenann/index/index_ivfpq_writer.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "faiss/Index.h"
 #include "faiss/impl/FaissAssert.h"
 #include "faiss/impl/FaissException.h"
@@ -27,6 +32,9 @@
 #include "faiss/index_io.h"
 #include "tenann/common/logging.h"
 #include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+#include "tenann/index/internal/ivfpq_sectioned_file.h"
+#include "tenann/index/internal/split_inverted_lists.h"
 #include "tenann/util/defer.h"
 
 namespace tenann {
@@ -46,6 +54,110 @@ void write_index_header(const faiss::Index* idx, faiss::IOWriter* f) {
   }
 }
 
+/*************************************************************
+ * Ported from faiss/impl/index_write.cpp
+ **************************************************************/
+
+static void write_direct_map(const faiss::DirectMap* dm, faiss::IOWriter* f) {
+  char maintain_direct_map = (char)dm->type;
+  WRITE1(maintain_direct_map);
+  WRITEVECTOR(dm->array);
+  if (dm->type == faiss::DirectMap::Hashtable) {
+    using idx_t = faiss::Index::idx_t;
+    std::vector<std::pair<idx_t, idx_t>> v;
+    const std::unordered_map<idx_t, idx_t>& map = dm->hashtable;
+    v.resize(map.size());
+    std::copy(map.begin(), map.end(), v.begin());
+    WRITEVECTOR(v);
+  }
+}
+
+static void write_ivf_header(const faiss::IndexIVF* ivf, faiss::IOWriter* f) {
+  write_index_header(ivf, f);
+  WRITE1(ivf->nlist);
+  WRITE1(ivf->nprobe);
+  faiss::write_index(ivf->quantizer, f);
+  write_direct_map(&ivf->direct_map, f);
+}
+
+// Same as faiss::write_index for IndexIVFPQ, with the inverted lists written by tenann
+// with the split layout if [split_codes_and_ids] or [compress_ids] is set
+static void write_ivfpq(const IndexIvfPq* ivpq, faiss::IOWriter* f, bool split_codes_and_ids,
+                        bool compress_ids) {
+  if (!split_codes_and_ids && !compress_ids) {
+    faiss::write_index(ivpq, f);
+    return;
+  }
+
+  uint32_t h = faiss::fourcc("IwPQ");
+  WRITE1(h);
+  write_ivf_header(ivpq, f);
+  WRITE1(ivpq->by_residual);
+  WRITE1(ivpq->code_size);
+  faiss::write_ProductQuantizer(&ivpq->pq, f);
+  SplitInvertedLists::Write(ivpq->invlists, f, compress_ids);
+}
+
+// The precomputed table is optional and written last, after the custom fields
+static void write_precomputed_table(const IndexIvfPq* ivpq, faiss::IOWriter* f,
+                                    bool write_precomputed_table) {
+  if (write_precomputed_table && IvfPqPrecomputedTable::IsApplicable(*ivpq)) {
+    IvfPqPrecomputedTable::Write(*ivpq, f);
+  }
+}
+
+// Write an IndexIvfPq, or an IndexPreTransform over one, as an `IvfPqSectionedFile`
+static void write_sectioned_ivfpq(const faiss::Index* index, faiss::IOWriter* out,
+                                  const IndexWriterOptions& options) {
+  const auto* ixpt = dynamic_cast<const faiss::IndexPreTransform*>(index);
+  const auto* ivpq = dynamic_cast<const IndexIvfPq*>(ixpt != nullptr ? ixpt->index : index);
+  FAISS_THROW_IF_NOT_MSG(ivpq != nullptr, "only ivfpq indexes can be written as sectioned files");
+
+  IvfPqSectionedFile::Writer file(out);
+  faiss::IOWriter* f = file.BeginSection(kIvfPqPreamble);
+  uint8_t has_pre_transform = ixpt != nullptr;
+  WRITE1(has_pre_transform);
+  if (ixpt != nullptr) {
+    write_index_header(ixpt, f);
+    int nt = ixpt->chain.size();
+    WRITE1(nt);
+    for (int i = 0; i < nt; i++) {
+      write_VectorTransform(ixpt->chain[i], f);
+    }
+  }
+  write_index_header(ivpq, f);
+  WRITE1(ivpq->nlist);
+  WRITE1(ivpq->nprobe);
+  write_direct_map(&ivpq->direct_map, f);
+  WRITE1(ivpq->by_residual);
+  WRITE1(ivpq->code_size);
+  WRITE1(ivpq->range_search_confidence);
+
+  f = file.BeginSection(kIvfPqQuantizer);
+  faiss::write_index(ivpq->quantizer, f);
+  f = file.BeginSection(kIvfPqCodebook);
+  faiss::write_ProductQuantizer(&ivpq->pq, f);
+
+  std::vector<uint8_t> encoded_ids;
+  auto header = SplitInvertedLists::MakeHeader(ivpq->invlists, options.compress_ids, &encoded_ids);
+  f = file.BeginSection(kIvfPqListDirectory);
+  SplitInvertedLists::WriteHeader(header, f);
+  f = file.BeginSection(kIvfPqListData);
+  SplitInvertedLists::WriteLists(ivpq->invlists, header, encoded_ids, f);
+
+  f = file.BeginSection(kIvfPqReconstructionErrors);
+  size_t vec_size = ivpq->reconstruction_errors.size();
+  WRITE1(vec_size);
+  for (const auto& sub_vec : ivpq->reconstruction_errors) {
+    WRITEVECTOR(sub_vec);
+  }
+
+  if (options.write_precomputed_table && IvfPqPrecomputedTable::IsApplicable(*ivpq)) {
+    IvfPqPrecomputedTable::Write(*ivpq, file.BeginSection(kIvfPqPrecomputedTable));
+  }
+  file.Finish();
+}
+
 void IndexIvfPqWriter::WriteIndexFile(IndexRef index, const std::string& path) {
   // open the index file and close it automatically
   // when we leave the current scope through `Defer`
@@ -57,16 +169,21 @@ void IndexIvfPqWriter::WriteIndexFile(IndexRef index, const std::string& path) {
   T_LOG_IF(ERROR, file == nullptr)
       << "could not open[" << path << "] for writing: " << strerror(errno);
 
+  // write custom fields with faiss FileIOWriter and IO macros
+  faiss::FileIOWriter writer(file);
+  writer.name = path;
+  WriteIndexTo(index, &writer);
+}
+
+void IndexIvfPqWriter::WriteIndexTo(IndexRef index, faiss::IOWriter* f) {
   try {
-    // write custom fields with faiss FileIOWriter and IO macros
-    faiss::FileIOWriter writer(file);
-    writer.name = path;
-    // the name `f` is needed for faiss IO macros
-    auto* f = &writer;
     const auto* faiss_index = static_cast<const faiss::Index*>(index->index_raw());
 
-    if (const IndexIvfPq* index_ivfpq = dynamic_cast<const IndexIvfPq*>(faiss_index)) {
-      faiss::write_index(index_ivfpq, f);
+    if (index_writer_options_.sectioned_file) {
+      write_sectioned_ivfpq(faiss_index, f, index_writer_options_);
+    } else if (const IndexIvfPq* index_ivfpq = dynamic_cast<const IndexIvfPq*>(faiss_index)) {
+      write_ivfpq(index_ivfpq, f, index_writer_options_.split_codes_and_ids,
+                  index_writer_options_.compress_ids);
       // write range_search_confidence
       WRITE1(index_ivfpq->range_search_confidence);
       // write reconstruction errors
@@ -75,6 +192,7 @@ void IndexIvfPqWriter::WriteIndexFile(IndexRef index, const std::string& path) {
       for (const auto& sub_vec : index_ivfpq->reconstruction_errors) {
         WRITEVECTOR(sub_vec);
       }
+      write_precomputed_table(index_ivfpq, f, index_writer_options_.write_precomputed_table);
     } else if (const faiss::IndexPreTransform* ixpt =
                    dynamic_cast<const faiss::IndexPreTransform*>(faiss_index)) {
       uint32_t h = faiss::fourcc("IxPT");
@@ -86,7 +204,8 @@ void IndexIvfPqWriter::WriteIndexFile(IndexRef index, const std::string& path) {
         write_VectorTransform(ixpt->chain[i], f);
       }
       const IndexIvfPq* index_ivfpq = dynamic_cast<const IndexIvfPq*>(ixpt->index);
-      faiss::write_index(index_ivfpq, f);
+      write_ivfpq(index_ivfpq, f, index_writer_options_.split_codes_and_ids,
+                  index_writer_options_.compress_ids);
       WRITE1(index_ivfpq->range_search_confidence);
       // write reconstruction errors
       size_t vec_size = index_ivfpq->reconstruction_errors.size();
@@ -94,6 +213,7 @@ void IndexIvfPqWriter::WriteIndexFile(IndexRef index, const std::string& path) {
       for (const auto& sub_vec : index_ivfpq->reconstruction_errors) {
         WRITEVECTOR(sub_vec);
       }
+      write_precomputed_table(index_ivfpq, f, index_writer_options_.write_precomputed_table);
     } else {
       faiss::write_index(faiss_index, f);
       T_LOG(INFO) << "Unknow index to writer. using faiss::write_index()";
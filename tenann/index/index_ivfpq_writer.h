@@ -34,6 +34,8 @@ class IndexIvfPqWriter: public IndexWriter {
 
   // Write index file
   void WriteIndexFile(IndexRef index, const std::string& path) override;
+
+  void WriteIndexTo(IndexRef index, faiss::IOWriter* f) override;
 };
 
 }  // namespace tenann
\ No newline at end of file
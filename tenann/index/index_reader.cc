@@ -21,6 +21,8 @@
 #include "tenann/index/parameter_serde.h"
 
 #include "index_reader.h"
+#include "tenann/index/internal/tombstone.h"
+#include "tenann/util/runtime_profile_macros.h"
 
 namespace tenann {
 
@@ -33,38 +35,89 @@ IndexReader::~IndexReader() = default;
 const IndexMeta& IndexReader::index_meta() const { return index_meta_; }
 
 IndexRef IndexReader::ReadIndex(const std::string& path) {
-  if (index_reader_options_.cache_index_file) {
-    auto cache_key = !index_reader_options_.custom_cache_key.empty() ? index_reader_options_.custom_cache_key : path;
-    T_LOG_IF(ERROR, index_cache_ == nullptr) << "index cache not set";
-    if (index_reader_options_.force_read_and_overwrite_cache) {
-      return ForceReadIndexAndOverwriteCache(path, cache_key);
-    } else {
-      auto found = index_cache_->Lookup(cache_key, &cache_handle_);
-      if (found) {
-        return cache_handle_.index_ref();
-      } else {
-        return ForceReadIndexAndOverwriteCache(path, cache_key);
-      }
-    }
-  } else {
-    return ReadIndexFile(path);
-  }
+  return ReadThroughCache(path, [this, &path]() {
+    IndexRef index_ref = ReadIndexFile(path);
+    LoadTombstone(path, index_ref.get());
+    return index_ref;
+  });
+}
+
+IndexRef IndexReader::ReadIndexBuffer(const uint8_t* data, size_t size, const std::string& name) {
+  return ReadIndexSource(RandomAccessSource::FromBuffer(name, data, size));
 }
 
-IndexRef IndexReader::ForceReadIndexAndOverwriteCache(const std::string& path, const std::string& cache_key) {
-  IndexRef index_ref = ReadIndexFile(path);
-  index_cache_->Insert(cache_key, index_ref, &cache_handle_);
+IndexRef IndexReader::ReadIndexSource(std::shared_ptr<RandomAccessSource> source) {
+  T_CHECK_NOTNULL(source);
+  return ReadThroughCache(source->name(),
+                          [this, &source]() { return ReadIndexFromSource(source); });
+}
+
+IndexRef IndexReader::ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source) {
+  T_LOG(ERROR) << "index type " << index_meta_.index_type()
+               << " can only be read from files, could not read " << source->name();
+  return nullptr;
+}
+
+IndexRef IndexReader::ReadThroughCache(const std::string& default_cache_key,
+                                       const std::function<IndexRef()>& read) {
+  T_SCOPED_TIMER(read_index_total_timer_);
+  if (!index_reader_options_.cache_index_file) {
+    return read();
+  }
+
+  auto cache_key = !index_reader_options_.custom_cache_key.empty()
+                       ? index_reader_options_.custom_cache_key
+                       : default_cache_key;
+  T_LOG_IF(ERROR, index_cache_ == nullptr) << "index cache not set";
+  CacheNamespaceId ns = cache_namespace();
+  if (!index_reader_options_.force_read_and_overwrite_cache &&
+      index_cache_->Lookup(cache_key, &cache_handle_, ns)) {
+    return cache_handle_.index_ref();
+  }
+  IndexRef index_ref = read();
+  // with blocks cached apart, the index is only the structure of the index
+  bool pinned = index_reader_options_.cache_index_block &&
+                index_cache_->namespace_options(ns).pin_index_structure;
+  index_cache_->Insert(cache_key, index_ref, &cache_handle_, nullptr, ns,
+                       pinned ? CachePriority::DURABLE : CachePriority::NORMAL);
   return index_ref;
 }
 
+void IndexReader::LoadTombstone(const std::string& path, Index* index) {
+  T_SCOPED_TIMER(load_tombstone_timer_);
+  // the index is not shared yet, no need to lock it
+  index->SetTombstone(Tombstone::Load(Tombstone::PathOf(path)));
+}
+
+void IndexReader::UpdateIndexCacheCharge(size_t charge) {
+  if (cache_handle_.cache() != nullptr) {
+    cache_handle_.UpdateCharge(charge);
+  }
+}
+
 IndexReader& IndexReader::SetIndexCache(IndexCache* cache) {
   T_CHECK_NOTNULL(cache);
   index_cache_ = cache;
   return *this;
 }
 
+IndexReader& IndexReader::EnableProfile() {
+  profile_ = std::make_unique<RuntimeProfile>("IndexReaderProfile");
+  read_index_total_timer_ = T_ADD_TIMER(profile_, "ReadIndexTotalTime");
+  load_tombstone_timer_ = T_ADD_TIMER(profile_, "LoadTombstoneTime");
+  PrepareProfile();
+  return *this;
+}
+
+CacheNamespaceId IndexReader::cache_namespace() {
+  return index_cache_ != nullptr ? index_cache_->GetNamespace(index_reader_options_.cache_namespace)
+                                 : kDefaultCacheNamespace;
+}
+
 IndexCache* IndexReader::index_cache() { return index_cache_; }
 
 const IndexCache* IndexReader::index_cache() const { return index_cache_; }
 
+RuntimeProfile* IndexReader::profile() { return profile_.get(); }
+
 }  // namespace tenann
\ No newline at end of file
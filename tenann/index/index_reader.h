@@ -19,12 +19,16 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <string>
 
 #include "tenann/common/json.h"
 #include "tenann/index/index.h"
 #include "tenann/index/parameters.h"
 #include "tenann/index/index_cache.h"
+#include "tenann/util/buffer_io.h"
+#include "tenann/util/runtime_profile.h"
 
 namespace tenann {
 
@@ -43,15 +47,51 @@ class IndexReader {
   // Read index file
   virtual IndexRef ReadIndexFile(const std::string& path) = 0;
 
+  /**
+   * @brief Read index from the [size] bytes at [data], e.g. an index embedded in a segment file.
+   *
+   * With `cache_index_block` the inverted lists are read from [data] on demand, so the bytes must
+   * outlive the index, otherwise they may be freed once the call returns.
+   */
+  IndexRef ReadIndexBuffer(const uint8_t* data, size_t size, const std::string& name);
+
+  /**
+   * @brief Read index from [source] without extracting it to a local file first.
+   *
+   * The index cache key is `custom_cache_key` or the source name. No tombstone is attached since
+   * tombstones are stored beside index files.
+   */
+  IndexRef ReadIndexSource(std::shared_ptr<RandomAccessSource> source);
+
+  /// Read index from [source], throw if the reader only reads files.
+  virtual IndexRef ReadIndexFromSource(std::shared_ptr<RandomAccessSource> source);
+
+  /**
+   * @brief Update the memory charged for the index read by this reader after it is modified in
+   * place. Do nothing if the index is not read from the cache.
+   */
+  void UpdateIndexCacheCharge(size_t charge);
+
   /** Setters */
   IndexReader& SetIndexCache(IndexCache* cache);
 
+  /// Collect the time spent in each phase of reading indexes, call before reading.
+  IndexReader& EnableProfile();
+
   /** Getters */
   const IndexMeta& index_meta() const;
+  const IndexReaderOptions& index_reader_options() const { return index_reader_options_; }
   IndexCache* index_cache();
   const IndexCache* index_cache() const;
+  /// Namespace of `index_cache()` named by `cache_namespace`
+  CacheNamespaceId cache_namespace();
+  /// nullptr unless the profile is enabled
+  RuntimeProfile* profile();
 
  protected:
+  /// Add the timers of the phases specific to the index type to `profile_`.
+  virtual void PrepareProfile() {}
+
   /// @brief index meta
   IndexMeta index_meta_;
   /// @brief read options
@@ -65,7 +105,17 @@ class IndexReader {
    */
   IndexCacheHandle cache_handle_;
 
-  IndexRef ForceReadIndexAndOverwriteCache(const std::string& path, const std::string& cache_key);
+  /* profile */
+  std::unique_ptr<RuntimeProfile> profile_;
+  RuntimeProfile::Counter* read_index_total_timer_ = nullptr;
+  RuntimeProfile::Counter* load_tombstone_timer_ = nullptr;
+
+  /// Look up the index cache if enabled, read the index with [read] on a miss.
+  IndexRef ReadThroughCache(const std::string& default_cache_key,
+                            const std::function<IndexRef()>& read);
+
+  /// Attach the rows deleted from the index file at [path] to the freshly read [index].
+  void LoadTombstone(const std::string& path, Index* index);
 };
 
 using IndexReaderRef = std::shared_ptr<IndexReader>;
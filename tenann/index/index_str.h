@@ -39,6 +39,12 @@ inline std::string IndexStr(const IndexMeta& meta) {
       FetchParameters(meta, &params);
       return fmt::format("ivf{}pq{}x{}", params.nlist, params.nbits, params.M);
     }
+    case IndexType::kDiskAnn: {
+      DiskAnnIndexParams params;
+      FetchParameters(meta, &params);
+      return fmt::format("diskann_R{}_L{}_alpha{}_pq{}", params.R, params.L, params.alpha,
+                         params.pq_M);
+    }
   }
 
   return "unknown index";
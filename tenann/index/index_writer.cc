@@ -47,6 +47,22 @@ void IndexWriter::WriteIndex(IndexRef index, const std::string& path, bool memor
   WriteIndexFile(index, path);
 }
 
+void IndexWriter::WriteIndexBuffer(IndexRef index, std::vector<uint8_t>* buffer) {
+  WriteIndexStream(index, [buffer](const void* data, size_t size) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    buffer->insert(buffer->end(), bytes, bytes + size);
+  });
+}
+
+void IndexWriter::WriteIndexStream(IndexRef index, const CallbackIOWriter::WriteFunc& write) {
+  CallbackIOWriter writer(write);
+  WriteIndexTo(index, &writer);
+}
+
+void IndexWriter::WriteIndexTo(IndexRef index, faiss::IOWriter* f) {
+  T_LOG(ERROR) << "index type " << index_meta_.index_type() << " can only be written to files";
+}
+
 IndexWriter& IndexWriter::SetIndexCache(IndexCache* cache) {
   T_CHECK_NOTNULL(cache);
   index_cache_ = cache;
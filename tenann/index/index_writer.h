@@ -20,11 +20,14 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "tenann/common/json.h"
 #include "tenann/index/index.h"
 #include "tenann/index/index_cache.h"
 #include "tenann/index/parameters.h"
+#include "tenann/util/buffer_io.h"
 
 namespace tenann {
 
@@ -43,6 +46,15 @@ class IndexWriter {
   // Write index file
   virtual void WriteIndexFile(IndexRef index, const std::string& path) = 0;
 
+  /// Append the index to [buffer], e.g. to embed it in a segment file.
+  void WriteIndexBuffer(IndexRef index, std::vector<uint8_t>* buffer);
+
+  /// Pass the bytes of the index to [write] in order, without a local file.
+  void WriteIndexStream(IndexRef index, const CallbackIOWriter::WriteFunc& write);
+
+  /// Write index to [f], throw if the writer only writes files.
+  virtual void WriteIndexTo(IndexRef index, faiss::IOWriter* f);
+
   /** Setters */
   IndexWriter& SetIndexCache(IndexCache* cache);
 
@@ -0,0 +1,385 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/consolidation.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "faiss/IndexFlat.h"
+#include "faiss/IndexHNSW.h"
+#include "faiss/IndexIDMap.h"
+#include "faiss/IndexPreTransform.h"
+#include "faiss/impl/AuxIndexStructures.h"
+#include "faiss/impl/HNSW.h"
+#include "faiss/invlists/InvertedLists.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+#include "tenann/index/internal/tombstone.h"
+
+namespace tenann {
+
+namespace {
+
+using storage_idx_t = faiss::HNSW::storage_idx_t;
+
+/// Collect the live neighbors of [v] at [level] into [neighbors]. The dropped neighbors are
+/// replaced by their own live neighbors, keeping the closest ones if there are more candidates
+/// than slots.
+void CollectLiveNeighbors(const faiss::HNSW& hnsw, faiss::DistanceComputer& dis,
+                          const std::vector<storage_idx_t>& new_ids, storage_idx_t v, int level,
+                          std::vector<storage_idx_t>* neighbors) {
+  size_t begin, end;
+  hnsw.neighbor_range(v, level, &begin, &end);
+
+  neighbors->clear();
+  auto add_candidate = [&](storage_idx_t u) {
+    if (u != v && new_ids[u] >= 0 &&
+        std::find(neighbors->begin(), neighbors->end(), u) == neighbors->end()) {
+      neighbors->push_back(u);
+    }
+  };
+  for (size_t i = begin; i < end; i++) {
+    storage_idx_t u = hnsw.neighbors[i];
+    if (u < 0) break;
+    if (new_ids[u] >= 0) {
+      add_candidate(u);
+      continue;
+    }
+    size_t u_begin, u_end;
+    hnsw.neighbor_range(u, level, &u_begin, &u_end);
+    for (size_t j = u_begin; j < u_end; j++) {
+      storage_idx_t w = hnsw.neighbors[j];
+      if (w < 0) break;
+      add_candidate(w);
+    }
+  }
+
+  size_t max_size = end - begin;
+  if (neighbors->size() > max_size) {
+    std::vector<std::pair<float, storage_idx_t>> sorted;
+    sorted.reserve(neighbors->size());
+    for (auto u : *neighbors) {
+      sorted.emplace_back(dis.symmetric_dis(v, u), u);
+    }
+    std::partial_sort(sorted.begin(), sorted.begin() + max_size, sorted.end());
+    for (size_t i = 0; i < max_size; i++) {
+      (*neighbors)[i] = sorted[i].second;
+    }
+    neighbors->resize(max_size);
+  }
+}
+
+void PrepareHnsw(const faiss::Index* faiss_index, const Tombstone& tombstone,
+                 ConsolidatedIndex* consolidated) {
+  auto [id_map, transform, index_hnsw] = faiss_util::UnpackHnsw(faiss_index);
+  T_LOG_IF(ERROR, id_map == nullptr)
+      << "consolidation is only supported for hnsw indexes built with custom row ids";
+  auto* storage = dynamic_cast<const faiss::IndexFlatCodes*>(index_hnsw->storage);
+  T_LOG_IF(ERROR, storage == nullptr) << "consolidation is only supported for flat hnsw storage";
+
+  const auto& hnsw = index_hnsw->hnsw;
+  const int64_t ntotal = index_hnsw->ntotal;
+
+  // old internal id -> new internal id, -1 for the dropped nodes
+  std::vector<storage_idx_t> new_ids(ntotal, -1);
+  storage_idx_t nlive = 0;
+  for (int64_t i = 0; i < ntotal; i++) {
+    if (!tombstone.IsDeleted(id_map->id_map[i])) {
+      new_ids[i] = nlive++;
+    }
+  }
+  consolidated->num_dropped = ntotal - nlive;
+  if (consolidated->num_dropped == 0) return;
+
+  // live nodes keep their relative order, and the slots of all their levels
+  size_t code_size = storage->code_size;
+  consolidated->offsets.resize(nlive + 1);
+  consolidated->levels.resize(nlive);
+  consolidated->codes.resize(nlive * code_size);
+  consolidated->id_map.resize(nlive);
+  size_t neighbor_offset = 0;
+  for (int64_t i = 0; i < ntotal; i++) {
+    storage_idx_t j = new_ids[i];
+    if (j < 0) continue;
+
+    consolidated->offsets[j] = neighbor_offset;
+    neighbor_offset += hnsw.offsets[i + 1] - hnsw.offsets[i];
+    consolidated->levels[j] = hnsw.levels[i];
+    if (hnsw.levels[i] - 1 > consolidated->max_level) {
+      consolidated->max_level = hnsw.levels[i] - 1;
+      consolidated->entry_point = j;
+    }
+    std::copy_n(storage->codes.data() + i * code_size, code_size,
+                consolidated->codes.data() + j * code_size);
+    consolidated->id_map[j] = id_map->id_map[i];
+  }
+  consolidated->offsets[nlive] = neighbor_offset;
+  if (hnsw.entry_point >= 0 && new_ids[hnsw.entry_point] >= 0) {
+    consolidated->entry_point = new_ids[hnsw.entry_point];
+  }
+
+  // reconnect the live nodes whose neighbors are dropped, and renumber the neighbors of every
+  // level into the same slots of the new span of the node
+  consolidated->neighbors.assign(neighbor_offset, -1);
+#pragma omp parallel
+  {
+    std::unique_ptr<faiss::DistanceComputer> dis(storage->get_distance_computer());
+    std::vector<storage_idx_t> neighbors;
+#pragma omp for schedule(dynamic, 64)
+    for (int64_t v = 0; v < ntotal; v++) {
+      if (new_ids[v] < 0) continue;
+      for (int level = 0; level < hnsw.levels[v]; level++) {
+        CollectLiveNeighbors(hnsw, *dis, new_ids, v, level, &neighbors);
+        size_t begin, end;
+        hnsw.neighbor_range(v, level, &begin, &end);
+        size_t new_begin = consolidated->offsets[new_ids[v]] + (begin - hnsw.offsets[v]);
+        for (size_t k = 0; k < neighbors.size(); k++) {
+          consolidated->neighbors[new_begin + k] = new_ids[neighbors[k]];
+        }
+      }
+    }
+  }
+}
+
+void ApplyHnsw(faiss::Index* faiss_index, ConsolidatedIndex* consolidated) {
+  auto [id_map, transform, index_hnsw] = faiss_util::UnpackHnswMutable(faiss_index);
+  auto* storage = static_cast<faiss::IndexFlatCodes*>(index_hnsw->storage);
+  auto& hnsw = index_hnsw->hnsw;
+
+  hnsw.neighbors.swap(consolidated->neighbors);
+  hnsw.offsets.swap(consolidated->offsets);
+  hnsw.levels.swap(consolidated->levels);
+  hnsw.entry_point = consolidated->entry_point;
+  hnsw.max_level = consolidated->max_level;
+  storage->codes.swap(consolidated->codes);
+  id_map->id_map.swap(consolidated->id_map);
+
+  int64_t nlive = id_map->id_map.size();
+  storage->ntotal = nlive;
+  index_hnsw->ntotal = nlive;
+  if (transform != nullptr) transform->ntotal = nlive;
+  id_map->ntotal = nlive;
+}
+
+void PrepareIvfPq(const faiss::Index* faiss_index, const Tombstone& tombstone,
+                  ConsolidatedIndex* consolidated) {
+  auto [transform, ivfpq] = faiss_util::UnpackIvfPq(faiss_index);
+  auto* invlists = dynamic_cast<const faiss::ArrayInvertedLists*>(ivfpq->invlists);
+  T_LOG_IF(ERROR, invlists == nullptr)
+      << "consolidation is only supported for ivfpq inverted lists loaded in memory";
+  T_LOG_IF(ERROR, !ivfpq->direct_map.no())
+      << "consolidation is not supported for ivfpq indexes with a direct map";
+
+  // only the lists with dropped entries are copied
+  size_t code_size = invlists->code_size;
+  std::vector<ConsolidatedIndex::InvertedList> lists(invlists->nlist);
+  std::vector<bool> has_dropped(invlists->nlist, false);
+  size_t ndropped = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : ndropped)
+  for (int64_t list_no = 0; list_no < invlists->nlist; list_no++) {
+    const auto& ids = invlists->ids[list_no];
+    const auto& codes = invlists->codes[list_no];
+    size_t nlive = 0;
+    for (auto id : ids) {
+      nlive += !tombstone.IsDeleted(id);
+    }
+    if (nlive == ids.size()) continue;
+
+    // reconstruction errors are only kept if the index is built for range search confidence
+    const std::vector<float>* errors = nullptr;
+    if (static_cast<size_t>(list_no) < ivfpq->reconstruction_errors.size() &&
+        ivfpq->reconstruction_errors[list_no].size() == ids.size()) {
+      errors = &ivfpq->reconstruction_errors[list_no];
+    }
+
+    auto& list = lists[list_no];
+    list.list_no = list_no;
+    list.has_errors = errors != nullptr;
+    list.ids.reserve(nlive);
+    list.codes.reserve(nlive * code_size);
+    if (errors != nullptr) list.errors.reserve(nlive);
+    for (size_t i = 0; i < ids.size(); i++) {
+      if (tombstone.IsDeleted(ids[i])) continue;
+      list.ids.push_back(ids[i]);
+      list.codes.insert(list.codes.end(), codes.data() + i * code_size,
+                        codes.data() + (i + 1) * code_size);
+      if (errors != nullptr) list.errors.push_back((*errors)[i]);
+    }
+    ndropped += ids.size() - nlive;
+    has_dropped[list_no] = true;
+  }
+
+  for (size_t list_no = 0; list_no < lists.size(); list_no++) {
+    if (has_dropped[list_no]) {
+      consolidated->lists.push_back(std::move(lists[list_no]));
+    }
+  }
+  consolidated->num_dropped = ndropped;
+}
+
+void ApplyIvfPq(faiss::Index* faiss_index, ConsolidatedIndex* consolidated) {
+  auto [transform, ivfpq] = faiss_util::UnpackIvfPqMutable(faiss_index);
+  auto* invlists = static_cast<faiss::ArrayInvertedLists*>(ivfpq->invlists);
+  for (auto& list : consolidated->lists) {
+    invlists->ids[list.list_no].swap(list.ids);
+    invlists->codes[list.list_no].swap(list.codes);
+    if (list.has_errors) {
+      ivfpq->reconstruction_errors[list.list_no].swap(list.errors);
+    }
+  }
+
+  ivfpq->ntotal -= consolidated->num_dropped;
+  if (transform != nullptr) transform->ntotal = ivfpq->ntotal;
+}
+
+}  // namespace
+
+bool IsConsolidationSupported(const Index& index) {
+  if (index.index_type() == IndexType::kFaissHnsw) {
+    auto [id_map, transform, index_hnsw] =
+        faiss_util::UnpackHnsw(static_cast<const faiss::Index*>(index.index_raw()));
+    return id_map != nullptr;
+  }
+  if (index.index_type() == IndexType::kFaissIvfPq) {
+    auto [transform, ivfpq] =
+        faiss_util::UnpackIvfPq(static_cast<const faiss::Index*>(index.index_raw()));
+    return dynamic_cast<const faiss::ArrayInvertedLists*>(ivfpq->invlists) != nullptr &&
+           ivfpq->direct_map.no();
+  }
+  return false;
+}
+
+int64_t CountIndexEntries(const Index& index) {
+  switch (index.index_type()) {
+    case IndexType::kFaissHnsw:
+    case IndexType::kFaissIvfPq:
+    case IndexType::kDiskAnn:
+      return static_cast<const faiss::Index*>(index.index_raw())->ntotal;
+    case IndexType::kFaissHnswMmap:
+      return static_cast<const MmapHnsw*>(index.index_raw())->ntotal();
+    default:
+      T_LOG(ERROR) << "unsupported index type: " << index.index_type();
+  }
+  return 0;
+}
+
+std::vector<int64_t> FilterIndexedRowIds(const Index& index, const int64_t* row_ids,
+                                         int64_t num_rows) {
+  std::unordered_set<int64_t> requested;
+  for (int64_t i = 0; i < num_rows; i++) {
+    if (row_ids[i] >= 0) requested.insert(row_ids[i]);
+  }
+  std::vector<int64_t> found;
+  auto scan = [&](const faiss::Index::idx_t* ids, size_t n) {
+    for (size_t i = 0; i < n && !requested.empty(); i++) {
+      if (requested.erase(ids[i]) > 0) found.push_back(ids[i]);
+    }
+  };
+  // without an id map, the row ids are the ordinals of the vectors
+  auto scan_ordinals = [&](int64_t ntotal) {
+    for (auto id : requested) {
+      if (id < ntotal) found.push_back(id);
+    }
+  };
+
+  switch (index.index_type()) {
+    case IndexType::kFaissHnsw: {
+      auto [id_map, transform, index_hnsw] =
+          faiss_util::UnpackHnsw(static_cast<const faiss::Index*>(index.index_raw()));
+      if (id_map != nullptr) {
+        scan(id_map->id_map.data(), id_map->id_map.size());
+      } else {
+        scan_ordinals(index_hnsw->ntotal);
+      }
+      break;
+    }
+    case IndexType::kFaissHnswMmap: {
+      auto* mmap_hnsw = static_cast<const MmapHnsw*>(index.index_raw());
+      if (mmap_hnsw->id_map() != nullptr) {
+        scan(mmap_hnsw->id_map(), mmap_hnsw->ntotal());
+      } else {
+        scan_ordinals(mmap_hnsw->ntotal());
+      }
+      break;
+    }
+    case IndexType::kFaissIvfPq: {
+      auto [transform, ivfpq] =
+          faiss_util::UnpackIvfPq(static_cast<const faiss::Index*>(index.index_raw()));
+      if (auto* invlists = dynamic_cast<const faiss::ArrayInvertedLists*>(ivfpq->invlists)) {
+        for (size_t list_no = 0; list_no < invlists->nlist; list_no++) {
+          scan(invlists->ids[list_no].data(), invlists->ids[list_no].size());
+        }
+        break;
+      }
+      found.assign(requested.begin(), requested.end());
+      break;
+    }
+    default:
+      found.assign(requested.begin(), requested.end());
+  }
+  return found;
+}
+
+ConsolidatedIndex PrepareConsolidation(const Index& index) {
+  ConsolidatedIndex consolidated;
+  auto* tombstone = index.tombstone();
+  if (tombstone == nullptr || tombstone->empty()) {
+    return consolidated;
+  }
+
+  auto* faiss_index = static_cast<const faiss::Index*>(index.index_raw());
+  try {
+    if (index.index_type() == IndexType::kFaissHnsw) {
+      PrepareHnsw(faiss_index, *tombstone, &consolidated);
+    } else if (index.index_type() == IndexType::kFaissIvfPq) {
+      PrepareIvfPq(faiss_index, *tombstone, &consolidated);
+    } else {
+      T_LOG(ERROR) << "consolidation is not supported for index type: " << index.index_type();
+    }
+  }
+  CATCH_FAISS_ERROR
+  return consolidated;
+}
+
+size_t ApplyConsolidation(Index* index, ConsolidatedIndex* consolidated) {
+  if (consolidated->num_dropped > 0) {
+    auto* faiss_index = static_cast<faiss::Index*>(index->index_raw());
+    if (index->index_type() == IndexType::kFaissHnsw) {
+      ApplyHnsw(faiss_index, consolidated);
+    } else {
+      ApplyIvfPq(faiss_index, consolidated);
+    }
+  }
+
+  // no row left in the index is marked any more
+  index->SetTombstone(nullptr);
+  return consolidated->num_dropped;
+}
+
+size_t ConsolidateIndex(Index* index) {
+  auto consolidated = PrepareConsolidation(*index);
+  return ApplyConsolidation(index, &consolidated);
+}
+
+}  // namespace tenann
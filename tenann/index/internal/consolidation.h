@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tenann/index/index.h"
+
+namespace tenann {
+
+/**
+ * @brief Whether the rows deleted from [index] can be dropped by `ConsolidateIndex`.
+ *
+ * Supported for hnsw indexes built with custom row ids and loaded in memory, where the graph is
+ * renumbered after dropping nodes, and for ivfpq indexes whose inverted lists are in memory.
+ */
+bool IsConsolidationSupported(const Index& index);
+
+/// Number of entries stored in [index], including the deleted ones not yet consolidated.
+int64_t CountIndexEntries(const Index& index);
+
+/**
+ * @brief The row ids among [row_ids] that are stored in [index], each returned once.
+ *
+ * Costs a pass over the ids of the index, so deletes should be batched. The ids of inverted lists
+ * read from disk on demand are not checked, all the valid row ids are returned for them.
+ */
+std::vector<int64_t> FilterIndexedRowIds(const Index& index, const int64_t* row_ids,
+                                         int64_t num_rows);
+
+/**
+ * @brief The arrays of an index without its deleted rows, built by `PrepareConsolidation`.
+ *
+ * `ApplyConsolidation` swaps them with the arrays of the index, after which they hold the old
+ * arrays, to be freed once the lock of the index is released.
+ */
+struct ConsolidatedIndex {
+  /// Number of dropped entries, the index is left as is if zero.
+  size_t num_dropped = 0;
+
+  // hnsw graph, flat storage codes and id map
+  std::vector<int32_t> neighbors;
+  std::vector<size_t> offsets;
+  std::vector<int> levels;
+  std::vector<uint8_t> codes;
+  std::vector<int64_t> id_map;
+  int32_t entry_point = -1;
+  int max_level = -1;
+
+  /// An ivfpq inverted list with dropped entries.
+  struct InvertedList {
+    size_t list_no = 0;
+    std::vector<int64_t> ids;
+    std::vector<uint8_t> codes;
+    bool has_errors = false;
+    std::vector<float> errors;
+  };
+  std::vector<InvertedList> lists;
+};
+
+/**
+ * @brief Build the arrays of [index] without the rows marked in its tombstone.
+ *
+ * The neighbors of the dropped hnsw nodes are reconnected to their own neighbors, so that the
+ * graph stays navigable. The index is only read, so searches go on meanwhile under a shared
+ * `index.rw_lock()`. The caller should hold `index.write_mutex()` until `ApplyConsolidation`, so
+ * that the index and its tombstone are not modified in between.
+ */
+ConsolidatedIndex PrepareConsolidation(const Index& index);
+
+/**
+ * @brief Swap the arrays built by `PrepareConsolidation` into [index] and drop its tombstone, so
+ * that the dropped row ids can be inserted again. The caller should hold `index->rw_lock()`
+ * exclusively.
+ *
+ * @return The number of dropped entries
+ */
+size_t ApplyConsolidation(Index* index, ConsolidatedIndex* consolidated);
+
+/// Physically drop the rows marked in the tombstone of [index], see `PrepareConsolidation` and
+/// `ApplyConsolidation`. The caller should hold `index->rw_lock()` exclusively.
+size_t ConsolidateIndex(Index* index);
+
+}  // namespace tenann
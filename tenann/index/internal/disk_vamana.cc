@@ -0,0 +1,508 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/disk_vamana.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+
+#include "faiss/IndexPreTransform.h"
+#include "faiss/VectorTransform.h"
+#include "faiss/impl/io.h"
+#include "faiss/utils/distances.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/index_cache.h"
+#include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/index_vamana.h"
+#include "tenann/util/defer.h"
+#include "tenann/util/memory_usage.h"
+
+namespace tenann {
+
+static_assert(sizeof(DiskVamanaFileHeader) <= DiskVamana::kSectorSize,
+              "the header of disk vamana must fit in the first sector");
+
+namespace {
+
+// upper bound of blocks read by a single preadv
+constexpr size_t kMaxBlocksPerRead = 64;
+
+inline size_t AlignUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+void WriteOrThrow(FILE* file, const void* data, size_t size, const std::string& path) {
+  if (size == 0) return;
+  size_t written = fwrite(data, 1, size, file);
+  T_LOG_IF(ERROR, written != size)
+      << "write error in " << path << ": " << written << " != " << size << " ("
+      << strerror(errno) << ")";
+}
+
+void PadToOrThrow(FILE* file, size_t from, size_t to, const std::string& path) {
+  static const char kZeros[DiskVamana::kSectorSize] = {0};
+  while (from < to) {
+    size_t n = std::min(to - from, sizeof(kZeros));
+    WriteOrThrow(file, kZeros, n, path);
+    from += n;
+  }
+}
+
+void PreadOrThrow(int fd, void* buffer, size_t size, uint64_t offset, const std::string& path) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd, static_cast<uint8_t*>(buffer) + done, size - done, offset + done);
+    if (n == -1 && errno == EINTR) continue;
+    T_LOG_IF(ERROR, n <= 0) << "read error in [" << path << "] at offset " << offset + done
+                            << ": " << (n == 0 ? "unexpected end of file" : strerror(errno));
+    done += n;
+  }
+}
+
+struct Candidate {
+  float dis;
+  DiskVamana::storage_idx_t id;
+  bool expanded;
+};
+
+}  // namespace
+
+DiskVamana::~DiskVamana() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+uint32_t DiskVamana::Magic() { return faiss::fourcc("TDaN"); }
+
+bool DiskVamana::IsDiskVamanaFile(const std::string& path) {
+  auto file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  Defer defer([file]() { fclose(file); });
+
+  uint32_t magic = 0;
+  return fread(&magic, sizeof(magic), 1, file) == 1 && magic == Magic();
+}
+
+std::unique_ptr<DiskVamana> DiskVamana::Open(const std::string& path, IndexCache* index_cache,
+                                             CacheNamespaceId cache_namespace) {
+  T_CHECK(index_cache != nullptr) << "disk vamana requires an index cache to cache blocks";
+
+  std::unique_ptr<DiskVamana> index(new DiskVamana());
+  index->path_ = path;
+  index->index_cache_ = index_cache;
+  index->cache_namespace_ = cache_namespace;
+
+  // node blocks bypass the page cache since they are cached by the block cache,
+  // fall back to buffered reads on file systems without O_DIRECT support
+  index->fd_ = open(path.c_str(), O_RDONLY | O_DIRECT);
+  if (index->fd_ == -1 && errno == EINVAL) {
+    index->fd_ = open(path.c_str(), O_RDONLY);
+  }
+  T_LOG_IF(ERROR, index->fd_ == -1)
+      << "could not open [" << path << "] for reading: " << strerror(errno);
+  int fd = index->fd_;
+
+  struct stat buf;
+  T_LOG_IF(ERROR, fstat(fd, &buf) != 0) << "fstat [" << path << "] failed: " << strerror(errno);
+  size_t file_size = buf.st_size;
+  T_LOG_IF(ERROR, file_size < kSectorSize)
+      << "[" << path << "] is too small to be a tenann disk vamana file: " << file_size;
+
+  // O_DIRECT requires aligned buffers
+  void* header_buffer = nullptr;
+  T_LOG_IF(ERROR, posix_memalign(&header_buffer, kSectorSize, kSectorSize) != 0)
+      << "posix_memalign error";
+  Defer free_header([header_buffer]() { free(header_buffer); });
+  PreadOrThrow(fd, header_buffer, kSectorSize, 0, path);
+  DiskVamanaFileHeader header;
+  memcpy(&header, header_buffer, sizeof(header));
+
+  T_LOG_IF(ERROR, header.magic != Magic())
+      << "[" << path << "] is not a tenann disk vamana file, got magic number "
+      << faiss::fourcc_inv_printable(header.magic);
+  T_LOG_IF(ERROR, header.version != kVersion)
+      << "unsupported disk vamana version " << header.version << " in [" << path
+      << "], expect " << kVersion;
+
+  for (int i = 0; i < kDiskVamanaNumSections; i++) {
+    const auto& section = header.sections[i];
+    T_LOG_IF(ERROR, section.offset % kSectorSize != 0 || section.offset < kSectorSize ||
+                        section.offset + section.size > file_size)
+        << "section " << i << " of [" << path << "] is broken, offset: " << section.offset
+        << ", size: " << section.size << ", file size: " << file_size;
+  }
+
+  index->d_ = header.d;
+  index->R_ = header.R;
+  index->ntotal_ = header.ntotal;
+  index->medoid_ = header.medoid;
+  index->search_list_size_ = header.search_list_size;
+  index->normalize_query_ = header.normalize_query != 0;
+  index->node_size_ = header.node_size;
+  index->nodes_per_block_ = header.nodes_per_block;
+  index->block_size_ = header.block_size;
+  index->nodes_offset_ = header.sections[kDiskVamanaNodes].offset;
+
+  size_t ntotal = index->ntotal_;
+  T_LOG_IF(ERROR, index->node_size_ != (index->d_ + 1 + index->R_) * sizeof(float) ||
+                      index->nodes_per_block_ == 0 || index->block_size_ % kSectorSize != 0 ||
+                      index->nodes_per_block_ * index->node_size_ > index->block_size_)
+      << "node layout of [" << path << "] is broken, node size: " << index->node_size_
+      << ", nodes per block: " << index->nodes_per_block_
+      << ", block size: " << index->block_size_;
+
+  size_t num_blocks = (ntotal + index->nodes_per_block_ - 1) / index->nodes_per_block_;
+  T_LOG_IF(ERROR, header.pq_M == 0 || index->d_ % header.pq_M != 0)
+      << "invalid pq_M " << header.pq_M << " for d " << index->d_ << " in [" << path << "]";
+  index->pq_ = faiss::ProductQuantizer(index->d_, header.pq_M, header.pq_nbits);
+  T_LOG_IF(ERROR, header.pq_nbits != 8 ||
+                      header.sections[kDiskVamanaPqCentroids].size !=
+                          index->pq_.centroids.size() * sizeof(float) ||
+                      header.sections[kDiskVamanaPqCodes].size != ntotal * index->pq_.code_size ||
+                      header.sections[kDiskVamanaIds].size != ntotal * sizeof(idx_t) ||
+                      header.sections[kDiskVamanaNodes].size != num_blocks * index->block_size_)
+      << "section sizes of [" << path << "] do not match ntotal " << ntotal << " and d "
+      << index->d_;
+  T_LOG_IF(ERROR, ntotal > 0 && (index->medoid_ < 0 || index->medoid_ >= ntotal))
+      << "invalid medoid " << index->medoid_ << " in [" << path << "]";
+
+  // load in-memory sections, read them through an aligned bounce buffer to satisfy O_DIRECT
+  auto load_section = [&](DiskVamanaSection section, void* dest) {
+    size_t size = header.sections[section].size;
+    size_t aligned_size = AlignUp(size, kSectorSize);
+    if (size == 0) return;
+    void* buffer = nullptr;
+    T_LOG_IF(ERROR, posix_memalign(&buffer, kSectorSize, aligned_size) != 0)
+        << "posix_memalign error";
+    Defer free_buffer([buffer]() { free(buffer); });
+    PreadOrThrow(fd, buffer, aligned_size, header.sections[section].offset, path);
+    memcpy(dest, buffer, size);
+  };
+  load_section(kDiskVamanaPqCentroids, index->pq_.centroids.data());
+  index->codes_.resize(ntotal * index->pq_.code_size);
+  load_section(kDiskVamanaPqCodes, index->codes_.data());
+  index->ids_.resize(ntotal);
+  load_section(kDiskVamanaIds, index->ids_.data());
+
+  // cache_key = hash(filename) + fileModificationTime + blockId
+  index->cache_key_base_.file_id = std::hash<std::string>{}(path);
+  index->cache_key_base_.generation = static_cast<uint32_t>(buf.st_mtime);
+
+  VLOG(VERBOSE_DEBUG) << "opened disk vamana [" << path << "], ntotal: " << ntotal
+                      << ", d: " << index->d_ << ", R: " << index->R_
+                      << ", nodes per block: " << index->nodes_per_block_;
+  return index;
+}
+
+void DiskVamana::Write(const faiss::Index* index, const std::string& path) {
+  auto [transform, vamana] = faiss_util::UnpackVamana(index);
+
+  bool normalize_query = false;
+  if (transform != nullptr) {
+    T_CHECK(transform->chain.size() == 1 &&
+            dynamic_cast<const faiss::NormalizationTransform*>(transform->chain[0]) != nullptr)
+        << "disk vamana only supports the `L2Norm` pre-transform";
+    normalize_query = true;
+  }
+  T_CHECK(vamana->pq.nbits == 8) << "disk vamana only supports 8-bit pq codes";
+
+  size_t ntotal = vamana->ntotal;
+  size_t d = vamana->d;
+  size_t R = vamana->R;
+
+  DiskVamanaFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = Magic();
+  header.version = kVersion;
+  header.d = d;
+  header.R = R;
+  header.ntotal = ntotal;
+  header.medoid = vamana->medoid;
+  header.search_list_size = vamana->search_list_size;
+  header.pq_M = vamana->pq.M;
+  header.pq_nbits = vamana->pq.nbits;
+  header.normalize_query = normalize_query;
+  header.node_size = (d + 1 + R) * sizeof(float);
+  if (header.node_size <= kSectorSize) {
+    header.block_size = kSectorSize;
+    header.nodes_per_block = kSectorSize / header.node_size;
+  } else {
+    header.block_size = AlignUp(header.node_size, kSectorSize);
+    header.nodes_per_block = 1;
+  }
+  size_t num_blocks = (ntotal + header.nodes_per_block - 1) / header.nodes_per_block;
+
+  const void* section_data[kDiskVamanaNumSections] = {
+      vamana->pq.centroids.data(),
+      vamana->codes.data(),
+      vamana->ids.data(),
+      nullptr,  // written block by block
+  };
+  size_t section_bytes[kDiskVamanaNumSections] = {
+      vamana->pq.centroids.size() * sizeof(float),
+      vamana->codes.size(),
+      vamana->ids.size() * sizeof(idx_t),
+      num_blocks * header.block_size,
+  };
+
+  size_t offset = kSectorSize;
+  for (int i = 0; i < kDiskVamanaNumSections; i++) {
+    header.sections[i].offset = offset;
+    header.sections[i].size = section_bytes[i];
+    offset = AlignUp(offset + section_bytes[i], kSectorSize);
+  }
+
+  auto file = fopen(path.c_str(), "wb");
+  Defer defer([file]() {
+    if (file != nullptr) fclose(file);
+  });
+  T_LOG_IF(ERROR, file == nullptr)
+      << "could not open [" << path << "] for writing: " << strerror(errno);
+
+  WriteOrThrow(file, &header, sizeof(header), path);
+  PadToOrThrow(file, sizeof(header), kSectorSize, path);
+  for (int i = 0; i < kDiskVamanaNumSections - 1; i++) {
+    WriteOrThrow(file, section_data[i], section_bytes[i], path);
+    size_t end = header.sections[i].offset + section_bytes[i];
+    PadToOrThrow(file, end, AlignUp(end, kSectorSize), path);
+  }
+
+  std::vector<uint8_t> block(header.block_size);
+  for (size_t b = 0; b < num_blocks; b++) {
+    std::fill(block.begin(), block.end(), 0);
+    for (size_t j = 0; j < header.nodes_per_block; j++) {
+      size_t node = b * header.nodes_per_block + j;
+      if (node >= ntotal) break;
+
+      uint8_t* ptr = block.data() + j * header.node_size;
+      const auto& neighbors = vamana->graph[node];
+      uint32_t degree = std::min(neighbors.size(), R);
+      memcpy(ptr, vamana->xb.data() + node * d, d * sizeof(float));
+      memcpy(ptr + d * sizeof(float), &degree, sizeof(degree));
+      memcpy(ptr + (d + 1) * sizeof(float), neighbors.data(), degree * sizeof(storage_idx_t));
+    }
+    WriteOrThrow(file, block.data(), block.size(), path);
+  }
+}
+
+size_t DiskVamana::memory_usage() const {
+  return AllocationSize(sizeof(*this)) + AllocationSize(path_) +
+         AllocationSize(pq_.centroids.capacity() * sizeof(float)) +
+         AllocationSize(codes_.capacity()) + AllocationSize(ids_.capacity() * sizeof(idx_t));
+}
+
+void DiskVamana::ReadBlocks(const std::vector<size_t>& blocks,
+                            std::vector<IndexCacheHandle>* handles,
+                            std::vector<const uint8_t*>* block_ptrs) const {
+  handles->clear();
+  handles->resize(blocks.size());
+  block_ptrs->assign(blocks.size(), nullptr);
+
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    if (index_cache_->Lookup(CacheKeyOf(blocks[i]), &(*handles)[i], cache_namespace_)) {
+      (*block_ptrs)[i] = static_cast<const uint8_t*>((*handles)[i].index_ref()->index_raw());
+    } else {
+      misses.push_back(i);
+    }
+  }
+
+  // read each run of adjacent missing blocks with a single preadv
+  std::vector<struct iovec> iov;
+  for (size_t begin = 0; begin < misses.size();) {
+    size_t end = begin + 1;
+    while (end < misses.size() && end - begin < kMaxBlocksPerRead &&
+           blocks[misses[end]] == blocks[misses[end - 1]] + 1) {
+      end++;
+    }
+
+    iov.resize(end - begin);
+    Defer free_buffers([&iov]() {
+      for (auto& vec : iov) free(vec.iov_base);
+    });
+    for (auto& vec : iov) {
+      vec.iov_base = nullptr;
+      vec.iov_len = block_size_;
+    }
+    for (auto& vec : iov) {
+      T_LOG_IF(ERROR, posix_memalign(&vec.iov_base, kSectorSize, block_size_) != 0)
+          << "posix_memalign error";
+    }
+
+    uint64_t offset = nodes_offset_ + blocks[misses[begin]] * block_size_;
+    size_t expected = iov.size() * block_size_;
+    ssize_t nread;
+    do {
+      nread = preadv(fd_, iov.data(), iov.size(), offset);
+    } while (nread == -1 && errno == EINTR);
+    T_LOG_IF(ERROR, nread != static_cast<ssize_t>(expected))
+        << "failed to read " << iov.size() << " blocks from [" << path_ << "] at offset "
+        << offset << ", expect " << expected << " bytes but got " << nread << ": "
+        << strerror(errno);
+
+    for (size_t i = begin; i < end; i++) {
+      auto& vec = iov[i - begin];
+      auto block_ref = std::make_shared<Index>(vec.iov_base, IndexType::kDiskAnnBlock,
+                                               [](void* block) { free(block); });
+      block_ref->SetBlockSize(block_size_);
+      (*block_ptrs)[misses[i]] = static_cast<const uint8_t*>(vec.iov_base);
+      // the buffer is owned by the cache entry now
+      vec.iov_base = nullptr;
+      size_t charge = AllocationSize(block_size_) + AllocationSize(sizeof(Index));
+      index_cache_->Insert(CacheKeyOf(blocks[misses[i]]), block_ref, &(*handles)[misses[i]],
+                           [charge]() { return charge; }, cache_namespace_);
+    }
+    begin = end;
+  }
+}
+
+void DiskVamana::Search(const float* x, int64_t k, float* distances, idx_t* labels,
+                        int search_list_size, int beam_width,
+                        const faiss::IDSelector* sel) const {
+  std::fill_n(distances, k, std::numeric_limits<float>::max());
+  std::fill_n(labels, k, -1);
+  if (ntotal_ == 0) return;
+
+  std::vector<float> query;
+  if (normalize_query_) {
+    query.assign(x, x + d_);
+    faiss::fvec_renorm_L2(d_, 1, query.data());
+    x = query.data();
+  }
+
+  // distances between the query and pq centroids, used to estimate distances of nodes
+  std::vector<float> dis_table(pq_.M * pq_.ksub);
+  pq_.compute_distance_table(x, dis_table.data());
+  auto pq_distance = [&](storage_idx_t i) {
+    const uint8_t* code = codes_.data() + static_cast<size_t>(i) * pq_.code_size;
+    const float* table = dis_table.data();
+    float dis = 0;
+    for (size_t m = 0; m < pq_.M; m++, table += pq_.ksub) {
+      dis += table[code[m]];
+    }
+    return dis;
+  };
+
+  if (search_list_size <= 0) search_list_size = search_list_size_;
+  size_t list_size = std::max<int64_t>(search_list_size, k);
+  beam_width = std::max(beam_width, 1);
+
+  // With a filter, the candidates falling out of the list are kept behind it, so that the list can
+  // be widened when it runs out of candidates before k filtered nodes are found.
+  std::vector<Candidate> pool;
+  pool.reserve(list_size + 1);
+  auto insert = [&pool, &list_size, sel](storage_idx_t id, float dis) {
+    if (sel == nullptr && pool.size() == list_size && dis >= pool.back().dis) return;
+    Candidate candidate{dis, id, false};
+    auto it = std::upper_bound(
+        pool.begin(), pool.end(), candidate,
+        [](const Candidate& left, const Candidate& right) { return left.dis < right.dis; });
+    pool.insert(it, candidate);
+    if (sel == nullptr && pool.size() > list_size) pool.pop_back();
+  };
+
+  std::unordered_set<storage_idx_t> visited;
+  visited.insert(medoid_);
+  insert(medoid_, pq_distance(medoid_));
+
+  // exact distances of the expanded nodes accepted by [sel], used for re-ranking. The rejected
+  // nodes are still expanded to navigate the graph.
+  std::vector<std::pair<float, storage_idx_t>> full_distances;
+  std::vector<storage_idx_t> frontier;
+  std::vector<size_t> blocks;
+  std::vector<IndexCacheHandle> handles;
+  std::vector<const uint8_t*> block_ptrs;
+
+  for (;;) {
+    frontier.clear();
+    for (size_t i = 0; i < std::min(list_size, pool.size()); i++) {
+      if (frontier.size() == static_cast<size_t>(beam_width)) break;
+      auto& candidate = pool[i];
+      if (candidate.expanded) continue;
+      candidate.expanded = true;
+      frontier.push_back(candidate.id);
+    }
+    if (frontier.empty()) {
+      // widen the list until k filtered nodes are found or all the reachable nodes are expanded
+      if (full_distances.size() >= static_cast<size_t>(k) || pool.size() <= list_size) break;
+      list_size *= 2;
+      continue;
+    }
+
+    blocks.clear();
+    for (auto node : frontier) {
+      blocks.push_back(node / nodes_per_block_);
+    }
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    ReadBlocks(blocks, &handles, &block_ptrs);
+
+    for (auto node : frontier) {
+      size_t block_no = node / nodes_per_block_;
+      size_t i = std::lower_bound(blocks.begin(), blocks.end(), block_no) - blocks.begin();
+      const uint8_t* ptr = block_ptrs[i] + (node % nodes_per_block_) * node_size_;
+
+      const auto* vector = reinterpret_cast<const float*>(ptr);
+      if (sel == nullptr || sel->is_member(node)) {
+        full_distances.emplace_back(faiss::fvec_L2sqr(x, vector, d_), node);
+      }
+
+      uint32_t degree;
+      memcpy(&degree, ptr + d_ * sizeof(float), sizeof(degree));
+      // a corrupted block would make the search read past the node or the pq codes
+      T_LOG_IF(ERROR, degree > static_cast<uint32_t>(R_))
+          << "node " << node << " of [" << path_ << "] has degree " << degree << ", above R "
+          << R_;
+      const auto* neighbors =
+          reinterpret_cast<const storage_idx_t*>(ptr + (d_ + 1) * sizeof(float));
+      for (uint32_t j = 0; j < degree; j++) {
+        storage_idx_t v = neighbors[j];
+        T_LOG_IF(ERROR, v < 0 || v >= ntotal_)
+            << "node " << node << " of [" << path_ << "] has invalid neighbor " << v
+            << ", ntotal: " << ntotal_;
+        if (visited.insert(v).second) {
+          insert(v, pq_distance(v));
+        }
+      }
+    }
+    // release the blocks of this step so that they can be evicted
+    handles.clear();
+  }
+
+  size_t nres = std::min<size_t>(k, full_distances.size());
+  std::partial_sort(full_distances.begin(), full_distances.begin() + nres, full_distances.end());
+  for (size_t i = 0; i < nres; i++) {
+    distances[i] = full_distances[i].first;
+    labels[i] = ids_[full_distances[i].second];
+  }
+}
+
+}  // namespace tenann
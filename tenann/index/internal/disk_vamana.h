@@ -0,0 +1,179 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "faiss/Index.h"
+#include "faiss/impl/IDSelector.h"
+#include "faiss/impl/ProductQuantizer.h"
+#include "tenann/common/macros.h"
+#include "tenann/index/index_cache.h"
+
+namespace tenann {
+
+/**
+ * @brief Sections of a tenann disk vamana file.
+ *
+ * Every section starts at a sector-aligned offset. The first three sections are loaded into
+ * memory when the file is opened, the node section stays on disk and is read block by block.
+ */
+enum DiskVamanaSection {
+  kDiskVamanaPqCentroids = 0,  // float[d * ksub], ProductQuantizer::centroids
+  kDiskVamanaPqCodes,          // uint8_t[ntotal * pq_M], pq codes of all nodes
+  kDiskVamanaIds,              // int64_t[ntotal], internal id to row id
+  kDiskVamanaNodes,            // node blocks, see `DiskVamanaFileHeader`
+  kDiskVamanaNumSections
+};
+
+/**
+ * A node is stored as `float vector[d] | uint32_t degree | int32_t neighbors[R]`.
+ * Small nodes are packed into one sector-sized block, while a large node takes a block of
+ * several sectors on its own, so that no node crosses a block boundary.
+ */
+struct DiskVamanaFileHeader {
+  struct Section {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  int32_t d;
+  int32_t R;
+  int64_t ntotal;
+  int32_t medoid;
+  int32_t search_list_size;
+  uint32_t pq_M;
+  uint32_t pq_nbits;
+  uint32_t node_size;
+  uint32_t nodes_per_block;
+  uint32_t block_size;
+  uint8_t normalize_query;
+  uint8_t reserved[3];
+  Section sections[kDiskVamanaNumSections];
+};
+
+/**
+ * @brief A read-only Vamana graph index (DiskANN) searched on disk.
+ *
+ * The PQ codes are kept in memory to guide the graph walk, while the graph and the
+ * full-precision vectors are read from sector-aligned blocks through `IndexCache`, which serves
+ * as a block cache shared with other indexes. Each step of the beam search reads the blocks of
+ * up to `beam_width` nodes with one `preadv` per run of adjacent blocks, and the final results are
+ * re-ranked with the full-precision vectors.
+ */
+class DiskVamana {
+ public:
+  using idx_t = faiss::Index::idx_t;
+  using storage_idx_t = int32_t;
+
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kSectorSize = 4096;
+
+  ~DiskVamana();
+
+  T_FORBID_COPY_AND_ASSIGN(DiskVamana);
+  T_FORBID_MOVE(DiskVamana);
+
+  /// Magic number of the file layout, "TDaN".
+  static uint32_t Magic();
+
+  /// Check the magic number of the file at [path].
+  static bool IsDiskVamanaFile(const std::string& path);
+
+  /// Open the file at [path] and load the in-memory sections, throw on any format error. The
+  /// blocks read on demand are cached in [index_cache] and charged to [cache_namespace].
+  static std::unique_ptr<DiskVamana> Open(
+      const std::string& path, IndexCache* index_cache,
+      CacheNamespaceId cache_namespace = kDefaultCacheNamespace);
+
+  /// Write an `IndexVamana` built by tenann to [path] with the disk layout.
+  static void Write(const faiss::Index* index, const std::string& path);
+
+  /**
+   * @brief Beam search for a single query.
+   *
+   * @param x Query vector, which is normalized internally if the index was built with `L2Norm`
+   * @param search_list_size Size of the candidate list, use the value written in the file if <= 0
+   * @param beam_width Max number of nodes read from disk in one step
+   * @param sel Applied on internal ids, use `ids()` to translate them to row ids. The rejected
+   * nodes are still expanded to navigate the graph, and the candidate list is widened until k
+   * accepted nodes are found or the reachable nodes are exhausted.
+   * @param labels Row ids
+   */
+  void Search(const float* x, int64_t k, float* distances, idx_t* labels, int search_list_size,
+              int beam_width, const faiss::IDSelector* sel = nullptr) const;
+
+  /* getters */
+  int d() const { return d_; }
+  idx_t ntotal() const { return ntotal_; }
+  bool normalize_query() const { return normalize_query_; }
+  /// Internal id to row id.
+  const idx_t* ids() const { return ids_.data(); }
+  const std::string& path() const { return path_; }
+  /// Memory held by the in-memory sections, blocks are accounted by the block cache.
+  size_t memory_usage() const;
+
+ private:
+  DiskVamana() = default;
+
+  /**
+   * @brief Fetch the given blocks from the block cache, and read the missing ones from disk.
+   *
+   * The blocks stay valid as long as [handles] are alive.
+   *
+   * @param blocks Sorted and unique block numbers
+   */
+  void ReadBlocks(const std::vector<size_t>& blocks, std::vector<IndexCacheHandle>* handles,
+                  std::vector<const uint8_t*>* block_ptrs) const;
+
+  CacheKey128 CacheKeyOf(size_t block) const {
+    return cache_key_base_.with_block_id(static_cast<uint32_t>(block));
+  }
+
+  std::string path_;
+  int fd_ = -1;
+  IndexCache* index_cache_ = nullptr;
+  CacheNamespaceId cache_namespace_ = kDefaultCacheNamespace;
+  /// Identifies the file and its version, the cache key of each block adds the block number
+  CacheKey128 cache_key_base_{};
+
+  int d_ = 0;
+  int R_ = 0;
+  idx_t ntotal_ = 0;
+  storage_idx_t medoid_ = -1;
+  int search_list_size_ = 100;
+  bool normalize_query_ = false;
+  size_t node_size_ = 0;
+  size_t nodes_per_block_ = 0;
+  size_t block_size_ = 0;
+  uint64_t nodes_offset_ = 0;
+
+  faiss::ProductQuantizer pq_;
+  std::vector<uint8_t> codes_;
+  std::vector<idx_t> ids_;
+};
+
+}  // namespace tenann
@@ -30,6 +30,7 @@
 #include "tenann/common/error.h"
 #include "tenann/index/index.h"
 #include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/index_vamana.h"
 #include "tenann/index/parameters.h"
 #include "tenann/store/index_type.h"
 
@@ -187,6 +188,34 @@ inline std::tuple<faiss::IndexPreTransform*, tenann::IndexIvfPq*> UnpackIvfPqMut
                          const_cast<tenann::IndexIvfPq*>(ivfpq));
 }
 
+/************************************************************
+ * Vamana index (DiskANN)
+ ************************************************************/
+
+inline std::tuple<const faiss::IndexPreTransform*, const tenann::IndexVamana*>
+CheckAndUnpackVamana(const faiss::Index* index, const VectorIndexCommonParams* common_params) {
+  const faiss::Index* sub_index = index;
+  const faiss::IndexPreTransform* transform = nullptr;
+
+  if (common_params != nullptr && common_params->metric_type == MetricType::kCosineSimilarity &&
+      !common_params->is_vector_normed) {
+    transform = CHECKED_FAISS_DOWN_CAST(faiss::IndexPreTransform, sub_index);
+    sub_index = transform->index;
+  } else if (transform = dynamic_cast<const faiss::IndexPreTransform*>(sub_index)) {
+    T_LOG(DEBUG) << " Parse Index as faiss::IndexPreTransform.";
+    sub_index = transform->index;
+  }
+
+  auto vamana = CHECKED_FAISS_DOWN_CAST(tenann::IndexVamana, sub_index);
+
+  return std::make_tuple(transform, vamana);
+}
+
+inline std::tuple<const faiss::IndexPreTransform*, const tenann::IndexVamana*> UnpackVamana(
+    const faiss::Index* index) {
+  return CheckAndUnpackVamana(index, nullptr);
+}
+
 }  // namespace faiss_util
 
 }  // namespace tenann
\ No newline at end of file
@@ -39,6 +39,8 @@
 #include "faiss/utils/distances.h"
 #include "faiss/utils/hamming.h"
 #include "faiss/utils/utils.h"
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+#include "tenann/index/internal/tombstone.h"
 
 #ifdef __AVX2__
 #include <immintrin.h>
@@ -51,7 +53,32 @@ using namespace faiss;
 
 IndexIvfPq::IndexIvfPq() : faiss::IndexIVFPQ() {}
 
-IndexIvfPq::~IndexIvfPq() {}
+// hand the borrowed memory back before `precomputed_table` frees it
+static void ReleaseBorrowedTable(AlignedTable<float>* table) {
+  table->tab.ptr = nullptr;
+  table->tab.numel = 0;
+  table->numel = 0;
+}
+
+IndexIvfPq::~IndexIvfPq() {
+  if (shared_precomputed_table != nullptr) {
+    ReleaseBorrowedTable(&precomputed_table);
+  }
+}
+
+void IndexIvfPq::SetPrecomputedTable(std::shared_ptr<IvfPqPrecomputedTable> table) {
+  if (shared_precomputed_table != nullptr) {
+    ReleaseBorrowedTable(&precomputed_table);
+  } else {
+    precomputed_table.resize(0);
+  }
+  shared_precomputed_table = std::move(table);
+  // the faiss scanners read `precomputed_table`, let it point to the shared table
+  precomputed_table.tab.ptr = const_cast<float*>(shared_precomputed_table->data());
+  precomputed_table.tab.numel = shared_precomputed_table->size();
+  precomputed_table.numel = shared_precomputed_table->size();
+  use_precomputed_table = 1;
+}
 
 static float* compute_residuals(const Index* quantizer, Index::idx_t n, const float* x,
                                 const Index::idx_t* list_nos) {
@@ -177,6 +204,57 @@ void IndexIvfPq::custom_add_core_o(idx_t n, const float* x, const idx_t* xids, f
   ntotal += n;
 }
 
+void IndexIvfPq::search(idx_t n, const float* x, idx_t k, float* distances, idx_t* labels,
+                        const SearchParameters* params_in) const {
+  const IVFSearchParameters* params = nullptr;
+  if (params_in) {
+    params = dynamic_cast<const IVFSearchParameters*>(params_in);
+    FAISS_THROW_IF_NOT_MSG(params, "IndexIVF params have incorrect type");
+  }
+  // faiss does not know about deleted rows, which are skipped by the scanner of tenann
+  auto ivfpq_params = dynamic_cast<const IndexIvfPqSearchParameters*>(params_in);
+  bool has_tombstone = ivfpq_params != nullptr && ivfpq_params->tombstone != nullptr;
+  // the selectors check the ids of the entries being scanned
+  bool fetch_ids = fetch_ids_after_scan && !(params && params->sel);
+  bool lazy_table = shared_precomputed_table != nullptr && shared_precomputed_table->lazy();
+  if (!fetch_ids && !lazy_table && !has_tombstone) {
+    IndexIVFPQ::search(n, x, k, distances, labels, params_in);
+    return;
+  }
+
+  const size_t nprobe = std::min(nlist, params ? params->nprobe : this->nprobe);
+  FAISS_THROW_IF_NOT(k > 0 && nprobe > 0);
+  std::unique_ptr<idx_t[]> keys(new idx_t[n * nprobe]);
+  std::unique_ptr<float[]> coarse_dis(new float[n * nprobe]);
+
+  double t0 = getmillisecs();
+  quantizer->search(n, x, nprobe, coarse_dis.get(), keys.get(),
+                    params ? params->quantizer_params : nullptr);
+  indexIVF_stats.quantization_time += getmillisecs() - t0;
+
+  t0 = getmillisecs();
+  invlists->prefetch_lists(keys.get(), n * nprobe);
+  if (lazy_table) {
+    shared_precomputed_table->EnsureLists(keys.get(), n * nprobe);
+  }
+  // scan with (list_no, offset) pairs as labels, then translate the results into ids
+  if (has_tombstone) {
+    custom_search_preassigned(n, x, k, keys.get(), coarse_dis.get(), distances, labels, fetch_ids,
+                              ivfpq_params, &indexIVF_stats);
+  } else {
+    search_preassigned(n, x, k, keys.get(), coarse_dis.get(), distances, labels, fetch_ids,
+                       params, &indexIVF_stats);
+  }
+  if (fetch_ids) {
+    for (idx_t i = 0; i < n * k; i++) {
+      if (labels[i] >= 0) {
+        labels[i] = invlists->get_single_id(lo_listno(labels[i]), lo_offset(labels[i]));
+      }
+    }
+  }
+  indexIVF_stats.search_time += getmillisecs() - t0;
+}
+
 // Ported from faiss/IndexIVFPQ.cpp
 void IndexIvfPq::range_search(idx_t nx, const float* x, float radius, RangeSearchResult* result,
                               const SearchParameters* params_in) const {
@@ -197,6 +275,9 @@ void IndexIvfPq::range_search(idx_t nx, const float* x, float radius, RangeSearc
 
   t0 = getmillisecs();
   invlists->prefetch_lists(keys.get(), nx * nprobe);
+  if (shared_precomputed_table != nullptr) {
+    shared_precomputed_table->EnsureLists(keys.get(), nx * nprobe);
+  }
 
   custom_range_search_preassigned(nx, x, radius, keys.get(), coarse_dis.get(), result, false,
                                   params, &indexIVF_stats);
@@ -221,6 +302,7 @@ void IndexIvfPq::custom_range_search_preassigned(idx_t nx, const float* x, float
 
   idx_t max_codes = params ? params->max_codes : this->max_codes;
   IDSelector* sel = params ? params->sel : nullptr;
+  const Tombstone* tombstone = params ? params->tombstone : nullptr;  // added by tenann
 
   size_t nlistv = 0, ndis = 0;
 
@@ -240,7 +322,7 @@ void IndexIvfPq::custom_range_search_preassigned(idx_t nx, const float* x, float
   {
     RangeSearchPartialResult pres(result);
     std::unique_ptr<InvertedListScanner> scanner(custom_get_InvertedListScanner(
-        store_pairs, sel, dynamic_range_search_confidence));  // modifid by tenann
+        store_pairs, sel, dynamic_range_search_confidence, tombstone));  // modifid by tenann
     FAISS_THROW_IF_NOT(scanner.get());
     all_pres[omp_get_thread_num()] = &pres;
 
@@ -335,6 +417,103 @@ void IndexIvfPq::custom_range_search_preassigned(idx_t nx, const float* x, float
   }
 }
 
+// Ported from faiss/IndexIVF.cpp, only the parallel mode over the queries is kept
+void IndexIvfPq::custom_search_preassigned(idx_t n, const float* x, idx_t k, const idx_t* keys,
+                                           const float* coarse_dis, float* distances,
+                                           idx_t* labels, bool store_pairs,
+                                           const IndexIvfPqSearchParameters* params,
+                                           IndexIVFStats* stats) const {
+  idx_t nprobe = params ? params->nprobe : this->nprobe;
+  nprobe = std::min((idx_t)nlist, nprobe);
+  FAISS_THROW_IF_NOT(k > 0 && nprobe > 0);
+
+  idx_t max_codes = params ? params->max_codes : this->max_codes;
+  IDSelector* sel = params ? params->sel : nullptr;
+  const Tombstone* tombstone = params ? params->tombstone : nullptr;
+  // the selectors check the ids of the entries being scanned
+  FAISS_THROW_IF_NOT_MSG(!(store_pairs && sel), "store_pairs is not supported with a selector");
+
+  size_t nlistv = 0, ndis = 0, nheap = 0;
+
+  bool interrupt = false;
+  std::mutex exception_mutex;
+  std::string exception_string;
+
+#pragma omp parallel if (n > 1) reduction(+ : nlistv, ndis, nheap)
+  {
+    std::unique_ptr<InvertedListScanner> scanner(
+        custom_get_InvertedListScanner(store_pairs, sel, 0, tombstone));
+    FAISS_THROW_IF_NOT(scanner.get());
+
+#pragma omp for
+    for (idx_t i = 0; i < n; i++) {
+      float* simi = distances + i * k;
+      idx_t* idxi = labels + i * k;
+      if (metric_type == METRIC_INNER_PRODUCT) {
+        heap_heapify<CMin<float, idx_t>>(k, simi, idxi);
+      } else {
+        heap_heapify<CMax<float, idx_t>>(k, simi, idxi);
+      }
+      if (interrupt) {
+        continue;
+      }
+
+      try {
+        scanner->set_query(x + i * d);
+        size_t nscan = 0;
+        for (idx_t ik = 0; ik < nprobe; ik++) {
+          idx_t key = keys[i * nprobe + ik]; /* select the list  */
+          if (key < 0) continue;
+          FAISS_THROW_IF_NOT_FMT(key < (idx_t)nlist,
+                                 "Invalid key=%" PRId64 " at ik=%" PRId64 " nlist=%zd\n", key, ik,
+                                 nlist);
+          const size_t list_size = invlists->list_size(key);
+          if (list_size == 0) continue;
+
+          scanner->set_list(key, coarse_dis[i * nprobe + ik]);
+          InvertedLists::ScopedCodes scodes(invlists, key);
+          // the ids are looked up by the scanner if the entries are scanned with pairs
+          std::unique_ptr<InvertedLists::ScopedIds> sids;
+          if (!store_pairs) {
+            sids.reset(new InvertedLists::ScopedIds(invlists, key));
+          }
+          nlistv++;
+          nheap += scanner->scan_codes(list_size, scodes.get(), sids ? sids->get() : nullptr,
+                                       simi, idxi, k);
+          nscan += list_size;
+          if (max_codes && nscan >= (size_t)max_codes) break;
+        }
+        ndis += nscan;
+      } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(exception_mutex);
+        exception_string = demangle_cpp_symbol(typeid(e).name()) + "  " + e.what();
+        interrupt = true;
+      }
+
+      if (metric_type == METRIC_INNER_PRODUCT) {
+        heap_reorder<CMin<float, idx_t>>(k, simi, idxi);
+      } else {
+        heap_reorder<CMax<float, idx_t>>(k, simi, idxi);
+      }
+    }
+  }
+
+  if (interrupt) {
+    if (!exception_string.empty()) {
+      FAISS_THROW_FMT("search interrupted with: %s", exception_string.c_str());
+    } else {
+      FAISS_THROW_MSG("computation interrupted");
+    }
+  }
+
+  if (stats) {
+    stats->nq += n;
+    stats->nlist += nlistv;
+    stats->ndis += ndis;
+    stats->nheap_updates += nheap;
+  }
+}
+
 /// 2G by default, accommodates tables up to PQ32 w/ 65536 centroids
 static size_t precomputed_table_max_bytes = ((size_t)1) << 31;
 
@@ -631,12 +810,17 @@ struct RangeSearchResults {
   const IDSelector* sel;
   const IndexIvfPq* ivfpq;                  // added by tenann
   const float range_search_confidence = 0;  // added by tenann
+  const Tombstone* tombstone = nullptr;     // added by tenann
 
   // wrapped result structure
   float radius;
   RangeQueryResult& rres;
 
-  inline bool skip_entry(idx_t j) { return use_sel && !sel->is_member(ids[j]); }
+  inline bool skip_entry(idx_t j) {
+    // deleted rows are checked inline without calling the selector (added by tenann)
+    if (tombstone != nullptr && tombstone->IsDeleted(ids[j])) return true;
+    return use_sel && !sel->is_member(ids[j]);
+  }
 
   inline void add(idx_t j, float dis) {
     if constexpr (use_range_search_confidence) {
@@ -659,6 +843,40 @@ struct RangeSearchResults {
   }
 };
 
+template <class C, bool use_sel>
+struct KnnSearchResults {
+  idx_t key;
+  const idx_t* ids;
+  const IDSelector* sel;
+  const InvertedLists* invlists;  // added by tenann
+  const Tombstone* tombstone;     // added by tenann
+
+  // heap params
+  size_t k;
+  float* heap_sim;
+  idx_t* heap_ids;
+
+  size_t nup;
+
+  inline bool skip_entry(idx_t j) { return use_sel && !sel->is_member(ids[j]); }
+
+  inline void add(idx_t j, float dis) {
+    if (C::cmp(heap_sim[0], dis)) {
+      /* The following lines are added by tenann */
+      // deleted rows are checked inline, only for the entries entering the heap, so that the ids
+      // of the entries scanned with (list_no, offset) pairs are looked up for these entries only
+      if (tombstone != nullptr &&
+          tombstone->IsDeleted(ids ? ids[j] : invlists->get_single_id(key, j))) {
+        return;
+      }
+      /* End tenann. */
+      idx_t id = ids ? ids[j] : lo_build(key, j);
+      heap_replace_top<C>(k, heap_sim, heap_ids, dis, id);
+      nup++;
+    }
+  }
+};
+
 /*****************************************************
  * Scaning the codes.
  * The scanning functions call their favorite precompute_*
@@ -849,8 +1067,9 @@ template <MetricType METRIC_TYPE, class C, class PQDecoder, bool use_sel>
 struct IVFPQScanner : IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>, InvertedListScanner {
   int precompute_mode;
   const IDSelector* sel;
-  const IndexIvfPq* ivfpq;            // modifiled by tenann
-  float range_search_confidence = 0;  // added by tenann
+  const IndexIvfPq* ivfpq;               // modifiled by tenann
+  float range_search_confidence = 0;     // added by tenann
+  const Tombstone* tombstone = nullptr;  // added by tenann
 
   IVFPQScanner(const IndexIvfPq& ivfpq, bool store_pairs, int precompute_mode,
                const IDSelector* sel)
@@ -881,6 +1100,32 @@ struct IVFPQScanner : IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>, Inver
     return dis;
   }
 
+  /* The following lines are added by tenann */
+  size_t scan_codes(size_t ncode, const uint8_t* codes, const idx_t* ids, float* heap_sim,
+                    idx_t* heap_ids, size_t k) const override {
+    KnnSearchResults<C, use_sel> res = {
+        /* key */ this->key,
+        /* ids */ this->store_pairs ? nullptr : ids,
+        /* sel */ this->sel,
+        /* invlists */ this->ivfpq->invlists,
+        /* tombstone */ this->tombstone,
+        /* k */ k,
+        /* heap_sim */ heap_sim,
+        /* heap_ids */ heap_ids,
+        /* nup */ 0};
+
+    if (this->polysemous_ht > 0) {
+      assert(precompute_mode == 2);
+      FAISS_THROW_MSG("polymous_ht is not supported for search with a tombstone");
+    } else if (precompute_mode == 2) {
+      this->scan_list_with_table(ncode, codes, res);
+    } else {
+      FAISS_THROW_MSG("bad precomp mode");
+    }
+    return res.nup;
+  }
+  /* End tenann. */
+
   void scan_codes_range(size_t ncode, const uint8_t* codes, const idx_t* ids, float radius,
                         RangeQueryResult& rres) const override {
     /* The following lines are added by tenann */
@@ -891,6 +1136,7 @@ struct IVFPQScanner : IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>, Inver
           /* sel */ this->sel,
           /* ivfpq */ this->ivfpq,                                      // added by tenann
           /* range_search_confidence */ this->range_search_confidence,  // added by tenann
+          /* tombstone */ this->tombstone,                              // added by tenann
           /* radius */ sqrtf(radius),  // modified by tenann (tenann uses squared root radius
                                        // instead)
           /* rres */ rres};
@@ -915,6 +1161,7 @@ struct IVFPQScanner : IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>, Inver
           /* sel */ this->sel,
           /* ivfpq */ this->ivfpq,                                      // added by tenann
           /* range_search_confidence */ this->range_search_confidence,  // added by tenann
+          /* tombstone */ this->tombstone,                              // added by tenann
           /* radius */ radius,
           /* rres */ rres};
 
@@ -937,16 +1184,19 @@ struct IVFPQScanner : IVFPQScannerT<Index::idx_t, METRIC_TYPE, PQDecoder>, Inver
 template <class PQDecoder, bool use_sel>
 InvertedListScanner* get_InvertedListScanner1(const IndexIvfPq& index, bool store_pairs,
                                               const IDSelector* sel,
-                                              float dynamic_range_search_confidence) {
+                                              float dynamic_range_search_confidence,
+                                              const Tombstone* tombstone) {
   if (index.metric_type == METRIC_INNER_PRODUCT) {
     auto ret = new IVFPQScanner<METRIC_INNER_PRODUCT, CMin<float, idx_t>, PQDecoder, use_sel>(
         index, store_pairs, 2, sel);
     ret->range_search_confidence = dynamic_range_search_confidence;
+    ret->tombstone = tombstone;
     return ret;
   } else if (index.metric_type == METRIC_L2) {
     auto ret = new IVFPQScanner<METRIC_L2, CMax<float, idx_t>, PQDecoder, use_sel>(
         index, store_pairs, 2, sel);
     ret->range_search_confidence = dynamic_range_search_confidence;
+    ret->tombstone = tombstone;
     return ret;
   }
   return nullptr;
@@ -955,28 +1205,34 @@ InvertedListScanner* get_InvertedListScanner1(const IndexIvfPq& index, bool stor
 template <bool use_sel>
 InvertedListScanner* get_InvertedListScanner2(const IndexIvfPq& index, bool store_pairs,
                                               const IDSelector* sel,
-                                              float dynamic_range_search_confidence) {
+                                              float dynamic_range_search_confidence,
+                                              const Tombstone* tombstone) {
   if (index.pq.nbits == 8) {
     return get_InvertedListScanner1<PQDecoder8, use_sel>(index, store_pairs, sel,
-                                                         dynamic_range_search_confidence);
+                                                         dynamic_range_search_confidence,
+                                                         tombstone);
   } else if (index.pq.nbits == 16) {
     return get_InvertedListScanner1<PQDecoder16, use_sel>(index, store_pairs, sel,
-                                                          dynamic_range_search_confidence);
+                                                          dynamic_range_search_confidence,
+                                                          tombstone);
   } else {
     return get_InvertedListScanner1<PQDecoderGeneric, use_sel>(index, store_pairs, sel,
-                                                               dynamic_range_search_confidence);
+                                                               dynamic_range_search_confidence,
+                                                               tombstone);
   }
 }
 
 }  // anonymous namespace
 
 InvertedListScanner* IndexIvfPq::custom_get_InvertedListScanner(
-    bool store_pairs, const IDSelector* sel, float dynamic_range_search_confidence) const {
+    bool store_pairs, const IDSelector* sel, float dynamic_range_search_confidence,
+    const Tombstone* tombstone) const {
   if (sel) {
-    return get_InvertedListScanner2<true>(*this, store_pairs, sel, dynamic_range_search_confidence);
+    return get_InvertedListScanner2<true>(*this, store_pairs, sel, dynamic_range_search_confidence,
+                                          tombstone);
   } else {
     return get_InvertedListScanner2<false>(*this, store_pairs, sel,
-                                           dynamic_range_search_confidence);
+                                           dynamic_range_search_confidence, tombstone);
   }
   return nullptr;
 }
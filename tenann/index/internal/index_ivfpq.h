@@ -19,13 +19,20 @@
 
 #pragma once
 
+#include <memory>
+
 #include "faiss/IndexIVFPQ.h"
 #include "faiss/IndexPreTransform.h"
 
 namespace tenann {
 
+class IvfPqPrecomputedTable;
+class Tombstone;
+
 struct IndexIvfPqSearchParameters : faiss::IVFPQSearchParameters {
   float range_search_confidence;
+  /// Deleted rows skipped by the scanner, checked before `sel`.
+  const Tombstone* tombstone = nullptr;
   IndexIvfPqSearchParameters() : range_search_confidence(0) {}
   ~IndexIvfPqSearchParameters() {}
 };
@@ -43,9 +50,21 @@ struct IndexIvfPq : faiss::IndexIVFPQ {
   /// will be greatly increased, and in the extreme case, all database vectors will be returned.
   float range_search_confidence = 0;
 
+  /// Scan the codes without their ids and look up the ids of the results only, set when the
+  /// inverted lists read the ids on demand, see `SplitInvertedLists`.
+  bool fetch_ids_after_scan = false;
+
+  /// Table borrowed by `precomputed_table`, possibly shared with other indexes, see
+  /// `SetPrecomputedTable`.
+  std::shared_ptr<IvfPqPrecomputedTable> shared_precomputed_table;
+
   IndexIvfPq(faiss::Index* quantizer, size_t d, size_t nlist, size_t M, size_t nbits_per_idx,
              faiss::MetricType metric = faiss::METRIC_L2);
 
+  /// Search with [table] as the precomputed table. `precomputed_table` borrows the memory of
+  /// [table] instead of holding a copy, and the lists of a lazy table are filled before the scan.
+  void SetPrecomputedTable(std::shared_ptr<IvfPqPrecomputedTable> table);
+
   void add_core(idx_t n, const float* x, const idx_t* xids, const idx_t* precomputed_idx) override;
 
   /// same as add_core, also:
@@ -54,18 +73,33 @@ struct IndexIvfPq : faiss::IndexIVFPQ {
   void custom_add_core_o(idx_t n, const float* x, const idx_t* xids, float* residuals_2,
                          const idx_t* precomputed_idx = nullptr);
 
+  /// Same as `faiss::IndexIVF::search`, except that the ids of the results are looked up after the
+  /// scan if `fetch_ids_after_scan` is set and no id selector is given, that the probed lists
+  /// of a lazy precomputed table are filled before the scan, and that the rows deleted by the
+  /// tombstone of `IndexIvfPqSearchParameters` are skipped.
+  void search(idx_t n, const float* x, idx_t k, float* distances, idx_t* labels,
+              const faiss::SearchParameters* params = nullptr) const override;
+
   void range_search(idx_t n, const float* x, float radius, faiss::RangeSearchResult* result,
                     const faiss::SearchParameters* params = nullptr) const override;
 
+  /// Same as `faiss::IndexIVF::search_preassigned`, except that the rows deleted by
+  /// `params->tombstone` are skipped by the scanner without a selector. With [store_pairs], the ids
+  /// are only looked up for the entries entering the result heap.
+  void custom_search_preassigned(idx_t n, const float* x, idx_t k, const idx_t* keys,
+                                 const float* coarse_dis, float* distances, idx_t* labels,
+                                 bool store_pairs, const IndexIvfPqSearchParameters* params,
+                                 faiss::IndexIVFStats* stats = nullptr) const;
+
   void custom_range_search_preassigned(idx_t nx, const float* x, float radius, const idx_t* keys,
                                        const float* coarse_dis, faiss::RangeSearchResult* result,
                                        bool store_pairs = false,
                                        const IndexIvfPqSearchParameters* params = nullptr,
                                        faiss::IndexIVFStats* stats = nullptr) const;
 
-  faiss::InvertedListScanner* custom_get_InvertedListScanner(bool store_pairs,
-                                                             const faiss::IDSelector* sel,
-                                                             float range_search_confidence) const;
+  faiss::InvertedListScanner* custom_get_InvertedListScanner(
+      bool store_pairs, const faiss::IDSelector* sel, float range_search_confidence,
+      const Tombstone* tombstone = nullptr) const;
 };
 
 }  // namespace tenann
\ No newline at end of file
@@ -0,0 +1,277 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/index_vamana.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+
+#include "faiss/impl/AuxIndexStructures.h"
+#include "faiss/impl/FaissAssert.h"
+#include "faiss/utils/distances.h"
+
+namespace tenann {
+
+IndexVamana::IndexVamana(int d, int R, int L, float alpha, size_t pq_M, size_t pq_nbits)
+    : faiss::Index(d, faiss::METRIC_L2), R(R), L(L), alpha(alpha), pq(d, pq_M, pq_nbits) {
+  FAISS_THROW_IF_NOT_MSG(pq_nbits == 8, "vamana only supports 8-bit pq codes");
+  is_trained = false;
+}
+
+IndexVamana::IndexVamana() = default;
+
+IndexVamana::~IndexVamana() = default;
+
+void IndexVamana::train(idx_t n, const float* x) {
+  pq.train(n, x);
+  is_trained = true;
+}
+
+void IndexVamana::add(idx_t n, const float* x) { add_with_ids(n, x, nullptr); }
+
+void IndexVamana::add_with_ids(idx_t n, const float* x, const idx_t* xids) {
+  FAISS_THROW_IF_NOT_MSG(is_trained, "vamana must be trained before adding vectors");
+  FAISS_THROW_IF_NOT_FMT(ntotal + n <= std::numeric_limits<storage_idx_t>::max(),
+                         "too many vectors for vamana: %zd", static_cast<size_t>(ntotal + n));
+  if (n == 0) return;
+
+  xb.insert(xb.end(), x, x + n * d);
+  codes.resize((ntotal + n) * pq.code_size);
+  pq.compute_codes(x, codes.data() + ntotal * pq.code_size, n);
+  for (idx_t i = 0; i < n; i++) {
+    ids.push_back(xids != nullptr ? xids[i] : ntotal + i);
+  }
+
+  idx_t n0 = ntotal;
+  ntotal += n;
+  BuildGraph(n0);
+}
+
+void IndexVamana::BuildGraph(idx_t n0) {
+  if (n0 == 0) {
+    // use the node closest to the centroid as the entry point
+    std::vector<float> centroid(d, 0);
+    for (idx_t i = 0; i < ntotal; i++) {
+      const float* v = Vector(i);
+      for (int j = 0; j < d; j++) centroid[j] += v[j];
+    }
+    for (int j = 0; j < d; j++) centroid[j] /= ntotal;
+
+    float d_medoid = std::numeric_limits<float>::max();
+    for (idx_t i = 0; i < ntotal; i++) {
+      float dis = faiss::fvec_L2sqr(centroid.data(), Vector(i), d);
+      if (dis < d_medoid) {
+        d_medoid = dis;
+        medoid = i;
+      }
+    }
+  }
+
+  graph.resize(ntotal);
+  std::vector<std::mutex> locks(ntotal);
+
+  std::vector<storage_idx_t> order(ntotal - n0);
+  std::iota(order.begin(), order.end(), n0);
+  std::shuffle(order.begin(), order.end(), std::mt19937(1234));
+
+  // the first build makes a pass with alpha = 1 to form a well-connected graph first,
+  // and a second pass with the configured alpha to add long edges
+  std::vector<float> alphas;
+  if (n0 == 0) alphas.push_back(1.0);
+  alphas.push_back(alpha);
+
+  for (float a : alphas) {
+#pragma omp parallel
+    {
+      faiss::VisitedTable vt(ntotal);
+#pragma omp for schedule(dynamic, 64)
+      for (size_t i = 0; i < order.size(); i++) {
+        InsertNode(order[i], a, vt, locks);
+      }
+    }
+  }
+}
+
+void IndexVamana::InsertNode(storage_idx_t p, float a, faiss::VisitedTable& vt,
+                             std::vector<std::mutex>& locks) {
+  std::vector<Candidate> pool;
+  std::vector<std::pair<float, storage_idx_t>> candidates;
+  GreedySearch(Vector(p), L, vt, &pool, &candidates, &locks);
+  vt.advance();
+
+  std::vector<storage_idx_t> neighbors;
+  {
+    std::lock_guard<std::mutex> guard(locks[p]);
+    for (auto v : graph[p]) {
+      candidates.emplace_back(Distance(p, v), v);
+    }
+  }
+  RobustPrune(p, a, &candidates, &neighbors);
+  {
+    std::lock_guard<std::mutex> guard(locks[p]);
+    graph[p] = neighbors;
+  }
+
+  // add reverse edges, and prune the neighbor list once it overflows
+  for (auto v : neighbors) {
+    std::lock_guard<std::mutex> guard(locks[v]);
+    auto& v_neighbors = graph[v];
+    if (std::find(v_neighbors.begin(), v_neighbors.end(), p) != v_neighbors.end()) {
+      continue;
+    }
+    if (v_neighbors.size() < static_cast<size_t>(R)) {
+      v_neighbors.push_back(p);
+      continue;
+    }
+
+    std::vector<std::pair<float, storage_idx_t>> v_candidates;
+    v_candidates.reserve(v_neighbors.size() + 1);
+    for (auto u : v_neighbors) {
+      v_candidates.emplace_back(Distance(v, u), u);
+    }
+    v_candidates.emplace_back(Distance(v, p), p);
+    RobustPrune(v, a, &v_candidates, &v_neighbors);
+  }
+}
+
+void IndexVamana::GreedySearch(const float* q, int list_size, faiss::VisitedTable& vt,
+                               std::vector<Candidate>* pool,
+                               std::vector<std::pair<float, storage_idx_t>>* expanded,
+                               std::vector<std::mutex>* locks) const {
+  pool->clear();
+  if (medoid < 0) return;
+
+  auto insert = [pool, list_size](storage_idx_t id, float dis) {
+    if (pool->size() == static_cast<size_t>(list_size) && dis >= pool->back().dis) return;
+    Candidate candidate{dis, id, false};
+    auto it = std::upper_bound(
+        pool->begin(), pool->end(), candidate,
+        [](const Candidate& left, const Candidate& right) { return left.dis < right.dis; });
+    pool->insert(it, candidate);
+    if (pool->size() > static_cast<size_t>(list_size)) pool->pop_back();
+  };
+
+  vt.set(medoid);
+  insert(medoid, faiss::fvec_L2sqr(q, Vector(medoid), d));
+
+  std::vector<storage_idx_t> neighbors;
+  for (;;) {
+    auto it = std::find_if(pool->begin(), pool->end(),
+                           [](const Candidate& candidate) { return !candidate.expanded; });
+    if (it == pool->end()) break;
+
+    it->expanded = true;
+    storage_idx_t p = it->id;
+    if (expanded != nullptr) {
+      expanded->emplace_back(it->dis, p);
+    }
+
+    if (locks != nullptr) {
+      std::lock_guard<std::mutex> guard((*locks)[p]);
+      neighbors = graph[p];
+    } else {
+      neighbors = graph[p];
+    }
+
+    for (auto v : neighbors) {
+      if (vt.get(v)) continue;
+      vt.set(v);
+      insert(v, faiss::fvec_L2sqr(q, Vector(v), d));
+    }
+  }
+}
+
+void IndexVamana::RobustPrune(storage_idx_t p, float a,
+                              std::vector<std::pair<float, storage_idx_t>>* candidates,
+                              std::vector<storage_idx_t>* neighbors) const {
+  auto& pool = *candidates;
+  std::sort(pool.begin(), pool.end());
+  pool.erase(std::unique(pool.begin(), pool.end()), pool.end());
+
+  neighbors->clear();
+  std::vector<bool> pruned(pool.size(), false);
+  for (size_t i = 0; i < pool.size() && neighbors->size() < static_cast<size_t>(R); i++) {
+    if (pruned[i] || pool[i].second == p) continue;
+
+    storage_idx_t selected = pool[i].second;
+    neighbors->push_back(selected);
+    for (size_t j = i + 1; j < pool.size(); j++) {
+      if (!pruned[j] && a * Distance(selected, pool[j].second) <= pool[j].first) {
+        pruned[j] = true;
+      }
+    }
+  }
+}
+
+float IndexVamana::Distance(storage_idx_t a, storage_idx_t b) const {
+  return faiss::fvec_L2sqr(Vector(a), Vector(b), d);
+}
+
+void IndexVamana::search(idx_t n, const float* x, idx_t k, float* distances, idx_t* labels,
+                         const faiss::SearchParameters* params) const {
+  auto* vamana_params = dynamic_cast<const SearchParametersVamana*>(params);
+  int list_size = vamana_params ? vamana_params->search_list_size : search_list_size;
+  list_size = std::max<int64_t>(list_size, k);
+  const faiss::IDSelector* sel = params ? params->sel : nullptr;
+
+#pragma omp parallel if (n > 1)
+  {
+    faiss::VisitedTable vt(ntotal);
+    std::vector<Candidate> pool;
+
+#pragma omp for
+    for (idx_t i = 0; i < n; i++) {
+      GreedySearch(x + i * d, list_size, vt, &pool, nullptr, nullptr);
+      vt.advance();
+
+      float* D = distances + i * k;
+      idx_t* I = labels + i * k;
+      idx_t nres = 0;
+      for (const auto& candidate : pool) {
+        if (nres == k) break;
+        if (sel != nullptr && !sel->is_member(candidate.id)) continue;
+        D[nres] = candidate.dis;
+        I[nres] = ids[candidate.id];
+        nres++;
+      }
+      for (; nres < k; nres++) {
+        D[nres] = std::numeric_limits<float>::max();
+        I[nres] = -1;
+      }
+    }
+  }
+}
+
+void IndexVamana::reset() {
+  codes.clear();
+  xb.clear();
+  ids.clear();
+  graph.clear();
+  medoid = -1;
+  ntotal = 0;
+}
+
+void IndexVamana::reconstruct(idx_t key, float* recons) const {
+  FAISS_THROW_IF_NOT(key >= 0 && key < ntotal);
+  std::copy_n(Vector(key), d, recons);
+}
+
+}  // namespace tenann
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "faiss/Index.h"
+#include "faiss/impl/ProductQuantizer.h"
+
+namespace faiss {
+struct VisitedTable;
+}
+
+namespace tenann {
+
+struct SearchParametersVamana : faiss::SearchParameters {
+  /// size of the candidate list, the larger the more accurate and the slower
+  int search_list_size = 100;
+
+  ~SearchParametersVamana() {}
+};
+
+/**
+ * @brief In-memory Vamana graph (DiskANN) used to build disk-resident indexes.
+ *
+ * Full-precision vectors and the graph live in memory only while building, the index is then
+ * written with the disk layout of `DiskVamana`, which keeps just the PQ codes in memory when
+ * searching. Only l2 distance is supported, cosine similarity is served with an `L2Norm`
+ * pre-transform.
+ *
+ * Unlike faiss HNSW, row ids are kept by the index itself, and `search` returns row ids while
+ * the `sel` of search parameters is applied on internal ids.
+ */
+struct IndexVamana : faiss::Index {
+  using storage_idx_t = int32_t;
+
+  /// max degree of the graph
+  int R = 64;
+  /// candidate list size used when building
+  int L = 100;
+  /// pruning factor, a larger alpha keeps more long edges
+  float alpha = 1.2;
+  /// default candidate list size used when searching
+  int search_list_size = 100;
+
+  /// compressed vectors, kept in memory when searching on disk
+  faiss::ProductQuantizer pq;
+  std::vector<uint8_t> codes;
+
+  /// full-precision vectors, written next to the graph on disk
+  std::vector<float> xb;
+  /// internal id to row id
+  std::vector<idx_t> ids;
+  /// out-neighbors of each node, with at most R entries
+  std::vector<std::vector<storage_idx_t>> graph;
+  /// entry point of all searches, the node closest to the centroid of the first batch
+  storage_idx_t medoid = -1;
+
+  IndexVamana(int d, int R, int L, float alpha, size_t pq_M, size_t pq_nbits);
+  IndexVamana();
+  ~IndexVamana() override;
+
+  /// train the product quantizer
+  void train(idx_t n, const float* x) override;
+
+  void add(idx_t n, const float* x) override;
+
+  void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
+
+  void search(idx_t n, const float* x, idx_t k, float* distances, idx_t* labels,
+              const faiss::SearchParameters* params = nullptr) const override;
+
+  void reset() override;
+
+  void reconstruct(idx_t key, float* recons) const override;
+
+ private:
+  struct Candidate {
+    float dis;
+    storage_idx_t id;
+    bool expanded;
+  };
+
+  /// link the nodes in [n0, ntotal) into the graph
+  void BuildGraph(idx_t n0);
+
+  /// insert node [p] with the given pruning factor, [locks] protect the neighbor lists
+  void InsertNode(storage_idx_t p, float alpha, faiss::VisitedTable& vt,
+                  std::vector<std::mutex>& locks);
+
+  /**
+   * @brief Greedy search from the medoid, keeping the [list_size] closest nodes in [pool].
+   *
+   * Every expanded node is appended to [expanded] if it is not null, which are the pruning
+   * candidates when building.
+   */
+  void GreedySearch(const float* q, int list_size, faiss::VisitedTable& vt,
+                    std::vector<Candidate>* pool,
+                    std::vector<std::pair<float, storage_idx_t>>* expanded,
+                    std::vector<std::mutex>* locks) const;
+
+  /// select at most R diverse neighbors of [p] from [candidates]
+  void RobustPrune(storage_idx_t p, float alpha,
+                   std::vector<std::pair<float, storage_idx_t>>* candidates,
+                   std::vector<storage_idx_t>* neighbors) const;
+
+  float Distance(storage_idx_t a, storage_idx_t b) const;
+
+  const float* Vector(storage_idx_t i) const { return xb.data() + static_cast<size_t>(i) * d; }
+};
+
+}  // namespace tenann
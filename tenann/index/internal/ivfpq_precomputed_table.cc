@@ -0,0 +1,214 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+
+#include <omp.h>
+
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+#include "faiss/IndexPQ.h"
+#include "faiss/impl/FaissAssert.h"
+#include "faiss/impl/io_macros.h"
+#include "tenann/util/memory_usage.h"
+#include "faiss/index_io.h"
+#include "faiss/utils/distances.h"
+
+namespace tenann {
+
+namespace {
+
+size_t HashFloats(const std::vector<float>& v) {
+  return std::hash<std::string_view>{}(
+      std::string_view(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(float)));
+}
+
+size_t TableSize(const faiss::IndexIVFPQ& index) {
+  return index.nlist * index.pq.M * index.pq.ksub;
+}
+
+/// Tables registered for sharing, keyed by the fingerprint of their codebooks
+struct Registry {
+  std::mutex mutex;
+  std::unordered_multimap<size_t, std::weak_ptr<IvfPqPrecomputedTable>> tables;
+};
+
+Registry& GetRegistry() {
+  static Registry registry;
+  return registry;
+}
+
+}  // namespace
+
+uint32_t IvfPqPrecomputedTable::Fourcc() { return faiss::fourcc("IpPT"); }
+
+bool IvfPqPrecomputedTable::IsApplicable(const faiss::IndexIVFPQ& index) {
+  return index.is_trained && index.by_residual && index.metric_type == faiss::METRIC_L2 &&
+         index.quantizer->metric_type == faiss::METRIC_L2 &&
+         dynamic_cast<const faiss::MultiIndexQuantizer*>(index.quantizer) == nullptr &&
+         TableSize(index) * sizeof(float) <= faiss::precomputed_table_max_bytes;
+}
+
+IvfPqPrecomputedTable::IvfPqPrecomputedTable(const faiss::IndexIVFPQ& index) : pq_(index.pq) {
+  FAISS_THROW_IF_NOT(IsApplicable(index));
+  coarse_centroids_.resize(index.nlist * index.d);
+  index.quantizer->reconstruct_n(0, index.nlist, coarse_centroids_.data());
+
+  r_norms_.resize(pq_.M * pq_.ksub);
+  for (size_t m = 0; m < pq_.M; m++) {
+    for (size_t j = 0; j < pq_.ksub; j++) {
+      r_norms_[m * pq_.ksub + j] = faiss::fvec_norm_L2sqr(pq_.get_centroids(m, j), pq_.dsub);
+    }
+  }
+
+  fingerprint_ = HashFloats(coarse_centroids_) ^ (HashFloats(pq_.centroids) * 31) ^
+                 std::hash<size_t>{}(pq_.nbits);
+}
+
+std::shared_ptr<IvfPqPrecomputedTable> IvfPqPrecomputedTable::Create(
+    const faiss::IndexIVFPQ& index, bool lazy) {
+  std::shared_ptr<IvfPqPrecomputedTable> table(new IvfPqPrecomputedTable(index));
+  size_t nlist = index.nlist;
+  table->table_.resize(TableSize(index));
+  table->lazy_ = lazy;
+  if (lazy) {
+    // the rows are written on first probe only, so that the pages of the lists never probed are
+    // not even backed by memory
+    table->computed_lists_ = std::make_unique<std::once_flag[]>(nlist);
+    return table;
+  }
+
+#pragma omp parallel for if (nlist > 1)
+  for (int64_t i = 0; i < static_cast<int64_t>(nlist); i++) {
+    table->ComputeList(i);
+  }
+  return table;
+}
+
+std::shared_ptr<IvfPqPrecomputedTable> IvfPqPrecomputedTable::Read(const faiss::IndexIVFPQ& index,
+                                                                   faiss::IOReader* f) {
+  uint32_t h;
+  // the table is optional and stored last, the file may end right here
+  if ((*f)(&h, sizeof(h), 1) != 1) {
+    return nullptr;
+  }
+  FAISS_THROW_IF_NOT_FMT(h == Fourcc(), "unexpected fourcc %ud of the precomputed table", h);
+
+  size_t size;
+  READ1(size);
+  FAISS_THROW_IF_NOT_FMT(size == TableSize(index), "precomputed table size %zu, expected %zu",
+                         size, TableSize(index));
+  std::shared_ptr<IvfPqPrecomputedTable> table(new IvfPqPrecomputedTable(index));
+  table->table_.resize(size);
+  READANDCHECK(table->table_.data(), size);
+  return table;
+}
+
+void IvfPqPrecomputedTable::Write(const faiss::IndexIVFPQ& index, faiss::IOWriter* f) {
+  FAISS_THROW_IF_NOT(IsApplicable(index));
+  uint32_t h = Fourcc();
+  WRITE1(h);
+  size_t size = TableSize(index);
+  WRITE1(size);
+  if (index.use_precomputed_table == 1 && index.precomputed_table.size() == size) {
+    WRITEANDCHECK(index.precomputed_table.data(), size);
+    return;
+  }
+  auto table = Create(index, false);
+  WRITEANDCHECK(table->data(), size);
+}
+
+std::shared_ptr<IvfPqPrecomputedTable> IvfPqPrecomputedTable::Lookup(
+    const faiss::IndexIVFPQ& index) {
+  if (!IsApplicable(index)) {
+    return nullptr;
+  }
+  // only the codebooks are needed to match the tables, the probe holds no table
+  IvfPqPrecomputedTable probe(index);
+  auto& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto [begin, end] = registry.tables.equal_range(probe.fingerprint_);
+  for (auto it = begin; it != end; it++) {
+    auto table = it->second.lock();
+    if (table != nullptr && table->SameCodebooks(probe)) {
+      return table;
+    }
+  }
+  return nullptr;
+}
+
+std::shared_ptr<IvfPqPrecomputedTable> IvfPqPrecomputedTable::Register(
+    std::shared_ptr<IvfPqPrecomputedTable> table) {
+  auto& registry = GetRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto [begin, end] = registry.tables.equal_range(table->fingerprint_);
+  for (auto it = begin; it != end;) {
+    auto registered = it->second.lock();
+    if (registered == nullptr) {
+      it = registry.tables.erase(it);
+    } else if (registered->SameCodebooks(*table)) {
+      return registered;
+    } else {
+      it++;
+    }
+  }
+  registry.tables.emplace(table->fingerprint_, table);
+  return table;
+}
+
+void IvfPqPrecomputedTable::EnsureLists(const idx_t* list_nos, size_t n) {
+  if (!lazy_) {
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    idx_t list_no = list_nos[i];
+    if (list_no < 0) continue;
+    std::call_once(computed_lists_[list_no], [this, list_no]() { ComputeList(list_no); });
+  }
+}
+
+bool IvfPqPrecomputedTable::SameCodebooks(const IvfPqPrecomputedTable& other) const {
+  return fingerprint_ == other.fingerprint_ && pq_.d == other.pq_.d && pq_.M == other.pq_.M &&
+         pq_.nbits == other.pq_.nbits && pq_.centroids == other.pq_.centroids &&
+         coarse_centroids_ == other.coarse_centroids_;
+}
+
+void IvfPqPrecomputedTable::ComputeList(size_t list_no) {
+  // term 2 of the L2 distance by residual, see `QueryTables` in index_ivfpq.cc
+  float* tab = table_.data() + list_no * pq_.M * pq_.ksub;
+  pq_.compute_inner_prod_table(coarse_centroids_.data() + list_no * pq_.d, tab);
+  faiss::fvec_madd(pq_.M * pq_.ksub, r_norms_.data(), 2.0, tab, tab);
+}
+
+size_t IvfPqPrecomputedTable::memory_usage() const {
+  size_t usage = AllocationSize(sizeof(*this)) + AllocationSize(table_.size() * sizeof(float));
+  for (const auto* v : {&pq_.centroids, &pq_.transposed_centroids, &pq_.centroids_sq_lengths,
+                        &pq_.sdc_table, &coarse_centroids_, &r_norms_}) {
+    usage += AllocationSize(v->capacity() * sizeof(float));
+  }
+  if (computed_lists_ != nullptr && pq_.d != 0) {
+    size_t nlist = coarse_centroids_.size() / pq_.d;
+    usage += AllocationSize(nlist * sizeof(std::once_flag));
+  }
+  return usage;
+}
+
+}  // namespace tenann
@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "faiss/IndexIVFPQ.h"
+#include "faiss/impl/io.h"
+#include "faiss/utils/AlignedTable.h"
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+/**
+ * @brief The precomputed table of an ivfpq index encoded by residual with L2 distance, the same as
+ * the one built by `faiss::IndexIVFPQ::precompute_table` with `use_precomputed_table == 1`.
+ *
+ * The table depends only on the coarse and the pq codebooks, so that indexes with identical
+ * codebooks may share a single table through `Lookup` and `Register`. A lazy table fills the rows
+ * of each list on its first probe, see `EnsureLists`, instead of paying for all the lists at load.
+ */
+class IvfPqPrecomputedTable {
+ public:
+  using idx_t = faiss::Index::idx_t;
+
+  T_FORBID_COPY_AND_ASSIGN(IvfPqPrecomputedTable);
+  T_FORBID_MOVE(IvfPqPrecomputedTable);
+
+  /// Fourcc of the table persisted in an index file, "IpPT".
+  static uint32_t Fourcc();
+
+  /// Whether [index] searches with a table of this kind, otherwise faiss decides how to search.
+  static bool IsApplicable(const faiss::IndexIVFPQ& index);
+
+  /// Build the table of [index], the rows are filled on demand if [lazy].
+  static std::shared_ptr<IvfPqPrecomputedTable> Create(const faiss::IndexIVFPQ& index, bool lazy);
+
+  /// Read the table persisted by `Write` if the next fourcc of [f] is `Fourcc()`, nullptr if the
+  /// file ends instead. Throw if the table does not match [index].
+  static std::shared_ptr<IvfPqPrecomputedTable> Read(const faiss::IndexIVFPQ& index,
+                                                     faiss::IOReader* f);
+
+  /// Persist the table of [index], reusing `index.precomputed_table` if it is already computed.
+  static void Write(const faiss::IndexIVFPQ& index, faiss::IOWriter* f);
+
+  /// The table registered for the codebooks of [index], nullptr if there is none.
+  static std::shared_ptr<IvfPqPrecomputedTable> Lookup(const faiss::IndexIVFPQ& index);
+
+  /// Register [table] for sharing and return it, or the table registered meanwhile for the same
+  /// codebooks. Tables are unregistered once they are no longer used.
+  static std::shared_ptr<IvfPqPrecomputedTable> Register(
+      std::shared_ptr<IvfPqPrecomputedTable> table);
+
+  /// Fill the rows of the lists not computed yet, a no-op for a table computed eagerly.
+  void EnsureLists(const idx_t* list_nos, size_t n);
+
+  const float* data() const { return table_.data(); }
+  size_t size() const { return table_.size(); }
+
+  /// Heap memory held by the table, see `AllocationSize`.
+  size_t memory_usage() const;
+  bool lazy() const { return lazy_; }
+
+ private:
+  explicit IvfPqPrecomputedTable(const faiss::IndexIVFPQ& index);
+
+  /// Whether the table was built from the same codebooks as [other]
+  bool SameCodebooks(const IvfPqPrecomputedTable& other) const;
+  void ComputeList(size_t list_no);
+
+  size_t fingerprint_ = 0;
+  faiss::ProductQuantizer pq_;
+  /// Coarse centroids, kept to compute the rows lazily and to compare the codebooks
+  std::vector<float> coarse_centroids_;
+  /// Squared norms of the pq centroids
+  std::vector<float> r_norms_;
+
+  faiss::AlignedTable<float> table_;
+  bool lazy_ = false;
+  std::unique_ptr<std::once_flag[]> computed_lists_;
+};
+
+}  // namespace tenann
@@ -0,0 +1,253 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/ivfpq_sectioned_file.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "faiss/impl/FaissAssert.h"
+#include "faiss/impl/io_macros.h"
+#include "faiss/index_io.h"
+#include "tenann/util/buffer_io.h"
+#include "tenann/util/crc32c.h"
+
+namespace tenann {
+
+static_assert(sizeof(IvfPqSectionedFile::Section) == 24, "the toc entries are persisted as is");
+
+namespace {
+
+// size of the file head: magic and version
+constexpr size_t kHeadSize = 8;
+
+size_t ReaderSize(faiss::IOReader* f) {
+  if (auto* reader = dynamic_cast<faiss::FileIOReader*>(f)) {
+    struct stat buf;
+    int ret = fstat(fileno(reader->f), &buf);
+    FAISS_THROW_IF_NOT_FMT(ret == 0, "fstat %s failed: %s", f->name.c_str(), strerror(errno));
+    return buf.st_size;
+  }
+  if (auto* reader = dynamic_cast<SourceIOReader*>(f)) {
+    return reader->source()->size();
+  }
+  FAISS_THROW_FMT("sectioned file %s can only be read from files and sources", f->name.c_str());
+}
+
+void SeekReader(faiss::IOReader* f, size_t offset) {
+  if (auto* reader = dynamic_cast<faiss::FileIOReader*>(f)) {
+    int ret = fseek(reader->f, offset, SEEK_SET);
+    FAISS_THROW_IF_NOT_FMT(ret == 0, "seek %s to %zu failed: %s", f->name.c_str(), offset,
+                           strerror(errno));
+  } else if (auto* reader = dynamic_cast<SourceIOReader*>(f)) {
+    reader->Seek(offset);
+  } else {
+    FAISS_THROW_FMT("sectioned file %s can only be read from files and sources", f->name.c_str());
+  }
+}
+
+// Reads the bytes of one section from the underlying reader, positioned at the section start
+class SectionReader : public faiss::IOReader {
+ public:
+  SectionReader(faiss::IOReader* f, const IvfPqSectionedFile::Section& section, bool verify)
+      : f_(f), section_(section), verify_(verify) {
+    name = f->name;
+  }
+
+  size_t operator()(void* ptr, size_t size, size_t nitems) override {
+    if (size == 0) return 0;
+    // a section ends like a file does
+    nitems = std::min<size_t>(nitems, (section_.size - read_) / size);
+    if (nitems == 0) return 0;
+
+    size_t ret = (*f_)(ptr, size, nitems);
+    FAISS_THROW_IF_NOT_FMT(ret == nitems, "read section %u of %s: %zu of %zu items", section_.type,
+                           name.c_str(), ret, nitems);
+    read_ += size * nitems;
+    if (verify_) {
+      crc_ = Crc32c(ptr, size * nitems, crc_);
+      FAISS_THROW_IF_NOT_FMT(read_ < section_.size || crc_ == section_.crc,
+                             "checksum mismatch of section %u of %s: %08x, expected %08x",
+                             section_.type, name.c_str(), crc_, section_.crc);
+    }
+    return nitems;
+  }
+
+ private:
+  faiss::IOReader* f_;
+  IvfPqSectionedFile::Section section_;
+  bool verify_;
+  size_t read_ = 0;
+  uint32_t crc_ = 0;
+};
+
+}  // namespace
+
+uint32_t IvfPqSectionedFile::Magic() { return faiss::fourcc("TnPQ"); }
+
+// Passes the bytes to the underlying writer, tracking the offset and the checksum of the section
+class IvfPqSectionedFile::Writer::SectionWriter : public faiss::IOWriter {
+ public:
+  explicit SectionWriter(faiss::IOWriter* f) : f_(f) { name = f->name; }
+
+  size_t operator()(const void* ptr, size_t size, size_t nitems) override {
+    size_t ret = (*f_)(ptr, size, nitems);
+    crc = Crc32c(ptr, size * ret, crc);
+    offset += size * ret;
+    return ret;
+  }
+
+  uint64_t offset = 0;
+  uint32_t crc = 0;
+
+ private:
+  faiss::IOWriter* f_;
+};
+
+IvfPqSectionedFile::Writer::Writer(faiss::IOWriter* out)
+    : writer_(std::make_unique<SectionWriter>(out)) {
+  faiss::IOWriter* f = writer_.get();
+  uint32_t magic = Magic();
+  uint32_t version = kVersion;
+  WRITE1(magic);
+  WRITE1(version);
+}
+
+IvfPqSectionedFile::Writer::~Writer() = default;
+
+faiss::IOWriter* IvfPqSectionedFile::Writer::BeginSection(IvfPqSection type) {
+  if (in_section_) {
+    EndSection();
+  }
+  for (const auto& section : sections_) {
+    FAISS_THROW_IF_NOT_FMT(section.type != type, "section %u written twice", type);
+  }
+  sections_.push_back({type, 0, writer_->offset, 0});
+  writer_->crc = 0;
+  in_section_ = true;
+  return writer_.get();
+}
+
+void IvfPqSectionedFile::Writer::EndSection() {
+  Section& section = sections_.back();
+  section.size = writer_->offset - section.offset;
+  section.crc = writer_->crc;
+  in_section_ = false;
+}
+
+void IvfPqSectionedFile::Writer::Finish() {
+  if (in_section_) {
+    EndSection();
+  }
+
+  faiss::IOWriter* f = writer_.get();
+  uint64_t toc_offset = writer_->offset;
+  uint32_t num_sections = sections_.size();
+  writer_->crc = 0;
+  WRITEANDCHECK(sections_.data(), sections_.size());
+  uint32_t toc_crc = writer_->crc;
+
+  uint32_t version = kVersion;
+  uint32_t magic = Magic();
+  WRITE1(toc_offset);
+  WRITE1(num_sections);
+  WRITE1(toc_crc);
+  WRITE1(version);
+  WRITE1(magic);
+}
+
+IvfPqSectionedFile::Reader::Reader(faiss::IOReader* f) : f_(f) {
+  size_t file_size = ReaderSize(f);
+  FAISS_THROW_IF_NOT_FMT(file_size >= kHeadSize + kFooterSize,
+                         "%s is too small to be a sectioned file: %zu bytes", f->name.c_str(),
+                         file_size);
+  size_t footer_offset = file_size - kFooterSize;
+  SeekReader(f, footer_offset);
+
+  uint64_t toc_offset;
+  uint32_t num_sections;
+  uint32_t toc_crc;
+  uint32_t magic;
+  READ1(toc_offset);
+  READ1(num_sections);
+  READ1(toc_crc);
+  READ1(version_);
+  READ1(magic);
+  FAISS_THROW_IF_NOT_FMT(magic == Magic(), "%s is not a sectioned file, footer magic %s",
+                         f->name.c_str(), faiss::fourcc_inv_printable(magic).c_str());
+  FAISS_THROW_IF_NOT_FMT(version_ >= 1 && version_ <= kVersion,
+                         "unsupported sectioned file version %u of %s", version_,
+                         f->name.c_str());
+  FAISS_THROW_IF_NOT_FMT(toc_offset >= kHeadSize &&
+                             toc_offset + num_sections * sizeof(Section) == footer_offset,
+                         "corrupted toc of %s", f->name.c_str());
+
+  SeekReader(f, toc_offset);
+  sections_.resize(num_sections);
+  READANDCHECK(sections_.data(), sections_.size());
+  uint32_t crc = Crc32c(sections_.data(), num_sections * sizeof(Section));
+  FAISS_THROW_IF_NOT_FMT(crc == toc_crc, "checksum mismatch of the toc of %s: %08x, expected %08x",
+                         f->name.c_str(), crc, toc_crc);
+  for (const auto& section : sections_) {
+    FAISS_THROW_IF_NOT_FMT(section.offset >= kHeadSize && section.offset <= toc_offset &&
+                               section.size <= toc_offset - section.offset,
+                           "section %u of %s out of bounds", section.type, f->name.c_str());
+  }
+}
+
+const IvfPqSectionedFile::Section* IvfPqSectionedFile::Reader::Find(IvfPqSection type) const {
+  for (const auto& section : sections_) {
+    if (section.type == type) {
+      return &section;
+    }
+  }
+  return nullptr;
+}
+
+const IvfPqSectionedFile::Section& IvfPqSectionedFile::Reader::Get(IvfPqSection type) const {
+  const Section* section = Find(type);
+  FAISS_THROW_IF_NOT_FMT(section != nullptr, "section %u missing in %s", type, f_->name.c_str());
+  return *section;
+}
+
+std::unique_ptr<faiss::IOReader> IvfPqSectionedFile::Reader::OpenSection(
+    IvfPqSection type, bool verify, faiss::IOReader* handle) const {
+  handle = handle != nullptr ? handle : f_;
+  const Section& section = Get(type);
+  SeekReader(handle, section.offset);
+  return std::make_unique<SectionReader>(handle, section, verify);
+}
+
+void IvfPqSectionedFile::Reader::SeekTo(IvfPqSection type, faiss::IOReader* handle) const {
+  SeekReader(handle != nullptr ? handle : f_, Get(type).offset);
+}
+
+std::unique_ptr<faiss::IOReader> IvfPqSectionedFile::Reader::Reopen() const {
+  if (auto* reader = dynamic_cast<SourceIOReader*>(f_)) {
+    return std::make_unique<SourceIOReader>(reader->source());
+  }
+  // opens the file by name and closes it on destruction
+  return std::make_unique<faiss::FileIOReader>(f_->name.c_str());
+}
+
+}  // namespace tenann
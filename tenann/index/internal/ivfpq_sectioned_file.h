@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "faiss/impl/io.h"
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+/// Sections of a tenann sectioned ivfpq file, the values are persisted.
+enum IvfPqSection : uint32_t {
+  // IndexPreTransform chain if any, index header, ivf and pq scalars, range_search_confidence
+  kIvfPqPreamble = 1,
+  kIvfPqQuantizer = 2,             // coarse quantizer written by faiss::write_index
+  kIvfPqCodebook = 3,              // faiss::ProductQuantizer
+  kIvfPqListDirectory = 4,         // SplitInvertedLists header: list sizes and id offsets
+  kIvfPqListData = 5,              // SplitInvertedLists codes region followed by the ids region
+  kIvfPqReconstructionErrors = 6,  // IndexIvfPq::reconstruction_errors
+  kIvfPqPrecomputedTable = 7,      // optional, IvfPqPrecomputedTable
+};
+
+/**
+ * @brief Versioned container of an ivfpq index, made of independent sections located by a table
+ * of contents at the end of the file.
+ *
+ * Layout:
+ *   magic, version,
+ *   section 0 .. section n-1,
+ *   toc: Section[n],
+ *   footer: toc offset, n, toc checksum, version, magic
+ *
+ * Every section and the toc carry a CRC-32C checksum. Opening a file reads the footer and the toc
+ * only, a reader then reads the sections it needs in any order, e.g. block cache reads the list
+ * directory and leaves the list data on disk.
+ */
+class IvfPqSectionedFile {
+ public:
+  struct Section {
+    uint32_t type;
+    uint32_t crc;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  static constexpr uint32_t kVersion = 1;
+  /// toc offset, number of sections, toc checksum, version and magic
+  static constexpr size_t kFooterSize = 24;
+
+  /// Magic number at both ends of the file, "TnPQ".
+  static uint32_t Magic();
+
+  /// Writes the sections one after another, the stream is never sought.
+  class Writer {
+   public:
+    /// Write the file head to [f], which must outlive the writer.
+    explicit Writer(faiss::IOWriter* f);
+    ~Writer();
+
+    T_FORBID_COPY_AND_ASSIGN(Writer);
+    T_FORBID_MOVE(Writer);
+
+    /// Start section [type], ending the previous one. The bytes written to the returned writer
+    /// until the next call belong to the section.
+    faiss::IOWriter* BeginSection(IvfPqSection type);
+
+    /// End the last section and write the toc and the footer.
+    void Finish();
+
+   private:
+    class SectionWriter;
+
+    void EndSection();
+
+    std::unique_ptr<SectionWriter> writer_;
+    std::vector<Section> sections_;
+    bool in_section_ = false;
+  };
+
+  /// Reads the toc of a file, then the sections on demand.
+  class Reader {
+   public:
+    /// Read the footer and the toc of the file read by [f], which must be a `FileIOReader` or a
+    /// `SourceIOReader` and outlive the reader. Throw if the file is not a sectioned file.
+    explicit Reader(faiss::IOReader* f);
+
+    /// Whether the file contains the [type] section.
+    bool Has(IvfPqSection type) const { return Find(type) != nullptr; }
+
+    /// The [type] section, throw if missing.
+    const Section& Get(IvfPqSection type) const;
+
+    /**
+     * @brief Reader over the bytes of section [type], throw if missing.
+     *
+     * The checksum is verified once the last byte of the section is read if [verify]. The
+     * section readers share [f] unless another [handle] from `Reopen` is given, so read one
+     * section at a time per handle.
+     */
+    std::unique_ptr<faiss::IOReader> OpenSection(IvfPqSection type, bool verify,
+                                                 faiss::IOReader* handle = nullptr) const;
+
+    /// Position [handle], [f] by default, at the start of section [type], for readers that read
+    /// the handle directly.
+    void SeekTo(IvfPqSection type, faiss::IOReader* handle = nullptr) const;
+
+    /// Another handle of the file, so that sections can be read concurrently.
+    std::unique_ptr<faiss::IOReader> Reopen() const;
+
+    uint32_t version() const { return version_; }
+    const std::vector<Section>& sections() const { return sections_; }
+
+   private:
+    const Section* Find(IvfPqSection type) const;
+
+    faiss::IOReader* f_;
+    uint32_t version_ = 0;
+    std::vector<Section> sections_;
+  };
+};
+
+}  // namespace tenann
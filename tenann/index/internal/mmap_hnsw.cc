@@ -0,0 +1,542 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/mmap_hnsw.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <tuple>
+
+#include "faiss/IndexFlat.h"
+#include "faiss/IndexHNSW.h"
+#include "faiss/IndexIDMap.h"
+#include "faiss/IndexPreTransform.h"
+#include "faiss/VectorTransform.h"
+#include "faiss/impl/AuxIndexStructures.h"
+#include "faiss/impl/io.h"
+#include "faiss/utils/Heap.h"
+#include "faiss/utils/distances.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/tombstone.h"
+#include "tenann/util/defer.h"
+
+namespace tenann {
+
+static_assert(sizeof(MmapHnswFileHeader) <= MmapHnsw::kPageSize,
+              "the header of mmap hnsw must fit in the first page");
+static_assert(sizeof(size_t) == sizeof(uint64_t), "hnsw offsets are persisted as uint64_t");
+
+namespace {
+
+using storage_idx_t = MmapHnsw::storage_idx_t;
+
+inline size_t AlignUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+/// L2 distance between the query and a vector in the mapped storage.
+struct MmapL2Distance {
+  const float* q;
+  const float* storage;
+  size_t d;
+
+  float operator()(storage_idx_t i) const { return faiss::fvec_L2sqr(q, storage + i * d, d); }
+};
+
+/// Negative inner product, so that a smaller distance always means a closer vector.
+struct MmapNegativeInnerProduct {
+  const float* q;
+  const float* storage;
+  size_t d;
+
+  float operator()(storage_idx_t i) const {
+    return -faiss::fvec_inner_product(q, storage + i * d, d);
+  }
+};
+
+void WriteOrThrow(FILE* file, const void* data, size_t size, const std::string& path) {
+  if (size == 0) return;
+  size_t written = fwrite(data, 1, size, file);
+  T_LOG_IF(ERROR, written != size)
+      << "write error in " << path << ": " << written << " != " << size << " ("
+      << strerror(errno) << ")";
+}
+
+void PadToOrThrow(FILE* file, size_t from, size_t to, const std::string& path) {
+  static const char kZeros[MmapHnsw::kPageSize] = {0};
+  while (from < to) {
+    size_t n = std::min(to - from, sizeof(kZeros));
+    WriteOrThrow(file, kZeros, n, path);
+    from += n;
+  }
+}
+
+/// Unpack a faiss HNSW index into its id map, HNSW index and flat storage, and whether the query
+/// is normalized. Throw if the index cannot be searched with the mmap layout.
+std::tuple<const faiss::IndexIDMap*, const faiss::IndexHNSW*, const faiss::IndexFlat*, bool>
+UnpackSupportedHnsw(const faiss::Index* index) {
+  auto [id_map, transform, index_hnsw] = faiss_util::UnpackHnsw(index);
+
+  bool normalize_query = false;
+  if (transform != nullptr) {
+    T_CHECK(transform->chain.size() == 1 &&
+            dynamic_cast<const faiss::NormalizationTransform*>(transform->chain[0]) != nullptr)
+        << "mmap hnsw only supports the `L2Norm` pre-transform";
+    normalize_query = true;
+  }
+
+  auto* storage = dynamic_cast<const faiss::IndexFlat*>(index_hnsw->storage);
+  T_CHECK(storage != nullptr) << "mmap hnsw only supports flat storage";
+  T_CHECK(index_hnsw->metric_type == faiss::METRIC_L2 ||
+          index_hnsw->metric_type == faiss::METRIC_INNER_PRODUCT)
+      << "mmap hnsw only supports l2 distance and inner product";
+  return std::make_tuple(id_map, index_hnsw, storage, normalize_query);
+}
+
+}  // namespace
+
+MmapHnsw::~MmapHnsw() {
+  if (mapped_addr_ != nullptr) {
+    munmap(mapped_addr_, mapped_size_);
+  }
+}
+
+uint32_t MmapHnsw::Magic() { return faiss::fourcc("THnM"); }
+
+bool MmapHnsw::IsMmapHnswFile(const std::string& path) {
+  auto file = fopen(path.c_str(), "rb");
+  if (file == nullptr) return false;
+  Defer defer([file]() { fclose(file); });
+
+  uint32_t magic = 0;
+  return fread(&magic, sizeof(magic), 1, file) == 1 && magic == Magic();
+}
+
+std::unique_ptr<MmapHnsw> MmapHnsw::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  T_LOG_IF(ERROR, fd == -1) << "could not open [" << path << "] for reading: " << strerror(errno);
+  // the mapping stays valid after the file descriptor is closed
+  Defer defer([fd]() { close(fd); });
+
+  struct stat buf;
+  T_LOG_IF(ERROR, fstat(fd, &buf) != 0) << "fstat [" << path << "] failed: " << strerror(errno);
+  size_t file_size = buf.st_size;
+  T_LOG_IF(ERROR, file_size < kPageSize)
+      << "[" << path << "] is too small to be a tenann mmap hnsw file: " << file_size;
+
+  void* addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  T_LOG_IF(ERROR, addr == MAP_FAILED) << "mmap [" << path << "] failed: " << strerror(errno);
+
+  std::unique_ptr<MmapHnsw> index(new MmapHnsw());
+  index->path_ = path;
+  index->mapped_addr_ = addr;
+  index->mapped_size_ = file_size;
+
+  const auto* header = static_cast<const MmapHnswFileHeader*>(addr);
+  T_LOG_IF(ERROR, header->magic != Magic())
+      << "[" << path << "] is not a tenann mmap hnsw file, got magic number "
+      << faiss::fourcc_inv_printable(header->magic);
+  T_LOG_IF(ERROR, header->version != kVersion)
+      << "unsupported mmap hnsw version " << header->version << " in [" << path << "], expect "
+      << kVersion;
+
+  for (int i = 0; i < kMmapHnswNumSections; i++) {
+    const auto& section = header->sections[i];
+    T_LOG_IF(ERROR, section.offset % kPageSize != 0 || section.offset < kPageSize ||
+                        section.offset + section.size > file_size)
+        << "section " << i << " of [" << path << "] is broken, offset: " << section.offset
+        << ", size: " << section.size << ", file size: " << file_size;
+  }
+
+  const auto* base = static_cast<const uint8_t*>(addr);
+  auto section_ptr = [&](MmapHnswSection section) {
+    return base + header->sections[section].offset;
+  };
+  auto section_size = [&](MmapHnswSection section) { return header->sections[section].size; };
+
+  index->d_ = header->d;
+  index->ntotal_ = header->ntotal;
+  index->metric_type_ = static_cast<faiss::MetricType>(header->metric_type);
+  index->normalize_query_ = header->normalize_query != 0;
+  index->entry_point_ = header->entry_point;
+  index->max_level_ = header->max_level;
+  index->efSearch_ = header->efSearch;
+  index->check_relative_distance_ = header->check_relative_distance != 0;
+
+  T_LOG_IF(ERROR, index->metric_type_ != faiss::METRIC_L2 &&
+                      index->metric_type_ != faiss::METRIC_INNER_PRODUCT)
+      << "unsupported metric type of mmap hnsw: " << header->metric_type;
+
+  size_t ntotal = index->ntotal_;
+  T_LOG_IF(ERROR,
+           section_size(kMmapHnswCumNeighbors) < (index->max_level_ + 2) * sizeof(int32_t) ||
+               section_size(kMmapHnswLevels) != ntotal * sizeof(int32_t) ||
+               section_size(kMmapHnswOffsets) != (ntotal + 1) * sizeof(uint64_t) ||
+               section_size(kMmapHnswStorage) != ntotal * index->d_ * sizeof(float) ||
+               (section_size(kMmapHnswIdMap) != 0 &&
+                section_size(kMmapHnswIdMap) != ntotal * sizeof(idx_t)))
+      << "section sizes of [" << path << "] do not match ntotal " << ntotal << " and d "
+      << index->d_;
+
+  index->cum_nneighbor_per_level_ =
+      reinterpret_cast<const int32_t*>(section_ptr(kMmapHnswCumNeighbors));
+  index->levels_ = reinterpret_cast<const int32_t*>(section_ptr(kMmapHnswLevels));
+  index->offsets_ = reinterpret_cast<const uint64_t*>(section_ptr(kMmapHnswOffsets));
+  index->neighbors_ = reinterpret_cast<const storage_idx_t*>(section_ptr(kMmapHnswNeighbors));
+  index->storage_ = reinterpret_cast<const float*>(section_ptr(kMmapHnswStorage));
+  if (section_size(kMmapHnswIdMap) != 0) {
+    index->id_map_ = reinterpret_cast<const idx_t*>(section_ptr(kMmapHnswIdMap));
+  }
+
+  T_LOG_IF(ERROR, section_size(kMmapHnswNeighbors) != index->offsets_[ntotal] * sizeof(int32_t))
+      << "neighbor section of [" << path << "] does not match the offsets";
+
+  // graph walks touch pages randomly, readahead only wastes the page cache
+  madvise(addr, file_size, MADV_RANDOM);
+
+  VLOG(VERBOSE_DEBUG) << "mapped hnsw [" << path << "], ntotal: " << ntotal
+                      << ", d: " << index->d_ << ", size: " << file_size;
+  return index;
+}
+
+void MmapHnsw::Write(const faiss::Index* index, const std::string& path) {
+  auto [id_map, index_hnsw, storage, normalize_query] = UnpackSupportedHnsw(index);
+
+  const auto& hnsw = index_hnsw->hnsw;
+  size_t ntotal = index_hnsw->ntotal;
+
+  MmapHnswFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = Magic();
+  header.version = kVersion;
+  header.d = index_hnsw->d;
+  header.metric_type = index_hnsw->metric_type;
+  header.metric_arg = index_hnsw->metric_arg;
+  header.entry_point = hnsw.entry_point;
+  header.max_level = hnsw.max_level;
+  header.efSearch = hnsw.efSearch;
+  header.ntotal = ntotal;
+  header.normalize_query = normalize_query;
+  header.check_relative_distance = hnsw.check_relative_distance;
+
+  const void* section_data[kMmapHnswNumSections] = {
+      hnsw.cum_nneighbor_per_level.data(),
+      hnsw.levels.data(),
+      hnsw.offsets.data(),
+      hnsw.neighbors.data(),
+      storage->get_xb(),
+      id_map != nullptr ? id_map->id_map.data() : nullptr,
+  };
+  size_t section_bytes[kMmapHnswNumSections] = {
+      hnsw.cum_nneighbor_per_level.size() * sizeof(int32_t),
+      hnsw.levels.size() * sizeof(int32_t),
+      hnsw.offsets.size() * sizeof(uint64_t),
+      hnsw.neighbors.size() * sizeof(storage_idx_t),
+      ntotal * index_hnsw->d * sizeof(float),
+      id_map != nullptr ? id_map->id_map.size() * sizeof(idx_t) : 0,
+  };
+
+  size_t offset = kPageSize;
+  for (int i = 0; i < kMmapHnswNumSections; i++) {
+    header.sections[i].offset = offset;
+    header.sections[i].size = section_bytes[i];
+    offset = AlignUp(offset + section_bytes[i], kPageSize);
+  }
+
+  auto file = fopen(path.c_str(), "wb");
+  Defer defer([file]() {
+    if (file != nullptr) fclose(file);
+  });
+  T_LOG_IF(ERROR, file == nullptr)
+      << "could not open [" << path << "] for writing: " << strerror(errno);
+
+  WriteOrThrow(file, &header, sizeof(header), path);
+  PadToOrThrow(file, sizeof(header), kPageSize, path);
+  for (int i = 0; i < kMmapHnswNumSections; i++) {
+    WriteOrThrow(file, section_data[i], section_bytes[i], path);
+    size_t end = header.sections[i].offset + section_bytes[i];
+    PadToOrThrow(file, end, AlignUp(end, kPageSize), path);
+  }
+}
+
+std::unique_ptr<MmapHnsw> MmapHnsw::View(const faiss::Index* index) {
+  auto [id_map, index_hnsw, storage, normalize_query] = UnpackSupportedHnsw(index);
+  const auto& hnsw = index_hnsw->hnsw;
+
+  std::unique_ptr<MmapHnsw> view(new MmapHnsw());
+  view->d_ = index_hnsw->d;
+  view->ntotal_ = index_hnsw->ntotal;
+  view->metric_type_ = index_hnsw->metric_type;
+  view->normalize_query_ = normalize_query;
+  view->entry_point_ = hnsw.entry_point;
+  view->max_level_ = hnsw.max_level;
+  view->efSearch_ = hnsw.efSearch;
+  view->check_relative_distance_ = hnsw.check_relative_distance;
+
+  view->cum_nneighbor_per_level_ = hnsw.cum_nneighbor_per_level.data();
+  view->levels_ = hnsw.levels.data();
+  view->offsets_ = reinterpret_cast<const uint64_t*>(hnsw.offsets.data());
+  view->neighbors_ = hnsw.neighbors.data();
+  view->storage_ = storage->get_xb();
+  if (id_map != nullptr) {
+    view->id_map_ = id_map->id_map.data();
+  }
+  return view;
+}
+
+const float* MmapHnsw::PrepareQuery(const float* x, std::vector<float>* buffer) const {
+  if (!normalize_query_) return x;
+  buffer->assign(x, x + d_);
+  faiss::fvec_renorm_L2(d_, 1, buffer->data());
+  return buffer->data();
+}
+
+bool MmapHnsw::IsResult(storage_idx_t v, const faiss::IDSelector* sel,
+                        const Tombstone* tombstone) const {
+  if (tombstone != nullptr && tombstone->IsDeleted(id_map_ != nullptr ? id_map_[v] : v)) {
+    return false;
+  }
+  return sel == nullptr || sel->is_member(v);
+}
+
+/** Ported from faiss/impl/HNSW.cpp */
+template <typename Distance>
+void MmapHnsw::GreedyUpdateNearest(const Distance& dis, int level, storage_idx_t& nearest,
+                                   float& d_nearest) const {
+  for (;;) {
+    storage_idx_t prev_nearest = nearest;
+
+    size_t begin, end;
+    NeighborRange(nearest, level, &begin, &end);
+    for (size_t i = begin; i < end; i++) {
+      storage_idx_t v = neighbors_[i];
+      if (v < 0) break;
+      float d = dis(v);
+      if (d < d_nearest) {
+        nearest = v;
+        d_nearest = d;
+      }
+    }
+    if (nearest == prev_nearest) {
+      return;
+    }
+  }
+}
+
+/** Ported from faiss::HNSW::search and faiss::HNSW::search_from_candidates */
+template <typename Distance>
+void MmapHnsw::SearchImpl(const Distance& dis, int64_t k, float* D, idx_t* I,
+                          const faiss::SearchParametersHNSW* params) const {
+  int efSearch = params ? params->efSearch : efSearch_;
+  bool do_dis_check = params ? params->check_relative_distance : check_relative_distance_;
+  const faiss::IDSelector* sel = params ? params->sel : nullptr;
+  auto mmap_params = dynamic_cast<const MmapHnswSearchParameters*>(params);
+  const Tombstone* tombstone = mmap_params ? mmap_params->tombstone : nullptr;
+
+  faiss::maxheap_heapify(k, D, I);
+  if (entry_point_ == -1) {
+    return;
+  }
+
+  // greedy search on upper levels
+  storage_idx_t nearest = entry_point_;
+  float d_nearest = dis(nearest);
+  for (int level = max_level_; level >= 1; level--) {
+    GreedyUpdateNearest(dis, level, nearest, d_nearest);
+  }
+
+  int ef = std::max<int64_t>(efSearch, k);
+  faiss::HNSW::MinimaxHeap candidates(ef);
+  candidates.push(nearest, d_nearest);
+  faiss::VisitedTable vt(ntotal_);
+
+  int64_t nres = 0;
+  if (IsResult(nearest, sel, tombstone)) {
+    faiss::maxheap_push(++nres, D, I, d_nearest, nearest);
+  }
+  vt.set(nearest);
+
+  int nstep = 0;
+  while (candidates.size() > 0) {
+    float d0 = 0;
+    int v0 = candidates.pop_min(&d0);
+
+    if (do_dis_check) {
+      // there are more than ef distances processed already that are smaller than d0
+      int n_dis_below = candidates.count_below(d0);
+      if (n_dis_below >= efSearch) {
+        break;
+      }
+    }
+
+    size_t begin, end;
+    NeighborRange(v0, 0, &begin, &end);
+    for (size_t j = begin; j < end; j++) {
+      storage_idx_t v1 = neighbors_[j];
+      if (v1 < 0) break;
+      if (vt.get(v1)) {
+        continue;
+      }
+      vt.set(v1);
+      float d = dis(v1);
+      if (IsResult(v1, sel, tombstone)) {
+        if (nres < k) {
+          faiss::maxheap_push(++nres, D, I, d, v1);
+        } else if (d < D[0]) {
+          faiss::maxheap_replace_top(nres, D, I, d, v1);
+        }
+      }
+      candidates.push(v1, d);
+    }
+
+    nstep++;
+    if (!do_dis_check && nstep > efSearch) {
+      break;
+    }
+  }
+
+  faiss::maxheap_reorder(k, D, I);
+}
+
+/** Ported from HnswRangeSearchFromCandidates in tenann/searcher/faiss_hnsw_ann_searcher.cc */
+template <typename Distance>
+void MmapHnsw::RangeSearchImpl(const Distance& dis, float radius, std::vector<idx_t>* result_ids,
+                               std::vector<float>* result_distances,
+                               const faiss::SearchParametersHNSW* params) const {
+  int efSearch = params ? params->efSearch : efSearch_;
+  const faiss::IDSelector* sel = params ? params->sel : nullptr;
+  auto mmap_params = dynamic_cast<const MmapHnswSearchParameters*>(params);
+  const Tombstone* tombstone = mmap_params ? mmap_params->tombstone : nullptr;
+
+  result_ids->clear();
+  result_distances->clear();
+  if (entry_point_ == -1) {
+    return;
+  }
+
+  storage_idx_t nearest = entry_point_;
+  float d_nearest = dis(nearest);
+  for (int level = max_level_; level >= 1; level--) {
+    GreedyUpdateNearest(dis, level, nearest, d_nearest);
+  }
+
+  faiss::HNSW::MinimaxHeap candidates(efSearch);
+  candidates.push(nearest, d_nearest);
+  faiss::VisitedTable vt(ntotal_);
+
+  std::priority_queue<faiss::HNSW::Node> results;
+  if (IsResult(nearest, sel, tombstone) && d_nearest <= radius) {
+    results.emplace(d_nearest, nearest);
+  }
+  vt.set(nearest);
+
+  int nstep = 0;
+  while (candidates.size() > 0) {
+    float d0 = 0;
+    int v0 = candidates.pop_min(&d0);
+
+    size_t begin, end;
+    NeighborRange(v0, 0, &begin, &end);
+    for (size_t j = begin; j < end; j++) {
+      storage_idx_t v1 = neighbors_[j];
+      if (v1 < 0) break;
+      if (vt.get(v1)) {
+        continue;
+      }
+      vt.set(v1);
+      float d = dis(v1);
+      if (IsResult(v1, sel, tombstone) && d <= radius) {
+        results.emplace(d, v1);
+      }
+      candidates.push(v1, d);
+    }
+
+    nstep++;
+    if (nstep > efSearch) {
+      break;
+    }
+  }
+
+  result_ids->resize(results.size());
+  result_distances->resize(results.size());
+  int64_t i = static_cast<int64_t>(results.size()) - 1;
+  while (!results.empty()) {
+    auto [d, id] = results.top();
+    results.pop();
+    (*result_distances)[i] = d;
+    (*result_ids)[i] = id;
+    i -= 1;
+  }
+}
+
+void MmapHnsw::Search(const float* x, int64_t k, float* distances, idx_t* labels,
+                      const faiss::SearchParametersHNSW* params) const {
+  std::vector<float> buffer;
+  const float* q = PrepareQuery(x, &buffer);
+
+  if (metric_type_ == faiss::METRIC_INNER_PRODUCT) {
+    SearchImpl(MmapNegativeInnerProduct{q, storage_, static_cast<size_t>(d_)}, k, distances,
+               labels, params);
+    for (int64_t i = 0; i < k; i++) {
+      distances[i] = -distances[i];
+    }
+  } else {
+    SearchImpl(MmapL2Distance{q, storage_, static_cast<size_t>(d_)}, k, distances, labels, params);
+  }
+}
+
+void MmapHnsw::RangeSearch(const float* x, float radius, int64_t limit,
+                           std::vector<idx_t>* result_ids, std::vector<float>* result_distances,
+                           const faiss::SearchParametersHNSW* params) const {
+  T_CHECK(metric_type_ == faiss::METRIC_L2) << "mmap hnsw range search only supports l2 distance";
+
+  if (limit > 0) {
+    // search top-ef nearest neighbors first, then perform post filtering based on the distances
+    int64_t efSearch = params ? params->efSearch : efSearch_;
+    int64_t ef = std::max(efSearch, limit);
+    result_ids->resize(ef);
+    result_distances->resize(ef);
+    Search(x, ef, result_distances->data(), result_ids->data(), params);
+
+    int64_t n = 0;
+    while (n < ef && (*result_ids)[n] >= 0 && (*result_distances)[n] <= radius) {
+      n += 1;
+    }
+    auto resize = std::min(n, limit);
+    result_ids->resize(resize);
+    result_distances->resize(resize);
+    return;
+  }
+
+  std::vector<float> buffer;
+  const float* q = PrepareQuery(x, &buffer);
+  RangeSearchImpl(MmapL2Distance{q, storage_, static_cast<size_t>(d_)}, radius, result_ids,
+                  result_distances, params);
+}
+
+}  // namespace tenann
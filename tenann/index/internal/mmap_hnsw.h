@@ -0,0 +1,199 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "faiss/Index.h"
+#include "faiss/impl/HNSW.h"
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+class Tombstone;
+
+/**
+ * @brief Sections of a tenann mmap hnsw file.
+ *
+ * Every section starts at a page-aligned offset so that it can be used in place after the whole
+ * file is mapped into memory.
+ */
+enum MmapHnswSection {
+  kMmapHnswCumNeighbors = 0,  // int32_t[max_level + 2], HNSW::cum_nneighbor_per_level
+  kMmapHnswLevels,            // int32_t[ntotal], HNSW::levels
+  kMmapHnswOffsets,           // uint64_t[ntotal + 1], HNSW::offsets
+  kMmapHnswNeighbors,         // int32_t[offsets[ntotal]], HNSW::neighbors
+  kMmapHnswStorage,           // float[ntotal * d], flat storage
+  kMmapHnswIdMap,             // int64_t[ntotal], IndexIDMap::id_map, empty if no id map
+  kMmapHnswNumSections
+};
+
+struct MmapHnswFileHeader {
+  struct Section {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  int32_t d;
+  int32_t metric_type;
+  float metric_arg;
+  int32_t entry_point;
+  int32_t max_level;
+  int32_t efSearch;
+  int64_t ntotal;
+  uint8_t normalize_query;
+  uint8_t check_relative_distance;
+  uint8_t reserved[6];
+  Section sections[kMmapHnswNumSections];
+};
+
+/// Search parameters of `MmapHnsw`, also accepted by faiss as `faiss::SearchParametersHNSW`.
+struct MmapHnswSearchParameters : faiss::SearchParametersHNSW {
+  /// Deleted rows skipped by the candidate loop, checked before `sel`.
+  const Tombstone* tombstone = nullptr;
+};
+
+/**
+ * @brief A read-only HNSW index that is searched in place on a memory-mapped index file.
+ *
+ * Opening a file only maps it and validates the header, the graph and the vectors are paged in
+ * lazily by the OS, and the OS page cache decides what stays resident.
+ * Only flat storage is supported, optionally wrapped by an `IndexIDMap` and an L2 normalization
+ * pre-transform, which covers every HNSW index built by tenann.
+ */
+class MmapHnsw {
+ public:
+  using idx_t = faiss::Index::idx_t;
+  using storage_idx_t = faiss::HNSW::storage_idx_t;
+
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kPageSize = 4096;
+
+  ~MmapHnsw();
+
+  T_FORBID_COPY_AND_ASSIGN(MmapHnsw);
+  T_FORBID_MOVE(MmapHnsw);
+
+  /// Magic number of the file layout, "THnM".
+  static uint32_t Magic();
+
+  /// Check the magic number of the file at [path] without mapping it.
+  static bool IsMmapHnswFile(const std::string& path);
+
+  /// Map the file at [path] read-only, throw on any format error.
+  static std::unique_ptr<MmapHnsw> Open(const std::string& path);
+
+  /// Write a faiss HNSW index built by tenann to [path] with the mmap layout.
+  static void Write(const faiss::Index* index, const std::string& path);
+
+  /**
+   * @brief View a faiss HNSW index built by tenann in place, so that it is searched by the same
+   * candidate loop as a mapped file.
+   *
+   * The view borrows the graph, the storage and the id map of [index], which must be neither
+   * modified nor freed while the view is in use.
+   */
+  static std::unique_ptr<MmapHnsw> View(const faiss::Index* index);
+
+  /**
+   * @brief Top-k search for a single query, the same semantics as `faiss::IndexHNSW::search`.
+   *
+   * @param x Query vector, which is normalized internally if the index was built with `L2Norm`
+   * @param labels Internal ids, use `id_map()` to translate them to row ids
+   * @param params Either `faiss::SearchParametersHNSW` or `MmapHnswSearchParameters`
+   */
+  void Search(const float* x, int64_t k, float* distances, idx_t* labels,
+              const faiss::SearchParametersHNSW* params = nullptr) const;
+
+  /**
+   * @brief Range search for a single query, the same semantics as the faiss HNSW range search
+   * used by `FaissHnswAnnSearcher`.
+   */
+  void RangeSearch(const float* x, float radius, int64_t limit, std::vector<idx_t>* result_ids,
+                   std::vector<float>* result_distances,
+                   const faiss::SearchParametersHNSW* params = nullptr) const;
+
+  /* getters */
+  int d() const { return d_; }
+  idx_t ntotal() const { return ntotal_; }
+  faiss::MetricType metric_type() const { return metric_type_; }
+  bool normalize_query() const { return normalize_query_; }
+  /// Internal id to row id, nullptr if the index has no id map.
+  const idx_t* id_map() const { return id_map_; }
+  const std::string& path() const { return path_; }
+  size_t mapped_size() const { return mapped_size_; }
+
+ private:
+  MmapHnsw() = default;
+
+  template <typename Distance>
+  void SearchImpl(const Distance& dis, int64_t k, float* distances, idx_t* labels,
+                  const faiss::SearchParametersHNSW* params) const;
+
+  template <typename Distance>
+  void RangeSearchImpl(const Distance& dis, float radius, std::vector<idx_t>* result_ids,
+                       std::vector<float>* result_distances,
+                       const faiss::SearchParametersHNSW* params) const;
+
+  template <typename Distance>
+  void GreedyUpdateNearest(const Distance& dis, int level, storage_idx_t& nearest,
+                           float& d_nearest) const;
+
+  /// Whether [v] may be returned, deleted rows are checked inline before calling [sel].
+  bool IsResult(storage_idx_t v, const faiss::IDSelector* sel, const Tombstone* tombstone) const;
+
+  void NeighborRange(idx_t no, int level, size_t* begin, size_t* end) const {
+    size_t o = offsets_[no];
+    *begin = o + cum_nneighbor_per_level_[level];
+    *end = o + cum_nneighbor_per_level_[level + 1];
+  }
+
+  /// Normalize the query if needed and return the vector to search with.
+  const float* PrepareQuery(const float* x, std::vector<float>* buffer) const;
+
+  std::string path_;
+  void* mapped_addr_ = nullptr;
+  size_t mapped_size_ = 0;
+
+  int d_ = 0;
+  idx_t ntotal_ = 0;
+  faiss::MetricType metric_type_ = faiss::METRIC_L2;
+  bool normalize_query_ = false;
+  storage_idx_t entry_point_ = -1;
+  int max_level_ = 0;
+  int efSearch_ = 16;
+  bool check_relative_distance_ = true;
+
+  /* views over the mapped file */
+  const int32_t* cum_nneighbor_per_level_ = nullptr;
+  const int32_t* levels_ = nullptr;
+  const uint64_t* offsets_ = nullptr;
+  const storage_idx_t* neighbors_ = nullptr;
+  const float* storage_ = nullptr;
+  const idx_t* id_map_ = nullptr;
+};
+
+}  // namespace tenann
@@ -0,0 +1,202 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/split_inverted_lists.h"
+
+#include <memory>
+#include <mutex>
+
+#include "faiss/impl/FaissAssert.h"
+#include "faiss/impl/io_macros.h"
+#include "faiss/index_io.h"
+#include "faiss/invlists/InvertedListsIOHook.h"
+#include "tenann/util/id_codec.h"
+
+namespace tenann {
+
+namespace {
+
+struct SplitInvertedListsIOHook : faiss::InvertedListsIOHook {
+  // lists are never written through the hook, the classname only has to be unique
+  SplitInvertedListsIOHook(const char* key, const char* classname, bool compressed_ids)
+      : InvertedListsIOHook(key, classname), compressed_ids(compressed_ids) {}
+
+  void write(const faiss::InvertedLists* ils, faiss::IOWriter* f) const override {
+    SplitInvertedLists::Write(ils, f, compressed_ids);
+  }
+
+  faiss::InvertedLists* read(faiss::IOReader* f, int /* io_flags */) const override {
+    SplitInvertedLists::Header header;
+    uint32_t h =
+        compressed_ids ? SplitInvertedLists::CompressedIdsFourcc() : SplitInvertedLists::Fourcc();
+    SplitInvertedLists::ReadHeader(f, h, &header);
+    return SplitInvertedLists::ReadLists(f, header);
+  }
+
+  bool compressed_ids;
+};
+
+}  // namespace
+
+uint32_t SplitInvertedLists::Fourcc() { return faiss::fourcc("ilsp"); }
+
+uint32_t SplitInvertedLists::CompressedIdsFourcc() { return faiss::fourcc("ilsc"); }
+
+void SplitInvertedLists::Write(const faiss::InvertedLists* ils, faiss::IOWriter* f,
+                               bool compress_ids) {
+  std::vector<uint8_t> encoded_ids;
+  Header header = MakeHeader(ils, compress_ids, &encoded_ids);
+  WriteHeader(header, f);
+  WriteLists(ils, header, encoded_ids, f);
+}
+
+SplitInvertedLists::Header SplitInvertedLists::MakeHeader(const faiss::InvertedLists* ils,
+                                                          bool compress_ids,
+                                                          std::vector<uint8_t>* encoded_ids) {
+  Header header;
+  header.nlist = ils->nlist;
+  header.code_size = ils->code_size;
+  header.compressed_ids = compress_ids;
+  header.sizes.resize(ils->nlist);
+  for (size_t i = 0; i < ils->nlist; i++) {
+    header.sizes[i] = ils->list_size(i);
+  }
+
+  // encode the ids up front, the header records where each list starts
+  header.id_offsets.resize(ils->nlist + 1, 0);
+  encoded_ids->clear();
+  for (size_t i = 0; i < ils->nlist; i++) {
+    if (!compress_ids) {
+      header.id_offsets[i + 1] =
+          header.id_offsets[i] + header.sizes[i] * sizeof(faiss::Index::idx_t);
+      continue;
+    }
+    header.id_offsets[i] = encoded_ids->size();
+    if (header.sizes[i] > 0) {
+      faiss::InvertedLists::ScopedIds ids(ils, i);
+      IdCodec::Encode(ids.get(), header.sizes[i], encoded_ids);
+    } else {
+      IdCodec::Encode(nullptr, 0, encoded_ids);
+    }
+  }
+  if (compress_ids) {
+    header.id_offsets[ils->nlist] = encoded_ids->size();
+  }
+  return header;
+}
+
+void SplitInvertedLists::WriteHeader(const Header& header, faiss::IOWriter* f) {
+  uint32_t h = header.compressed_ids ? CompressedIdsFourcc() : Fourcc();
+  WRITE1(h);
+  WRITE1(header.nlist);
+  WRITE1(header.code_size);
+  uint32_t list_type = faiss::fourcc("full");
+  WRITE1(list_type);
+  WRITEVECTOR(header.sizes);
+  if (header.compressed_ids) {
+    WRITEVECTOR(header.id_offsets);
+  }
+}
+
+void SplitInvertedLists::WriteLists(const faiss::InvertedLists* ils, const Header& header,
+                                    const std::vector<uint8_t>& encoded_ids,
+                                    faiss::IOWriter* f) {
+  for (size_t i = 0; i < header.nlist; i++) {
+    if (header.sizes[i] > 0) {
+      faiss::InvertedLists::ScopedCodes codes(ils, i);
+      WRITEANDCHECK(codes.get(), header.sizes[i] * header.code_size);
+    }
+  }
+  if (header.compressed_ids) {
+    WRITEANDCHECK(encoded_ids.data(), encoded_ids.size());
+    return;
+  }
+  for (size_t i = 0; i < header.nlist; i++) {
+    if (header.sizes[i] > 0) {
+      faiss::InvertedLists::ScopedIds ids(ils, i);
+      WRITEANDCHECK(ids.get(), header.sizes[i]);
+    }
+  }
+}
+
+void SplitInvertedLists::ReadHeader(faiss::IOReader* f, uint32_t h, Header* header) {
+  FAISS_THROW_IF_NOT_FMT(h == Fourcc() || h == CompressedIdsFourcc(),
+                         "fourcc %ud is not a split inverted lists layout", h);
+  READ1(header->nlist);
+  READ1(header->code_size);
+  uint32_t list_type;
+  READ1(list_type);
+  FAISS_THROW_IF_NOT_FMT(list_type == faiss::fourcc("full"), "list_type %ud not recognized",
+                         list_type);
+  READVECTOR(header->sizes);
+  FAISS_THROW_IF_NOT(header->sizes.size() == header->nlist);
+
+  header->compressed_ids = h == CompressedIdsFourcc();
+  if (header->compressed_ids) {
+    READVECTOR(header->id_offsets);
+    FAISS_THROW_IF_NOT(header->id_offsets.size() == header->nlist + 1);
+    for (size_t i = 0; i < header->nlist; i++) {
+      FAISS_THROW_IF_NOT(header->id_offsets[i] < header->id_offsets[i + 1]);
+    }
+  } else {
+    header->id_offsets.resize(header->nlist + 1);
+    header->id_offsets[0] = 0;
+    for (size_t i = 0; i < header->nlist; i++) {
+      header->id_offsets[i + 1] =
+          header->id_offsets[i] + header->sizes[i] * sizeof(faiss::Index::idx_t);
+    }
+  }
+}
+
+faiss::ArrayInvertedLists* SplitInvertedLists::ReadLists(faiss::IOReader* f,
+                                                         const Header& header) {
+  size_t nlist = header.nlist;
+  auto ails = std::make_unique<faiss::ArrayInvertedLists>(nlist, header.code_size);
+  for (size_t i = 0; i < nlist; i++) {
+    ails->codes[i].resize(header.sizes[i] * header.code_size);
+    READANDCHECK(ails->codes[i].data(), ails->codes[i].size());
+  }
+  if (!header.compressed_ids) {
+    for (size_t i = 0; i < nlist; i++) {
+      ails->ids[i].resize(header.sizes[i]);
+      READANDCHECK(ails->ids[i].data(), ails->ids[i].size());
+    }
+    return ails.release();
+  }
+
+  std::vector<uint8_t> encoded(header.id_offsets[nlist]);
+  READANDCHECK(encoded.data(), encoded.size());
+  for (size_t i = 0; i < nlist; i++) {
+    ails->ids[i].resize(header.sizes[i]);
+    IdCodec::Decode(encoded.data() + header.id_offsets[i], header.sizes[i], ails->ids[i].data());
+  }
+  return ails.release();
+}
+
+void SplitInvertedLists::RegisterIOHook() {
+  static std::once_flag registered;
+  std::call_once(registered, []() {
+    faiss::InvertedListsIOHook::add_callback(
+        new SplitInvertedListsIOHook("ilsp", "tenann::SplitInvertedLists", false));
+    faiss::InvertedListsIOHook::add_callback(
+        new SplitInvertedListsIOHook("ilsc", "tenann::SplitInvertedLists::CompressedIds", true));
+  });
+}
+
+}  // namespace tenann
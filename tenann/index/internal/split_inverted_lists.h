@@ -0,0 +1,91 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "faiss/impl/io.h"
+#include "faiss/invlists/InvertedLists.h"
+
+namespace tenann {
+
+/**
+ * @brief Inverted lists layout storing the codes and the ids of all lists in separate regions.
+ *
+ * Layout after the "ilsp" fourcc:
+ *   nlist, code_size, "full", sizes[nlist],
+ *   codes of list 0 .. codes of list nlist-1,
+ *   ids of list 0 .. ids of list nlist-1
+ *
+ * The "ilsc" variant stores the ids of each list encoded by `IdCodec`:
+ *   nlist, code_size, "full", sizes[nlist], id_offsets[nlist + 1],
+ *   codes of list 0 .. codes of list nlist-1,
+ *   encoded ids of list 0 .. encoded ids of list nlist-1
+ * where id_offsets are the byte offsets of the encoded lists in the ids region.
+ *
+ * A scan reads only the codes region and looks up the ids of the results afterwards, which saves
+ * the cache memory and the io spent on ids with block cache.
+ */
+struct SplitInvertedLists {
+  struct Header {
+    size_t nlist = 0;
+    size_t code_size = 0;
+    std::vector<size_t> sizes;
+    /// The ids are encoded by `IdCodec`
+    bool compressed_ids = false;
+    /// Byte offsets of the ids of each list in the ids region, nlist + 1 entries
+    std::vector<size_t> id_offsets;
+  };
+
+  /// Fourcc of the layout, "ilsp".
+  static uint32_t Fourcc();
+
+  /// Fourcc of the layout with compressed ids, "ilsc".
+  static uint32_t CompressedIdsFourcc();
+
+  /// Write [ils] with the split layout, fourcc included, encoding the ids if [compress_ids].
+  static void Write(const faiss::InvertedLists* ils, faiss::IOWriter* f,
+                    bool compress_ids = false);
+
+  /// The header of [ils], the ids are encoded into [encoded_ids] if [compress_ids].
+  static Header MakeHeader(const faiss::InvertedLists* ils, bool compress_ids,
+                           std::vector<uint8_t>* encoded_ids);
+
+  /// Write [header], fourcc included.
+  static void WriteHeader(const Header& header, faiss::IOWriter* f);
+
+  /// Write the codes region and the ids region of [ils] described by [header].
+  static void WriteLists(const faiss::InvertedLists* ils, const Header& header,
+                         const std::vector<uint8_t>& encoded_ids, faiss::IOWriter* f);
+
+  /// Read the header following the fourcc [h], the codes region starts right after it.
+  static void ReadHeader(faiss::IOReader* f, uint32_t h, Header* header);
+
+  /// Read the codes region and the ids region described by [header].
+  static faiss::ArrayInvertedLists* ReadLists(faiss::IOReader* f, const Header& header);
+
+  /// Register the io hooks reading both layouts into `faiss::ArrayInvertedLists`, so that faiss
+  /// reads these lists as well. Idempotent.
+  static void RegisterIOHook();
+};
+
+}  // namespace tenann
@@ -0,0 +1,196 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/index/internal/tombstone.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "faiss/impl/io.h"
+#include "tenann/common/logging.h"
+#include "tenann/util/defer.h"
+#include "tenann/util/memory_usage.h"
+
+namespace tenann {
+
+namespace {
+
+struct TombstoneFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t num_deleted;
+  /// Number of words of the bitmap, followed by the sparse row ids.
+  uint64_t num_words;
+  uint64_t num_sparse_ids;
+};
+
+}  // namespace
+
+std::string Tombstone::PathOf(const std::string& index_path) { return index_path + kFileSuffix; }
+
+uint32_t Tombstone::Magic() { return faiss::fourcc("TDel"); }
+
+std::unique_ptr<Tombstone> Tombstone::Load(const std::string& path) {
+  auto file = fopen(path.c_str(), "rb");
+  Defer defer([file]() {
+    if (file != nullptr) fclose(file);
+  });
+  if (file == nullptr) {
+    T_LOG_IF(ERROR, errno != ENOENT)
+        << "could not open [" << path << "] for reading: " << strerror(errno);
+    return nullptr;
+  }
+
+  TombstoneFileHeader header;
+  T_LOG_IF(ERROR, fread(&header, sizeof(header), 1, file) != 1)
+      << "failed to read the header of tombstone file [" << path << "]";
+  T_LOG_IF(ERROR, header.magic != Magic()) << "[" << path << "] is not a tombstone file";
+  T_LOG_IF(ERROR, header.version != kVersion)
+      << "unsupported tombstone file version: " << header.version;
+
+  auto tombstone = std::make_unique<Tombstone>();
+  tombstone->words_.resize(header.num_words);
+  std::vector<int64_t> sparse_ids(header.num_sparse_ids);
+  T_LOG_IF(ERROR, fread(tombstone->words_.data(), sizeof(uint64_t), header.num_words, file) !=
+                          header.num_words ||
+                      fread(sparse_ids.data(), sizeof(int64_t), sparse_ids.size(), file) !=
+                          sparse_ids.size())
+      << "tombstone file [" << path << "] is truncated";
+  tombstone->sparse_ids_.insert(sparse_ids.begin(), sparse_ids.end());
+  tombstone->num_deleted_ = header.num_deleted;
+  return tombstone;
+}
+
+void Tombstone::Save(const std::string& path) const {
+  std::vector<int64_t> sparse_ids(sparse_ids_.begin(), sparse_ids_.end());
+  // the index file still holds the replaced entries of the rows inserted again
+  auto words = words_;
+  size_t num_deleted = num_deleted_;
+  for (auto row_id : undeleted_ids_) {
+    if (IsDeleted(row_id)) continue;
+    auto word = static_cast<uint64_t>(row_id) >> 6;
+    if (word < words.size()) {
+      words[word] |= uint64_t(1) << (row_id & 63);
+    } else {
+      sparse_ids.push_back(row_id);
+    }
+    num_deleted++;
+  }
+  std::sort(sparse_ids.begin(), sparse_ids.end());
+
+  auto tmp_path = path + ".tmp";
+  {
+    auto file = fopen(tmp_path.c_str(), "wb");
+    Defer defer([file]() {
+      if (file != nullptr) fclose(file);
+    });
+    T_LOG_IF(ERROR, file == nullptr)
+        << "could not open [" << tmp_path << "] for writing: " << strerror(errno);
+
+    TombstoneFileHeader header{Magic(), kVersion, num_deleted, words.size(), sparse_ids.size()};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(words.data(), sizeof(uint64_t), words.size(), file) == words.size() &&
+              fwrite(sparse_ids.data(), sizeof(int64_t), sparse_ids.size(), file) ==
+                  sparse_ids.size() &&
+              fflush(file) == 0;
+    T_LOG_IF(ERROR, !ok) << "write error in " << tmp_path << ": " << strerror(errno);
+  }
+
+  T_LOG_IF(ERROR, rename(tmp_path.c_str(), path.c_str()) != 0)
+      << "failed to rename [" << tmp_path << "] to [" << path << "]: " << strerror(errno);
+}
+
+bool Tombstone::ReserveBitmap(size_t word) {
+  if (word < words_.size()) {
+    return true;
+  }
+  size_t max_words = std::max(kMinBitmapWords, kMaxBitmapWordsPerRow * (num_deleted_ + 1));
+  if (word >= max_words) {
+    return false;
+  }
+
+  // grow geometrically to amortize deletes with increasing row ids
+  words_.resize(std::min(std::max(word + 1, words_.size() * 2), max_words), 0);
+  for (auto it = sparse_ids_.begin(); it != sparse_ids_.end();) {
+    auto id_word = static_cast<uint64_t>(*it) >> 6;
+    if (id_word < words_.size()) {
+      words_[id_word] |= uint64_t(1) << (*it & 63);
+      it = sparse_ids_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return true;
+}
+
+bool Tombstone::Delete(int64_t row_id) {
+  T_CHECK_GE(row_id, 0) << "invalid row id";
+  if (IsDeleted(row_id)) {
+    return false;
+  }
+
+  auto word = static_cast<uint64_t>(row_id) >> 6;
+  if (ReserveBitmap(word)) {
+    words_[word] |= uint64_t(1) << (row_id & 63);
+  } else {
+    sparse_ids_.insert(row_id);
+  }
+  num_deleted_ += 1;
+  return true;
+}
+
+bool Tombstone::Undelete(int64_t row_id) {
+  if (row_id < 0 || !IsDeleted(row_id)) {
+    return false;
+  }
+  auto word = static_cast<uint64_t>(row_id) >> 6;
+  if (word < words_.size()) {
+    words_[word] &= ~(uint64_t(1) << (row_id & 63));
+  } else {
+    sparse_ids_.erase(row_id);
+  }
+  num_deleted_ -= 1;
+  undeleted_ids_.insert(row_id);
+  return true;
+}
+
+void Tombstone::Clear() {
+  std::fill(words_.begin(), words_.end(), 0);
+  sparse_ids_.clear();
+  num_deleted_ = 0;
+  undeleted_ids_.clear();
+  num_replaced_entries_ = 0;
+}
+
+size_t Tombstone::memory_usage() const {
+  size_t usage = AllocationSize(sizeof(*this)) +
+                 AllocationSize(words_.capacity() * sizeof(uint64_t));
+  for (const auto* ids : {&sparse_ids_, &undeleted_ids_}) {
+    // a node of a hash set holds the next pointer and the id
+    usage += ids->size() * AllocationSize(sizeof(void*) + sizeof(int64_t));
+    if (!ids->empty()) {
+      usage += AllocationSize(ids->bucket_count() * sizeof(void*));
+    }
+  }
+  return usage;
+}
+
+}  // namespace tenann
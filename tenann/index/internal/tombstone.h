@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+/**
+ * @brief The deleted row ids of an index, persisted beside the index file as `<index path>.del`.
+ *
+ * Searches skip the deleted rows until consolidation drops them from the index. Small row ids are
+ * marked in a bitmap, which only grows as long as it stays small relative to the number of
+ * deleted rows, the larger ones, e.g. sparse custom row ids, are kept in a hash set.
+ *
+ * Not thread-safe. The tombstone is only modified by the writers of the owner index, which are
+ * serialized by `Index::write_mutex()` and hold `Index::rw_lock()` exclusively while modifying
+ * it, so that it can be saved by the writer without blocking searches.
+ */
+class Tombstone {
+ public:
+  static constexpr uint32_t kVersion = 2;
+  static constexpr const char* kFileSuffix = ".del";
+  /// Row id given to the entries of an index replaced by an insert with the same row id, always
+  /// deleted, see `Undelete`.
+  static constexpr int64_t kReplacedRowId = -2;
+
+  Tombstone() = default;
+  ~Tombstone() = default;
+
+  T_FORBID_COPY_AND_ASSIGN(Tombstone);
+  T_FORBID_MOVE(Tombstone);
+
+  /// Path of the tombstone file of the index file at [index_path].
+  static std::string PathOf(const std::string& index_path);
+
+  /// Magic number of the file layout, "TDel".
+  static uint32_t Magic();
+
+  /// Read the tombstone file at [path], return nullptr if it does not exist.
+  static std::unique_ptr<Tombstone> Load(const std::string& path);
+
+  /// Write the tombstone to [path] atomically through a temporary file.
+  void Save(const std::string& path) const;
+
+  /// Mark [row_id] as deleted, return false if it has been deleted before.
+  bool Delete(int64_t row_id);
+
+  /**
+   * @brief Unmark [row_id] when it is inserted again, return false if it is not deleted.
+   *
+   * The caller relabels the entries of the index that hold [row_id] to `kReplacedRowId` and
+   * reports them with `AddReplacedEntries`, so that they stay deleted while the inserted entry is
+   * searched. [row_id] is still saved as deleted until the next `Clear`, since the inserted entry
+   * is only written to the index file by consolidation.
+   */
+  bool Undelete(int64_t row_id);
+
+  /// Count [num_entries] entries relabeled to `kReplacedRowId`, which are dropped by consolidation.
+  void AddReplacedEntries(size_t num_entries) { num_replaced_entries_ += num_entries; }
+
+  bool IsDeleted(int64_t row_id) const {
+    auto word = static_cast<uint64_t>(row_id) >> 6;
+    if (word < words_.size()) {
+      return words_[word] >> (row_id & 63) & 1;
+    }
+    if (row_id < 0) {
+      return row_id == kReplacedRowId;
+    }
+    return !sparse_ids_.empty() && sparse_ids_.count(row_id) > 0;
+  }
+
+  /// Unmark all rows after consolidation has dropped them from the index, so that their row ids
+  /// can be inserted again.
+  void Clear();
+
+  /* getters */
+  /// Number of entries to be dropped by consolidation, i.e. the marked rows and the replaced
+  /// entries.
+  size_t num_deleted() const { return num_deleted_ + num_replaced_entries_; }
+
+  /// Heap memory held by the bitmap and the hash sets, see `AllocationSize`.
+  size_t memory_usage() const;
+  bool empty() const { return num_deleted_ == 0 && num_replaced_entries_ == 0; }
+
+ private:
+  /// The bitmap is always allowed to grow up to this many words.
+  static constexpr size_t kMinBitmapWords = 1024;
+  /// Otherwise it is only grown to at most this many words per deleted row.
+  static constexpr size_t kMaxBitmapWordsPerRow = 4;
+
+  /// Grow the bitmap to cover [word] if it stays small enough, and move the ids of the hash set
+  /// that it covers then. Return whether [word] is covered.
+  bool ReserveBitmap(size_t word);
+
+  std::vector<uint64_t> words_;
+  /// Deleted row ids not covered by `words_`.
+  std::unordered_set<int64_t> sparse_ids_;
+  size_t num_deleted_ = 0;
+  /// Row ids unmarked by `Undelete`, which are still saved as deleted.
+  std::unordered_set<int64_t> undeleted_ids_;
+  size_t num_replaced_entries_ = 0;
+};
+
+}  // namespace tenann
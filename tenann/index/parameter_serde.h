@@ -116,11 +116,32 @@ inline void FetchParameters(const IndexMeta& meta, FaissIvfPqSearchParams* out_p
   out_params->Validate();
 }
 
+inline void FetchParameters(const IndexMeta& meta, DiskAnnIndexParams* out_params) {
+  GET_OPTIONAL_INDEX_PARAM_TO(meta, *out_params, R);
+  GET_OPTIONAL_INDEX_PARAM_TO(meta, *out_params, L);
+  GET_OPTIONAL_INDEX_PARAM_TO(meta, *out_params, alpha);
+  GET_OPTIONAL_INDEX_PARAM_TO(meta, *out_params, pq_M);
+
+  out_params->Validate();
+}
+
+inline void FetchParameters(const IndexMeta& meta, DiskAnnSearchParams* out_params) {
+  GET_OPTIONAL_SEARCH_PARAM_TO(meta, *out_params, search_list_size);
+  GET_OPTIONAL_SEARCH_PARAM_TO(meta, *out_params, beam_width);
+
+  out_params->Validate();
+}
+
 inline void FetchParameters(const IndexMeta& meta, IndexWriterOptions* out_params) {
   GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, write_index_cache);
   if (meta.index_writer_options().contains("custom_cache_key")) {
       out_params->custom_cache_key = meta.index_writer_options()["custom_cache_key"];
   }
+  GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, use_mmap_layout);
+  GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, split_codes_and_ids);
+  GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, compress_ids);
+  GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, write_precomputed_table);
+  GET_OPTIONAL_WRITE_INDEX_PARAM_TO(meta, *out_params, sectioned_file);
 
   out_params->Validate();
 }
@@ -130,8 +151,19 @@ inline void FetchParameters(const IndexMeta& meta, IndexReaderOptions* out_param
   if (meta.index_reader_options().contains("custom_cache_key")) {
       out_params->custom_cache_key = meta.index_reader_options()["custom_cache_key"];
   }
+  if (meta.index_reader_options().contains("cache_namespace")) {
+      out_params->cache_namespace = meta.index_reader_options()["cache_namespace"];
+  }
   GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, force_read_and_overwrite_cache);
   GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, cache_index_block);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, block_cache_superblock_size);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, warm_up_largest_lists);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, consolidate_threshold);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, lazy_precompute_table);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, share_precomputed_table);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, verify_checksums);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, load_parallelism);
+  GET_OPTIONAL_READ_INDEX_PARAM_TO(meta, *out_params, read_hnsw_file_up_front);
 
   out_params->Validate();
 }
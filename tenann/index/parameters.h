@@ -104,9 +104,52 @@ struct FaissHnswSearchParams {
   void Validate() { ASSERT_PARAM_IN_RANGE(efSearch, 1, INT_MAX); }
 };
 
+/** Parameters for DiskANN */
+struct DiskAnnIndexParams {
+  /// max degree of the graph
+  DEFINE_OPTIONAL_PARAM(int, R, 64);
+  /// candidate list size used when building
+  DEFINE_OPTIONAL_PARAM(int, L, 100);
+  DEFINE_OPTIONAL_PARAM(float, alpha, 1.2);
+  /// number of pq sub-quantizers of the in-memory codes, 0 means dim / 4 if possible
+  DEFINE_OPTIONAL_PARAM(size_t, pq_M, 0);
+
+  void Validate() {
+    ASSERT_PARAM_IN_RANGE(R, 1, 1024);
+    ASSERT_PARAM_IN_RANGE(L, 1, INT_MAX);
+    ASSERT_PARAM_IN_RANGE(alpha, 1, 10);
+    ASSERT_PARAM_IN_RANGE(pq_M, 0, 65536);
+  }
+};
+
+struct DiskAnnSearchParams {
+  DEFINE_OPTIONAL_PARAM(int, search_list_size, 100);
+  /// max number of nodes read from disk in one step
+  DEFINE_OPTIONAL_PARAM(int, beam_width, 4);
+
+  void Validate() {
+    ASSERT_PARAM_IN_RANGE(search_list_size, 1, INT_MAX);
+    ASSERT_PARAM_IN_RANGE(beam_width, 1, 1024);
+  }
+};
+
 struct IndexWriterOptions {
   DEFINE_OPTIONAL_PARAM(bool, write_index_cache, false);
   std::string custom_cache_key = "";
+  /// Write hnsw with the tenann mmap layout, which is searched in place after being mapped.
+  DEFINE_OPTIONAL_PARAM(bool, use_mmap_layout, false);
+  /// Write the codes and the ids of ivfpq inverted lists in separate regions, so that block cache
+  /// reads and caches the codes only.
+  DEFINE_OPTIONAL_PARAM(bool, split_codes_and_ids, false);
+  /// Encode the ids of each ivfpq inverted list compactly, see `IdCodec`, which implies
+  /// `split_codes_and_ids`.
+  DEFINE_OPTIONAL_PARAM(bool, compress_ids, false);
+  /// Persist the precomputed table of ivfpq in the index file, so that reading the index skips
+  /// computing it.
+  DEFINE_OPTIONAL_PARAM(bool, write_precomputed_table, false);
+  /// Write ivfpq as an `IvfPqSectionedFile`, whose sections are located by a table of contents
+  /// and checksummed. The inverted lists take the split layout.
+  DEFINE_OPTIONAL_PARAM(bool, sectioned_file, false);
 
   void Validate() {}
 };
@@ -114,10 +157,40 @@ struct IndexWriterOptions {
 struct IndexReaderOptions {
   DEFINE_OPTIONAL_PARAM(bool, cache_index_file, false);
   std::string custom_cache_key = "";
+  /// Namespace of the index cache the index and its blocks are charged to, e.g. the table, see
+  /// `IndexCache::GetNamespace`. Empty for the default namespace.
+  std::string cache_namespace = "";
   DEFINE_OPTIONAL_PARAM(bool, force_read_and_overwrite_cache, false);
   DEFINE_OPTIONAL_PARAM(bool, cache_index_block, false);
+  /// With `cache_index_block`, cache consecutive inverted lists together in blocks of up to this
+  /// many bytes instead of an entry per list, 0 means an entry per list.
+  DEFINE_OPTIONAL_PARAM(size_t, block_cache_superblock_size, 0);
+  /// With `cache_index_block`, read the blocks of this many largest inverted lists in the
+  /// background as soon as the index is read, besides the blocks planned by
+  /// `IndexCache::LoadWarmUpPlan`.
+  DEFINE_OPTIONAL_PARAM(size_t, warm_up_largest_lists, 0);
+  /// Drop the deleted rows from the index in the background once they take up this ratio of the
+  /// index, 0 means never.
+  DEFINE_OPTIONAL_PARAM(float, consolidate_threshold, 0.2);
+  /// Compute the rows of the ivfpq precomputed table for each inverted list on its first probe
+  /// instead of computing the whole table when reading the index, unless the table is persisted.
+  DEFINE_OPTIONAL_PARAM(bool, lazy_precompute_table, false);
+  /// Share one ivfpq precomputed table among the loaded indexes with identical coarse and pq
+  /// codebooks.
+  DEFINE_OPTIONAL_PARAM(bool, share_precomputed_table, false);
+  /// Verify the checksums of the sections read from an ivfpq sectioned file.
+  DEFINE_OPTIONAL_PARAM(bool, verify_checksums, true);
+  /// Number of concurrent reads loading one index: the sections of an ivfpq sectioned file, or the
+  /// chunks of an hnsw file read up front, see `read_hnsw_file_up_front`.
+  DEFINE_OPTIONAL_PARAM(int, load_parallelism, 1);
+  /// Read a faiss hnsw file into memory with `load_parallelism` concurrent reads before
+  /// deserializing it, instead of letting faiss map the file, e.g. for remote file systems.
+  DEFINE_OPTIONAL_PARAM(bool, read_hnsw_file_up_front, false);
 
-  void Validate() {}
+  void Validate() {
+    ASSERT_PARAM_IN_RANGE(consolidate_threshold, 0, 1);
+    ASSERT_PARAM_IN_RANGE(load_parallelism, 1, 1024);
+  }
 };
 
 }  // namespace tenann
@@ -18,6 +18,18 @@
  * under the License.
  */
 
+#include "tenann/searcher/ann_searcher.h"
+
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/consolidation.h"
+#include "tenann/index/internal/tombstone.h"
 #include "tenann/index/parameter_serde.h"
 
 namespace tenann {
@@ -26,7 +38,7 @@ AnnSearcher::AnnSearcher(const IndexMeta& meta) : Searcher<AnnSearcher>(meta) {
   FetchParameters(meta, &common_params_);
 }
 
-AnnSearcher::~AnnSearcher() = default;
+AnnSearcher::~AnnSearcher() { WaitForConsolidation(); }
 
 void AnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float range, int64_t limit,
                               ResultOrder result_order, std::vector<int64_t>* result_ids,
@@ -41,4 +53,114 @@ void AnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float range, int64_
   RangeSearch(query_vector, range, limit, result_order, result_ids, &distanes);
 }
 
+void AnnSearcher::Insert(const ArraySeqView& vectors, const int64_t* row_ids) {
+  T_LOG(ERROR) << "insert not implemented";
+}
+
+void AnnSearcher::Delete(const int64_t* row_ids, int64_t num_rows) {
+  T_LOG(ERROR) << "delete not implemented";
+}
+
+void AnnSearcher::Consolidate() { T_LOG(ERROR) << "consolidate not implemented"; }
+
+void AnnSearcher::OnIndexLoading() { WaitForConsolidation(); }
+
+void AnnSearcher::DeleteWithTombstone(const int64_t* row_ids, int64_t num_rows) {
+  T_CHECK_NOTNULL(index_ref_);
+  // the tombstone is persisted beside the index file
+  T_LOG_IF(ERROR, index_path_.empty()) << "deletes are only supported for indexes read from a file";
+
+  bool need_consolidation = false;
+  {
+    // Only the writers modify the index and the tombstone, so they are read and saved below
+    // without blocking searches. Searches are only blocked while the rows are marked.
+    std::lock_guard<std::mutex> write_guard(index_ref_->write_mutex());
+    // rows missing from the index are not marked, so that they do not count towards the
+    // consolidation threshold
+    auto indexed_ids = FilterIndexedRowIds(*index_ref_, row_ids, num_rows);
+    if (indexed_ids.empty()) {
+      return;
+    }
+
+    Tombstone* tombstone = nullptr;
+    {
+      std::unique_lock<std::shared_mutex> guard(index_ref_->rw_lock());
+      if (index_ref_->tombstone() == nullptr) {
+        index_ref_->SetTombstone(std::make_unique<Tombstone>());
+      }
+      tombstone = index_ref_->tombstone();
+      for (auto row_id : indexed_ids) {
+        tombstone->Delete(row_id);
+      }
+    }
+    tombstone->Save(Tombstone::PathOf(index_path_));
+
+    auto threshold = index_reader_->index_reader_options().consolidate_threshold;
+    auto num_entries = CountIndexEntries(*index_ref_);
+    need_consolidation = threshold > 0 && num_entries > 0 &&
+                         tombstone->num_deleted() >= threshold * num_entries &&
+                         IsConsolidationSupported(*index_ref_);
+  }
+
+  std::lock_guard<std::mutex> consolidation_guard(consolidation_mutex_);
+  bool is_running = consolidation_.valid() &&
+                    consolidation_.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+  if (need_consolidation && !is_running) {
+    consolidation_ = std::async(std::launch::async, [this]() {
+      try {
+        ConsolidateWithTombstone();
+      } catch (Error& e) {
+        T_LOG(WARNING) << "background consolidation failed: " << e.what();
+      }
+    });
+  }
+}
+
+void AnnSearcher::ConsolidateWithTombstone() {
+  T_CHECK_NOTNULL(index_ref_);
+  // the consolidated index is written back to the index file
+  T_LOG_IF(ERROR, index_path_.empty())
+      << "consolidation is only supported for indexes read from a file";
+
+  // inserts and deletes wait until the consolidated index and tombstone are persisted together,
+  // so that a reload neither consolidates again nor hides the row ids inserted again
+  std::lock_guard<std::mutex> write_guard(index_ref_->write_mutex());
+  auto* tombstone = index_ref_->tombstone();
+  if (tombstone == nullptr || tombstone->empty()) {
+    return;
+  }
+  // the compacted arrays are built without blocking searches, which only wait for the swap
+  ConsolidatedIndex consolidated;
+  {
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
+    consolidated = PrepareConsolidation(*index_ref_);
+  }
+  {
+    std::unique_lock<std::shared_mutex> guard(index_ref_->rw_lock());
+    auto num_dropped = ApplyConsolidation(index_ref_.get(), &consolidated);
+    VLOG(VERBOSE_DEBUG) << "consolidated " << num_dropped << " deleted rows from " << index_path_;
+  }
+  // free the old arrays
+  consolidated = ConsolidatedIndex();
+  // charge the cache for the shrunk index
+  index_reader_->UpdateIndexCacheCharge(index_ref_->EstimateMemoryUsage());
+
+  // the index is only read while being written, searches are not blocked meanwhile
+  auto tmp_path = index_path_ + ".tmp";
+  IndexFactory::CreateWriterFromMeta(index_meta_)->WriteIndexFile(index_ref_, tmp_path);
+  T_LOG_IF(ERROR, rename(tmp_path.c_str(), index_path_.c_str()) != 0)
+      << "failed to rename [" << tmp_path << "] to [" << index_path_ << "]: " << strerror(errno);
+  // the index file no longer holds deleted rows
+  auto tombstone_path = Tombstone::PathOf(index_path_);
+  T_LOG_IF(ERROR, remove(tombstone_path.c_str()) != 0 && errno != ENOENT)
+      << "failed to remove [" << tombstone_path << "]: " << strerror(errno);
+}
+
+void AnnSearcher::WaitForConsolidation() {
+  std::lock_guard<std::mutex> guard(consolidation_mutex_);
+  if (consolidation_.valid()) {
+    consolidation_.wait();
+  }
+}
+
 }  // namespace tenann
\ No newline at end of file
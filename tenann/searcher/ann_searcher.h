@@ -19,7 +19,9 @@
 
 #pragma once
 
+#include <future>
 #include <memory>
+#include <mutex>
 
 #include "tenann/common/seq_view.h"
 #include "tenann/index/parameters.h"
@@ -80,8 +82,57 @@ class AnnSearcher : public Searcher<AnnSearcher> {
                            ResultOrder result_order, std::vector<int64_t>* result_ids,
                            const IdFilter* id_filter = nullptr);
 
+  /**
+   * @brief Insert vectors into the loaded index in place.
+   *
+   * Safe to be called alongside searches on the same index, including searches from other
+   * searchers sharing the index through the index cache. The deleted row ids inserted again are
+   * searched again, see `Tombstone::Undelete`.
+   *
+   * @param vectors  The vectors to insert.
+   * @param row_ids  Row ids of the vectors, required if and only if the index is built with
+   * custom row ids.
+   */
+  virtual void Insert(const ArraySeqView& vectors, const int64_t* row_ids = nullptr);
+
+  /**
+   * @brief Delete rows from the loaded index without rebuilding it.
+   *
+   * The rows are marked in a tombstone bitmap persisted beside the index file as
+   * `<index path>.del` and are skipped by all later searches. Once the deleted rows take up
+   * `consolidate_threshold` of the index, they are dropped from the index in the background, see
+   * `Consolidate`. Not supported for indexes read from a source, which have no index file.
+   *
+   * @param row_ids   Row ids to delete, which are the vector ordinals if the index is built
+   * without custom row ids.
+   * @param num_rows  Number of rows to delete.
+   */
+  virtual void Delete(const int64_t* row_ids, int64_t num_rows);
+
+  /**
+   * @brief Drop the deleted rows from the loaded index in place, searches are blocked meanwhile.
+   *
+   * The shrunk index is written back to the index file along with the cleared tombstone.
+   */
+  virtual void Consolidate();
+
  protected:
+  void OnIndexLoading() override;
+
+  /// Shared implementation of `Delete` for indexes that skip the rows in their tombstone.
+  void DeleteWithTombstone(const int64_t* row_ids, int64_t num_rows);
+
+  /// Shared implementation of `Consolidate`, see `ConsolidateIndex`.
+  void ConsolidateWithTombstone();
+
+  /// Wait for the background consolidation started by `Delete` if there is one.
+  void WaitForConsolidation();
+
   VectorIndexCommonParams common_params_;
+  /// Only touches the members of this class, so that it can be waited in the destructor.
+  std::future<void> consolidation_;
+  /// Guards `consolidation_`, which is started by concurrent deletes.
+  std::mutex consolidation_mutex_;
 };
 
 using AnnSearcherRef = std::shared_ptr<AnnSearcher>;
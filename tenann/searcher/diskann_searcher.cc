@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/searcher/diskann_searcher.h"
+
+#include "faiss/Index.h"
+#include "tenann/common/logging.h"
+#include "tenann/index/internal/disk_vamana.h"
+#include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/index_vamana.h"
+#include "tenann/index/parameter_serde.h"
+#include "tenann/searcher/internal/id_filter_adapter.h"
+#include "tenann/util/distance_util.h"
+#include "tenann/util/vector_convert.h"
+
+namespace tenann {
+
+DiskAnnSearcher::DiskAnnSearcher(const IndexMeta& meta) : AnnSearcher(meta) {
+  FetchParameters(meta, &search_params_);
+}
+
+DiskAnnSearcher::~DiskAnnSearcher() = default;
+
+void DiskAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k, int64_t* result_id,
+                                const IdFilter* id_filter) {
+  std::vector<float> distances(k);
+  AnnSearch(query_vector, k, result_id, reinterpret_cast<uint8_t*>(distances.data()), id_filter);
+}
+
+void DiskAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k, int64_t* result_ids,
+                                uint8_t* result_distances, const IdFilter* id_filter) {
+  T_CHECK_NOTNULL(index_ref_);
+  std::vector<float> query_buffer;
+  const float* query = VectorAsFloat(query_vector, &query_buffer);
+
+  auto distances = reinterpret_cast<float*>(result_distances);
+  SearchImpl(query, k, distances, result_ids, id_filter);
+
+  if (common_params_.metric_type == MetricType::kCosineSimilarity) {
+    L2DistanceToCosineSimilarity(distances, distances, k);
+  }
+}
+
+void DiskAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float range, int64_t limit,
+                                  ResultOrder result_order, std::vector<int64_t>* result_ids,
+                                  std::vector<float>* result_distances,
+                                  const IdFilter* id_filter) {
+  T_CHECK_NOTNULL(index_ref_);
+  std::vector<float> query_buffer;
+  const float* query = VectorAsFloat(query_vector, &query_buffer);
+
+  float radius = range;
+  if (common_params_.metric_type == MetricType::kCosineSimilarity) {
+    radius = CosineSimilarityThresholdToL2Distance(range);
+    T_CHECK(result_order == ResultOrder::kDescending)
+        << "only descending order is allowed for range search results based on cosine similarity";
+  } else {
+    T_CHECK(result_order == ResultOrder::kAscending)
+        << "only ascending order is allowed for range search with l2 distance";
+  }
+
+  int64_t k = std::max<int64_t>(search_params_.search_list_size, limit);
+  std::vector<float> distances(k);
+  std::vector<int64_t> ids(k);
+  SearchImpl(query, k, distances.data(), ids.data(), id_filter);
+
+  // results are sorted in ascending order of l2 distances
+  result_ids->clear();
+  result_distances->clear();
+  for (int64_t i = 0; i < k; i++) {
+    if (ids[i] < 0 || distances[i] > radius) break;
+    if (limit >= 0 && static_cast<int64_t>(result_ids->size()) >= limit) break;
+    result_ids->push_back(ids[i]);
+    result_distances->push_back(distances[i]);
+  }
+
+  if (common_params_.metric_type == MetricType::kCosineSimilarity) {
+    auto distances = result_distances->data();
+    L2DistanceToCosineSimilarity(distances, distances, result_distances->size());
+  }
+}
+
+void DiskAnnSearcher::SearchImpl(const float* query, int64_t k, float* distances,
+                                 int64_t* result_ids, const IdFilter* id_filter) {
+  try {
+    std::shared_ptr<IdFilterAdapter> id_filter_adapter;
+    if (disk_vamana_ != nullptr) {
+      auto disk_vamana = static_cast<const DiskVamana*>(disk_vamana_);
+      if (id_filter) {
+        id_filter_adapter =
+            IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter, disk_vamana->ids());
+      }
+      disk_vamana->Search(query, k, distances, result_ids, search_params_.search_list_size,
+                          search_params_.beam_width, id_filter_adapter.get());
+      return;
+    }
+
+    T_CHECK(vamana_ != nullptr) << "index is not loaded";
+    auto vamana = static_cast<const IndexVamana*>(vamana_);
+    SearchParametersVamana search_parameters;
+    search_parameters.search_list_size = search_params_.search_list_size;
+    if (id_filter) {
+      id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter, &vamana->ids);
+      search_parameters.sel = id_filter_adapter.get();
+    }
+
+    // the parameters are passed to the underlying index by faiss::IndexPreTransform
+    auto faiss_index = static_cast<const faiss::Index*>(index_ref_->index_raw());
+    faiss_index->search(ANN_SEARCHER_QUERY_COUNT, query, k, distances, result_ids,
+                        &search_parameters);
+  }
+  CATCH_FAISS_ERROR
+}
+
+void DiskAnnSearcher::OnSearchParamItemChange(const std::string& key, const json& value) {
+  try {
+    if (key == DiskAnnSearchParams::search_list_size_key) {
+      search_params_.search_list_size = value.get<DiskAnnSearchParams::search_list_size_type>();
+      return;
+    }
+
+    if (key == DiskAnnSearchParams::beam_width_key) {
+      search_params_.beam_width = value.get<DiskAnnSearchParams::beam_width_type>();
+      return;
+    }
+  } catch (json::exception& e) {
+    T_LOG(ERROR) << "failed to get search parameter from json: " << e.what();
+  }
+
+  T_LOG(ERROR) << "unsupport search parameter: " << key;
+}
+
+void DiskAnnSearcher::OnSearchParamsChange(const json& value) {
+  for (auto it = value.begin(); it != value.end(); ++it) {
+    OnSearchParamItemChange(it.key(), it.value());
+  }
+}
+
+void DiskAnnSearcher::OnIndexLoaded() {
+  disk_vamana_ = nullptr;
+  vamana_ = nullptr;
+
+  if (index_ref_->index_type() == IndexType::kDiskAnnOnDisk) {
+    auto disk_vamana = static_cast<const DiskVamana*>(index_ref_->index_raw());
+    T_CHECK_EQ(disk_vamana->d(), common_params_.dim);
+    T_CHECK(common_params_.metric_type != MetricType::kCosineSimilarity ||
+            common_params_.is_vector_normed || disk_vamana->normalize_query())
+        << "the DiskANN index in [" << disk_vamana->path()
+        << "] is inconsistent with the cosine similarity metric";
+    disk_vamana_ = disk_vamana;
+    return;
+  }
+
+  T_CHECK_EQ(index_ref_->index_type(), IndexType::kDiskAnn);
+  auto faiss_index = static_cast<const faiss::Index*>(index_ref_->index_raw());
+  auto [transform, vamana] = faiss_util::CheckAndUnpackVamana(faiss_index, &common_params_);
+  vamana_ = vamana;
+}
+
+}  // namespace tenann
@@ -0,0 +1,72 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include "tenann/index/parameters.h"
+#include "tenann/searcher/ann_searcher.h"
+
+namespace tenann {
+
+/**
+ * @brief Searcher of DiskANN indexes.
+ *
+ * Searches the graph on disk if the index is opened from a file, or searches the in-memory graph
+ * if the index just built is read from the index cache.
+ */
+class DiskAnnSearcher : public AnnSearcher {
+ public:
+  explicit DiskAnnSearcher(const IndexMeta& meta);
+  virtual ~DiskAnnSearcher();
+
+  T_FORBID_MOVE(DiskAnnSearcher);
+  T_FORBID_COPY_AND_ASSIGN(DiskAnnSearcher);
+
+  void AnnSearch(PrimitiveSeqView query_vector, int64_t k, int64_t* result_id,
+                 const IdFilter* id_filter = nullptr) override;
+
+  void AnnSearch(PrimitiveSeqView query_vector, int64_t k, int64_t* result_ids,
+                 uint8_t* result_distances, const IdFilter* id_filter = nullptr) override;
+
+  /// Range search over the top `max(search_list_size, limit)` nearest neighbors.
+  void RangeSearch(PrimitiveSeqView query_vector, float range, int64_t limit,
+                   ResultOrder result_order, std::vector<int64_t>* result_ids,
+                   std::vector<float>* result_distances,
+                   const IdFilter* id_filter = nullptr) override;
+
+ protected:
+  void OnSearchParamItemChange(const std::string& key, const json& value) override;
+
+  void OnSearchParamsChange(const json& value) override;
+
+  void OnIndexLoaded() override;
+
+ private:
+  /// Top-k search in l2 distances, the results are padded with -1 if there are less than k.
+  void SearchImpl(const float* query, int64_t k, float* distances, int64_t* result_ids,
+                  const IdFilter* id_filter);
+
+  DiskAnnSearchParams search_params_;
+  /// Set if the index is opened from a file.
+  const void* disk_vamana_ = nullptr;
+  /// Set if the index is built in memory.
+  const void* vamana_ = nullptr;
+};
+
+}  // namespace tenann
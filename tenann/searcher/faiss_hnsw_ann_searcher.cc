@@ -20,6 +20,9 @@
 #include "tenann/searcher/faiss_hnsw_ann_searcher.h"
 
 #include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
 
 #include "faiss/IndexHNSW.h"
 #include "faiss/IndexIDMap.h"
@@ -28,10 +31,13 @@
 #include "faiss_hnsw_ann_searcher.h"
 #include "tenann/common/logging.h"
 #include "tenann/index/internal/faiss_index_util.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+#include "tenann/index/internal/tombstone.h"
 #include "tenann/index/parameter_serde.h"
 #include "tenann/searcher/internal/id_filter_adapter.h"
 #include "tenann/store/index_meta.h"
 #include "tenann/util/distance_util.h"
+#include "tenann/util/vector_convert.h"
 
 namespace tenann {
 
@@ -250,30 +256,41 @@ void FaissHnswAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k, i
   try {
     T_CHECK_NOTNULL(index_ref_);
 
-    T_CHECK_EQ(index_ref_->index_type(), IndexType::kFaissHnsw);
-    T_CHECK_EQ(query_vector.elem_type, PrimitiveType::kFloatType);
+    T_CHECK(index_ref_->index_type() == IndexType::kFaissHnsw ||
+            index_ref_->index_type() == IndexType::kFaissHnswMmap)
+        << "unexpected index type: " << index_ref_->index_type();
+    std::vector<float> query_buffer;
+    const float* query = VectorAsFloat(query_vector, &query_buffer);
+    // keep the index from being modified by concurrent inserts
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
 
-    faiss::SearchParametersHNSW faiss_search_parameters;
+    MmapHnswSearchParameters faiss_search_parameters;
     faiss_search_parameters.efSearch = search_params_.efSearch;
     faiss_search_parameters.check_relative_distance = search_params_.check_relative_distance;
+    // deleted rows are checked by the candidate loop itself, `sel` is left for the user filter
+    faiss_search_parameters.tombstone = index_ref_->tombstone();
+    const int64_t* id_map = GetIdMap();
     std::shared_ptr<IdFilterAdapter> id_filter_adapter;
     if (id_filter) {
-      if (faiss_id_map_ != nullptr) {
-        id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(
-            id_filter, &reinterpret_cast<const faiss::IndexIDMap*>(faiss_id_map_)->id_map);
-      } else {
-        id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter);
-      }
+      id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter, id_map);
       faiss_search_parameters.sel = id_filter_adapter.get();
     }
+    std::unique_ptr<MmapHnsw> view;
+    const MmapHnsw* mmap_hnsw = GetMmapHnsw(faiss_search_parameters.tombstone, &view);
 
     VLOG(VERBOSE_DEBUG) << "efSearch: " << faiss_search_parameters.efSearch
                         << ", check_relative_distance: "
                         << faiss_search_parameters.check_relative_distance;
+    TrackedMemory scratch(memory_tracker_,
+                          SearchScratchSize(std::max<int64_t>(search_params_.efSearch, k)));
 
     // transform the query vector first if a pre-transform is set
-    const float* x = reinterpret_cast<const float*>(query_vector.data);
-    if (faiss_transform_ != nullptr) {
+    const float* x = query;
+    if (mmap_hnsw != nullptr) {
+      // the mmap index normalizes the query by itself
+      mmap_hnsw->Search(x, k, reinterpret_cast<float*>(result_distances), result_ids,
+                        &faiss_search_parameters);
+    } else if (faiss_transform_ != nullptr) {
       const float* xt = reinterpret_cast<const faiss::IndexPreTransform*>(faiss_transform_)
                             ->apply_chain(ANN_SEARCHER_QUERY_COUNT, x);
       faiss::ScopeDeleter<float> del(xt == x ? nullptr : xt);
@@ -287,12 +304,10 @@ void FaissHnswAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k, i
                    result_ids, &faiss_search_parameters);
     }
 
-    if (faiss_id_map_ != nullptr) {
+    if (id_map != nullptr) {
       int64_t* li = result_ids;
       for (int64_t i = 0; i < ANN_SEARCHER_QUERY_COUNT * k; i++) {
-        li[i] = li[i] < 0
-                    ? li[i]
-                    : reinterpret_cast<const faiss::IndexIDMap*>(faiss_id_map_)->id_map[li[i]];
+        li[i] = li[i] < 0 ? li[i] : id_map[li[i]];
       }
     }
 
@@ -311,8 +326,11 @@ void FaissHnswAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float rang
   try {
     T_CHECK_NOTNULL(index_ref_);
 
-    T_CHECK_EQ(index_ref_->index_type(), IndexType::kFaissHnsw);
-    T_CHECK_EQ(query_vector.elem_type, PrimitiveType::kFloatType);
+    T_CHECK(index_ref_->index_type() == IndexType::kFaissHnsw ||
+            index_ref_->index_type() == IndexType::kFaissHnswMmap)
+        << "unexpected index type: " << index_ref_->index_type();
+    std::vector<float> query_buffer;
+    const float* query = VectorAsFloat(query_vector, &query_buffer);
     T_CHECK_NE(common_params_.metric_type, MetricType::kInnerProduct)
         << "Range search is currently not supported for inner product metric.";
 
@@ -328,10 +346,13 @@ void FaissHnswAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float rang
       T_LOG(ERROR) << "using unsupported distance metric, hnsw range search only supports l2 "
                       "distance and cosine similarity";
     }
+    // keep the index from being modified by concurrent inserts
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
 
-    faiss::SearchParametersHNSW faiss_search_parameters;
+    MmapHnswSearchParameters faiss_search_parameters;
     faiss_search_parameters.efSearch = search_params_.efSearch;
     faiss_search_parameters.check_relative_distance = search_params_.check_relative_distance;
+    faiss_search_parameters.tombstone = index_ref_->tombstone();
     std::shared_ptr<IdFilterAdapter> id_filter_adapter;
 
     VLOG(VERBOSE_DEBUG) << "efSearch: " << faiss_search_parameters.efSearch
@@ -340,19 +361,24 @@ void FaissHnswAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float rang
                         << ", radius: " << radius << ", limit: " << limit
                         << ", result_order: " << result_order;
 
+    const int64_t* id_map = GetIdMap();
     if (id_filter) {
-      if (faiss_id_map_ != nullptr) {
-        id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(
-            id_filter, &reinterpret_cast<const faiss::IndexIDMap*>(faiss_id_map_)->id_map);
-      } else {
-        id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter);
-      }
+      id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter, id_map);
       faiss_search_parameters.sel = id_filter_adapter.get();
     }
+    std::unique_ptr<MmapHnsw> view;
+    const MmapHnsw* mmap_hnsw = GetMmapHnsw(faiss_search_parameters.tombstone, &view);
+
+    TrackedMemory scratch(memory_tracker_,
+                          SearchScratchSize(std::max<int64_t>(search_params_.efSearch, limit)));
 
     // Transform the query vector first if a pre-transform is set
-    const float* x = reinterpret_cast<const float*>(query_vector.data);
-    if (faiss_transform_ != nullptr) {
+    const float* x = query;
+    if (mmap_hnsw != nullptr) {
+      // The mmap index normalizes the query by itself
+      mmap_hnsw->RangeSearch(x, radius, limit, result_ids, result_distances,
+                             &faiss_search_parameters);
+    } else if (faiss_transform_ != nullptr) {
       const float* xt = reinterpret_cast<const faiss::IndexPreTransform*>(faiss_transform_)
                             ->apply_chain(ANN_SEARCHER_QUERY_COUNT, x);
       faiss::ScopeDeleter<float> del(xt == x ? nullptr : xt);
@@ -367,12 +393,10 @@ void FaissHnswAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float rang
                                    result_distances, &faiss_search_parameters);
     }
 
-    if (faiss_id_map_ != nullptr) {
+    if (id_map != nullptr) {
       int64_t* li = result_ids->data();
       for (int64_t i = 0; i < ANN_SEARCHER_QUERY_COUNT * result_ids->size(); i++) {
-        li[i] = li[i] < 0
-                    ? li[i]
-                    : reinterpret_cast<const faiss::IndexIDMap*>(faiss_id_map_)->id_map[li[i]];
+        li[i] = li[i] < 0 ? li[i] : id_map[li[i]];
       }
     }
 
@@ -384,6 +408,98 @@ void FaissHnswAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float rang
   CATCH_FAISS_ERROR
 }
 
+const MmapHnsw* FaissHnswAnnSearcher::GetMmapHnsw(const Tombstone* tombstone,
+                                                  std::unique_ptr<MmapHnsw>* view) const {
+  if (mmap_hnsw_ != nullptr) {
+    return reinterpret_cast<const MmapHnsw*>(mmap_hnsw_);
+  }
+  if (tombstone == nullptr || tombstone->empty()) {
+    return nullptr;
+  }
+  // faiss can only skip rows through an id selector, which costs a virtual call per candidate,
+  // so an index in memory with deleted rows is searched through a view taken under the read lock
+  *view = MmapHnsw::View(static_cast<const faiss::Index*>(index_ref_->index_raw()));
+  return view->get();
+}
+
+size_t FaissHnswAnnSearcher::SearchScratchSize(int64_t ef) const {
+  int64_t ntotal = mmap_hnsw_ != nullptr
+                       ? reinterpret_cast<const MmapHnsw*>(mmap_hnsw_)->ntotal()
+                       : reinterpret_cast<const faiss::IndexHNSW*>(faiss_hnsw_)->ntotal;
+  // the visited table takes a byte per vector, the candidate and the result queues take a
+  // distance and an id per entry, plus the transformed query
+  return ntotal + 2 * ef * (sizeof(float) + sizeof(int64_t)) + common_params_.dim * sizeof(float);
+}
+
+void FaissHnswAnnSearcher::Insert(const ArraySeqView& vectors, const int64_t* row_ids) {
+  try {
+    T_CHECK_NOTNULL(index_ref_);
+
+    T_CHECK(index_ref_->index_type() == IndexType::kFaissHnsw)
+        << "inserts are only supported for hnsw indexes loaded in memory, got index type: "
+        << index_ref_->index_type();
+    T_CHECK_EQ(vectors.dim, common_params_.dim);
+    T_CHECK((row_ids != nullptr) == (faiss_id_map_ != nullptr))
+        << "row ids should be given if and only if the index is built with custom row ids";
+
+    auto faiss_index = static_cast<faiss::Index*>(index_ref_->index_raw());
+    std::vector<float> buffer;
+    const float* data = VectorAsFloat(vectors, &buffer);
+
+    // faiss reallocates the storage and the graph when adding vectors,
+    // so searches are blocked until the insert finishes
+    std::lock_guard<std::mutex> write_guard(index_ref_->write_mutex());
+    std::unique_lock<std::shared_mutex> guard(index_ref_->rw_lock());
+    auto* tombstone = index_ref_->tombstone();
+    bool has_undeleted = false;
+    if (row_ids != nullptr && tombstone != nullptr && !tombstone->empty()) {
+      // the deleted row ids inserted again are searched again, while their old entries stay
+      // deleted until consolidation drops them
+      std::unordered_set<int64_t> undeleted;
+      for (uint32_t i = 0; i < vectors.size; i++) {
+        if (tombstone->Undelete(row_ids[i])) {
+          undeleted.insert(row_ids[i]);
+        }
+      }
+      if (!undeleted.empty()) {
+        auto [id_map, transform, hnsw] = faiss_util::UnpackHnswMutable(faiss_index);
+        size_t num_replaced = 0;
+        for (auto& row_id : id_map->id_map) {
+          if (undeleted.count(row_id) > 0) {
+            row_id = Tombstone::kReplacedRowId;
+            num_replaced++;
+          }
+        }
+        tombstone->AddReplacedEntries(num_replaced);
+        has_undeleted = true;
+      }
+    }
+    if (row_ids != nullptr) {
+      faiss_index->add_with_ids(vectors.size, data, row_ids);
+    } else {
+      faiss_index->add(vectors.size, data);
+    }
+    guard.unlock();
+
+    // the tombstone is only modified by the writers, save it without blocking searches
+    if (has_undeleted) {
+      tombstone->Save(Tombstone::PathOf(index_path_));
+    }
+    // charge the cache for the grown index
+    index_reader_->UpdateIndexCacheCharge(index_ref_->EstimateMemoryUsage());
+
+    VLOG(VERBOSE_DEBUG) << "inserted " << vectors.size << " vectors, ntotal: "
+                        << faiss_index->ntotal;
+  }
+  CATCH_FAISS_ERROR
+}
+
+void FaissHnswAnnSearcher::Delete(const int64_t* row_ids, int64_t num_rows) {
+  DeleteWithTombstone(row_ids, num_rows);
+}
+
+void FaissHnswAnnSearcher::Consolidate() { ConsolidateWithTombstone(); }
+
 void FaissHnswAnnSearcher::OnSearchParamItemChange(const std::string& key, const json& value) {
   try {
     if (key == FaissHnswSearchParams::efSearch_key) {
@@ -406,7 +522,29 @@ void FaissHnswAnnSearcher::OnSearchParamsChange(const json& value) {
 }
 
 void FaissHnswAnnSearcher::OnIndexLoaded() {
+  if (index_ref_->index_type() == IndexType::kFaissHnswMmap) {
+    auto mmap_hnsw = static_cast<const MmapHnsw*>(index_ref_->index_raw());
+    T_CHECK_EQ(mmap_hnsw->d(), common_params_.dim);
+    T_CHECK(common_params_.metric_type != MetricType::kCosineSimilarity ||
+            common_params_.is_vector_normed || mmap_hnsw->normalize_query())
+        << "the mmap hnsw index in [" << mmap_hnsw->path()
+        << "] is inconsistent with the cosine similarity metric";
+    // cosine similarity is searched as the l2 distance of normalized vectors
+    auto metric_type = common_params_.metric_type == MetricType::kInnerProduct
+                           ? faiss::METRIC_INNER_PRODUCT
+                           : faiss::METRIC_L2;
+    T_CHECK_EQ(mmap_hnsw->metric_type(), metric_type)
+        << "the metric of the mmap hnsw index in [" << mmap_hnsw->path()
+        << "] is inconsistent with the index meta";
+    mmap_hnsw_ = mmap_hnsw;
+    faiss_id_map_ = nullptr;
+    faiss_transform_ = nullptr;
+    faiss_hnsw_ = nullptr;
+    return;
+  }
+
   // fetch and check faiss index here
+  mmap_hnsw_ = nullptr;
   auto faiss_index = static_cast<faiss::Index*>(index_ref_->index_raw());
   auto [id_map, transform, hnsw] = faiss_util::CheckAndUnpackHnsw(faiss_index, &common_params_);
   faiss_id_map_ = id_map;
@@ -414,4 +552,14 @@ void FaissHnswAnnSearcher::OnIndexLoaded() {
   faiss_hnsw_ = hnsw;
 }
 
+const int64_t* FaissHnswAnnSearcher::GetIdMap() const {
+  if (mmap_hnsw_ != nullptr) {
+    return reinterpret_cast<const MmapHnsw*>(mmap_hnsw_)->id_map();
+  }
+  if (faiss_id_map_ != nullptr) {
+    return reinterpret_cast<const faiss::IndexIDMap*>(faiss_id_map_)->id_map.data();
+  }
+  return nullptr;
+}
+
 }  // namespace tenann
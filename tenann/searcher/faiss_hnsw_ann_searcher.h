@@ -19,10 +19,15 @@
 
 #pragma once
 
+#include <memory>
+
 #include "tenann/searcher/ann_searcher.h"
 
 namespace tenann {
 
+class MmapHnsw;
+class Tombstone;
+
 class FaissHnswAnnSearcher : public AnnSearcher {
  public:
   explicit FaissHnswAnnSearcher(const IndexMeta& meta);
@@ -43,6 +48,14 @@ class FaissHnswAnnSearcher : public AnnSearcher {
                    std::vector<float>* result_distances,
                    const IdFilter* id_filter = nullptr) override;
 
+  /// Only supported for indexes loaded in memory, indexes with the mmap layout are read-only.
+  void Insert(const ArraySeqView& vectors, const int64_t* row_ids = nullptr) override;
+
+  void Delete(const int64_t* row_ids, int64_t num_rows) override;
+
+  /// Only supported for indexes built with custom row ids and loaded in memory.
+  void Consolidate() override;
+
  protected:
   void OnSearchParamItemChange(const std::string& key, const json& value) override;
 
@@ -51,10 +64,22 @@ class FaissHnswAnnSearcher : public AnnSearcher {
   void OnIndexLoaded() override;
 
  private:
+  /// Internal id to row id, nullptr if the index has no id map.
+  const int64_t* GetIdMap() const;
+
+  /// The mmap index to search with, or a view of the index in memory if it has a [tombstone],
+  /// kept alive by [view]. nullptr if the index is searched by faiss.
+  const MmapHnsw* GetMmapHnsw(const Tombstone* tombstone, std::unique_ptr<MmapHnsw>* view) const;
+
+  /// Bytes allocated by a search with [ef] candidates besides the results.
+  size_t SearchScratchSize(int64_t ef) const;
+
   FaissHnswSearchParams search_params_;
-  const void* faiss_id_map_;
-  const void* faiss_transform_;
-  const void* faiss_hnsw_;
+  const void* faiss_id_map_ = nullptr;
+  const void* faiss_transform_ = nullptr;
+  const void* faiss_hnsw_ = nullptr;
+  /// Set instead of the faiss pointers if the index is loaded with the mmap layout.
+  const void* mmap_hnsw_ = nullptr;
 };
 
 }  // namespace tenann
\ No newline at end of file
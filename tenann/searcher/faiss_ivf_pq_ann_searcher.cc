@@ -20,7 +20,9 @@
 #include "tenann/searcher/faiss_ivf_pq_ann_searcher.h"
 
 #include <algorithm>
+#include <mutex>
 #include <queue>
+#include <shared_mutex>
 
 #include "faiss/IndexIVFPQ.h"
 #include "faiss/impl/AuxIndexStructures.h"
@@ -28,10 +30,12 @@
 #include "tenann/common/logging.h"
 #include "tenann/index/internal/faiss_index_util.h"
 #include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/tombstone.h"
 #include "tenann/index/parameter_serde.h"
 #include "tenann/index/parameters.h"
 #include "tenann/searcher/internal/id_filter_adapter.h"
 #include "tenann/util/distance_util.h"
+#include "tenann/util/vector_convert.h"
 namespace tenann {
 
 FaissIvfPqAnnSearcher::FaissIvfPqAnnSearcher(const IndexMeta& meta) : AnnSearcher(meta) {
@@ -52,15 +56,20 @@ void FaissIvfPqAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k,
     T_CHECK_NOTNULL(index_ref_);
 
     T_CHECK_EQ(index_ref_->index_type(), IndexType::kFaissIvfPq);
-    T_CHECK_EQ(query_vector.elem_type, PrimitiveType::kFloatType);
+    std::vector<float> query_buffer;
+    const float* query = VectorAsFloat(query_vector, &query_buffer);
 
     auto faiss_index = static_cast<faiss::Index*>(index_ref_->index_raw());
+    // keep the tombstone and the inverted lists from being modified by deletes and consolidation
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
 
-    faiss::IVFPQSearchParameters faiss_search_parameters;
+    IndexIvfPqSearchParameters faiss_search_parameters;
     faiss_search_parameters.nprobe = search_params_.nprobe;
     faiss_search_parameters.max_codes = search_params_.max_codes;
     faiss_search_parameters.polysemous_ht = search_params_.polysemous_ht;
     faiss_search_parameters.scan_table_threshold = search_params_.scan_table_threshold;
+    // the scanner skips deleted rows by itself, `sel` is left for the user filter
+    faiss_search_parameters.tombstone = index_ref_->tombstone();
     std::shared_ptr<IdFilterAdapter> id_filter_adapter;
     if (id_filter) {
       id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter);
@@ -68,9 +77,11 @@ void FaissIvfPqAnnSearcher::AnnSearch(PrimitiveSeqView query_vector, int64_t k,
     }
 
     VLOG(VERBOSE_DEBUG) << "nprobe: " << faiss_search_parameters.nprobe;
+    TrackedMemory scratch(memory_tracker_,
+                          memory_tracker_ != nullptr ? SearchScratchSize(faiss_index, k) : 0);
 
-    faiss_index->search(ANN_SEARCHER_QUERY_COUNT, reinterpret_cast<const float*>(query_vector.data),
-                        k, reinterpret_cast<float*>(result_distances), result_ids,
+    faiss_index->search(ANN_SEARCHER_QUERY_COUNT, query, k,
+                        reinterpret_cast<float*>(result_distances), result_ids,
                         &faiss_search_parameters);
 
     if (common_params_.metric_type == MetricType::kCosineSimilarity) {
@@ -91,11 +102,14 @@ void FaissIvfPqAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float ran
     T_CHECK_NOTNULL(index_ref_);
 
     T_CHECK_EQ(index_ref_->index_type(), IndexType::kFaissIvfPq);
-    T_CHECK_EQ(query_vector.elem_type, PrimitiveType::kFloatType);
+    std::vector<float> query_buffer;
+    const float* query = VectorAsFloat(query_vector, &query_buffer);
     T_CHECK_NE(common_params_.metric_type, MetricType::kInnerProduct)
         << "Range search is currently not supported for inner product metric.";
 
     auto faiss_index = static_cast<const faiss::Index*>(index_ref_->index_raw());
+    // keep the tombstone and the inverted lists from being modified by deletes and consolidation
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
 
     IndexIvfPqSearchParameters dynamic_search_parameters;
     dynamic_search_parameters.nprobe = search_params_.nprobe;
@@ -103,6 +117,8 @@ void FaissIvfPqAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float ran
     dynamic_search_parameters.polysemous_ht = search_params_.polysemous_ht;
     dynamic_search_parameters.scan_table_threshold = search_params_.scan_table_threshold;
     dynamic_search_parameters.range_search_confidence = search_params_.range_search_confidence;
+    // the scanner skips deleted rows by itself
+    dynamic_search_parameters.tombstone = index_ref_->tombstone();
     std::shared_ptr<IdFilterAdapter> id_filter_adapter;
     if (id_filter) {
       id_filter_adapter = IdFilterAdapterFactory::CreateIdFilterAdapter(id_filter);
@@ -128,13 +144,16 @@ void FaissIvfPqAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float ran
     // Note that the parameters pass to faiss::IndexPretransform::range_search will be transparently
     // passed to the underlying index
     // (here the params will be passed to tenann::IndexIvfPq::range_search).
+    TrackedMemory scratch(memory_tracker_,
+                          memory_tracker_ != nullptr ? SearchScratchSize(faiss_index, 0) : 0);
     faiss::RangeSearchResult results(ANN_SEARCHER_QUERY_COUNT);
-    faiss_index->range_search(ANN_SEARCHER_QUERY_COUNT,
-                              reinterpret_cast<const float*>(query_vector.data), radius, &results,
+    faiss_index->range_search(ANN_SEARCHER_QUERY_COUNT, query, radius, &results,
                               &dynamic_search_parameters);
 
     // number of results returned by index search
     int64_t num_results = results.lims[1];
+    // the results of faiss, and the indices and the heap used to sort them
+    scratch.Resize(scratch.bytes() + num_results * (sizeof(float) + 3 * sizeof(int64_t)));
     // number of results to preserve
     auto num_preserve_results = limit < 0 ? num_results : std::min(num_results, limit);
     result_ids->resize(num_preserve_results);
@@ -188,6 +207,52 @@ void FaissIvfPqAnnSearcher::RangeSearch(PrimitiveSeqView query_vector, float ran
   CATCH_FAISS_ERROR
 }
 
+size_t FaissIvfPqAnnSearcher::SearchScratchSize(const faiss::Index* index, int64_t k) const {
+  auto [transform, index_ivf_pq] = faiss_util::UnpackIvfPq(index);
+  size_t nprobe = std::min(search_params_.nprobe, index_ivf_pq->nlist);
+  // the probed lists with their coarse distances, the distance tables of the pq scanner and the
+  // result heap, plus the transformed query
+  return nprobe * (sizeof(float) + sizeof(int64_t)) +
+         2 * index_ivf_pq->pq.M * index_ivf_pq->pq.ksub * sizeof(float) +
+         k * (sizeof(float) + sizeof(int64_t)) + index_ivf_pq->d * sizeof(float);
+}
+
+void FaissIvfPqAnnSearcher::Delete(const int64_t* row_ids, int64_t num_rows) {
+  DeleteWithTombstone(row_ids, num_rows);
+}
+
+void FaissIvfPqAnnSearcher::Consolidate() { ConsolidateWithTombstone(); }
+
+void FaissIvfPqAnnSearcher::WarmUp(PrimitiveSeqView vectors) {
+  try {
+    T_CHECK_NOTNULL(index_ref_);
+
+    T_CHECK_EQ(index_ref_->index_type(), IndexType::kFaissIvfPq);
+
+    auto faiss_index = static_cast<const faiss::Index*>(index_ref_->index_raw());
+    std::shared_lock<std::shared_mutex> guard(index_ref_->rw_lock());
+    auto [transform, index_ivf_pq] = faiss_util::UnpackIvfPq(faiss_index);
+    T_CHECK_EQ(vectors.size % faiss_index->d, 0) << "the vectors do not match the index dimension";
+    auto n = static_cast<faiss::Index::idx_t>(vectors.size / faiss_index->d);
+    if (n == 0) {
+      return;
+    }
+
+    std::vector<float> buffer;
+    const float* x = VectorAsFloat(vectors, &buffer);
+    const float* xt = transform != nullptr ? transform->apply_chain(n, x) : x;
+    std::unique_ptr<const float[]> transformed(xt != x ? xt : nullptr);
+
+    auto nprobe = static_cast<faiss::Index::idx_t>(
+        std::min(search_params_.nprobe, index_ivf_pq->nlist));
+    std::vector<faiss::Index::idx_t> list_nos(n * nprobe);
+    std::vector<float> coarse_distances(n * nprobe);
+    index_ivf_pq->quantizer->search(n, xt, nprobe, coarse_distances.data(), list_nos.data());
+    index_ivf_pq->invlists->prefetch_lists(list_nos.data(), static_cast<int>(list_nos.size()));
+  }
+  CATCH_FAISS_ERROR
+}
+
 void FaissIvfPqAnnSearcher::OnSearchParamItemChange(const std::string& key, const json& value) {
   try {
     if (key == FaissIvfPqSearchParams::nprobe_key) {
@@ -45,11 +45,26 @@ class FaissIvfPqAnnSearcher : public AnnSearcher {
                    std::vector<float>* result_distances,
                    const IdFilter* id_filter = nullptr) override;
 
+  void Delete(const int64_t* row_ids, int64_t num_rows) override;
+
+  /// Only supported for indexes read without `cache_index_block`.
+  void Consolidate() override;
+
+  /**
+   * @brief Read in the background the inverted lists of the `nprobe` centroids nearest to each of
+   * [vectors], e.g. a sample of recent queries, so that the first searches around them hit the
+   * block cache. Do nothing unless the index is read with `cache_index_block`.
+   */
+  void WarmUp(PrimitiveSeqView vectors);
+
  protected:
   void OnSearchParamItemChange(const std::string& key, const json& value) override;
   void OnSearchParamsChange(const json& value) override;
 
  private:
+  /// Bytes allocated by a search of the [k] nearest neighbors besides the results.
+  size_t SearchScratchSize(const faiss::Index* index, int64_t k) const;
+
   FaissIvfPqSearchParams search_params_;
 };
 
@@ -30,6 +30,10 @@ namespace tenann {
 class IdFilterAdapter : public faiss::IDSelector {
  public:
   IdFilterAdapter(const IdFilter* id_filter, const std::vector<int64_t>* id_map = nullptr)
+      : id_filter_(id_filter), id_map_(id_map ? id_map->data() : nullptr) {}
+
+  /// The [id_map] may point into a memory-mapped index file.
+  IdFilterAdapter(const IdFilter* id_filter, const int64_t* id_map)
       : id_filter_(id_filter), id_map_(id_map) {}
 
   bool is_member(int64_t id) const override {
@@ -38,14 +42,14 @@ class IdFilterAdapter : public faiss::IDSelector {
     }
 
     if (id_map_) {
-      return id_filter_->IsMember((*id_map_)[id]);
+      return id_filter_->IsMember(id_map_[id]);
     }
     return id_filter_->IsMember(id);
   }
 
  private:
   const IdFilter* id_filter_;
-  const std::vector<int64_t>* id_map_;
+  const int64_t* id_map_;
 };
 
 class IdFilterAdapterFactory {
@@ -54,6 +58,11 @@ class IdFilterAdapterFactory {
       const IdFilter* id_filter, const std::vector<int64_t>* id_map = nullptr) {
     return std::make_shared<IdFilterAdapter>(id_filter, id_map);
   }
+
+  static std::shared_ptr<IdFilterAdapter> CreateIdFilterAdapter(const IdFilter* id_filter,
+                                                                const int64_t* id_map) {
+    return std::make_shared<IdFilterAdapter>(id_filter, id_map);
+  }
 };
 
 struct IDSelectorRangeAdapter : faiss::IDSelectorRange {
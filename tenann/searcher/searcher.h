@@ -25,6 +25,7 @@
 #include "tenann/index/index_reader.h"
 #include "tenann/store/index_meta.h"
 #include "tenann/factory/index_factory.h"
+#include "tenann/util/memory_tracker.h"
 
 namespace tenann {
 
@@ -47,7 +48,21 @@ class Searcher {
   T_FORBID_MOVE(Searcher);
 
   ChildSearcher& ReadIndex(const std::string& path) {
+    OnIndexLoading();
     index_ref_ = index_reader_->ReadIndex(path);
+    index_path_ = path;
+    is_index_loaded_ = true;
+
+    OnIndexLoaded();
+    return static_cast<ChildSearcher&>(*this);
+  };
+
+  /// Read index from [source] instead of a local file, see `IndexReader::ReadIndexSource`.
+  /// The index has no backing file, `index_path()` is left empty.
+  ChildSearcher& ReadIndexSource(std::shared_ptr<RandomAccessSource> source) {
+    OnIndexLoading();
+    index_path_.clear();
+    index_ref_ = index_reader_->ReadIndexSource(std::move(source));
     is_index_loaded_ = true;
 
     OnIndexLoaded();
@@ -66,28 +81,45 @@ class Searcher {
     return static_cast<ChildSearcher&>(*this);
   }
 
+  /// Charge the scratch memory of each search, e.g. visited tables and candidate queues, to
+  /// [tracker] while the search runs.
+  ChildSearcher& SetMemoryTracker(MemoryTrackerRef tracker) {
+    memory_tracker_ = std::move(tracker);
+    return static_cast<ChildSearcher&>(*this);
+  }
+
   /* setters and getters */
   IndexRef index_ref() const { return index_ref_; }
 
+  const MemoryTrackerRef& memory_tracker() const { return memory_tracker_; }
+
   const IndexReader* index_reader() const { return index_reader_.get(); }
 
   IndexReader* index_reader() { return index_reader_.get(); }
 
   bool is_index_loaded() const { return is_index_loaded_; }
 
+  /// Path of the index file, empty if the index is read from a source.
+  const std::string& index_path() const { return index_path_; }
+
  protected:
   virtual void OnSearchParamItemChange(const std::string& key, const json& value) = 0;
 
   virtual void OnSearchParamsChange(const json& value) = 0;
 
+  virtual void OnIndexLoading(){};
+
   virtual void OnIndexLoaded(){};
 
   IndexMeta index_meta_;
   IndexRef index_ref_;
+  std::string index_path_;
   bool is_index_loaded_;
 
   /* reader */
   IndexReaderRef index_reader_;
+
+  MemoryTrackerRef memory_tracker_ = nullptr;
 };
 
 }  // namespace tenann
@@ -31,8 +31,12 @@ enum IndexType {
   kFaissHnsw = 0,  // 0: faiss hnsw
   kFaissIvfFlat,   // 1: faiss ivf-flat
   kFaissIvfPq,     // 2: faiss ivf-pq
+  kDiskAnn,        // 3: vamana graph on disk with in-memory pq (DiskANN)
 
-  kFaissIvfPqOneInvertedList = 100  // 100: one inverted list of faiss ivf-pq, use for block cache
+  kFaissIvfPqOneInvertedList = 100,  // 100: one inverted list of faiss ivf-pq, use for block cache
+  kFaissHnswMmap = 101,              // 101: tenann hnsw searched in place on a memory-mapped file
+  kDiskAnnOnDisk = 102,              // 102: opened DiskANN index, whose graph stays on disk
+  kDiskAnnBlock = 103                // 103: one block of DiskANN graph nodes, use for block cache
 };
 
 enum MetricType {
@@ -4,6 +4,8 @@
 
 #include "tenann/store/lru_cache.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <sstream>
@@ -58,6 +60,76 @@ uint32_t CacheKey::hash(const char* data, size_t n, uint32_t seed) const {
 
 Cache::~Cache() = default;
 
+const char* cache_eviction_policy_name(CacheEvictionPolicy policy) {
+  switch (policy) {
+    case CacheEvictionPolicy::LRU:
+      return "lru";
+    case CacheEvictionPolicy::TINY_LFU:
+      return "tiny_lfu";
+  }
+  return "unknown";
+}
+
+void FrequencySketch::resize(size_t expected_entries) {
+  size_t size = 1;
+  while (size < expected_entries) {
+    size <<= 1;
+  }
+  _table.assign(size, 0);
+  _sample_size = 10 * size;
+  _additions = 0;
+}
+
+void FrequencySketch::_locate(uint32_t hash, int i, size_t* word, int* shift) const {
+  static constexpr uint64_t kSeeds[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                        0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+  uint64_t h = (static_cast<uint64_t>(hash) + kSeeds[i]) * kSeeds[i];
+  h ^= h >> 32;
+  *word = h & (_table.size() - 1);
+  // each row uses a different quarter of the 16 counters of a word
+  *shift = ((i << 2) + ((hash >> (i << 3)) & 3)) << 2;
+}
+
+void FrequencySketch::increment(uint32_t hash) {
+  if (_table.empty()) {
+    return;
+  }
+  bool added = false;
+  for (int i = 0; i < 4; i++) {
+    size_t word;
+    int shift;
+    _locate(hash, i, &word, &shift);
+    if (((_table[word] >> shift) & 0xf) < 0xf) {
+      _table[word] += 1ULL << shift;
+      added = true;
+    }
+  }
+  if (added && ++_additions >= _sample_size) {
+    _reset();
+  }
+}
+
+uint32_t FrequencySketch::frequency(uint32_t hash) const {
+  if (_table.empty()) {
+    return 0;
+  }
+  uint32_t frequency = 0xf;
+  for (int i = 0; i < 4; i++) {
+    size_t word;
+    int shift;
+    _locate(hash, i, &word, &shift);
+    frequency = std::min<uint32_t>(frequency, (_table[word] >> shift) & 0xf);
+  }
+  return frequency;
+}
+
+void FrequencySketch::_reset() {
+  for (auto& word : _table) {
+    word = (word >> 1) & 0x7777777777777777ULL;
+  }
+  _additions /= 2;
+}
+
 // LRU cache implementation
 LRUHandle* HandleTable::lookup(const CacheKey& key, uint32_t hash) {
   return *_find_pointer(key, hash);
@@ -153,20 +225,32 @@ LRUCache::LRUCache() {
   // Make empty circular linked list
   _lru.next = &_lru;
   _lru.prev = &_lru;
+  _window.next = &_window;
+  _window.prev = &_window;
 }
 
 LRUCache::~LRUCache() noexcept { prune(); }
 
 bool LRUCache::_unref(LRUHandle* e) {
   T_DCHECK(e->refs > 0);
-  e->refs--;
-  return e->refs == 0;
+  // a single atomic step, handles may be released concurrently without the lock
+  return e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+
+void LRUCache::_uncharge(LRUHandle* e) {
+  _usage -= e->charge;
+  if (e->in_window) {
+    _window_usage -= e->charge;
+  }
 }
 
 void LRUCache::_lru_remove(LRUHandle* e) {
   e->next->prev = e->prev;
   e->prev->next = e->next;
   e->prev = e->next = nullptr;
+  e->group_next->group_prev = e->group_prev;
+  e->group_prev->group_next = e->group_next;
+  e->group_prev = e->group_next = nullptr;
 }
 
 void LRUCache::_lru_append(LRUHandle* list, LRUHandle* e) {
@@ -175,6 +259,23 @@ void LRUCache::_lru_append(LRUHandle* list, LRUHandle* e) {
   e->prev = list->prev;
   e->prev->next = e;
   e->next->prev = e;
+  // and the newest entry of its group
+  LRUHandle* group_list = _group_list(e->group);
+  e->group_next = group_list;
+  e->group_prev = group_list->group_prev;
+  e->group_prev->group_next = e;
+  e->group_next->group_prev = e;
+}
+
+LRUHandle* LRUCache::_group_list(uint32_t group) {
+  if (group >= _groups.size()) {
+    _groups.resize(group + 1);
+  }
+  if (_groups[group] == nullptr) {
+    _groups[group] = std::make_unique<LRUHandle>();
+    _groups[group]->group_next = _groups[group]->group_prev = _groups[group].get();
+  }
+  return _groups[group].get();
 }
 
 void LRUCache::set_capacity(size_t capacity) {
@@ -182,37 +283,144 @@ void LRUCache::set_capacity(size_t capacity) {
   {
     std::lock_guard l(_mutex);
     _capacity = capacity;
+    if (_policy == CacheEvictionPolicy::TINY_LFU) {
+      _resize_tiny_lfu();
+    }
     _evict_from_lru(0, &last_ref_list);
   }
 
   for (auto entry : last_ref_list) {
-    entry->free();
+    _free(entry);
   }
 }
 
-uint64_t LRUCache::get_lookup_count() {
-  std::lock_guard l(_mutex);
-  return _lookup_count;
+void LRUCache::_resize_tiny_lfu() {
+  _window_capacity = static_cast<size_t>(_capacity * kWindowRatio);
+  size_t expected_entries = std::clamp<size_t>(_capacity / kSketchAverageCharge, 64, 1 << 20);
+  _sketch.resize(expected_entries);
+}
+
+void LRUCache::set_eviction_policy(CacheEvictionPolicy policy) {
+  std::vector<LRUHandle*> last_ref_list;
+  {
+    std::lock_guard l(_mutex);
+    if (_policy == policy) {
+      return;
+    }
+    _policy = policy;
+    if (policy == CacheEvictionPolicy::TINY_LFU) {
+      _resize_tiny_lfu();
+    } else {
+      // the window entries join the main space as the most recently used ones, and the referenced
+      // ones are appended to it when released
+      while (_window.next != &_window) {
+        LRUHandle* e = _window.next;
+        _lru_remove(e);
+        e->in_window = false;
+        _window_usage -= e->charge;
+        _lru_append(&_lru, e);
+      }
+      _window_capacity = 0;
+      _sketch.resize(0);
+    }
+    _evict_from_lru(0, &last_ref_list);
+  }
+
+  for (auto entry : last_ref_list) {
+    _free(entry);
+  }
 }
 
-uint64_t LRUCache::get_hit_count() {
+void LRUCache::set_eviction_listener(void (*listener)(const CacheKey& key, void* value)) {
   std::lock_guard l(_mutex);
-  return _hit_count;
+  _eviction_listener = listener;
+}
+
+CacheEvictionPolicy LRUCache::get_eviction_policy() {
+  std::shared_lock l(_mutex);
+  return _policy;
+}
+
+uint64_t LRUCache::get_lookup_count() { return _lookup_count.load(std::memory_order_relaxed); }
+
+uint64_t LRUCache::get_hit_count() { return _hit_count.load(std::memory_order_relaxed); }
+
+LRUCache::PolicyStats LRUCache::get_policy_stats(CacheEvictionPolicy policy) {
+  int i = static_cast<int>(policy);
+  PolicyStats stats;
+  stats.lookup_count = _policy_lookup_count[i].load(std::memory_order_relaxed);
+  stats.hit_count = _policy_hit_count[i].load(std::memory_order_relaxed);
+  return stats;
+}
+
+uint64_t LRUCache::get_admitted_count() {
+  std::shared_lock l(_mutex);
+  return _admitted_count;
+}
+
+uint64_t LRUCache::get_rejected_count() {
+  std::shared_lock l(_mutex);
+  return _rejected_count;
 }
 
 size_t LRUCache::get_usage() {
-  std::lock_guard l(_mutex);
+  std::shared_lock l(_mutex);
   return _usage;
 }
 
 size_t LRUCache::get_capacity() {
-  std::lock_guard l(_mutex);
+  std::shared_lock l(_mutex);
   return _capacity;
 }
 
+bool LRUCache::_try_ref_shared(LRUHandle* e) {
+  uint32_t refs = e->refs.load(std::memory_order_relaxed);
+  while (refs >= 2) {
+    if (e->refs.compare_exchange_weak(refs, refs + 1, std::memory_order_acq_rel)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LRUCache::_try_unref_shared(LRUHandle* e) {
+  uint32_t refs = e->refs.load(std::memory_order_relaxed);
+  while (refs > 2) {
+    if (e->refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LRUCache::_count_lookup(bool hit) {
+  // the policy is read under either lock
+  int policy = static_cast<int>(_policy);
+  _lookup_count.fetch_add(1, std::memory_order_relaxed);
+  _policy_lookup_count[policy].fetch_add(1, std::memory_order_relaxed);
+  if (hit) {
+    _hit_count.fetch_add(1, std::memory_order_relaxed);
+    _policy_hit_count[policy].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
 Cache::Handle* LRUCache::lookup(const CacheKey& key, uint32_t hash) {
+  {
+    std::shared_lock l(_mutex);
+    if (_policy == CacheEvictionPolicy::LRU) {
+      LRUHandle* e = _table.lookup(key, hash);
+      if (e == nullptr || _try_ref_shared(e)) {
+        _count_lookup(e != nullptr);
+        return reinterpret_cast<Cache::Handle*>(e);
+      }
+    }
+  }
+
   std::lock_guard l(_mutex);
-  ++_lookup_count;
+  if (_policy == CacheEvictionPolicy::TINY_LFU) {
+    // misses are counted as well, so that a key missed repeatedly can be admitted
+    _sketch.increment(hash);
+  }
   LRUHandle* e = _table.lookup(key, hash);
   if (e != nullptr) {
     // we get it from _table, so in_cache must be true
@@ -222,8 +430,8 @@ Cache::Handle* LRUCache::lookup(const CacheKey& key, uint32_t hash) {
       _lru_remove(e);
     }
     e->refs++;
-    ++_hit_count;
   }
+  _count_lookup(e != nullptr);
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
@@ -232,23 +440,39 @@ void LRUCache::release(Cache::Handle* handle) {
     return;
   }
   auto* e = reinterpret_cast<LRUHandle*>(handle);
+  // the entry stays out of the LRU lists while other handles reference it, so neither the lists
+  // nor the table are touched, and no lock is needed
+  if (_try_unref_shared(e)) {
+    return;
+  }
+
   bool last_ref = false;
+  std::vector<LRUHandle*> last_ref_list;
   {
     std::lock_guard l(_mutex);
     last_ref = _unref(e);
     if (last_ref) {
-      _usage -= e->charge;
+      _uncharge(e);
     } else if (e->in_cache && e->refs == 1) {
       // only exists in cache
-      if (_usage > _capacity) {
+      if (_policy == CacheEvictionPolicy::TINY_LFU) {
+        // the entry competes with the main space's victim instead of being removed outright
+        _lru_append(_lru_list(e), e);
+        _evict_from_lru(0, &last_ref_list);
+      } else if (_usage > _capacity) {
         // take this opportunity and remove the item
         _table.remove(e->key(), e->hash);
         e->in_cache = false;
+        e->evicted = true;
         _unref(e);
-        _usage -= e->charge;
+        _uncharge(e);
         last_ref = true;
       } else {
-        // put it to LRU free list
+        // put it to LRU free list, it may have been inserted into the window of TINY_LFU
+        if (e->in_window) {
+          e->in_window = false;
+          _window_usage -= e->charge;
+        }
         _lru_append(&_lru, e);
       }
     }
@@ -256,11 +480,38 @@ void LRUCache::release(Cache::Handle* handle) {
 
   // free handle out of mutex
   if (last_ref) {
-    e->free();
+    _free(e);
+  }
+  for (auto entry : last_ref_list) {
+    _free(entry);
+  }
+}
+
+void LRUCache::update_charge(Cache::Handle* handle, size_t charge) {
+  auto* e = reinterpret_cast<LRUHandle*>(handle);
+  std::vector<LRUHandle*> last_ref_list;
+  {
+    std::lock_guard l(_mutex);
+    // the entry is referenced by the handle, so it is not in the LRU free list,
+    // and its charge is still counted in _usage even if it has been erased
+    _usage = _usage - e->charge + charge;
+    if (e->in_window) {
+      _window_usage = _window_usage - e->charge + charge;
+    }
+    e->charge = charge;
+    _evict_from_lru(0, &last_ref_list);
+  }
+
+  for (auto entry : last_ref_list) {
+    _free(entry);
   }
 }
 
 void LRUCache::_evict_from_lru(size_t charge, std::vector<LRUHandle*>* deleted) {
+  if (_policy == CacheEvictionPolicy::TINY_LFU) {
+    _evict_from_lru_tiny_lfu(charge, deleted);
+    return;
+  }
   LRUHandle* cur = &_lru;
   // 1. evict normal cache entries
   while (_usage + charge > _capacity && cur->next != &_lru) {
@@ -281,19 +532,87 @@ void LRUCache::_evict_from_lru(size_t charge, std::vector<LRUHandle*>* deleted)
   }
 }
 
+void LRUCache::_evict_from_lru_tiny_lfu(size_t charge, std::vector<LRUHandle*>* deleted) {
+  // [charge] is about to be added to the window
+  while (true) {
+    bool full = _usage + charge > _capacity;
+    bool window_full = _window_usage + charge > _window_capacity && _window.next != &_window;
+    if (!full && !window_full) {
+      break;
+    }
+
+    // the victim of the main space prefers normal entries like the LRU policy
+    LRUHandle* victim = nullptr;
+    for (LRUHandle* cur = _lru.next; cur != &_lru; cur = cur->next) {
+      if (cur->priority == CachePriority::NORMAL) {
+        victim = cur;
+        break;
+      }
+    }
+    if (victim == nullptr && _lru.next != &_lru) {
+      victim = _lru.next;
+    }
+
+    if (window_full) {
+      // the oldest entry of the window leaves it, either to the main space or out of the cache
+      LRUHandle* candidate = _window.next;
+      bool admit = !full;
+      if (full && victim != nullptr) {
+        admit = _sketch.frequency(candidate->hash) > _sketch.frequency(victim->hash);
+        admit ? ++_admitted_count : ++_rejected_count;
+        if (admit) {
+          _evict_one_entry(victim);
+          deleted->push_back(victim);
+        }
+      }
+      if (admit) {
+        _lru_remove(candidate);
+        candidate->in_window = false;
+        _window_usage -= candidate->charge;
+        _lru_append(&_lru, candidate);
+      } else {
+        _evict_one_entry(candidate);
+        deleted->push_back(candidate);
+      }
+    } else if (victim != nullptr) {
+      _evict_one_entry(victim);
+      deleted->push_back(victim);
+    } else if (_window.next != &_window) {
+      LRUHandle* old = _window.next;
+      _evict_one_entry(old);
+      deleted->push_back(old);
+    } else {
+      // all entries are referenced
+      break;
+    }
+  }
+}
+
 void LRUCache::_evict_one_entry(LRUHandle* e) {
+  _remove_one_entry(e);
+  e->evicted = true;
+}
+
+void LRUCache::_free(LRUHandle* e) {
+  if (e->evicted && _eviction_listener != nullptr) {
+    _eviction_listener(e->key(), e->value);
+  }
+  e->free();
+}
+
+void LRUCache::_remove_one_entry(LRUHandle* e) {
   T_DCHECK(e->in_cache);
   T_DCHECK(e->refs == 1);  // LRU list contains elements which may be evicted
   _lru_remove(e);
   _table.remove(e->key(), e->hash);
   e->in_cache = false;
   _unref(e);
-  _usage -= e->charge;
+  _uncharge(e);
 }
 
 Cache::Handle* LRUCache::insert(const CacheKey& key, uint32_t hash, void* value, size_t charge,
                                 void (*deleter)(const CacheKey& key, void* value),
-                                CachePriority priority) {
+                                CachePriority priority, uint32_t group) {
   auto* e = reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
   e->value = value;
   e->deleter = deleter;
@@ -302,7 +621,11 @@ Cache::Handle* LRUCache::insert(const CacheKey& key, uint32_t hash, void* value,
   e->hash = hash;
   e->refs = 2;  // one for the returned handle, one for LRUCache.
   e->next = e->prev = nullptr;
+  e->group_next = e->group_prev = nullptr;
+  e->group = group;
   e->in_cache = true;
+  e->in_window = false;
+  e->evicted = false;
   e->priority = priority;
   memcpy(e->key_data, key.data(), key.size());
   std::vector<LRUHandle*> last_ref_list;
@@ -318,10 +641,15 @@ Cache::Handle* LRUCache::insert(const CacheKey& key, uint32_t hash, void* value,
     // space was freed
     auto old = _table.insert(e);
     _usage += charge;
+    if (_policy == CacheEvictionPolicy::TINY_LFU) {
+      _sketch.increment(hash);
+      e->in_window = true;
+      _window_usage += charge;
+    }
     if (old != nullptr) {
       old->in_cache = false;
       if (_unref(old)) {
-        _usage -= old->charge;
+        _uncharge(old);
         // old is on LRU because it's in cache and its reference count
         // was just 1 (Unref returned 0)
         _lru_remove(old);
@@ -333,7 +661,7 @@ Cache::Handle* LRUCache::insert(const CacheKey& key, uint32_t hash, void* value,
   // we free the entries here outside of mutex for
   // performance reasons
   for (auto entry : last_ref_list) {
-    entry->free();
+    _free(entry);
   }
 
   return reinterpret_cast<Cache::Handle*>(e);
@@ -348,7 +676,7 @@ void LRUCache::erase(const CacheKey& key, uint32_t hash) {
     if (e != nullptr) {
       last_ref = _unref(e);
       if (last_ref) {
-        _usage -= e->charge;
+        _uncharge(e);
         if (e->in_cache) {
           // locate in free list
           _lru_remove(e);
@@ -359,47 +687,154 @@ void LRUCache::erase(const CacheKey& key, uint32_t hash) {
   }
   // free handle out of mutex, when last_ref is true, e must not be nullptr
   if (last_ref) {
-    e->free();
+    _free(e);
   }
 }
 
+void LRUCache::erase(Cache::Handle* handle) {
+  auto* e = reinterpret_cast<LRUHandle*>(handle);
+  std::lock_guard l(_mutex);
+  // an entry replaced under its key is no longer in the table
+  if (!e->in_cache) {
+    return;
+  }
+  _table.remove(e->key(), e->hash);
+  e->in_cache = false;
+  // the entry is referenced by the handle, so it is not in the LRU lists and is freed once the
+  // handle is released
+  _unref(e);
+}
+
 int LRUCache::prune() {
   std::vector<LRUHandle*> last_ref_list;
   {
     std::lock_guard l(_mutex);
-    while (_lru.next != &_lru) {
-      LRUHandle* old = _lru.next;
-      T_DCHECK(old->in_cache);
-      T_DCHECK(old->refs == 1);  // LRU list contains elements which may be evicted
-      _lru_remove(old);
-      _table.remove(old->key(), old->hash);
-      old->in_cache = false;
-      _unref(old);
-      _usage -= old->charge;
-      last_ref_list.push_back(old);
+    for (LRUHandle* list : {&_window, &_lru}) {
+      while (list->next != list) {
+        LRUHandle* old = list->next;
+        _remove_one_entry(old);
+        last_ref_list.push_back(old);
+      }
     }
   }
   for (auto entry : last_ref_list) {
-    entry->free();
+    _free(entry);
   }
   return last_ref_list.size();
 }
 
+size_t LRUCache::evict_to(size_t usage) {
+  std::vector<LRUHandle*> last_ref_list;
+  size_t evicted = 0;
+  {
+    std::lock_guard l(_mutex);
+    // normal entries go first, and the main space of TINY_LFU before the admission window
+    for (CachePriority priority : {CachePriority::NORMAL, CachePriority::DURABLE}) {
+      for (LRUHandle* list : {&_lru, &_window}) {
+        LRUHandle* cur = list->next;
+        while (_usage > usage && cur != list) {
+          LRUHandle* old = cur;
+          cur = cur->next;
+          if (old->priority != priority) {
+            continue;
+          }
+          evicted += old->charge;
+          _evict_one_entry(old);
+          last_ref_list.push_back(old);
+        }
+      }
+    }
+  }
+  for (auto entry : last_ref_list) {
+    _free(entry);
+  }
+  return evicted;
+}
+
+size_t LRUCache::evict_group(uint32_t group, size_t charge) {
+  std::vector<LRUHandle*> last_ref_list;
+  size_t evicted = 0;
+  {
+    std::lock_guard l(_mutex);
+    if (group >= _groups.size() || _groups[group] == nullptr) {
+      return 0;
+    }
+    // the group list only holds the unreferenced entries of the group, normal entries go first
+    LRUHandle* list = _groups[group].get();
+    for (CachePriority priority : {CachePriority::NORMAL, CachePriority::DURABLE}) {
+      LRUHandle* cur = list->group_next;
+      while (evicted < charge && cur != list) {
+        LRUHandle* old = cur;
+        cur = cur->group_next;
+        if (old->priority != priority) {
+          continue;
+        }
+        evicted += old->charge;
+        _evict_one_entry(old);
+        last_ref_list.push_back(old);
+      }
+    }
+  }
+  for (auto entry : last_ref_list) {
+    _free(entry);
+  }
+  return evicted;
+}
+
+void LRUCache::get_hot_keys(size_t limit, std::vector<std::string>* keys) {
+  std::shared_lock l(_mutex);
+  size_t end = keys->size() + limit;
+  // the referenced entries are in use right now, they are in neither list
+  _table.for_each([&](LRUHandle* e) {
+    if (keys->size() < end && e->in_cache && e->refs.load(std::memory_order_relaxed) > 1) {
+      keys->push_back(e->key().to_string());
+    }
+  });
+  // the main space of TINY_LFU holds the entries accessed more often than the admission window
+  for (LRUHandle* list : {&_lru, &_window}) {
+    for (LRUHandle* e = list->prev; e != list && keys->size() < end; e = e->prev) {
+      keys->push_back(e->key().to_string());
+    }
+  }
+}
+
 inline uint32_t ShardedLRUCache::_hash_slice(const CacheKey& s) {
+  if (s.size() == sizeof(CacheKey128)) {
+    // mix the two words of a fixed-size key instead of hashing it four bytes at a time, the shard
+    // is taken from the high bits
+    uint64_t lo;
+    uint64_t hi;
+    memcpy(&lo, s.data(), sizeof(lo));
+    memcpy(&hi, s.data() + sizeof(lo), sizeof(hi));
+    uint64_t h = lo ^ (hi * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<uint32_t>(h >> 32);
+  }
   return s.hash(s.data(), s.size(), 0);
 }
 
-uint32_t ShardedLRUCache::_shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+uint32_t ShardedLRUCache::_shard(uint32_t hash) const {
+  return _num_shard_bits > 0 ? hash >> (32 - _num_shard_bits) : 0;
+}
 
-ShardedLRUCache::ShardedLRUCache(size_t capacity) : _last_id(0), _capacity(capacity) {
-  const size_t per_shard = (_capacity + (kNumShards - 1)) / kNumShards;
+ShardedLRUCache::ShardedLRUCache(size_t capacity, CacheEvictionPolicy policy, int num_shard_bits)
+    : _num_shard_bits(std::clamp(num_shard_bits, 0, kMaxNumShardBits)),
+      _shards(size_t{1} << _num_shard_bits),
+      _last_id(0),
+      _capacity(capacity) {
+  const size_t per_shard = (_capacity + (_shards.size() - 1)) / _shards.size();
   for (auto& _shard : _shards) {
     _shard.set_capacity(per_shard);
+    _shard.set_eviction_policy(policy);
   }
 }
 
 void ShardedLRUCache::_set_capacity(size_t capacity) {
-  const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+  const size_t per_shard = (capacity + (_shards.size() - 1)) / _shards.size();
   for (auto& _shard : _shards) {
     _shard.set_capacity(per_shard);
   }
@@ -422,11 +857,63 @@ bool ShardedLRUCache::adjust_capacity(int64_t delta, size_t min_capacity) {
   return true;
 }
 
+size_t ShardedLRUCache::evict_to(size_t usage) {
+  size_t total_usage = get_memory_usage();
+  if (total_usage <= usage) {
+    return 0;
+  }
+  // every shard gives up its share of the excess, so that the hot entries of one shard are not
+  // evicted while another one still holds cold entries
+  size_t excess = total_usage - usage;
+  size_t evicted = 0;
+  for (auto& shard : _shards) {
+    size_t shard_usage = shard.get_usage();
+    auto shard_excess = static_cast<size_t>(
+        std::ceil(static_cast<double>(excess) * shard_usage / total_usage));
+    evicted += shard.evict_to(shard_usage - std::min(shard_usage, shard_excess));
+  }
+  return evicted;
+}
+
+size_t ShardedLRUCache::evict_group(uint32_t group, size_t charge) {
+  // every shard gives up an equal share first, then the shards that still hold entries of the
+  // group make up for the others
+  size_t share = (charge + _shards.size() - 1) / _shards.size();
+  size_t evicted = 0;
+  for (auto& shard : _shards) {
+    evicted += shard.evict_group(group, std::min(share, charge - std::min(charge, evicted)));
+  }
+  for (auto& shard : _shards) {
+    if (evicted >= charge) {
+      break;
+    }
+    evicted += shard.evict_group(group, charge - evicted);
+  }
+  return evicted;
+}
+
+void ShardedLRUCache::set_eviction_listener(void (*listener)(const CacheKey& key,
+                                                            void* value)) {
+  for (auto& shard : _shards) {
+    shard.set_eviction_listener(listener);
+  }
+}
+
+void ShardedLRUCache::set_eviction_policy(CacheEvictionPolicy policy) {
+  for (auto& _shard : _shards) {
+    _shard.set_eviction_policy(policy);
+  }
+}
+
+CacheEvictionPolicy ShardedLRUCache::get_eviction_policy() {
+  return _shards[0].get_eviction_policy();
+}
+
 Cache::Handle* ShardedLRUCache::insert(const CacheKey& key, void* value, size_t charge,
                                        void (*deleter)(const CacheKey& key, void* value),
-                                       CachePriority priority) {
+                                       CachePriority priority, uint32_t group) {
   const uint32_t hash = _hash_slice(key);
-  return _shards[_shard(hash)].insert(key, hash, value, charge, deleter, priority);
+  return _shards[_shard(hash)].insert(key, hash, value, charge, deleter, priority, group);
 }
 
 Cache::Handle* ShardedLRUCache::lookup(const CacheKey& key) {
@@ -439,11 +926,21 @@ void ShardedLRUCache::release(Handle* handle) {
   _shards[_shard(h->hash)].release(handle);
 }
 
+void ShardedLRUCache::update_charge(Handle* handle, size_t charge) {
+  auto* h = reinterpret_cast<LRUHandle*>(handle);
+  _shards[_shard(h->hash)].update_charge(handle, charge);
+}
+
 void ShardedLRUCache::erase(const CacheKey& key) {
   const uint32_t hash = _hash_slice(key);
   _shards[_shard(hash)].erase(key, hash);
 }
 
+void ShardedLRUCache::erase(Handle* handle) {
+  auto* h = reinterpret_cast<LRUHandle*>(handle);
+  _shards[_shard(h->hash)].erase(handle);
+}
+
 void* ShardedLRUCache::value(Handle* handle) { return reinterpret_cast<LRUHandle*>(handle)->value; }
 
 uint64_t ShardedLRUCache::new_id() {
@@ -475,7 +972,7 @@ size_t ShardedLRUCache::get_lookup_count() { return _get_stat(&LRUCache::get_loo
 size_t ShardedLRUCache::get_hit_count() { return _get_stat(&LRUCache::get_hit_count); }
 
 void ShardedLRUCache::get_cache_status(json* document) {
-  size_t shard_count = sizeof(_shards) / sizeof(LRUCache);
+  size_t shard_count = _shards.size();
 
   for (uint32_t i = 0; i < shard_count; ++i) {
     size_t capacity = _shards[i].get_capacity();
@@ -504,11 +1001,61 @@ void ShardedLRUCache::get_cache_status(json* document) {
     }
 
     shard_info["hit_ratio"] = hit_ratio;
+    shard_info["eviction_policy"] =
+        cache_eviction_policy_name(_shards[i].get_eviction_policy());
 
     document->push_back(shard_info);
   }
 }
 
-Cache* new_lru_cache(size_t capacity) { return new ShardedLRUCache(capacity); }
+void ShardedLRUCache::get_policy_status(json* document) {
+  (*document)["eviction_policy"] = cache_eviction_policy_name(get_eviction_policy());
+  for (auto policy : {CacheEvictionPolicy::LRU, CacheEvictionPolicy::TINY_LFU}) {
+    uint64_t lookup_count = 0;
+    uint64_t hit_count = 0;
+    for (auto& shard : _shards) {
+      auto stats = shard.get_policy_stats(policy);
+      lookup_count += stats.lookup_count;
+      hit_count += stats.hit_count;
+    }
+    json policy_info;
+    policy_info["lookup_count"] = lookup_count;
+    policy_info["hit_count"] = hit_count;
+    policy_info["hit_ratio"] =
+        lookup_count != 0 ? static_cast<float>(hit_count) / static_cast<float>(lookup_count)
+                          : 0.0f;
+    if (policy == CacheEvictionPolicy::TINY_LFU) {
+      policy_info["admitted_count"] = _get_stat(&LRUCache::get_admitted_count);
+      policy_info["rejected_count"] = _get_stat(&LRUCache::get_rejected_count);
+    }
+    (*document)[cache_eviction_policy_name(policy)] = policy_info;
+  }
+}
+
+std::vector<std::string> ShardedLRUCache::get_hot_keys(size_t limit) {
+  std::vector<std::vector<std::string>> shard_keys(_shards.size());
+  for (size_t i = 0; i < _shards.size(); i++) {
+    _shards[i].get_hot_keys(limit, &shard_keys[i]);
+  }
+  // take the keys of the shards in turns, so that each shard keeps its own order
+  std::vector<std::string> keys;
+  for (size_t rank = 0; keys.size() < limit; rank++) {
+    bool found = false;
+    for (auto& shard_key : shard_keys) {
+      if (rank < shard_key.size() && keys.size() < limit) {
+        keys.push_back(std::move(shard_key[rank]));
+        found = true;
+      }
+    }
+    if (!found) {
+      break;
+    }
+  }
+  return keys;
+}
+
+Cache* new_lru_cache(size_t capacity, CacheEvictionPolicy policy, int num_shard_bits) {
+  return new ShardedLRUCache(capacity, policy, num_shard_bits);
+}
 
 }  // namespace tenann
@@ -4,10 +4,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -19,9 +23,43 @@ namespace tenann {
 class Cache;
 class CacheKey;
 
+// The entry with smaller CachePriority will evict firstly
+enum class CachePriority { NORMAL = 0, DURABLE = 1 };
+
+// How a full cache chooses the entries to evict.
+//
+// LRU: evict the least recently used entry.
+// TINY_LFU: W-TinyLFU. New entries enter a small LRU window, and an entry leaving the window is
+// only admitted to the main LRU space if it has been accessed more often than the main space's
+// victim, according to a frequency sketch that also remembers evicted keys. A scan over many cold
+// entries only churns the window and leaves the frequently used entries in place.
+enum class CacheEvictionPolicy { LRU = 0, TINY_LFU = 1 };
+
+const char* cache_eviction_policy_name(CacheEvictionPolicy policy);
+
+static const int kDefaultNumShardBits = 1;
+static const int kMaxNumShardBits = 10;
+
+// Fixed-size key of a block of a file, e.g. an inverted list, built and compared without any
+// string formatting or allocation. The cache sees its 16 bytes as any other key, keys of other
+// lengths never collide with it.
+struct CacheKey128 {
+  // Identifies the file, e.g. a hash of its name.
+  uint64_t file_id;
+  // Changes whenever the file is rewritten, e.g. its modification time.
+  uint32_t generation;
+  uint32_t block_id;
+
+  CacheKey128 with_block_id(uint32_t id) const { return {file_id, generation, id}; }
+};
+static_assert(sizeof(CacheKey128) == 16, "CacheKey128 must not be padded");
+
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
-extern Cache* new_lru_cache(size_t capacity);
+// of Cache uses a least-recently-used eviction policy by default.
+// See ShardedLRUCache for [num_shard_bits].
+extern Cache* new_lru_cache(size_t capacity,
+                            CacheEvictionPolicy policy = CacheEvictionPolicy::LRU,
+                            int num_shard_bits = kDefaultNumShardBits);
 
 class CacheKey {
  public:
@@ -38,6 +76,9 @@ class CacheKey {
   // Create a slice that refers to the contents of "s"
   CacheKey(std::string_view s) : _data(s.data()), _size(s.size()) {}
 
+  // Create a slice that refers to the bytes of "k"
+  CacheKey(const CacheKey128& k) : _data(reinterpret_cast<const char*>(&k)), _size(sizeof(k)) {}
+
   ~CacheKey() = default;
 
   // Return a pointer to the beginning of the referenced data
@@ -110,9 +151,6 @@ class CacheKey {
   size_t _size{0};
 };
 
-// The entry with smaller CachePriority will evict firstly
-enum class CachePriority { NORMAL = 0, DURABLE = 1 };
-
 class Cache {
  public:
   Cache() = default;
@@ -133,9 +171,12 @@ class Cache {
   //
   // When the inserted entry is no longer needed, the key and
   // value will be passed to "deleter".
+  //
+  // Entries of the same [group], e.g. the entries charged to one quota, can be evicted together
+  // with evict_group.
   virtual Handle* insert(const CacheKey& key, void* value, size_t charge,
                          void (*deleter)(const CacheKey& key, void* value),
-                         CachePriority priority = CachePriority::NORMAL) = 0;
+                         CachePriority priority = CachePriority::NORMAL, uint32_t group = 0) = 0;
 
   // If the cache has no mapping for "key", returns NULL.
   //
@@ -155,11 +196,23 @@ class Cache {
   // REQUIRES: handle must have been returned by a method on *this.
   virtual void* value(Handle* handle) = 0;
 
+  // Update the charge of an entry whose value has grown or shrunk in place,
+  // and evict unreferenced entries if the cache gets larger than its capacity.
+  // REQUIRES: handle must not have been released yet.
+  // REQUIRES: handle must have been returned by a method on *this.
+  virtual void update_charge(Handle* handle, size_t charge) = 0;
+
   // If the cache contains entry for key, erase it.  Note that the
   // underlying entry will be kept around until all existing handles
   // to it have been released.
   virtual void erase(const CacheKey& key) = 0;
 
+  // Erase the entry of handle if it is still cached. Unlike erasing its key,
+  // an entry inserted since under the same key is kept.
+  // REQUIRES: handle must not have been released yet.
+  // REQUIRES: handle must have been returned by a method on *this.
+  virtual void erase(Handle* handle) = 0;
+
   // Return a new numeric id.  May be used by multiple clients who are
   // sharing the same cache to partition the key space.  Typically the
   // client will allocate a new id at startup and prepend the id to
@@ -184,6 +237,33 @@ class Cache {
   //  Decrease or increase cache capacity.
   virtual bool adjust_capacity(int64_t delta, size_t min_capacity = 0) = 0;
 
+  // Evict unreferenced entries until the memory usage is at most [usage], e.g. under memory
+  // pressure, while the capacity is unchanged. Return the charge of the evicted entries.
+  virtual size_t evict_to(size_t usage) = 0;
+
+  // Evict unreferenced entries of [group], the least recently used first, until their charges add
+  // up to [charge], e.g. to keep the group within a quota. Return the charge of the evicted
+  // entries. Only the unreferenced entries of the group are visited, so it returns at once when
+  // all of them are referenced.
+  virtual size_t evict_group(uint32_t group, size_t charge) = 0;
+
+  // Call [listener] with the key and value of every entry evicted to make room or to honour
+  // evict_to and evict_group, right before its deleter. Entries that are erased, replaced by an
+  // insert of the same key, or freed with the cache are not passed to it. Set it before use.
+  virtual void set_eviction_listener(void (*listener)(const CacheKey& key, void* value)) = 0;
+
+  // Switch the eviction policy, the cached entries are kept.
+  virtual void set_eviction_policy(CacheEvictionPolicy policy) = 0;
+  virtual CacheEvictionPolicy get_eviction_policy() = 0;
+
+  // Lookup and hit counts accumulated under each eviction policy, and the admission decisions of
+  // the TINY_LFU policy, so that policies can be compared on the same workload.
+  virtual void get_policy_status(json* document) = 0;
+
+  // Keys of up to [limit] cached entries, hottest first: the entries referenced by handles, then
+  // the unreferenced ones from the most recently used, e.g. to warm up the cache after a restart.
+  virtual std::vector<std::string> get_hot_keys(size_t limit) = 0;
+
  private:
   Cache(const Cache&) = delete;
   const Cache& operator=(const Cache&) = delete;
@@ -200,7 +280,14 @@ typedef struct LRUHandle {
   size_t charge;
   size_t key_length;
   bool in_cache;  // Whether entry is in the cache.
-  uint32_t refs;
+  bool in_window;  // Whether entry is charged to the admission window of TINY_LFU.
+  bool evicted;  // Whether entry left the cache by eviction, see Cache::set_eviction_listener.
+  // Links of the unreferenced entries of the same group, ordered like next and prev.
+  LRUHandle* group_next;
+  LRUHandle* group_prev;
+  uint32_t group;
+  // Changed without the shard's exclusive lock as long as it stays at 2 or above, see LRUCache.
+  std::atomic<uint32_t> refs;
   uint32_t hash;  // Hash of key(); used for fast sharding and comparisons
   CachePriority priority = CachePriority::NORMAL;
   char key_data[1];  // Beginning of key
@@ -240,6 +327,15 @@ class HandleTable {
 
   LRUHandle* remove(const CacheKey& key, uint32_t hash);
 
+  template <typename Fn>
+  void for_each(Fn&& fn) const {
+    for (uint32_t i = 0; i < _length; i++) {
+      for (LRUHandle* h = _list[i]; h != nullptr; h = h->next_hash) {
+        fn(h);
+      }
+    }
+  }
+
  private:
   // The tablet consists of an array of buckets where each bucket is
   // a linked list of cache entries that hash into the bucket.
@@ -254,7 +350,38 @@ class HandleTable {
   bool _resize();
 };
 
+// Count-min sketch with 4-bit counters estimating how often each key hash has been accessed
+// recently. All counters are halved once the number of recorded accesses reaches ten times the
+// expected number of entries, so that the estimate follows changes of the workload.
+class FrequencySketch {
+ public:
+  // Size the sketch for [expected_entries] distinct keys, this clears the recorded accesses.
+  void resize(size_t expected_entries);
+
+  void increment(uint32_t hash);
+
+  // Estimated number of recent accesses of [hash], saturated at 15.
+  uint32_t frequency(uint32_t hash) const;
+
+ private:
+  // Index of the word holding the counter of [hash] in row [i], and the counter in the word.
+  void _locate(uint32_t hash, int i, size_t* word, int* shift) const;
+  void _reset();
+
+  // every word holds 16 counters, each row of the sketch uses one counter of a word
+  std::vector<uint64_t> _table;
+  size_t _sample_size{0};
+  size_t _additions{0};
+};
+
 // A single shard of sharded cache.
+//
+// An entry is in the LRU lists only while the cache holds the sole reference to it, and it is
+// promoted there when the last handle is released instead of on every hit. Hence hits on entries
+// already referenced, e.g. whole indexes held by running searchers, only change the reference
+// count under the shared lock, and releases that leave other handles take no lock at all.
+// Everything else, and every lookup under TINY_LFU which records the access in the frequency
+// sketch, takes the exclusive lock.
 class LRUCache {
  public:
   LRUCache();
@@ -263,59 +390,120 @@ class LRUCache {
   // Separate from constructor so caller can easily make an array of LRUCache
   void set_capacity(size_t capacity);
 
+  void set_eviction_policy(CacheEvictionPolicy policy);
+  CacheEvictionPolicy get_eviction_policy();
+
+  void set_eviction_listener(void (*listener)(const CacheKey& key, void* value));
+
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* insert(const CacheKey& key, uint32_t hash, void* value, size_t charge,
                         void (*deleter)(const CacheKey& key, void* value),
-                        CachePriority priority = CachePriority::NORMAL);
+                        CachePriority priority = CachePriority::NORMAL, uint32_t group = 0);
   Cache::Handle* lookup(const CacheKey& key, uint32_t hash);
   void release(Cache::Handle* handle);
+  void update_charge(Cache::Handle* handle, size_t charge);
   void erase(const CacheKey& key, uint32_t hash);
+  void erase(Cache::Handle* handle);
   int prune();
+  size_t evict_to(size_t usage);
+  size_t evict_group(uint32_t group, size_t charge);
+  // Append the keys of up to [limit] entries to [keys], see Cache::get_hot_keys.
+  void get_hot_keys(size_t limit, std::vector<std::string>* keys);
 
   uint64_t get_lookup_count();
   uint64_t get_hit_count();
   size_t get_usage();
   size_t get_capacity();
 
+  struct PolicyStats {
+    uint64_t lookup_count{0};
+    uint64_t hit_count{0};
+  };
+  PolicyStats get_policy_stats(CacheEvictionPolicy policy);
+  uint64_t get_admitted_count();
+  uint64_t get_rejected_count();
+
+  // Share of the capacity given to the admission window of TINY_LFU.
+  static constexpr double kWindowRatio = 0.01;
+  // Average charge assumed to size the frequency sketch of TINY_LFU.
+  static constexpr size_t kSketchAverageCharge = 16 * 1024;
+
  private:
   void _lru_remove(LRUHandle* e);
   void _lru_append(LRUHandle* list, LRUHandle* e);
+  // The list an unreferenced entry in cache belongs to.
+  LRUHandle* _lru_list(LRUHandle* e) { return e->in_window ? &_window : &_lru; }
+  // Dummy head of the list of the unreferenced entries of [group], created on first use.
+  LRUHandle* _group_list(uint32_t group);
   bool _unref(LRUHandle* e);
+  // Add a reference to [e] if it is referenced by a handle already, i.e. not in the LRU lists.
+  static bool _try_ref_shared(LRUHandle* e);
+  // Drop a reference to [e] if other handles still reference it afterwards, without any lock.
+  static bool _try_unref_shared(LRUHandle* e);
+  void _count_lookup(bool hit);
+  void _uncharge(LRUHandle* e);
   void _evict_from_lru(size_t charge, std::vector<LRUHandle*>* deleted);
+  void _evict_from_lru_tiny_lfu(size_t charge, std::vector<LRUHandle*>* deleted);
   void _evict_one_entry(LRUHandle* e);
+  // Remove an unreferenced entry from the cache without evicting it, e.g. on prune.
+  void _remove_one_entry(LRUHandle* e);
+  // Free an entry whose last reference is gone, out of the lock.
+  void _free(LRUHandle* e);
+  void _resize_tiny_lfu();
 
   // Initialized before use.
   size_t _capacity{0};
+  void (*_eviction_listener)(const CacheKey& key, void* value){nullptr};
 
-  // _mutex protects the following state.
-  std::mutex _mutex;
+  // _mutex protects the following state, the reference counts of entries aside.
+  std::shared_mutex _mutex;
   size_t _usage{0};
+  CacheEvictionPolicy _policy{CacheEvictionPolicy::LRU};
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
+  // With TINY_LFU, this is the main space that entries are admitted to from the window.
   LRUHandle _lru;
 
+  // Dummy head of the admission window of TINY_LFU, empty with LRU. Ordered like _lru.
+  LRUHandle _window;
+
+  // Dummy heads of the lists of the entries in _lru or _window by group, indexed by group.
+  std::vector<std::unique_ptr<LRUHandle>> _groups;
+  size_t _window_capacity{0};
+  size_t _window_usage{0};
+  FrequencySketch _sketch;
+
   HandleTable _table;
 
-  uint64_t _lookup_count{0};
-  uint64_t _hit_count{0};
+  // Counted under the shared lock too.
+  std::atomic<uint64_t> _lookup_count{0};
+  std::atomic<uint64_t> _hit_count{0};
+  std::atomic<uint64_t> _policy_lookup_count[2]{};
+  std::atomic<uint64_t> _policy_hit_count[2]{};
+  uint64_t _admitted_count{0};
+  uint64_t _rejected_count{0};
 };
 
-static const int kNumShardBits = 1;
-static const int kNumShards = 1 << kNumShardBits;
-
 class ShardedLRUCache : public Cache {
  public:
-  explicit ShardedLRUCache(size_t capacity);
+  // The cache is split into 2^[num_shard_bits] shards by key hash, each with its own lock and an
+  // equal share of the capacity. More shards spread the locking of many threads, but an entry
+  // larger than the capacity of its shard is not kept once released.
+  explicit ShardedLRUCache(size_t capacity,
+                           CacheEvictionPolicy policy = CacheEvictionPolicy::LRU,
+                           int num_shard_bits = kDefaultNumShardBits);
   ~ShardedLRUCache() override = default;
   Handle* insert(const CacheKey& key, void* value, size_t charge,
                  void (*deleter)(const CacheKey& key, void* value),
-                 CachePriority priority = CachePriority::NORMAL) override;
+                 CachePriority priority = CachePriority::NORMAL, uint32_t group = 0) override;
   Handle* lookup(const CacheKey& key) override;
   void release(Handle* handle) override;
   void erase(const CacheKey& key) override;
+  void erase(Handle* handle) override;
   void* value(Handle* handle) override;
+  void update_charge(Handle* handle, size_t charge) override;
   uint64_t new_id() override;
   void prune() override;
   void get_cache_status(json* document) override;
@@ -325,14 +513,22 @@ class ShardedLRUCache : public Cache {
   uint64_t get_lookup_count() override;
   uint64_t get_hit_count() override;
   bool adjust_capacity(int64_t delta, size_t min_capacity = 0) override;
+  size_t evict_to(size_t usage) override;
+  size_t evict_group(uint32_t group, size_t charge) override;
+  void set_eviction_listener(void (*listener)(const CacheKey& key, void* value)) override;
+  void set_eviction_policy(CacheEvictionPolicy policy) override;
+  CacheEvictionPolicy get_eviction_policy() override;
+  void get_policy_status(json* document) override;
+  std::vector<std::string> get_hot_keys(size_t limit) override;
 
  private:
   static uint32_t _hash_slice(const CacheKey& s);
-  static uint32_t _shard(uint32_t hash);
+  uint32_t _shard(uint32_t hash) const;
   void _set_capacity(size_t capacity);
   size_t _get_stat(size_t (LRUCache::*mem_fun)());
 
-  LRUCache _shards[kNumShards];
+  const int _num_shard_bits;
+  std::vector<LRUCache> _shards;
   std::mutex _mutex;
   uint64_t _last_id;
   size_t _capacity;
@@ -0,0 +1,357 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/store/spill_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+#include "tenann/common/logging.h"
+#include "tenann/util/crc32c.h"
+
+namespace tenann {
+
+namespace {
+
+struct SpillFileHeader {
+  uint32_t magic;
+  uint32_t key_size;
+  uint64_t size;
+  uint32_t crc;  // crc32c of the key followed by the value
+  uint32_t reserved;
+};
+
+constexpr uint32_t kSpillFileMagic = 0x6c705354;  // "TSpl"
+
+bool WriteAll(int fd, const void* data, size_t size, size_t offset) {
+  auto* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, p, size, offset);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    p += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+bool ReadAll(int fd, void* data, size_t size, size_t offset) {
+  auto* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t nread = pread(fd, p, size, offset);
+    if (nread < 0 && errno == EINTR) {
+      continue;
+    }
+    if (nread <= 0) {
+      return false;
+    }
+    p += nread;
+    size -= nread;
+    offset += nread;
+  }
+  return true;
+}
+
+}  // namespace
+
+SpillCache::SpillCache(std::string dir, size_t capacity)
+    : dir_(std::move(dir)), capacity_(capacity) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir_, ec);
+  T_LOG_IF(ERROR, ec) << "failed to create spill cache directory " << dir_ << ": " << ec.message();
+
+  // entries of a previous process are not tracked by anyone, reclaim their space
+  for (const auto& file : std::filesystem::directory_iterator(dir_, ec)) {
+    if (file.path().extension() == kFileSuffix) {
+      std::filesystem::remove(file.path(), ec);
+    }
+  }
+}
+
+SpillCache::~SpillCache() {
+  std::vector<uint64_t> ids;
+  for (const auto& [key, entry] : entries_) {
+    ids.push_back(entry.id);
+  }
+  RemoveFiles(ids);
+}
+
+bool SpillCache::Put(const CacheKey& key, const void* data, size_t size) {
+  uint64_t ticket = Reserve(key, true);
+  return Commit(key, ticket, data, size);
+}
+
+uint64_t SpillCache::Reserve(const CacheKey& key, bool overwrite) {
+  std::vector<uint64_t> stale;
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = entries_.find(key.to_string());
+    if (it != entries_.end()) {
+      if (!overwrite) {
+        return 0;
+      }
+      // a pending write has no file yet, its `Commit` deletes the file it writes
+      if (!it->second.pending) {
+        DetachLocked(it->second);
+        stale.push_back(it->second.id);
+      }
+      entries_.erase(it);
+    }
+    ticket = next_id_++;
+    entries_.emplace(key.to_string(), Entry{ticket, 0, true, lru_.end()});
+  }
+  RemoveFiles(stale);
+  return ticket;
+}
+
+bool SpillCache::Commit(const CacheKey& key, uint64_t ticket, const void* data, size_t size) {
+  if (data == nullptr) {
+    return CommitStream(key, ticket, [](const ChunkWriter& /* write */) { return false; });
+  }
+  return CommitStream(key, ticket,
+                      [data, size](const ChunkWriter& write) { return write(data, size); });
+}
+
+bool SpillCache::CommitStream(const CacheKey& key, uint64_t ticket,
+                              const std::function<bool(const ChunkWriter& write)>& write) {
+  auto cancel = [this, &key, ticket]() {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = entries_.find(key.to_string());
+    if (it != entries_.end() && it->second.id == ticket) {
+      entries_.erase(it);
+    }
+  };
+
+  // the header is written last, once the size and the checksum of the value are known
+  std::string path = FilePath(ticket);
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  size_t max_size = capacity();
+  size_t size = 0;
+  uint32_t crc = Crc32c(key.data(), key.size());
+  // abandoned writes and values larger than the capacity are not I/O errors
+  bool io_ok = fd >= 0 && WriteAll(fd, key.data(), key.size(), sizeof(SpillFileHeader));
+  bool rejected = false;
+  bool written = io_ok && write([&](const void* data, size_t chunk_size) {
+    rejected = rejected || size + chunk_size > max_size;
+    if (!rejected &&
+        !WriteAll(fd, data, chunk_size, sizeof(SpillFileHeader) + key.size() + size)) {
+      io_ok = false;
+    }
+    if (rejected || !io_ok) {
+      return false;
+    }
+    crc = Crc32c(data, chunk_size, crc);
+    size += chunk_size;
+    return true;
+  });
+  written = written && io_ok && !rejected;
+  if (written) {
+    SpillFileHeader header{kSpillFileMagic, static_cast<uint32_t>(key.size()), size, crc, 0};
+    io_ok = WriteAll(fd, &header, sizeof(header), 0);
+  }
+  if (fd >= 0) {
+    io_ok = close(fd) == 0 && io_ok;
+  }
+  if (!written || !io_ok) {
+    T_LOG_IF(WARNING, !io_ok) << "failed to write spill cache file " << path << ": "
+                              << strerror(errno);
+    unlink(path.c_str());
+    cancel();
+    return false;
+  }
+
+  bool committed = false;
+  std::vector<uint64_t> victims;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = entries_.find(key.to_string());
+    if (it == entries_.end() || it->second.id != ticket) {
+      // cancelled or superseded while the file was being written
+      victims.push_back(ticket);
+    } else {
+      committed = true;
+      Entry& entry = it->second;
+      entry.pending = false;
+      entry.size = size;
+      entry.lru_pos = lru_.insert(lru_.end(), it->first);
+      usage_ += size;
+      write_count_++;
+      victims = EvictLocked();
+    }
+  }
+  RemoveFiles(victims);
+  return committed;
+}
+
+bool SpillCache::Get(const CacheKey& key, std::string* data) {
+  uint64_t id;
+  size_t size;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    lookup_count_++;
+    auto it = entries_.find(key.to_string());
+    if (it == entries_.end() || it->second.pending) {
+      return false;
+    }
+    id = it->second.id;
+    size = it->second.size;
+    lru_.splice(lru_.end(), lru_, it->second.lru_pos);
+  }
+
+  // the file may be evicted concurrently, which is a miss as well
+  std::string path = FilePath(id);
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  SpillFileHeader header;
+  std::string stored_key(key.size(), '\0');
+  data->resize(size);
+  bool ok = ReadAll(fd, &header, sizeof(header), 0) && header.magic == kSpillFileMagic &&
+            header.key_size == key.size() && header.size == size &&
+            ReadAll(fd, stored_key.data(), key.size(), sizeof(header)) &&
+            ReadAll(fd, data->data(), size, sizeof(header) + key.size()) &&
+            CacheKey(stored_key) == key &&
+            header.crc == Crc32c(data->data(), size, Crc32c(key.data(), key.size()));
+  close(fd);
+
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = entries_.find(key.to_string());
+  if (!ok) {
+    data->clear();
+    if (it != entries_.end() && it->second.id == id) {
+      T_LOG(WARNING) << "drop corrupted spill cache file " << path;
+      DetachLocked(it->second);
+      entries_.erase(it);
+      unlink(path.c_str());
+    }
+    return false;
+  }
+  hit_count_++;
+  return true;
+}
+
+bool SpillCache::Contains(const CacheKey& key) {
+  std::lock_guard<std::mutex> l(mutex_);
+  auto it = entries_.find(key.to_string());
+  return it != entries_.end() && !it->second.pending;
+}
+
+void SpillCache::Erase(const CacheKey& key) {
+  std::vector<uint64_t> stale;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto it = entries_.find(key.to_string());
+    if (it == entries_.end()) {
+      return;
+    }
+    if (!it->second.pending) {
+      DetachLocked(it->second);
+      stale.push_back(it->second.id);
+    }
+    entries_.erase(it);
+  }
+  RemoveFiles(stale);
+}
+
+void SpillCache::SetCapacity(size_t capacity) {
+  std::vector<uint64_t> victims;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    capacity_ = capacity;
+    victims = EvictLocked();
+  }
+  RemoveFiles(victims);
+}
+
+json SpillCache::status() {
+  std::lock_guard<std::mutex> l(mutex_);
+  json doc;
+  doc["dir"] = dir_;
+  doc["capacity"] = capacity_;
+  doc["usage"] = usage_;
+  doc["usage_ratio"] = capacity_ != 0 ? static_cast<float>(usage_) / capacity_ : 0.0f;
+  doc["entry_count"] = lru_.size();
+  doc["lookup_count"] = lookup_count_;
+  doc["hit_count"] = hit_count_;
+  doc["hit_ratio"] =
+      lookup_count_ != 0 ? static_cast<float>(hit_count_) / lookup_count_ : 0.0f;
+  doc["write_count"] = write_count_;
+  doc["evict_count"] = evict_count_;
+  return doc;
+}
+
+size_t SpillCache::capacity() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return capacity_;
+}
+
+size_t SpillCache::usage() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return usage_;
+}
+
+uint64_t SpillCache::lookup_count() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return lookup_count_;
+}
+
+uint64_t SpillCache::hit_count() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return hit_count_;
+}
+
+std::string SpillCache::FilePath(uint64_t id) const {
+  return dir_ + "/" + std::to_string(id) + kFileSuffix;
+}
+
+void SpillCache::DetachLocked(const Entry& entry) {
+  lru_.erase(entry.lru_pos);
+  usage_ -= entry.size;
+}
+
+std::vector<uint64_t> SpillCache::EvictLocked() {
+  std::vector<uint64_t> victims;
+  while (usage_ > capacity_ && !lru_.empty()) {
+    auto it = entries_.find(lru_.front());
+    victims.push_back(it->second.id);
+    DetachLocked(it->second);
+    entries_.erase(it);
+    evict_count_++;
+  }
+  return victims;
+}
+
+void SpillCache::RemoveFiles(const std::vector<uint64_t>& ids) const {
+  for (uint64_t id : ids) {
+    unlink(FilePath(id).c_str());
+  }
+}
+
+}  // namespace tenann
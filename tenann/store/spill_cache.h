@@ -0,0 +1,147 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tenann/common/json.h"
+#include "tenann/common/macros.h"
+#include "tenann/store/lru_cache.h"
+
+namespace tenann {
+
+/**
+ * @brief A byte cache on a local directory with its own capacity and LRU, used as the second tier
+ * of `IndexCache` to keep entries evicted from memory on a local SSD.
+ *
+ * Every entry is stored in its own file together with its key and a checksum, a corrupted or
+ * vanished file is reported as a miss. The directory is owned by the cache, stale entry files left
+ * by a previous process are removed when the cache is created. Thread-safe, file I/O is done out of
+ * the lock.
+ *
+ * Writes can be split into `Reserve` and `Commit` so that the slow write can be done in the
+ * background: an `Erase` of the key between them cancels the pending write.
+ */
+class SpillCache {
+ public:
+  static constexpr const char* kFileSuffix = ".spill";
+
+  SpillCache(std::string dir, size_t capacity);
+  ~SpillCache();
+
+  T_FORBID_COPY_AND_ASSIGN(SpillCache);
+  T_FORBID_MOVE(SpillCache);
+
+  /// Store [size] bytes at [data] under [key], replacing any previous value.
+  bool Put(const CacheKey& key, const void* data, size_t size);
+
+  /**
+   * @brief Reserve a pending write for [key].
+   *
+   * @param overwrite Whether to replace a value that is already cached
+   * @return A ticket to pass to `Commit`, or 0 if the key is cached or being written and
+   *         [overwrite] is false
+   */
+  uint64_t Reserve(const CacheKey& key, bool overwrite);
+
+  /**
+   * @brief Write the value of a pending write and make it visible, evicting the least recently
+   * used entries if the cache gets larger than its capacity.
+   *
+   * Pass nullptr as [data] to abandon the write.
+   *
+   * @return false if the write has been cancelled or superseded, the value does not fit into the
+   *         cache or the file could not be written
+   */
+  bool Commit(const CacheKey& key, uint64_t ticket, const void* data, size_t size);
+
+  /// Append [size] bytes at [data] to the value being written, return false to abandon it.
+  using ChunkWriter = std::function<bool(const void* data, size_t size)>;
+
+  /**
+   * @brief Like `Commit`, but the value is streamed to its file by [write], which passes it to
+   * the given `ChunkWriter` in consecutive chunks, so that it is never held in memory as a whole.
+   *
+   * [write] returns false to abandon the write. The write is also abandoned as soon as the value
+   * gets larger than the capacity.
+   */
+  bool CommitStream(const CacheKey& key, uint64_t ticket,
+                    const std::function<bool(const ChunkWriter& write)>& write);
+
+  /// Read the value of [key] into [data], return false on a miss.
+  bool Get(const CacheKey& key, std::string* data);
+
+  bool Contains(const CacheKey& key);
+
+  /// Drop [key] and cancel its pending write if any.
+  void Erase(const CacheKey& key);
+
+  void SetCapacity(size_t capacity);
+
+  json status();
+
+  const std::string& dir() const { return dir_; }
+  size_t capacity();
+  size_t usage();
+  uint64_t lookup_count();
+  uint64_t hit_count();
+
+ private:
+  struct Entry {
+    uint64_t id;
+    size_t size;
+    bool pending;
+    std::list<std::string>::iterator lru_pos;
+  };
+
+  std::string FilePath(uint64_t id) const;
+
+  /// Remove [entry] from the LRU list and the usage, the caller deletes its file.
+  void DetachLocked(const Entry& entry);
+
+  /// Evict entries until the usage fits into the capacity, return the ids of the files to delete.
+  std::vector<uint64_t> EvictLocked();
+
+  void RemoveFiles(const std::vector<uint64_t>& ids) const;
+
+  const std::string dir_;
+
+  std::mutex mutex_;
+  size_t capacity_;
+  size_t usage_ = 0;
+  uint64_t next_id_ = 1;
+  std::unordered_map<std::string, Entry> entries_;
+  // front is the least recently used key, pending entries are not in the list
+  std::list<std::string> lru_;
+
+  uint64_t lookup_count_ = 0;
+  uint64_t hit_count_ = 0;
+  uint64_t write_count_ = 0;
+  uint64_t evict_count_ = 0;
+};
+
+}  // namespace tenann
@@ -0,0 +1,159 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/buffer_io.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "faiss/impl/FaissAssert.h"
+#include "tenann/util/thread_pool.h"
+
+namespace tenann {
+
+RandomAccessSource::RandomAccessSource(std::string name, size_t size, ReadAtFunc read_at)
+    : name_(std::move(name)), size_(size), read_at_(std::move(read_at)) {}
+
+std::shared_ptr<RandomAccessSource> RandomAccessSource::FromBuffer(std::string name,
+                                                                   const uint8_t* data,
+                                                                   size_t size) {
+  return std::make_shared<RandomAccessSource>(
+      std::move(name), size, [data, size](void* buf, size_t n, uint64_t offset) -> int64_t {
+        if (offset >= size) return 0;
+        n = std::min<size_t>(n, size - offset);
+        memcpy(buf, data + offset, n);
+        return n;
+      });
+}
+
+std::shared_ptr<RandomAccessSource> RandomAccessSource::FromFile(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  FAISS_THROW_IF_NOT_FMT(fd != -1, "could not open %s: %s", path.c_str(), strerror(errno));
+  // the descriptor is closed with the last copy of the read function
+  std::shared_ptr<int> file(new int(fd), [](int* fd) {
+    close(*fd);
+    delete fd;
+  });
+  struct stat st;
+  FAISS_THROW_IF_NOT_FMT(fstat(fd, &st) == 0, "fstat %s failed: %s", path.c_str(),
+                         strerror(errno));
+  return std::make_shared<RandomAccessSource>(
+      path, st.st_size, [file](void* buf, size_t n, uint64_t offset) -> int64_t {
+        ssize_t ret = pread(*file, buf, n, offset);
+        return ret < 0 ? -errno : ret;
+      });
+}
+
+void RandomAccessSource::Read(IoRequest* requests, size_t n) const {
+  for (size_t i = 0; i < n; i++) {
+    IoRequest& request = requests[i];
+    // the callback may return fewer bytes than requested before the end of the source
+    int64_t done = 0;
+    while (done < static_cast<int64_t>(request.size)) {
+      int64_t ret = read_at_(static_cast<uint8_t*>(request.buf) + done, request.size - done,
+                             request.offset + done);
+      if (ret <= 0) {
+        done = ret < 0 ? ret : done;
+        break;
+      }
+      done += ret;
+    }
+    request.result = done;
+  }
+}
+
+std::vector<uint8_t> RandomAccessSource::ReadAll(int parallelism, size_t chunk_size) const {
+  std::vector<uint8_t> data(size_);
+  size_t num_chunks = (size_ + chunk_size - 1) / chunk_size;
+  ThreadPool::GetIoInstance()->ParallelFor(num_chunks, parallelism, [&](size_t i) {
+    IoRequest request;
+    request.buf = data.data() + i * chunk_size;
+    request.size = std::min(chunk_size, size_ - i * chunk_size);
+    request.offset = i * chunk_size;
+    Read(&request, 1);
+    FAISS_THROW_IF_NOT_FMT(request.result == static_cast<int64_t>(request.size),
+                           "read %s at %zu: read_bytes: %ld, expected_read_size: %zu (%s)",
+                           name_.c_str(), request.offset, request.result, request.size,
+                           request.result < 0 ? strerror(-request.result) : "short read");
+  });
+  return data;
+}
+
+SourceIOReader::SourceIOReader(std::shared_ptr<RandomAccessSource> source, size_t buffer_size)
+    : source_(std::move(source)), buffer_(buffer_size) {
+  name = source_->name();
+}
+
+size_t SourceIOReader::operator()(void* ptr, size_t size, size_t nitems) {
+  if (size == 0 || position_ >= source_->size()) return 0;
+  nitems = std::min(nitems, (source_->size() - position_) / size);
+  size_t total = size * nitems;
+  auto* out = static_cast<uint8_t*>(ptr);
+
+  while (total > 0) {
+    // serve what the buffer holds
+    if (position_ >= buffer_offset_ && position_ < buffer_offset_ + buffer_size_) {
+      size_t n = std::min(total, buffer_offset_ + buffer_size_ - position_);
+      memcpy(out, buffer_.data() + (position_ - buffer_offset_), n);
+      out += n;
+      position_ += n;
+      total -= n;
+      continue;
+    }
+
+    // read large chunks directly, refill the buffer for small ones
+    IoRequest request;
+    bool direct = total >= buffer_.size();
+    request.buf = direct ? out : buffer_.data();
+    request.size = direct ? total : std::min(buffer_.size(), source_->size() - position_);
+    request.offset = position_;
+    source_->Read(&request, 1);
+    FAISS_THROW_IF_NOT_FMT(request.result == static_cast<int64_t>(request.size),
+                           "read %s at %zu: read_bytes: %ld, expected_read_size: %zu (%s)",
+                           name.c_str(), position_, request.result, request.size,
+                           request.result < 0 ? strerror(-request.result) : "short read");
+    if (direct) {
+      out += total;
+      position_ += total;
+      total = 0;
+    } else {
+      buffer_offset_ = position_;
+      buffer_size_ = request.size;
+    }
+  }
+  return nitems;
+}
+
+void SourceIOReader::Seek(size_t position) {
+  FAISS_THROW_IF_NOT_FMT(position <= source_->size(), "seek %s to %zu beyond its size %zu",
+                         name.c_str(), position, source_->size());
+  position_ = position;
+}
+
+size_t CallbackIOWriter::operator()(const void* ptr, size_t size, size_t nitems) {
+  write_(ptr, size * nitems);
+  return nitems;
+}
+
+}  // namespace tenann
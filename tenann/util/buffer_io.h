@@ -0,0 +1,116 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "faiss/impl/io.h"
+#include "tenann/util/io_backend.h"
+
+namespace tenann {
+
+/**
+ * @brief Random access to the bytes of an index stored out of the local filesystem, e.g. inside a
+ * segment file or in object storage.
+ *
+ * The name identifies the bytes, the index cache and the block cache keys are derived from it.
+ */
+class RandomAccessSource {
+ public:
+  /// Read [size] bytes at [offset] into [buf], return the number of bytes read or -errno.
+  /// Called concurrently by the threads reading the index.
+  using ReadAtFunc = std::function<int64_t(void* buf, size_t size, uint64_t offset)>;
+
+  RandomAccessSource(std::string name, size_t size, ReadAtFunc read_at);
+
+  /// Source over the [size] bytes at [data], which must outlive the source.
+  static std::shared_ptr<RandomAccessSource> FromBuffer(std::string name, const uint8_t* data,
+                                                        size_t size);
+
+  /// Source over the local file at [path] read with pread, throw if it could not be opened.
+  static std::shared_ptr<RandomAccessSource> FromFile(const std::string& path);
+
+  /// Read the [n] requests, a request stops short at the end of the source only. Failures are
+  /// reported through `IoRequest::result` rather than thrown.
+  void Read(IoRequest* requests, size_t n) const;
+
+  /// Read the whole source with up to [parallelism] reads of [chunk_size] bytes in flight.
+  std::vector<uint8_t> ReadAll(int parallelism, size_t chunk_size = kDefaultChunkSize) const;
+
+  static constexpr size_t kDefaultChunkSize = 4 << 20;
+
+  const std::string& name() const { return name_; }
+  size_t size() const { return size_; }
+
+ private:
+  std::string name_;
+  size_t size_;
+  ReadAtFunc read_at_;
+};
+
+/**
+ * @brief Sequential faiss reader over a `RandomAccessSource`.
+ *
+ * Small reads, which make up most of an index header, are served from a read-ahead buffer.
+ */
+class SourceIOReader : public faiss::IOReader {
+ public:
+  static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+  explicit SourceIOReader(std::shared_ptr<RandomAccessSource> source,
+                          size_t buffer_size = kDefaultBufferSize);
+
+  size_t operator()(void* ptr, size_t size, size_t nitems) override;
+
+  /// Offset of the next byte to read
+  size_t position() const { return position_; }
+  void Seek(size_t position);
+
+  const std::shared_ptr<RandomAccessSource>& source() const { return source_; }
+
+ private:
+  std::shared_ptr<RandomAccessSource> source_;
+  size_t position_ = 0;
+
+  std::vector<uint8_t> buffer_;
+  /// Offset of the buffered bytes in the source
+  size_t buffer_offset_ = 0;
+  size_t buffer_size_ = 0;
+};
+
+/// Faiss writer passing the bytes to a callback, e.g. to stream an index into a segment file.
+class CallbackIOWriter : public faiss::IOWriter {
+ public:
+  using WriteFunc = std::function<void(const void* data, size_t size)>;
+
+  explicit CallbackIOWriter(WriteFunc write) : write_(std::move(write)) {}
+
+  size_t operator()(const void* ptr, size_t size, size_t nitems) override;
+
+ private:
+  WriteFunc write_;
+};
+
+}  // namespace tenann
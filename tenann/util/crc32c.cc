@@ -0,0 +1,82 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/crc32c.h"
+
+#include <array>
+#include <cstring>
+
+namespace tenann {
+
+namespace {
+
+constexpr uint32_t kPolynomial = 0x82f63b78;  // reversed Castagnoli polynomial
+
+// Tables of the slicing-by-8 algorithm, tables[k][b] is the crc of byte b followed by k zeros
+struct Crc32cTables {
+  std::array<std::array<uint32_t, 256>, 8> tables;
+
+  Crc32cTables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int i = 0; i < 8; i++) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+      }
+      tables[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+      for (size_t k = 1; k < 8; k++) {
+        uint32_t prev = tables[k - 1][b];
+        tables[k][b] = (prev >> 8) ^ tables[0][prev & 0xff];
+      }
+    }
+  }
+};
+
+const Crc32cTables& GetTables() {
+  static const Crc32cTables tables;
+  return tables;
+}
+
+}  // namespace
+
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc) {
+  const auto& t = GetTables().tables;
+  const auto* p = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+
+  // 8 bytes at a time, the bytes are consumed in little endian order
+  while (size >= 8) {
+    uint32_t lo;
+    uint32_t hi;
+    memcpy(&lo, p, 4);
+    memcpy(&hi, p + 4, 4);
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  return ~crc;
+}
+
+}  // namespace tenann
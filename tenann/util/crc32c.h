@@ -0,0 +1,35 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tenann {
+
+/**
+ * @brief CRC-32C (Castagnoli) checksum of [size] bytes at [data].
+ *
+ * Pass the checksum of the preceding bytes as [crc] to checksum data spread over several buffers,
+ * e.g. `Crc32c(b, nb, Crc32c(a, na))` equals the checksum of `a` followed by `b`.
+ */
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+}  // namespace tenann
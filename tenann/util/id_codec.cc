@@ -0,0 +1,288 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/id_codec.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "tenann/common/logging.h"
+
+namespace tenann {
+
+namespace {
+
+constexpr size_t kBlockHeaderSize = sizeof(int64_t) + sizeof(uint8_t);
+
+template <typename T>
+T LoadUnaligned(const uint8_t* p) {
+  T v;
+  memcpy(&v, p, sizeof(T));
+  return v;
+}
+
+template <typename T>
+void Append(std::vector<uint8_t>* out, T v) {
+  auto pos = out->size();
+  out->resize(pos + sizeof(T));
+  memcpy(out->data() + pos, &v, sizeof(T));
+}
+
+bool IsSorted(const int64_t* ids, size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    if (ids[i] < ids[i - 1]) return false;
+  }
+  return true;
+}
+
+int BitWidth(uint64_t v) {
+  int width = 0;
+  while (v != 0) {
+    width++;
+    v >>= 1;
+  }
+  return width;
+}
+
+size_t NumBlocks(size_t n) { return (n + IdCodec::kBlockSize - 1) / IdCodec::kBlockSize; }
+
+size_t BlockCount(size_t n, size_t block_no) {
+  return std::min(IdCodec::kBlockSize, n - block_no * IdCodec::kBlockSize);
+}
+
+size_t PackedSize(size_t count, int width) { return ((count - 1) * width + 7) / 8; }
+
+int BlockWidth(const int64_t* ids, size_t count) {
+  uint64_t max_delta = 0;
+  for (size_t i = 1; i < count; i++) {
+    uint64_t delta = static_cast<uint64_t>(ids[i]) - static_cast<uint64_t>(ids[i - 1]);
+    max_delta = std::max(max_delta, delta);
+  }
+  return BitWidth(max_delta);
+}
+
+size_t DeltaPackedSize(const int64_t* ids, size_t n) {
+  size_t num_blocks = NumBlocks(n);
+  size_t size = num_blocks * sizeof(uint32_t);
+  for (size_t b = 0; b < num_blocks; b++) {
+    auto count = BlockCount(n, b);
+    size += kBlockHeaderSize + PackedSize(count, BlockWidth(ids + b * IdCodec::kBlockSize, count));
+  }
+  return size;
+}
+
+/// Read the [i]-th [width]-bit value of a little-endian bit stream.
+uint64_t UnpackAt(const uint8_t* packed, int width, size_t i) {
+  uint64_t v = 0;
+  size_t bit = i * width;
+  for (int got = 0; got < width;) {
+    size_t byte = bit / 8;
+    int shift = bit % 8;
+    int take = std::min(8 - shift, width - got);
+    uint64_t bits = (packed[byte] >> shift) & ((1u << take) - 1);
+    v |= bits << got;
+    got += take;
+    bit += take;
+  }
+  return v;
+}
+
+void PackBlock(const int64_t* ids, size_t count, std::vector<uint8_t>* out) {
+  int width = BlockWidth(ids, count);
+  Append<int64_t>(out, ids[0]);
+  Append<uint8_t>(out, static_cast<uint8_t>(width));
+
+  auto pos = out->size();
+  out->resize(pos + PackedSize(count, width), 0);
+  uint8_t* packed = out->data() + pos;
+  size_t bit = 0;
+  for (size_t i = 1; i < count; i++) {
+    uint64_t v = static_cast<uint64_t>(ids[i]) - static_cast<uint64_t>(ids[i - 1]);
+    for (int put = 0; put < width;) {
+      size_t byte = bit / 8;
+      int shift = bit % 8;
+      int take = std::min(8 - shift, width - put);
+      packed[byte] |= static_cast<uint8_t>(((v >> put) & ((1u << take) - 1)) << shift);
+      put += take;
+      bit += take;
+    }
+  }
+}
+
+/// Decode the first [count] ids of the block at [block].
+void UnpackBlock(const uint8_t* block, size_t count, int64_t* ids) {
+  auto v = static_cast<uint64_t>(LoadUnaligned<int64_t>(block));
+  int width = block[sizeof(int64_t)];
+  const uint8_t* packed = block + kBlockHeaderSize;
+  ids[0] = static_cast<int64_t>(v);
+  for (size_t i = 1; i < count; i++) {
+    v += UnpackAt(packed, width, i - 1);
+    ids[i] = static_cast<int64_t>(v);
+  }
+}
+
+}  // namespace
+
+IdCodec::Encoding IdCodec::ChooseEncoding(const int64_t* ids, size_t n) {
+  if (n == 0) return kRaw;
+
+  auto [min_it, max_it] = std::minmax_element(ids, ids + n);
+  auto span = static_cast<uint64_t>(*max_it) - static_cast<uint64_t>(*min_it);
+
+  Encoding best = kRaw;
+  size_t best_size = n * sizeof(int64_t);
+  if (span <= std::numeric_limits<uint32_t>::max()) {
+    size_t size = sizeof(int64_t) + n * sizeof(uint32_t);
+    if (size < best_size) {
+      best = kBase32;
+      best_size = size;
+    }
+  }
+  if (IsSorted(ids, n) && DeltaPackedSize(ids, n) < best_size) {
+    best = kDeltaPacked;
+  }
+  return best;
+}
+
+void IdCodec::Encode(const int64_t* ids, size_t n, std::vector<uint8_t>* out) {
+  Encode(ids, n, ChooseEncoding(ids, n), out);
+}
+
+void IdCodec::Encode(const int64_t* ids, size_t n, Encoding encoding, std::vector<uint8_t>* out) {
+  Append<uint8_t>(out, encoding);
+  switch (encoding) {
+    case kRaw: {
+      if (n == 0) break;
+      auto pos = out->size();
+      out->resize(pos + n * sizeof(int64_t));
+      memcpy(out->data() + pos, ids, n * sizeof(int64_t));
+      break;
+    }
+    case kBase32: {
+      int64_t base = n == 0 ? 0 : *std::min_element(ids, ids + n);
+      Append<int64_t>(out, base);
+      for (size_t i = 0; i < n; i++) {
+        auto offset = static_cast<uint64_t>(ids[i]) - static_cast<uint64_t>(base);
+        T_LOG_IF(ERROR, offset > std::numeric_limits<uint32_t>::max())
+            << "ids span more than 2^32, can not be encoded with base32";
+        Append<uint32_t>(out, static_cast<uint32_t>(offset));
+      }
+      break;
+    }
+    case kDeltaPacked: {
+      T_LOG_IF(ERROR, !IsSorted(ids, n)) << "ids must be sorted to be delta packed";
+      size_t num_blocks = NumBlocks(n);
+      auto table_pos = out->size();
+      out->resize(table_pos + num_blocks * sizeof(uint32_t));
+      auto blocks_pos = out->size();
+      for (size_t b = 0; b < num_blocks; b++) {
+        auto block_offset = static_cast<uint32_t>(out->size() - blocks_pos);
+        memcpy(out->data() + table_pos + b * sizeof(uint32_t), &block_offset, sizeof(uint32_t));
+        PackBlock(ids + b * kBlockSize, BlockCount(n, b), out);
+      }
+      break;
+    }
+    default:
+      T_LOG(ERROR) << "unknown id encoding: " << static_cast<int>(encoding);
+  }
+}
+
+size_t IdCodec::EncodedSize(const uint8_t* data, size_t n) {
+  switch (data[0]) {
+    case kRaw:
+      return 1 + n * sizeof(int64_t);
+    case kBase32:
+      return 1 + sizeof(int64_t) + n * sizeof(uint32_t);
+    case kDeltaPacked: {
+      if (n == 0) return 1;
+      size_t num_blocks = NumBlocks(n);
+      const uint8_t* table = data + 1;
+      const uint8_t* blocks = table + num_blocks * sizeof(uint32_t);
+      auto last_offset = LoadUnaligned<uint32_t>(table + (num_blocks - 1) * sizeof(uint32_t));
+      int width = blocks[last_offset + sizeof(int64_t)];
+      return (blocks - data) + last_offset + kBlockHeaderSize +
+             PackedSize(BlockCount(n, num_blocks - 1), width);
+    }
+    default:
+      T_LOG(ERROR) << "unknown id encoding: " << static_cast<int>(data[0]);
+  }
+  return 0;
+}
+
+void IdCodec::Decode(const uint8_t* data, size_t n, int64_t* ids) {
+  const uint8_t* payload = data + 1;
+  switch (data[0]) {
+    case kRaw:
+      if (n > 0) memcpy(ids, payload, n * sizeof(int64_t));
+      break;
+    case kBase32: {
+      auto base = static_cast<uint64_t>(LoadUnaligned<int64_t>(payload));
+      const uint8_t* offsets = payload + sizeof(int64_t);
+      for (size_t i = 0; i < n; i++) {
+        auto offset = LoadUnaligned<uint32_t>(offsets + i * sizeof(uint32_t));
+        ids[i] = static_cast<int64_t>(base + offset);
+      }
+      break;
+    }
+    case kDeltaPacked: {
+      size_t num_blocks = NumBlocks(n);
+      const uint8_t* blocks = payload + num_blocks * sizeof(uint32_t);
+      for (size_t b = 0; b < num_blocks; b++) {
+        auto block_offset = LoadUnaligned<uint32_t>(payload + b * sizeof(uint32_t));
+        UnpackBlock(blocks + block_offset, BlockCount(n, b), ids + b * kBlockSize);
+      }
+      break;
+    }
+    default:
+      T_LOG(ERROR) << "unknown id encoding: " << static_cast<int>(data[0]);
+  }
+}
+
+int64_t IdCodec::DecodeAt(const uint8_t* data, size_t n, size_t i) {
+  T_DCHECK_LT(i, n);
+  const uint8_t* payload = data + 1;
+  switch (data[0]) {
+    case kRaw:
+      return LoadUnaligned<int64_t>(payload + i * sizeof(int64_t));
+    case kBase32: {
+      auto base = static_cast<uint64_t>(LoadUnaligned<int64_t>(payload));
+      auto offset = LoadUnaligned<uint32_t>(payload + sizeof(int64_t) + i * sizeof(uint32_t));
+      return static_cast<int64_t>(base + offset);
+    }
+    case kDeltaPacked: {
+      size_t num_blocks = NumBlocks(n);
+      size_t b = i / kBlockSize;
+      auto block_offset = LoadUnaligned<uint32_t>(payload + b * sizeof(uint32_t));
+      const uint8_t* block = payload + num_blocks * sizeof(uint32_t) + block_offset;
+      auto v = static_cast<uint64_t>(LoadUnaligned<int64_t>(block));
+      int width = block[sizeof(int64_t)];
+      const uint8_t* packed = block + kBlockHeaderSize;
+      for (size_t j = 0; j < i % kBlockSize; j++) {
+        v += UnpackAt(packed, width, j);
+      }
+      return static_cast<int64_t>(v);
+    }
+    default:
+      T_LOG(ERROR) << "unknown id encoding: " << static_cast<int>(data[0]);
+  }
+  return -1;
+}
+
+}  // namespace tenann
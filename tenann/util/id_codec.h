@@ -0,0 +1,69 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tenann {
+
+/**
+ * @brief Compact encodings of row id arrays.
+ *
+ * The encoded bytes start with the encoding tag, followed by:
+ *   - kRaw: int64_t ids[n]
+ *   - kBase32: int64_t base, uint32_t ids[n] - base, for ids spanning less than 2^32
+ *   - kDeltaPacked: for non-decreasing ids, uint32_t block_offsets[num_blocks] then blocks of
+ *     `kBlockSize` ids, each block being int64_t first, uint8_t bit width and the bit-packed
+ *     deltas between consecutive ids
+ *
+ * The number of ids is not encoded, callers keep it beside the encoded bytes.
+ */
+class IdCodec {
+ public:
+  enum Encoding : uint8_t {
+    kRaw = 0,
+    kBase32 = 1,
+    kDeltaPacked = 2,
+  };
+
+  static constexpr size_t kBlockSize = 128;
+
+  /// The smallest encoding applicable to the ids.
+  static Encoding ChooseEncoding(const int64_t* ids, size_t n);
+
+  /// Append [n] ids encoded with the smallest applicable encoding to [out].
+  static void Encode(const int64_t* ids, size_t n, std::vector<uint8_t>* out);
+
+  /// Append [n] ids encoded with [encoding] to [out], throw if it does not apply to the ids.
+  static void Encode(const int64_t* ids, size_t n, Encoding encoding, std::vector<uint8_t>* out);
+
+  /// Size in bytes of [n] encoded ids.
+  static size_t EncodedSize(const uint8_t* data, size_t n);
+
+  /// Decode all the [n] ids.
+  static void Decode(const uint8_t* data, size_t n, int64_t* ids);
+
+  /// Decode the [i]-th of the [n] ids, only the block holding it is decoded for kDeltaPacked.
+  static int64_t DecodeAt(const uint8_t* data, size_t n, size_t i);
+};
+
+}  // namespace tenann
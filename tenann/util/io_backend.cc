@@ -0,0 +1,375 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/io_backend.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define TENANN_HAS_IO_URING 1
+#else
+#define TENANN_HAS_IO_URING 0
+#endif
+
+#include "tenann/common/logging.h"
+#include "tenann/util/runtime_profile_macros.h"
+#include "tenann/util/stop_watch.h"
+
+namespace tenann {
+
+IoBackend::IoBackend(const std::string& name)
+    : profile_(std::make_unique<RuntimeProfile>(name)) {
+  read_requests_counter_ = T_ADD_COUNTER(profile_, "ReadRequests", TUnit::UNIT);
+  read_bytes_counter_ = T_ADD_COUNTER(profile_, "ReadBytes", TUnit::BYTES);
+  submit_calls_counter_ = T_ADD_COUNTER(profile_, "SubmitCalls", TUnit::UNIT);
+  queue_depth_counter_ = profile_->AddHighWaterMarkCounter(
+      "QueueDepth", TUnit::UNIT, RuntimeProfile::Counter::create_strategy(TUnit::UNIT));
+  read_latency_timer_ = T_ADD_TIMER(profile_, "ReadLatency");
+}
+
+void IoBackend::OnRequestDone(const IoRequest& request, int64_t latency_ns) {
+  T_COUNTER_UPDATE(read_requests_counter_, 1);
+  if (request.result > 0) {
+    T_COUNTER_UPDATE(read_bytes_counter_, request.result);
+  }
+  T_COUNTER_ADD(queue_depth_counter_, -1);
+  T_COUNTER_UPDATE(read_latency_timer_, latency_ns);
+}
+
+/*************************************************************
+ * pread
+ **************************************************************/
+
+class PreadIoBackend : public IoBackend {
+ public:
+  PreadIoBackend() : IoBackend("PreadIoBackend") {}
+
+  void Read(int fd, IoRequest* requests, size_t n) override {
+    for (size_t i = 0; i < n; i++) {
+      IoRequest& request = requests[i];
+      T_COUNTER_ADD(queue_depth_counter_, 1);
+      T_COUNTER_UPDATE(submit_calls_counter_, 1);
+      MonotonicStopWatch watch;
+      watch.start();
+      ssize_t ret;
+      do {
+        ret = pread(fd, request.buf, request.size, request.offset);
+      } while (ret < 0 && errno == EINTR);
+      request.result = ret < 0 ? -errno : ret;
+      OnRequestDone(request, watch.elapsed_time());
+    }
+  }
+
+  size_t max_batch_size() const override { return 1; }
+};
+
+std::unique_ptr<IoBackend> IoBackend::CreatePread() { return std::make_unique<PreadIoBackend>(); }
+
+/*************************************************************
+ * io_uring
+ **************************************************************/
+
+#if TENANN_HAS_IO_URING
+
+/**
+ * io_uring driven by raw syscalls, so that no liburing is required.
+ *
+ * Callers fill the submission queue and enter the kernel under `submit_mutex_`, a single reaper
+ * thread drains the completion queue and wakes up the callers whose requests are all done.
+ * The number of requests in flight is bounded by the size of the completion queue so that no
+ * completion is ever dropped.
+ */
+class IoUringIoBackend : public IoBackend {
+ public:
+  static std::unique_ptr<IoBackend> Create(unsigned queue_depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ring_fd = syscall(__NR_io_uring_setup, queue_depth, &params);
+    if (ring_fd < 0) {
+      T_LOG(WARNING) << "io_uring is not available: " << strerror(errno);
+      return nullptr;
+    }
+
+    std::unique_ptr<IoUringIoBackend> backend(new IoUringIoBackend(ring_fd, params));
+    if (!backend->MapRings()) {
+      T_LOG(WARNING) << "failed to map io_uring rings: " << strerror(errno);
+      return nullptr;
+    }
+    backend->reaper_ = std::thread([backend = backend.get()]() { backend->ReapLoop(); });
+    return backend;
+  }
+
+  ~IoUringIoBackend() override {
+    if (reaper_.joinable()) {
+      // a nop with an empty user_data stops the reaper once everything before it is reaped
+      io_uring_sqe stop;
+      memset(&stop, 0, sizeof(stop));
+      stop.opcode = IORING_OP_NOP;
+      Submit(&stop, 1, nullptr);
+      reaper_.join();
+    }
+    if (sqes_ != nullptr) munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != nullptr && cq_ptr_ != sq_ptr_) munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_ != nullptr) munmap(sq_ptr_, sq_size_);
+    close(ring_fd_);
+  }
+
+  void Read(int fd, IoRequest* requests, size_t n) override {
+    if (n == 0) return;
+
+    Batch batch;
+    batch.remaining = n;
+    std::vector<Slot> slots(n);
+    std::vector<io_uring_sqe> sqes(n);
+    for (size_t i = 0; i < n; i++) {
+      slots[i].backend = this;
+      slots[i].batch = &batch;
+      slots[i].request = &requests[i];
+      slots[i].iov.iov_base = requests[i].buf;
+      slots[i].iov.iov_len = requests[i].size;
+
+      io_uring_sqe& sqe = sqes[i];
+      memset(&sqe, 0, sizeof(sqe));
+      // READV rather than READ, which requires linux 5.6
+      sqe.opcode = IORING_OP_READV;
+      sqe.fd = fd;
+      sqe.off = requests[i].offset;
+      sqe.addr = reinterpret_cast<uint64_t>(&slots[i].iov);
+      sqe.len = 1;
+      sqe.user_data = reinterpret_cast<uint64_t>(&slots[i]);
+    }
+    Submit(sqes.data(), n, slots.data());
+
+    std::unique_lock<std::mutex> lock(batch.mutex);
+    batch.done.wait(lock, [&batch]() { return batch.remaining == 0; });
+  }
+
+  size_t max_batch_size() const override { return cq_entries_; }
+
+ private:
+  struct Batch {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = 0;
+  };
+
+  struct Slot {
+    IoUringIoBackend* backend;
+    Batch* batch;
+    IoRequest* request;
+    iovec iov;
+    MonotonicStopWatch watch;
+
+    void Complete(int64_t result) {
+      request->result = result;
+      backend->OnRequestDone(*request, watch.elapsed_time());
+      // notify under the lock, the batch is destroyed as soon as the caller sees it done
+      std::lock_guard<std::mutex> guard(batch->mutex);
+      if (--batch->remaining == 0) {
+        batch->done.notify_all();
+      }
+    }
+  };
+
+  IoUringIoBackend(int ring_fd, const io_uring_params& params)
+      : IoBackend("IoUringIoBackend"), ring_fd_(ring_fd), params_(params) {
+    sq_entries_ = params.sq_entries;
+    cq_entries_ = params.cq_entries;
+  }
+
+  bool MapRings() {
+    sq_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cq_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+
+    void* sq_ptr = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) return false;
+    sq_ptr_ = sq_ptr;
+
+    if (single_mmap) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      void* cq_ptr = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd_, IORING_OFF_CQ_RING);
+      if (cq_ptr == MAP_FAILED) return false;
+      cq_ptr_ = cq_ptr;
+    }
+
+    sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    auto* sq = static_cast<char*>(sq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+
+    auto* cq = static_cast<char*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+    return true;
+  }
+
+  int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0);
+  }
+
+  /// Submit [n] sqes, the requests failed to be submitted are completed with the error.
+  void Submit(const io_uring_sqe* sqes, size_t n, Slot* slots) {
+    size_t submitted = 0;
+    while (submitted < n) {
+      std::unique_lock<std::mutex> lock(submit_mutex_);
+      slot_available_.wait(lock, [this]() { return in_flight_ < cq_entries_; });
+
+      unsigned count = std::min<size_t>({n - submitted, cq_entries_ - in_flight_, sq_entries_});
+      unsigned tail = *sq_tail_;
+      for (unsigned i = 0; i < count; i++) {
+        unsigned index = (tail + i) & sq_mask_;
+        sqes_[index] = sqes[submitted + i];
+        sq_array_[index] = index;
+        if (slots != nullptr) {
+          slots[submitted + i].watch.start();
+        }
+      }
+      __atomic_store_n(sq_tail_, tail + count, __ATOMIC_RELEASE);
+      in_flight_ += count;
+      T_COUNTER_ADD(queue_depth_counter_, count);
+
+      unsigned pending = count;
+      while (pending > 0) {
+        T_COUNTER_UPDATE(submit_calls_counter_, 1);
+        int ret = Enter(pending, 0, 0);
+        if (ret >= 0) {
+          pending -= ret;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+          break;
+        }
+      }
+
+      if (pending > 0) {
+        // the kernel consumes sqes only inside io_uring_enter, take back the rejected ones
+        int err = errno;
+        __atomic_store_n(sq_tail_, tail + count - pending, __ATOMIC_RELEASE);
+        in_flight_ -= pending;
+        lock.unlock();
+        for (unsigned i = count - pending; i < count && slots != nullptr; i++) {
+          slots[submitted + i].Complete(-err);
+        }
+      }
+      submitted += count;
+    }
+  }
+
+  void ReapLoop() {
+    bool stopped = false;
+    while (!stopped) {
+      int ret = Enter(0, 1, IORING_ENTER_GETEVENTS);
+      if (ret < 0 && errno != EINTR) {
+        T_LOG(WARNING) << "io_uring_enter failed while waiting for completions: "
+                       << strerror(errno);
+      }
+
+      unsigned head = *cq_head_;
+      unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      unsigned reaped = tail - head;
+      for (; head != tail; head++) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        if (cqe.user_data == 0) {
+          T_COUNTER_ADD(queue_depth_counter_, -1);
+          stopped = true;
+        } else {
+          reinterpret_cast<Slot*>(cqe.user_data)->Complete(cqe.res);
+        }
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+      if (reaped > 0) {
+        std::lock_guard<std::mutex> guard(submit_mutex_);
+        in_flight_ -= reaped;
+        slot_available_.notify_all();
+      }
+    }
+  }
+
+  int ring_fd_;
+  io_uring_params params_;
+  unsigned sq_entries_ = 0;
+  unsigned cq_entries_ = 0;
+
+  void* sq_ptr_ = nullptr;
+  size_t sq_size_ = 0;
+  void* cq_ptr_ = nullptr;
+  size_t cq_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  std::mutex submit_mutex_;
+  std::condition_variable slot_available_;
+  size_t in_flight_ = 0;
+  std::thread reaper_;
+};
+
+std::unique_ptr<IoBackend> IoBackend::CreateIoUring(unsigned queue_depth) {
+  return IoUringIoBackend::Create(queue_depth);
+}
+
+#else
+
+std::unique_ptr<IoBackend> IoBackend::CreateIoUring(unsigned queue_depth) { return nullptr; }
+
+#endif
+
+IoBackend* IoBackend::GetInstance() {
+  static std::unique_ptr<IoBackend> instance = []() {
+    auto backend = CreateIoUring();
+    return backend != nullptr ? std::move(backend) : CreatePread();
+  }();
+  return instance.get();
+}
+
+}  // namespace tenann
@@ -0,0 +1,100 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "tenann/common/macros.h"
+#include "tenann/util/runtime_profile.h"
+
+namespace tenann {
+
+struct IoRequest {
+  void* buf = nullptr;
+  size_t size = 0;
+  uint64_t offset = 0;
+  /// Bytes read, or -errno on failure, filled in by the backend
+  int64_t result = 0;
+};
+
+/**
+ * @brief Positional reads from files, shared by all threads reading an index.
+ *
+ * Every backend keeps the following counters in its profile:
+ *   - ReadRequests/ReadBytes: number of requests completed and bytes read
+ *   - SubmitCalls: number of syscalls issuing the requests, lower than ReadRequests if the
+ *     backend batches them
+ *   - QueueDepth: requests in flight, the profile reports the peak
+ *   - ReadLatency: time from the submission to the completion of requests, summed over requests
+ */
+class IoBackend {
+ public:
+  static constexpr unsigned kDefaultQueueDepth = 256;
+
+  virtual ~IoBackend() = default;
+
+  T_FORBID_COPY_AND_ASSIGN(IoBackend);
+  T_FORBID_MOVE(IoBackend);
+
+  /// The io_uring backend if the kernel supports it, otherwise the pread backend.
+  static IoBackend* GetInstance();
+
+  /// Backend issuing a blocking pread for each request.
+  static std::unique_ptr<IoBackend> CreatePread();
+
+  /**
+   * @brief Backend submitting requests to an io_uring shared by all callers, so that the
+   * requests of concurrent callers are in flight together.
+   *
+   * @return nullptr if io_uring is not available, e.g. on kernels older than 5.1
+   */
+  static std::unique_ptr<IoBackend> CreateIoUring(unsigned queue_depth = kDefaultQueueDepth);
+
+  /**
+   * @brief Read [n] requests from [fd] and block until all of them are done.
+   *
+   * Failures are reported through `IoRequest::result` rather than thrown. Thread-safe.
+   */
+  virtual void Read(int fd, IoRequest* requests, size_t n) = 0;
+
+  /// Number of requests worth passing to a single `Read`, 1 if the backend reads them one by one.
+  virtual size_t max_batch_size() const = 0;
+
+  const std::string& name() const { return profile_->name(); }
+  RuntimeProfile* profile() { return profile_.get(); }
+
+ protected:
+  explicit IoBackend(const std::string& name);
+
+  /// Account for a finished request, [latency_ns] is measured from its submission.
+  void OnRequestDone(const IoRequest& request, int64_t latency_ns);
+
+  std::unique_ptr<RuntimeProfile> profile_;
+  RuntimeProfile::Counter* read_requests_counter_ = nullptr;
+  RuntimeProfile::Counter* read_bytes_counter_ = nullptr;
+  RuntimeProfile::Counter* submit_calls_counter_ = nullptr;
+  RuntimeProfile::HighWaterMarkCounter* queue_depth_counter_ = nullptr;
+  RuntimeProfile::Counter* read_latency_timer_ = nullptr;
+};
+
+}  // namespace tenann
@@ -0,0 +1,80 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/memory_tracker.h"
+
+#include <utility>
+
+namespace tenann {
+
+void CountingMemoryTracker::Consume(int64_t bytes) {
+  int64_t consumption = consumption_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  int64_t peak = peak_consumption_.load(std::memory_order_relaxed);
+  while (consumption > peak &&
+         !peak_consumption_.compare_exchange_weak(peak, consumption, std::memory_order_relaxed)) {
+  }
+  if (parent_ != nullptr) {
+    parent_->Consume(bytes);
+  }
+}
+
+void CountingMemoryTracker::Release(int64_t bytes) {
+  consumption_.fetch_sub(bytes, std::memory_order_relaxed);
+  if (parent_ != nullptr) {
+    parent_->Release(bytes);
+  }
+}
+
+TrackedMemory::TrackedMemory(MemoryTrackerRef tracker, int64_t bytes)
+    : tracker_(std::move(tracker)) {
+  Resize(bytes);
+}
+
+TrackedMemory::~TrackedMemory() { Reset(); }
+
+TrackedMemory::TrackedMemory(TrackedMemory&& other) noexcept
+    : tracker_(std::move(other.tracker_)), bytes_(std::exchange(other.bytes_, 0)) {}
+
+TrackedMemory& TrackedMemory::operator=(TrackedMemory&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    tracker_ = std::move(other.tracker_);
+    bytes_ = std::exchange(other.bytes_, 0);
+  }
+  return *this;
+}
+
+void TrackedMemory::Resize(int64_t bytes) {
+  if (tracker_ == nullptr) {
+    return;
+  }
+  if (bytes > bytes_) {
+    tracker_->Consume(bytes - bytes_);
+  } else if (bytes < bytes_) {
+    tracker_->Release(bytes_ - bytes);
+  }
+  bytes_ = bytes;
+}
+
+void TrackedMemory::Reset() {
+  Resize(0);
+  tracker_ = nullptr;
+}
+
+}  // namespace tenann
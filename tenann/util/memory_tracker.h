@@ -0,0 +1,103 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+/**
+ * @brief Receives every charge and release of memory made on behalf of a host component.
+ *
+ * Implemented by the host to forward tenann memory to its own accounting, e.g. a StarRocks
+ * MemTracker. Calls may come from any thread, including the background threads of the index cache,
+ * so implementations must be thread-safe and must not call back into tenann.
+ */
+class MemoryTracker {
+ public:
+  virtual ~MemoryTracker() = default;
+
+  /// [bytes] have been allocated.
+  virtual void Consume(int64_t bytes) = 0;
+
+  /// [bytes] consumed before have been freed.
+  virtual void Release(int64_t bytes) = 0;
+};
+
+using MemoryTrackerRef = std::shared_ptr<MemoryTracker>;
+
+/**
+ * @brief A tracker that counts the consumption and its peak, optionally forwarding to [parent].
+ */
+class CountingMemoryTracker : public MemoryTracker {
+ public:
+  explicit CountingMemoryTracker(MemoryTrackerRef parent = nullptr) : parent_(std::move(parent)) {}
+
+  void Consume(int64_t bytes) override;
+
+  void Release(int64_t bytes) override;
+
+  int64_t consumption() const { return consumption_.load(std::memory_order_relaxed); }
+
+  int64_t peak_consumption() const { return peak_consumption_.load(std::memory_order_relaxed); }
+
+ private:
+  MemoryTrackerRef parent_;
+  std::atomic<int64_t> consumption_ = 0;
+  std::atomic<int64_t> peak_consumption_ = 0;
+};
+
+/**
+ * @brief Memory of a buffer charged to a tracker for as long as this object lives.
+ *
+ * Resized along with the buffer it stands for, the difference is consumed or released right away.
+ * A null tracker makes it a no-op, so that callers do not need to check whether tracking is on.
+ */
+class TrackedMemory {
+ public:
+  TrackedMemory() = default;
+  explicit TrackedMemory(MemoryTrackerRef tracker, int64_t bytes = 0);
+  ~TrackedMemory();
+
+  T_FORBID_COPY_AND_ASSIGN(TrackedMemory);
+
+  TrackedMemory(TrackedMemory&& other) noexcept;
+  TrackedMemory& operator=(TrackedMemory&& other) noexcept;
+
+  /// Charge [bytes] in total from now on.
+  void Resize(int64_t bytes);
+
+  /// Release all the charged bytes and detach from the tracker.
+  void Reset();
+
+  int64_t bytes() const { return bytes_; }
+
+  const MemoryTrackerRef& tracker() const { return tracker_; }
+
+ private:
+  MemoryTrackerRef tracker_;
+  int64_t bytes_ = 0;
+};
+
+}  // namespace tenann
@@ -0,0 +1,60 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/memory_usage.h"
+
+namespace tenann {
+
+size_t AllocationSize(size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  if (size <= 128) {
+    return (size + 15) & ~static_cast<size_t>(15);
+  }
+  // the largest power of two below [size], whose quarter is the step of the size classes
+  size_t group = size_t{1} << (63 - __builtin_clzll(size - 1));
+  size_t step = group / 4;
+  return (size + step - 1) / step * step;
+}
+
+size_t AllocationSize(const std::string& s) {
+  // an empty string has the capacity of the inline buffer
+  return s.capacity() > std::string().capacity() ? AllocationSize(s.capacity() + 1) : 0;
+}
+
+void MemoryUsage::AddAllocation(const std::string& component, size_t size, size_t n) {
+  AddBytes(component, AllocationSize(size) * n);
+}
+
+void MemoryUsage::AddBytes(const std::string& component, size_t size) {
+  components_[component] += size;
+  total_ += size;
+}
+
+json MemoryUsage::ToJson() const {
+  json doc = json::object();
+  for (const auto& [component, size] : components_) {
+    doc[component] = size;
+  }
+  doc["total"] = total_;
+  return doc;
+}
+
+}  // namespace tenann
@@ -0,0 +1,74 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tenann/common/json.h"
+
+namespace tenann {
+
+/**
+ * @brief Bytes the allocator reserves for a request of [size] bytes, 0 for an empty request.
+ *
+ * Modeled on the size classes of jemalloc, which glibc malloc stays close to: 16-byte steps up to
+ * 128 bytes, and four classes per power of two above, i.e. up to 25% of slack.
+ */
+size_t AllocationSize(size_t size);
+
+/// Bytes allocated for the characters of [s], 0 if they are stored inline.
+size_t AllocationSize(const std::string& s);
+
+/**
+ * @brief Memory usage of an object, accumulated by component.
+ */
+class MemoryUsage {
+ public:
+  /// Charge [n] heap allocations of [size] bytes each to [component].
+  void AddAllocation(const std::string& component, size_t size, size_t n = 1);
+
+  /// Charge the buffer of [v] to [component], the vector object itself is charged by its owner.
+  template <typename T>
+  void AddVector(const std::string& component, const std::vector<T>& v) {
+    AddAllocation(component, v.capacity() * sizeof(T));
+  }
+
+  /// Charge the characters of [s] to [component], if they are not stored inline.
+  void AddString(const std::string& component, const std::string& s) {
+    AddBytes(component, AllocationSize(s));
+  }
+
+  /// Charge [size] bytes that are not allocated on their own, e.g. a share of a shared object.
+  void AddBytes(const std::string& component, size_t size);
+
+  size_t total() const { return total_; }
+
+  /// Bytes of each component, and their sum under "total".
+  json ToJson() const;
+
+ private:
+  std::map<std::string, size_t> components_;
+  size_t total_ = 0;
+};
+
+}  // namespace tenann
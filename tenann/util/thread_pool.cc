@@ -0,0 +1,110 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace tenann {
+
+ThreadPool::ThreadPool(int num_threads) {
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    threads_.emplace_back([this]() { WorkerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    stopped_ = true;
+  }
+  cond_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+ThreadPool* ThreadPool::GetIoInstance() {
+  // io requests mostly wait on the device, so use more threads than cores to keep it busy
+  static ThreadPool instance(std::max(32, static_cast<int>(std::thread::hardware_concurrency())));
+  return &instance;
+}
+
+void ThreadPool::ParallelFor(size_t n, int parallelism, const std::function<void(size_t)>& func) {
+  std::atomic<size_t> next = 0;
+  auto worker = [&next, n, &func]() {
+    try {
+      for (size_t i = next++; i < n; i = next++) {
+        func(i);
+      }
+    } catch (...) {
+      next = n;
+      throw;
+    }
+  };
+
+  size_t num_helpers = std::min<size_t>(std::max(parallelism, 1), n);
+  num_helpers = num_helpers > 0 ? num_helpers - 1 : 0;
+  std::vector<std::future<void>> helpers;
+  helpers.reserve(num_helpers);
+  for (size_t i = 0; i < num_helpers; i++) {
+    helpers.push_back(Submit(worker));
+  }
+
+  // wait for every helper before rethrowing, they refer to the caller's stack
+  std::exception_ptr error;
+  try {
+    worker();
+  } catch (...) {
+    error = std::current_exception();
+  }
+  for (auto& helper : helpers) {
+    try {
+      helper.get();
+    } catch (...) {
+      if (error == nullptr) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error != nullptr) {
+    std::rethrow_exception(error);
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return stopped_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+}  // namespace tenann
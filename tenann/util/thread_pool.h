@@ -0,0 +1,89 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "tenann/common/macros.h"
+
+namespace tenann {
+
+/**
+ * @brief A fixed-size pool of threads running tasks in FIFO order.
+ *
+ * Meant for blocking work such as disk reads, which should not occupy the OpenMP threads used
+ * for computation.
+ */
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  /// Run the queued tasks to completion and join all threads.
+  ~ThreadPool();
+
+  T_FORBID_COPY_AND_ASSIGN(ThreadPool);
+  T_FORBID_MOVE(ThreadPool);
+
+  /// Thread pool shared by all index readers for asynchronous io.
+  static ThreadPool* GetIoInstance();
+
+  /// Queue [func] and return a future of its result, exceptions are delivered through the future.
+  template <typename Func>
+  std::future<std::invoke_result_t<Func>> Submit(Func&& func) {
+    using Result = std::invoke_result_t<Func>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+    auto future = task->get_future();
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      tasks_.emplace([task]() { (*task)(); });
+    }
+    cond_.notify_one();
+    return future;
+  }
+
+  /**
+   * @brief Run [func] for each of 0 .. n-1 on up to [parallelism] threads, the calling thread
+   * included, and wait for all of them.
+   *
+   * The calling thread takes part so that the loop progresses even if the pool is busy. The
+   * remaining items are skipped once one throws, and the first exception is rethrown.
+   */
+  void ParallelFor(size_t n, int parallelism, const std::function<void(size_t)>& func);
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  void WorkerLoop();
+
+  std::vector<std::thread> threads_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stopped_ = false;
+};
+
+}  // namespace tenann
@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "tenann/util/vector_convert.h"
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "tenann/common/logging.h"
+
+namespace tenann {
+
+namespace {
+
+uint32_t FloatBits(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+float BitsToFloat(uint32_t bits) {
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+void Fp16ToFloatN(const uint16_t* src, size_t n, float* dst) {
+  size_t i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = Fp16ToFloat(src[i]);
+  }
+}
+
+// bf16 is the upper half of a float, a widening shift is all it takes
+void Bf16ToFloatN(const uint16_t* src, size_t n, float* dst) {
+  size_t i = 0;
+#ifdef __AVX2__
+  for (; i + 8 <= n; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    __m256i bits = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+    _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(bits));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = Bf16ToFloat(src[i]);
+  }
+}
+
+template <typename T>
+void IntToFloatN(const T* src, size_t n, float* dst) {
+  size_t i = 0;
+#ifdef __AVX2__
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+    __m256i v32;
+    if constexpr (std::is_signed_v<T>) {
+      v32 = _mm256_cvtepi8_epi32(v);
+    } else {
+      v32 = _mm256_cvtepu8_epi32(v);
+    }
+    _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(v32));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = static_cast<float>(src[i]);
+  }
+}
+
+}  // namespace
+
+size_t PrimitiveTypeSize(PrimitiveType type) {
+  switch (type) {
+    case PrimitiveType::kBoolType:
+    case PrimitiveType::kInt8Type:
+    case PrimitiveType::kUInt8Type:
+      return 1;
+    case PrimitiveType::kInt16Type:
+    case PrimitiveType::kUInt16Type:
+    case PrimitiveType::kFloat16Type:
+    case PrimitiveType::kBFloat16Type:
+      return 2;
+    case PrimitiveType::kInt32Type:
+    case PrimitiveType::kUInt32Type:
+    case PrimitiveType::kFloatType:
+      return 4;
+    case PrimitiveType::kInt64Type:
+    case PrimitiveType::kUInt64Type:
+    case PrimitiveType::kDoubleType:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+bool IsVectorElemType(PrimitiveType type) {
+  return type == PrimitiveType::kFloatType || type == PrimitiveType::kFloat16Type ||
+         type == PrimitiveType::kBFloat16Type || type == PrimitiveType::kInt8Type ||
+         type == PrimitiveType::kUInt8Type;
+}
+
+float Fp16ToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    // zero or subnormal, mantissa * 2^-24
+    float magnitude = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+    return BitsToFloat(sign | FloatBits(magnitude));
+  }
+  if (exponent == 0x1f) {
+    return BitsToFloat(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return BitsToFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+uint16_t FloatToFp16(float f) {
+  uint32_t bits = FloatBits(f);
+  auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  bits &= 0x7fffffff;
+  if (bits >= 0x7f800000) {
+    // infinity, or a quiet nan
+    return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+  }
+  if (bits >= 0x477ff000) {
+    // 65520 and above round to infinity
+    return sign | 0x7c00;
+  }
+  if (bits < 0x38800000) {
+    // below the smallest normal fp16 2^-14, the rounding mode is to nearest even by default
+    float magnitude = BitsToFloat(bits);
+    return sign | static_cast<uint16_t>(std::nearbyint(magnitude * 16777216.0f));
+  }
+  bits += 0xfff + ((bits >> 13) & 1);
+  return sign | static_cast<uint16_t>((bits - 0x38000000) >> 13);
+}
+
+float Bf16ToFloat(uint16_t h) { return BitsToFloat(static_cast<uint32_t>(h) << 16); }
+
+uint16_t FloatToBf16(float f) {
+  uint32_t bits = FloatBits(f);
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    // keep nans quiet instead of rounding them to infinities
+    return static_cast<uint16_t>((bits >> 16) | 0x40);
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+void ConvertToFloat(PrimitiveType type, const uint8_t* src, size_t n, float* dst) {
+  switch (type) {
+    case PrimitiveType::kFloatType:
+      std::memcpy(dst, src, n * sizeof(float));
+      return;
+    case PrimitiveType::kFloat16Type:
+      Fp16ToFloatN(reinterpret_cast<const uint16_t*>(src), n, dst);
+      return;
+    case PrimitiveType::kBFloat16Type:
+      Bf16ToFloatN(reinterpret_cast<const uint16_t*>(src), n, dst);
+      return;
+    case PrimitiveType::kInt8Type:
+      IntToFloatN(reinterpret_cast<const int8_t*>(src), n, dst);
+      return;
+    case PrimitiveType::kUInt8Type:
+      IntToFloatN(src, n, dst);
+      return;
+    default:
+      T_LOG(ERROR) << "unsupported vector element type: " << type;
+  }
+}
+
+const float* VectorAsFloat(const PrimitiveSeqView& view, std::vector<float>* buffer) {
+  T_CHECK(IsVectorElemType(view.elem_type))
+      << "unsupported vector element type: " << view.elem_type;
+  if (view.elem_type == PrimitiveType::kFloatType) {
+    return reinterpret_cast<const float*>(view.data);
+  }
+  buffer->resize(view.size);
+  ConvertToFloat(view.elem_type, view.data, view.size, buffer->data());
+  return buffer->data();
+}
+
+const float* VectorAsFloat(const ArraySeqView& view, std::vector<float>* buffer) {
+  return VectorAsFloat(
+      PrimitiveSeqView{.data = view.data, .size = view.dim * view.size, .elem_type = view.elem_type},
+      buffer);
+}
+
+}  // namespace tenann
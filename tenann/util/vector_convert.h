@@ -0,0 +1,61 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tenann/common/seq_view.h"
+
+namespace tenann {
+
+/// Size in bytes of an element of [type], 0 for unknown types.
+size_t PrimitiveTypeSize(PrimitiveType type);
+
+/// Whether vectors with elements of [type] can be indexed and searched, i.e. float, fp16, bf16,
+/// int8 and uint8. The other types are converted to float with `ConvertToFloat`.
+bool IsVectorElemType(PrimitiveType type);
+
+float Fp16ToFloat(uint16_t h);
+
+/// Round to the nearest fp16, ties to even, values out of range become infinities.
+uint16_t FloatToFp16(float f);
+
+float Bf16ToFloat(uint16_t h);
+
+/// Round to the nearest bf16, ties to even.
+uint16_t FloatToBf16(float f);
+
+/**
+ * @brief Convert [n] elements of [type] at [src] to float.
+ *
+ * fp16 is converted with F16C, bf16 and the 8-bit integers with AVX2, when the library is built
+ * with them. [type] must be a vector element type, see `IsVectorElemType`.
+ */
+void ConvertToFloat(PrimitiveType type, const uint8_t* src, size_t n, float* dst);
+
+/// The elements of [view] as floats, in place if they are floats already, otherwise converted
+/// into [buffer].
+const float* VectorAsFloat(const PrimitiveSeqView& view, std::vector<float>* buffer);
+
+const float* VectorAsFloat(const ArraySeqView& view, std::vector<float>* buffer);
+
+}  // namespace tenann
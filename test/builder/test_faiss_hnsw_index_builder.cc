@@ -23,8 +23,11 @@
 #include <cstdio>
 #include <iostream>
 #include <random>
+#include <thread>
 
+#include "faiss/IndexIDMap.h"
 #include "test/faiss_test_base.h"
+#include "tenann/util/vector_convert.h"
 
 namespace tenann {
 
@@ -117,4 +120,68 @@ TEST_F(FaissHnswIndexBuilderTest, Add) {
   std::make_unique<FaissHnswIndexBuilder>(faiss_hnsw_meta())->Open().Add({base_vl_view()});
 }
 
-}  // namespace tenann
\ No newline at end of file
+TEST_F(FaissHnswIndexBuilderTest, ThreadSafeAdd) {
+  // 多个线程各自添加批次, 空值行的压缩并行进行, 向索引的添加串行进行
+  auto builder = std::make_unique<FaissHnswIndexBuilder>(faiss_hnsw_meta());
+  builder->EnableCustomRowId().EnableThreadSafeAdd().Open();
+  constexpr int kNumThreads = 4;
+  size_t batch_size = nb_ / kNumThreads;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t]() {
+      size_t begin = t * batch_size;
+      ArraySeqView batch_view{.data = reinterpret_cast<uint8_t*>(base_.data() + begin * d_),
+                              .dim = d_,
+                              .size = static_cast<uint32_t>(batch_size),
+                              .elem_type = PrimitiveType::kFloatType};
+      builder->Add({batch_view}, ids_.data() + begin, null_flags_.data() + begin);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::unordered_set<int64_t> expected_ids;
+  for (size_t i = 0; i < batch_size * kNumThreads; i++) {
+    if (null_flags_[i] == 0) {
+      expected_ids.insert(ids_[i]);
+    }
+  }
+  auto* index = static_cast<faiss::Index*>(builder->index_ref()->index_raw());
+  EXPECT_EQ(index->ntotal, expected_ids.size());
+  auto* index_id_map = dynamic_cast<faiss::IndexIDMap*>(index);
+  ASSERT_NE(index_id_map, nullptr);
+  EXPECT_EQ(std::unordered_set<int64_t>(index_id_map->id_map.begin(), index_id_map->id_map.end()),
+            expected_ids);
+  builder->Close();
+}
+
+TEST_F(FaissHnswIndexBuilderTest, AddHalfPrecision) {
+  // 半精度向量在添加时转换为 float, 空值行同时被压缩
+  std::vector<uint16_t> base_fp16(base_.size());
+  for (size_t i = 0; i < base_.size(); i++) {
+    base_fp16[i] = FloatToFp16(base_[i]);
+  }
+  ArraySeqView fp16_view{.data = reinterpret_cast<uint8_t*>(base_fp16.data()),
+                         .dim = d_,
+                         .size = static_cast<uint32_t>(nb_),
+                         .elem_type = PrimitiveType::kFloat16Type};
+  auto builder = std::make_unique<FaissHnswIndexBuilder>(faiss_hnsw_meta());
+  builder->EnableCustomRowId().Open().Add({fp16_view}, ids_.data(), null_flags_.data());
+
+  size_t num_non_null = std::count(null_flags_.begin(), null_flags_.begin() + nb_, 0);
+  auto* index = static_cast<faiss::Index*>(builder->index_ref()->index_raw());
+  EXPECT_EQ(index->ntotal, num_non_null);
+  builder->Close();
+
+  // 不支持的元素类型
+  ArraySeqView double_view{.data = reinterpret_cast<uint8_t*>(base_.data()),
+                           .dim = d_,
+                           .size = 1,
+                           .elem_type = PrimitiveType::kDoubleType};
+  EXPECT_THROW(
+      std::make_unique<FaissHnswIndexBuilder>(faiss_hnsw_meta())->Open().Add({double_view}),
+      Error);
+}
+
+}  // namespace tenann
@@ -157,4 +157,37 @@ TEST_F(FaissIvfPqIndexBuilderTest, Add) {
   std::make_unique<FaissIvfPqIndexBuilder>(faiss_ivf_pq_meta())->Open().Add({base_vl_view()});
 }
 
-}  // namespace tenann
\ No newline at end of file
+TEST_F(FaissIvfPqIndexBuilderTest, AddNullableAfterReferencedBatch) {
+  // 引用的批次之后添加可空批次, 两个批次都不丢失
+  size_t num_non_null = std::count(null_flags().begin(), null_flags().end(), 0);
+  auto builder = std::make_unique<FaissIvfPqIndexBuilder>(faiss_ivf_pq_meta());
+  builder->EnableCustomRowId()
+      .Open()
+      .Add({base_view()}, ids().data(), nullptr, true)
+      .Add({base_view()}, ids().data(), null_flags().data(), true)
+      .Flush();
+  auto* index = static_cast<faiss::Index*>(builder->index_ref()->index_raw());
+  EXPECT_EQ(index->ntotal, nb_ + num_non_null);
+
+  // 训练之后的可空批次直接加入索引
+  builder->Add({base_view()}, ids().data(), null_flags().data());
+  EXPECT_EQ(index->ntotal, nb_ + 2 * num_non_null);
+  builder->Close();
+}
+
+TEST_F(FaissIvfPqIndexBuilderTest, AddBufferedBatches) {
+  // 引用的批次和拷贝的批次交替加入缓冲, 训练后全部加入索引
+  auto builder = std::make_unique<FaissIvfPqIndexBuilder>(faiss_ivf_pq_meta());
+  builder->EnableCustomRowId().Open();
+  for (int i = 0; i < 8; i++) {
+    builder->Add({base_view()}, ids().data(), nullptr, i % 3 == 0);
+  }
+  auto* index = static_cast<faiss::Index*>(builder->index_ref()->index_raw());
+  EXPECT_EQ(index->ntotal, 0);
+  builder->Flush();
+  EXPECT_EQ(index->ntotal, 8 * nb_);
+  EXPECT_TRUE(index->is_trained);
+  builder->Close();
+}
+
+}  // namespace tenann
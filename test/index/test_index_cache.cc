@@ -0,0 +1,263 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "tenann/index/index_cache.h"
+
+namespace tenann {
+
+class IndexCacheNamespaceTest : public ::testing::Test {
+ protected:
+  /// Insert a block of [size] bytes under [key] in [ns], and keep it referenced by [handle] if
+  /// given.
+  static void InsertBlock(IndexCache* cache, const std::string& key, size_t size,
+                          CacheNamespaceId ns, IndexCacheHandle* handle = nullptr,
+                          CachePriority priority = CachePriority::NORMAL) {
+    auto buffer = std::make_shared<std::string>(size, 'x');
+    auto block = std::make_shared<Index>(buffer->data(), IndexType::kFaissIvfPqOneInvertedList,
+                                         [buffer](void* /* block */) {});
+    IndexCacheHandle local_handle;
+    cache->Insert(key, block, handle != nullptr ? handle : &local_handle,
+                  [size]() { return size; }, ns, priority);
+  }
+
+  static bool Contains(IndexCache* cache, const std::string& key, CacheNamespaceId ns) {
+    IndexCacheHandle handle;
+    return cache->Lookup(key, &handle, ns);
+  }
+};
+
+TEST_F(IndexCacheNamespaceTest, GetNamespace) {
+  IndexCache cache(1000);
+  // 空名字即默认命名空间
+  EXPECT_EQ(cache.GetNamespace(""), kDefaultCacheNamespace);
+  EXPECT_EQ(cache.GetNamespace("default"), kDefaultCacheNamespace);
+  CacheNamespaceId table_a = cache.GetNamespace("table_a");
+  CacheNamespaceId table_b = cache.GetNamespace("table_b");
+  EXPECT_NE(table_a, kDefaultCacheNamespace);
+  EXPECT_NE(table_a, table_b);
+  EXPECT_EQ(cache.GetNamespace("table_a"), table_a);
+
+  CacheNamespaceOptions options;
+  options.soft_quota = 100;
+  options.hard_quota = 200;
+  EXPECT_EQ(cache.SetNamespaceOptions("table_a", options), table_a);
+  EXPECT_EQ(cache.namespace_options(table_a).hard_quota, 200);
+  EXPECT_EQ(cache.namespace_options(table_b).hard_quota, 0);
+
+  // 软配额不能高于硬配额
+  options.soft_quota = 300;
+  EXPECT_ANY_THROW(cache.SetNamespaceOptions("table_a", options));
+}
+
+TEST_F(IndexCacheNamespaceTest, HardQuota) {
+  IndexCache cache(10000);
+  CacheNamespaceOptions options;
+  options.hard_quota = 500;
+  CacheNamespaceId table_a = cache.SetNamespaceOptions("table_a", options);
+  CacheNamespaceId table_b = cache.GetNamespace("table_b");
+  for (int i = 0; i < 5; i++) {
+    InsertBlock(&cache, "b" + std::to_string(i), 100, table_b);
+  }
+
+  // 超过硬配额时淘汰本命名空间最久未使用的条目
+  for (int i = 0; i < 8; i++) {
+    InsertBlock(&cache, "a" + std::to_string(i), 100, table_a);
+  }
+  auto status = cache.namespace_status();
+  EXPECT_EQ(status["table_a"]["usage"], 500);
+  EXPECT_EQ(status["table_b"]["usage"], 500);
+  EXPECT_FALSE(Contains(&cache, "a0", table_a));
+  EXPECT_TRUE(Contains(&cache, "a7", table_a));
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(Contains(&cache, "b" + std::to_string(i), table_b));
+  }
+
+  // 放不下的索引不进入缓存, 但调用方仍然可以使用
+  {
+    IndexCacheHandle handle;
+    InsertBlock(&cache, "huge", 600, table_a, &handle);
+    EXPECT_NE(handle.index_ref(), nullptr);
+    EXPECT_FALSE(Contains(&cache, "huge", table_a));
+  }
+  status = cache.namespace_status();
+  EXPECT_EQ(status["table_a"]["bypass_count"], 1);
+  EXPECT_LE(status["table_a"]["usage"].get<int64_t>(), 500);
+
+  // 放不下的索引不会替换同一个 key 下已缓存的条目
+  {
+    IndexCacheHandle handle;
+    InsertBlock(&cache, "a7", 600, table_a, &handle);
+    EXPECT_EQ(handle.cache(), nullptr);
+    IndexCacheHandle cached;
+    ASSERT_TRUE(cache.Lookup(std::string("a7"), &cached, table_a));
+    EXPECT_NE(cached.index_ref(), handle.index_ref());
+  }
+
+  // 被引用的条目不会被淘汰
+  IndexCacheHandle pinned;
+  InsertBlock(&cache, "big", 500, table_a, &pinned);
+  InsertBlock(&cache, "more", 100, table_a);
+  EXPECT_FALSE(Contains(&cache, "more", table_a));
+  EXPECT_TRUE(Contains(&cache, "big", table_a));
+  EXPECT_EQ(cache.namespace_status()["table_a"]["usage"], 500);
+}
+
+TEST_F(IndexCacheNamespaceTest, HardQuotaBypassKeepsOtherNamespaces) {
+  IndexCache cache(1000, CacheEvictionPolicy::LRU, 0);
+  CacheNamespaceOptions options;
+  options.hard_quota = 500;
+  CacheNamespaceId table_a = cache.SetNamespaceOptions("table_a", options);
+  CacheNamespaceId table_b = cache.GetNamespace("table_b");
+  for (int i = 0; i < 9; i++) {
+    InsertBlock(&cache, "b" + std::to_string(i), 100, table_b);
+  }
+
+  // 超过硬配额的索引不进入缓存, 也不会为它淘汰其他命名空间的条目
+  IndexCacheHandle handle;
+  InsertBlock(&cache, "huge", 600, table_a, &handle);
+  EXPECT_NE(handle.index_ref(), nullptr);
+  EXPECT_EQ(cache.memory_usage(), 900);
+  for (int i = 0; i < 9; i++) {
+    EXPECT_TRUE(Contains(&cache, "b" + std::to_string(i), table_b));
+  }
+  EXPECT_EQ(cache.namespace_status()["table_b"]["evict_count"], 0);
+}
+
+TEST_F(IndexCacheNamespaceTest, SoftQuota) {
+  IndexCache cache(1000, CacheEvictionPolicy::LRU, 0);
+  CacheNamespaceOptions options;
+  options.soft_quota = 200;
+  CacheNamespaceId table_a = cache.SetNamespaceOptions("table_a", options);
+  CacheNamespaceId table_b = cache.SetNamespaceOptions("table_b", options);
+
+  // table_b 的条目更早插入, 但缓存满时先淘汰超出软配额更多的 table_a
+  for (int i = 0; i < 3; i++) {
+    InsertBlock(&cache, "b" + std::to_string(i), 100, table_b);
+  }
+  for (int i = 0; i < 7; i++) {
+    InsertBlock(&cache, "a" + std::to_string(i), 100, table_a);
+  }
+  EXPECT_EQ(cache.memory_usage(), 1000);
+  InsertBlock(&cache, "b3", 100, table_b);
+  auto status = cache.namespace_status();
+  EXPECT_EQ(status["table_a"]["usage"], 600);
+  EXPECT_EQ(status["table_b"]["usage"], 400);
+  EXPECT_FALSE(Contains(&cache, "a0", table_a));
+  for (int i = 0; i < 4; i++) {
+    EXPECT_TRUE(Contains(&cache, "b" + std::to_string(i), table_b));
+  }
+
+  // 没有命名空间超出软配额时按 LRU 淘汰
+  options.soft_quota = 0;
+  cache.SetNamespaceOptions("table_a", options);
+  cache.SetNamespaceOptions("table_b", options);
+  InsertBlock(&cache, "b4", 100, table_b);
+  EXPECT_EQ(cache.memory_usage(), 1000);
+  EXPECT_FALSE(Contains(&cache, "a1", table_a));
+}
+
+TEST_F(IndexCacheNamespaceTest, PinIndexStructure) {
+  IndexCache cache(1000, CacheEvictionPolicy::LRU, 0);
+  CacheNamespaceOptions options;
+  options.pin_index_structure = true;
+  CacheNamespaceId ns = cache.SetNamespaceOptions("table_a", options);
+  EXPECT_TRUE(cache.namespace_options(ns).pin_index_structure);
+
+  // 常驻的索引结构比倒排链的块活得更久
+  InsertBlock(&cache, "structure", 300, ns, nullptr, CachePriority::DURABLE);
+  for (int i = 0; i < 20; i++) {
+    InsertBlock(&cache, "block" + std::to_string(i), 100, ns);
+  }
+  EXPECT_TRUE(Contains(&cache, "structure", ns));
+  EXPECT_EQ(cache.memory_usage(), 1000);
+}
+
+TEST_F(IndexCacheNamespaceTest, Status) {
+  IndexCache cache(1000);
+  CacheNamespaceId ns = cache.GetNamespace("table_a");
+  InsertBlock(&cache, "a0", 100, ns);
+  EXPECT_TRUE(Contains(&cache, "a0", ns));
+  EXPECT_FALSE(Contains(&cache, "a1", ns));
+  EXPECT_FALSE(Contains(&cache, "a1", kDefaultCacheNamespace));
+
+  // 分片状态的格式保持不变
+  auto shards = cache.status();
+  ASSERT_TRUE(shards.is_array());
+  EXPECT_EQ(shards[0]["usage"], 100);
+
+  auto status = cache.namespace_status();
+  auto table_a = status["table_a"];
+  EXPECT_EQ(table_a["usage"], 100);
+  EXPECT_EQ(table_a["insert_count"], 1);
+  EXPECT_EQ(table_a["hit_count"], 1);
+  EXPECT_EQ(table_a["miss_count"], 1);
+  EXPECT_FLOAT_EQ(table_a["hit_ratio"].get<float>(), 0.5f);
+  EXPECT_EQ(status["default"]["miss_count"], 1);
+
+  // 被替换的条目不计入淘汰
+  InsertBlock(&cache, "a0", 100, ns);
+  EXPECT_EQ(cache.namespace_status()["table_a"]["evict_count"], 0);
+
+  // 淘汰的条目计入所属的命名空间
+  cache.SetCapacity(0);
+  status = cache.namespace_status();
+  EXPECT_EQ(status["table_a"]["usage"], 0);
+  EXPECT_EQ(status["table_a"]["evict_count"], 1);
+}
+
+TEST_F(IndexCacheNamespaceTest, UpdateChargeHardQuota) {
+  IndexCache cache(10000);
+  CacheNamespaceOptions options;
+  options.hard_quota = 500;
+  CacheNamespaceId ns = cache.SetNamespaceOptions("table_a", options);
+  InsertBlock(&cache, "a0", 100, ns);
+  IndexCacheHandle handle;
+  InsertBlock(&cache, "grow", 100, ns, &handle);
+
+  // 原地增长时先淘汰同一命名空间的其他条目
+  handle.UpdateCharge(450);
+  EXPECT_FALSE(Contains(&cache, "a0", ns));
+  EXPECT_TRUE(Contains(&cache, "grow", ns));
+  EXPECT_EQ(cache.namespace_status()["table_a"]["usage"], 450);
+
+  // 超过硬配额时移出缓存, 释放后不再占用配额
+  handle.UpdateCharge(600);
+  EXPECT_NE(handle.index_ref(), nullptr);
+  EXPECT_FALSE(Contains(&cache, "grow", ns));
+  EXPECT_EQ(cache.namespace_status()["table_a"]["bypass_count"], 1);
+  EXPECT_EQ(handle.cache(), nullptr);
+  EXPECT_EQ(cache.namespace_status()["table_a"]["usage"], 0);
+  handle = IndexCacheHandle();
+
+  // 只移出该句柄的条目, 之后在同一个 key 下缓存的条目保留
+  IndexCacheHandle old_handle;
+  InsertBlock(&cache, "grow", 100, ns, &old_handle);
+  IndexCacheHandle new_handle;
+  InsertBlock(&cache, "grow", 100, ns, &new_handle);
+  old_handle.UpdateCharge(600);
+  EXPECT_EQ(old_handle.cache(), nullptr);
+  EXPECT_TRUE(Contains(&cache, "grow", ns));
+  EXPECT_EQ(cache.namespace_status()["table_a"]["bypass_count"], 2);
+  EXPECT_EQ(cache.namespace_status()["table_a"]["usage"], 100);
+}
+
+}  // namespace tenann
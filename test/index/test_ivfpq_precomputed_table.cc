@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include "faiss/IndexFlat.h"
+#include "faiss/impl/io.h"
+#include "gtest/gtest.h"
+#include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/ivfpq_precomputed_table.h"
+#include "tenann/util/random.h"
+
+class IvfPqPrecomputedTableTest : public ::testing::Test {
+ protected:
+  static constexpr int dim_ = 8;
+  static constexpr int nlist_ = 4;
+  static constexpr int nb_ = 1024;
+
+  void SetUp() override {
+    base_ = tenann::RandomVectors(nb_, dim_, 0);
+    ivfpq_ = NewIndex();
+  }
+
+  // 训练新的索引, 或者复用 [trained] 的码本
+  std::unique_ptr<tenann::IndexIvfPq> NewIndex(const tenann::IndexIvfPq* trained = nullptr) {
+    auto ivfpq =
+        std::make_unique<tenann::IndexIvfPq>(new faiss::IndexFlatL2(dim_), dim_, nlist_, 2, 8);
+    ivfpq->own_fields = true;
+    if (trained == nullptr) {
+      ivfpq->train(nb_, base_.data());
+    } else {
+      std::vector<float> centroids(nlist_ * dim_);
+      trained->quantizer->reconstruct_n(0, nlist_, centroids.data());
+      ivfpq->quantizer->add(nlist_, centroids.data());
+      ivfpq->pq = trained->pq;
+      ivfpq->is_trained = true;
+    }
+    ivfpq->add(nb_, base_.data());
+    return ivfpq;
+  }
+
+  // 与 faiss 训练时计算的 precomputed table 对比
+  void ExpectSameAsFaiss(const tenann::IvfPqPrecomputedTable& table, size_t list_no) {
+    size_t row_size = ivfpq_->pq.M * ivfpq_->pq.ksub;
+    ASSERT_EQ(table.size(), ivfpq_->precomputed_table.size());
+    for (size_t i = list_no * row_size; i < (list_no + 1) * row_size; i++) {
+      ASSERT_NEAR(table.data()[i], ivfpq_->precomputed_table[i], 1e-4);
+    }
+  }
+
+  std::vector<float> base_;
+  std::unique_ptr<tenann::IndexIvfPq> ivfpq_;
+};
+
+TEST_F(IvfPqPrecomputedTableTest, test_eager_and_lazy) {
+  ASSERT_TRUE(tenann::IvfPqPrecomputedTable::IsApplicable(*ivfpq_));
+  ASSERT_EQ(ivfpq_->use_precomputed_table, 1);
+
+  auto eager = tenann::IvfPqPrecomputedTable::Create(*ivfpq_, false);
+  EXPECT_FALSE(eager->lazy());
+  for (size_t list_no = 0; list_no < nlist_; list_no++) {
+    ExpectSameAsFaiss(*eager, list_no);
+  }
+
+  // 只计算被 probe 的 list
+  auto lazy = tenann::IvfPqPrecomputedTable::Create(*ivfpq_, true);
+  EXPECT_TRUE(lazy->lazy());
+  std::vector<faiss::Index::idx_t> list_nos = {2, -1, 2};
+  lazy->EnsureLists(list_nos.data(), list_nos.size());
+  ExpectSameAsFaiss(*lazy, 2);
+}
+
+TEST_F(IvfPqPrecomputedTableTest, test_write_and_read) {
+  faiss::VectorIOWriter writer;
+  tenann::IvfPqPrecomputedTable::Write(*ivfpq_, &writer);
+
+  faiss::VectorIOReader reader;
+  reader.data = writer.data;
+  auto table = tenann::IvfPqPrecomputedTable::Read(*ivfpq_, &reader);
+  ASSERT_NE(table, nullptr);
+  for (size_t list_no = 0; list_no < nlist_; list_no++) {
+    ExpectSameAsFaiss(*table, list_no);
+  }
+  // 文件在此结束, 没有 precomputed table
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Read(*ivfpq_, &reader), nullptr);
+}
+
+TEST_F(IvfPqPrecomputedTableTest, test_share_and_search) {
+  std::vector<float> expected_distances(10 * 10);
+  std::vector<faiss::Index::idx_t> expected_labels(10 * 10);
+  ivfpq_->nprobe = 2;
+  ivfpq_->search(10, base_.data(), 10, expected_distances.data(), expected_labels.data());
+
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Lookup(*ivfpq_), nullptr);
+  auto table = tenann::IvfPqPrecomputedTable::Register(
+      tenann::IvfPqPrecomputedTable::Create(*ivfpq_, true));
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Lookup(*ivfpq_), table);
+
+  // 码本相同的索引共享同一个 table
+  auto other = NewIndex(ivfpq_.get());
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Lookup(*other), table);
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Register(
+                tenann::IvfPqPrecomputedTable::Create(*other, false)),
+            table);
+
+  for (auto* index : {ivfpq_.get(), other.get()}) {
+    index->SetPrecomputedTable(table);
+    EXPECT_EQ(index->precomputed_table.data(), table->data());
+    index->nprobe = 2;
+    std::vector<float> distances(10 * 10);
+    std::vector<faiss::Index::idx_t> labels(10 * 10);
+    index->search(10, base_.data(), 10, distances.data(), labels.data());
+    EXPECT_EQ(labels, expected_labels);
+  }
+
+  // 不再被使用的 table 不会被共享
+  std::weak_ptr<tenann::IvfPqPrecomputedTable> weak_table = table;
+  table.reset();
+  ivfpq_.reset();
+  other.reset();
+  EXPECT_TRUE(weak_table.expired());
+  auto index = NewIndex();
+  EXPECT_EQ(tenann::IvfPqPrecomputedTable::Lookup(*index), nullptr);
+}
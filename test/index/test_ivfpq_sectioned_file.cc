@@ -0,0 +1,144 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include "faiss/impl/FaissException.h"
+#include "faiss/impl/io_macros.h"
+#include "gtest/gtest.h"
+#include "tenann/index/internal/ivfpq_sectioned_file.h"
+#include "tenann/util/buffer_io.h"
+#include "tenann/util/crc32c.h"
+
+namespace tenann {
+
+class IvfPqSectionedFileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    CallbackIOWriter out([this](const void* data, size_t size) {
+      auto* bytes = static_cast<const uint8_t*>(data);
+      file_.insert(file_.end(), bytes, bytes + size);
+    });
+    IvfPqSectionedFile::Writer writer(&out);
+    faiss::IOWriter* f = writer.BeginSection(kIvfPqPreamble);
+    int64_t ntotal = 12345;
+    WRITE1(ntotal);
+    f = writer.BeginSection(kIvfPqListData);
+    WRITEVECTOR(codes_);
+    // 空 section
+    writer.BeginSection(kIvfPqReconstructionErrors);
+    writer.Finish();
+  }
+
+  std::unique_ptr<SourceIOReader> Open() {
+    return std::make_unique<SourceIOReader>(
+        RandomAccessSource::FromBuffer("sectioned", file_.data(), file_.size()));
+  }
+
+  std::vector<uint8_t> codes_ = std::vector<uint8_t>(10000, 7);
+  std::vector<uint8_t> file_;
+};
+
+TEST(Crc32cTest, KnownValues) {
+  EXPECT_EQ(Crc32c("", 0), 0);
+  EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283);
+
+  // 分段计算与整体计算一致
+  std::vector<uint8_t> data(1000);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i * 31 + 7;
+  }
+  uint32_t crc = Crc32c(data.data(), data.size());
+  for (size_t split : {1, 7, 8, 500, 999}) {
+    EXPECT_EQ(Crc32c(data.data() + split, data.size() - split, Crc32c(data.data(), split)), crc);
+  }
+}
+
+TEST_F(IvfPqSectionedFileTest, ReadSections_InAnyOrder) {
+  auto reader = Open();
+  IvfPqSectionedFile::Reader file(reader.get());
+  EXPECT_EQ(file.version(), IvfPqSectionedFile::kVersion);
+  ASSERT_EQ(file.sections().size(), 3);
+  EXPECT_TRUE(file.Has(kIvfPqListData));
+  EXPECT_FALSE(file.Has(kIvfPqQuantizer));
+  EXPECT_THROW(file.OpenSection(kIvfPqQuantizer, true), faiss::FaissException);
+  EXPECT_EQ(file.Get(kIvfPqReconstructionErrors).size, 0);
+
+  auto f = file.OpenSection(kIvfPqListData, true);
+  std::vector<uint8_t> codes;
+  READVECTOR(codes);
+  EXPECT_EQ(codes, codes_);
+  // section 结束后读不到更多数据
+  uint8_t byte;
+  EXPECT_EQ((*f)(&byte, 1, 1), 0);
+
+  f = file.OpenSection(kIvfPqPreamble, true);
+  int64_t ntotal;
+  READ1(ntotal);
+  EXPECT_EQ(ntotal, 12345);
+}
+
+TEST_F(IvfPqSectionedFileTest, Checksum_DetectsCorruption) {
+  // 修改 list data 中的一个字节
+  {
+    auto reader = Open();
+    IvfPqSectionedFile::Reader file(reader.get());
+    file_[file.Get(kIvfPqListData).offset + 100] ^= 1;
+  }
+
+  auto reader = Open();
+  IvfPqSectionedFile::Reader file(reader.get());
+  std::vector<uint8_t> codes;
+  {
+    auto f = file.OpenSection(kIvfPqListData, true);
+    EXPECT_THROW(READVECTOR(codes), faiss::FaissException);
+  }
+  {
+    // 不校验时可以读取
+    auto f = file.OpenSection(kIvfPqListData, false);
+    READVECTOR(codes);
+    EXPECT_NE(codes, codes_);
+  }
+  // 其他 section 不受影响
+  auto f = file.OpenSection(kIvfPqPreamble, true);
+  int64_t ntotal;
+  READ1(ntotal);
+  EXPECT_EQ(ntotal, 12345);
+}
+
+TEST_F(IvfPqSectionedFileTest, Toc_DetectsCorruptionAndOtherFormats) {
+  // toc 位于 footer 之前
+  file_[file_.size() - IvfPqSectionedFile::kFooterSize - 1] ^= 1;
+  auto reader = Open();
+  EXPECT_THROW(IvfPqSectionedFile::Reader file(reader.get()), faiss::FaissException);
+
+  file_.assign(100, 0);
+  reader = Open();
+  EXPECT_THROW(IvfPqSectionedFile::Reader file(reader.get()), faiss::FaissException);
+}
+
+TEST_F(IvfPqSectionedFileTest, Writer_RejectsDuplicateSections) {
+  CallbackIOWriter out([](const void*, size_t) {});
+  IvfPqSectionedFile::Writer writer(&out);
+  writer.BeginSection(kIvfPqPreamble);
+  EXPECT_THROW(writer.BeginSection(kIvfPqPreamble), faiss::FaissException);
+}
+
+}  // namespace tenann
@@ -0,0 +1,130 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <vector>
+
+#include "faiss/impl/io.h"
+#include "faiss/impl/io_macros.h"
+#include "faiss/index_io.h"
+#include "faiss/invlists/InvertedLists.h"
+#include "gtest/gtest.h"
+#include "tenann/index/internal/split_inverted_lists.h"
+
+TEST(SplitInvertedListsTest, test_write_and_read) {
+  size_t nlist = 5, code_size = 3;
+  faiss::ArrayInvertedLists lists(nlist, code_size);
+  for (size_t list_no = 0; list_no < nlist; list_no++) {
+    // list 2 is empty
+    size_t size = list_no == 2 ? 0 : list_no + 1;
+    for (size_t i = 0; i < size; i++) {
+      faiss::Index::idx_t id = list_no * 100 + i;
+      std::vector<uint8_t> code(code_size, static_cast<uint8_t>(id));
+      lists.add_entry(list_no, id, code.data());
+    }
+  }
+
+  faiss::VectorIOWriter writer;
+  tenann::SplitInvertedLists::Write(&lists, &writer);
+
+  // header, codes region, ids region
+  size_t total_size = 0;
+  for (size_t list_no = 0; list_no < nlist; list_no++) {
+    total_size += lists.list_size(list_no);
+  }
+  {
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    auto* f = &reader;
+    uint32_t h;
+    READ1(h);
+    EXPECT_EQ(h, tenann::SplitInvertedLists::Fourcc());
+    tenann::SplitInvertedLists::Header header;
+    tenann::SplitInvertedLists::ReadHeader(&reader, h, &header);
+    EXPECT_EQ(header.nlist, nlist);
+    EXPECT_EQ(header.code_size, code_size);
+    EXPECT_FALSE(header.compressed_ids);
+    for (size_t list_no = 0; list_no < nlist; list_no++) {
+      EXPECT_EQ(header.sizes[list_no], lists.list_size(list_no));
+    }
+    EXPECT_EQ(header.id_offsets[nlist], total_size * sizeof(faiss::Index::idx_t));
+    size_t ids_begin = reader.rp + total_size * code_size;
+    EXPECT_EQ(writer.data.size(), ids_begin + total_size * sizeof(faiss::Index::idx_t));
+    auto* first_id = reinterpret_cast<const faiss::Index::idx_t*>(writer.data.data() + ids_begin);
+    EXPECT_EQ(*first_id, 0);
+  }
+
+  // faiss reads the layout through the io hook
+  tenann::SplitInvertedLists::RegisterIOHook();
+  tenann::SplitInvertedLists::RegisterIOHook();
+  faiss::VectorIOReader reader;
+  reader.data = writer.data;
+  std::unique_ptr<faiss::InvertedLists> read_lists(faiss::read_InvertedLists(&reader));
+  auto* array_lists = dynamic_cast<faiss::ArrayInvertedLists*>(read_lists.get());
+  ASSERT_NE(array_lists, nullptr);
+  for (size_t list_no = 0; list_no < nlist; list_no++) {
+    EXPECT_EQ(array_lists->codes[list_no], lists.codes[list_no]);
+    EXPECT_EQ(array_lists->ids[list_no], lists.ids[list_no]);
+  }
+}
+
+TEST(SplitInvertedListsTest, test_write_and_read_compressed_ids) {
+  size_t nlist = 4, code_size = 2;
+  faiss::ArrayInvertedLists lists(nlist, code_size);
+  for (size_t list_no = 0; list_no < nlist; list_no++) {
+    // list 1 is empty, list 3 holds unsorted ids
+    size_t size = list_no == 1 ? 0 : 300;
+    for (size_t i = 0; i < size; i++) {
+      faiss::Index::idx_t id = list_no == 3 ? (i * 7919) % 300 : (int64_t(1) << 40) + i * 3;
+      std::vector<uint8_t> code(code_size, static_cast<uint8_t>(i));
+      lists.add_entry(list_no, id, code.data());
+    }
+  }
+
+  faiss::VectorIOWriter plain_writer;
+  tenann::SplitInvertedLists::Write(&lists, &plain_writer);
+  faiss::VectorIOWriter writer;
+  tenann::SplitInvertedLists::Write(&lists, &writer, true);
+  EXPECT_LT(writer.data.size() * 2, plain_writer.data.size());
+
+  {
+    faiss::VectorIOReader reader;
+    reader.data = writer.data;
+    auto* f = &reader;
+    uint32_t h;
+    READ1(h);
+    EXPECT_EQ(h, tenann::SplitInvertedLists::CompressedIdsFourcc());
+    tenann::SplitInvertedLists::Header header;
+    tenann::SplitInvertedLists::ReadHeader(&reader, h, &header);
+    EXPECT_TRUE(header.compressed_ids);
+    ASSERT_EQ(header.id_offsets.size(), nlist + 1);
+    EXPECT_EQ(writer.data.size(), reader.rp + 900 * code_size + header.id_offsets[nlist]);
+  }
+
+  tenann::SplitInvertedLists::RegisterIOHook();
+  faiss::VectorIOReader reader;
+  reader.data = writer.data;
+  std::unique_ptr<faiss::InvertedLists> read_lists(faiss::read_InvertedLists(&reader));
+  auto* array_lists = dynamic_cast<faiss::ArrayInvertedLists*>(read_lists.get());
+  ASSERT_NE(array_lists, nullptr);
+  for (size_t list_no = 0; list_no < nlist; list_no++) {
+    EXPECT_EQ(array_lists->codes[list_no], lists.codes[list_no]);
+    EXPECT_EQ(array_lists->ids[list_no], lists.ids[list_no]);
+  }
+}
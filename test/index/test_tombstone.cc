@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "faiss/IndexFlat.h"
+#include "gtest/gtest.h"
+#include "tenann/common/error.h"
+#include "tenann/index/index.h"
+#include "tenann/index/internal/consolidation.h"
+#include "tenann/index/internal/index_ivfpq.h"
+#include "tenann/index/internal/tombstone.h"
+#include "tenann/util/random.h"
+
+TEST(TombstoneTest, test_delete_and_persist) {
+  tenann::Tombstone tombstone;
+  EXPECT_TRUE(tombstone.empty());
+  EXPECT_TRUE(tombstone.Delete(3));
+  EXPECT_TRUE(tombstone.Delete(1000));
+  EXPECT_FALSE(tombstone.Delete(3));
+  EXPECT_THROW(tombstone.Delete(-1), tenann::Error);
+
+  EXPECT_EQ(tombstone.num_deleted(), 2);
+  EXPECT_TRUE(tombstone.IsDeleted(3));
+  EXPECT_TRUE(tombstone.IsDeleted(1000));
+  EXPECT_FALSE(tombstone.IsDeleted(4));
+  EXPECT_FALSE(tombstone.IsDeleted(1 << 20));
+  EXPECT_FALSE(tombstone.IsDeleted(-1));
+
+  auto path = tenann::Tombstone::PathOf("/tmp/test_tombstone_index");
+  EXPECT_EQ(path, "/tmp/test_tombstone_index.del");
+  std::remove(path.c_str());
+  EXPECT_EQ(tenann::Tombstone::Load(path), nullptr);
+
+  tombstone.Save(path);
+  auto loaded = tenann::Tombstone::Load(path);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->num_deleted(), 2);
+  EXPECT_TRUE(loaded->IsDeleted(3));
+  EXPECT_TRUE(loaded->IsDeleted(1000));
+  EXPECT_FALSE(loaded->IsDeleted(4));
+
+  loaded->Clear();
+  EXPECT_TRUE(loaded->empty());
+  EXPECT_FALSE(loaded->IsDeleted(3));
+  loaded->Save(path);
+  EXPECT_TRUE(tenann::Tombstone::Load(path)->empty());
+  std::remove(path.c_str());
+}
+
+TEST(TombstoneTest, test_sparse_row_ids) {
+  tenann::Tombstone tombstone;
+  // 很大的自定义 row id 不会按 bitmap 分配内存
+  const int64_t large_id = int64_t(1) << 40;
+  EXPECT_TRUE(tombstone.Delete(large_id));
+  EXPECT_TRUE(tombstone.Delete(100000));
+  EXPECT_FALSE(tombstone.Delete(large_id));
+  EXPECT_TRUE(tombstone.IsDeleted(large_id));
+  EXPECT_TRUE(tombstone.IsDeleted(100000));
+  EXPECT_FALSE(tombstone.IsDeleted(large_id + 1));
+  EXPECT_LT(tombstone.memory_usage(), 64 * 1024);
+
+  // 删除的行变多后 bitmap 扩大, 被覆盖的稀疏 id 移入 bitmap
+  for (int64_t id = 0; id < 400; id++) {
+    EXPECT_TRUE(tombstone.Delete(id));
+  }
+  EXPECT_TRUE(tombstone.Delete(64 * 1600));
+  EXPECT_EQ(tombstone.num_deleted(), 403);
+  EXPECT_TRUE(tombstone.IsDeleted(100000));
+  EXPECT_FALSE(tombstone.Delete(100000));
+  EXPECT_TRUE(tombstone.IsDeleted(large_id));
+
+  auto path = tenann::Tombstone::PathOf("/tmp/test_tombstone_sparse_index");
+  tombstone.Save(path);
+  auto loaded = tenann::Tombstone::Load(path);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->num_deleted(), 403);
+  for (int64_t id : {int64_t(0), int64_t(399), int64_t(100000), int64_t(64 * 1600), large_id}) {
+    EXPECT_TRUE(loaded->IsDeleted(id)) << id;
+  }
+  EXPECT_FALSE(loaded->IsDeleted(400));
+  std::remove(path.c_str());
+}
+
+TEST(TombstoneTest, test_undelete) {
+  tenann::Tombstone tombstone;
+  const int64_t large_id = int64_t(1) << 40;
+  EXPECT_TRUE(tombstone.Delete(3));
+  EXPECT_TRUE(tombstone.Delete(large_id));
+  EXPECT_FALSE(tombstone.Undelete(4));
+  EXPECT_FALSE(tombstone.Undelete(-1));
+
+  // 重新插入的 row id 不再被删除, 被替换的旧行使用保留的 row id 且一直被删除
+  EXPECT_TRUE(tombstone.Undelete(3));
+  EXPECT_TRUE(tombstone.Undelete(large_id));
+  EXPECT_FALSE(tombstone.Undelete(3));
+  EXPECT_FALSE(tombstone.IsDeleted(3));
+  EXPECT_FALSE(tombstone.IsDeleted(large_id));
+  EXPECT_TRUE(tombstone.IsDeleted(tenann::Tombstone::kReplacedRowId));
+  EXPECT_TRUE(tombstone.empty());
+  tombstone.AddReplacedEntries(2);
+  EXPECT_FALSE(tombstone.empty());
+  EXPECT_EQ(tombstone.num_deleted(), 2);
+
+  // 索引文件中仍是旧的行, 因此持久化时依然标记为删除
+  auto path = tenann::Tombstone::PathOf("/tmp/test_tombstone_undelete_index");
+  tombstone.Save(path);
+  auto loaded = tenann::Tombstone::Load(path);
+  ASSERT_NE(loaded, nullptr);
+  EXPECT_EQ(loaded->num_deleted(), 2);
+  EXPECT_TRUE(loaded->IsDeleted(3));
+  EXPECT_TRUE(loaded->IsDeleted(large_id));
+
+  tombstone.Clear();
+  EXPECT_TRUE(tombstone.empty());
+  tombstone.Save(path);
+  EXPECT_TRUE(tenann::Tombstone::Load(path)->empty());
+  std::remove(path.c_str());
+}
+
+TEST(TombstoneTest, test_consolidate_ivfpq) {
+  const int dim = 8;
+  const int nb = 1024;
+
+  auto base = tenann::RandomVectors(nb, dim, 0);
+  auto* coarse_quantizer = new faiss::IndexFlatL2(dim);
+  auto* ivfpq = new tenann::IndexIvfPq(coarse_quantizer, dim, 4, 2, 8);
+  ivfpq->own_fields = true;
+  ivfpq->train(nb, base.data());
+  ivfpq->add(nb, base.data());
+  tenann::Index index(ivfpq, tenann::IndexType::kFaissIvfPq,
+                      [](void* index) { delete static_cast<tenann::IndexIvfPq*>(index); });
+  EXPECT_TRUE(tenann::IsConsolidationSupported(index));
+
+  // 只有索引中存在的 row id 才会被标记删除
+  std::vector<int64_t> row_ids = {0, 5, nb + 10, -1, 5};
+  auto indexed_ids = tenann::FilterIndexedRowIds(index, row_ids.data(), row_ids.size());
+  std::sort(indexed_ids.begin(), indexed_ids.end());
+  EXPECT_EQ(indexed_ids, std::vector<int64_t>({0, 5}));
+
+  // nothing to drop without a tombstone
+  EXPECT_EQ(tenann::ConsolidateIndex(&index), 0);
+
+  index.SetTombstone(std::make_unique<tenann::Tombstone>());
+  for (int i = 0; i < nb; i += 2) {
+    index.tombstone()->Delete(i);
+  }
+  EXPECT_EQ(tenann::ConsolidateIndex(&index), nb / 2);
+  EXPECT_EQ(tenann::CountIndexEntries(index), nb / 2);
+  // 物理删除后删除标记被丢弃
+  EXPECT_EQ(index.tombstone(), nullptr);
+
+  for (size_t list_no = 0; list_no < ivfpq->nlist; list_no++) {
+    auto size = ivfpq->get_list_size(list_no);
+    EXPECT_EQ(ivfpq->reconstruction_errors[list_no].size(), size);
+    for (size_t offset = 0; offset < size; offset++) {
+      EXPECT_EQ(ivfpq->invlists->get_single_id(list_no, offset) % 2, 1);
+    }
+  }
+
+  // consolidating again drops nothing
+  EXPECT_EQ(tenann::ConsolidateIndex(&index), 0);
+}
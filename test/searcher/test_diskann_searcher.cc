@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cmath>
+#include <cstdio>
+
+#include "tenann/index/parameters.h"
+#include "tenann/store/index_type.h"
+#include "test/faiss_test_base.h"
+
+namespace tenann {
+
+class DiskAnnSearcherTest : public FaissTestBase {
+ public:
+  DiskAnnSearcherTest() : FaissTestBase() {
+    int dim = 8;
+    nb() = 1000;
+    d() = dim;
+    diskann_meta_.SetMetaVersion(0);
+    diskann_meta_.SetIndexFamily(IndexFamily::kVectorIndex);
+    diskann_meta_.SetIndexType(IndexType::kDiskAnn);
+    diskann_meta_.common_params()["dim"] = dim;
+    diskann_meta_.common_params()["is_vector_normed"] = false;
+    diskann_meta_.common_params()["metric_type"] = MetricType::kL2Distance;
+    diskann_meta_.index_params()["R"] = 16;
+    diskann_meta_.index_params()["L"] = 50;
+    diskann_meta_.index_params()["pq_M"] = 4;
+    diskann_meta_.search_params()["search_list_size"] = 50;
+    diskann_meta_.search_params()["beam_width"] = 4;
+  }
+
+ protected:
+  void CreateAndWriteDiskAnnIndex(bool use_custom_row_id, int id_filter_count = INT_MAX) {
+    InitAccurateQueryResult(use_custom_row_id, id_filter_count);
+
+    auto builder = IndexFactory::CreateBuilderFromMeta(diskann_meta_);
+    if (use_custom_row_id) {
+      builder->EnableCustomRowId()
+          .Open(index_with_primary_key_path_)
+          .Add({base_view_}, ids_.data(), null_flags_.data())
+          .Flush()
+          .Close();
+    } else {
+      builder->Open(index_with_primary_key_path_)
+          .Add({base_view_}, nullptr, nullptr)
+          .Flush()
+          .Close();
+    }
+
+    meta_ = diskann_meta_;
+  }
+
+  IndexMeta diskann_meta_;
+};
+
+TEST_F(DiskAnnSearcherTest, AnnSearch_Check_DiskAnn_IsWork) {
+  CreateAndWriteDiskAnnIndex(false);
+  ReadIndexAndDefaultSearch();
+  EXPECT_EQ(ann_searcher_->index_ref()->index_type(), IndexType::kDiskAnnOnDisk);
+  EXPECT_TRUE(RecallCheckResult_80Percent());
+
+  {
+    // 节点块已被缓存，再次查询结果应一致
+    auto cached_result_ids = result_ids_;
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_EQ(cached_result_ids, result_ids_);
+  }
+
+  {
+    // beam_width = 1, 退化为逐个节点读取的贪心搜索
+    ann_searcher_->SetSearchParamItem(DiskAnnSearchParams::beam_width_key, 1);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(DiskAnnSearcherTest, AnnSearch_Check_ID_Filter_IsWork) {
+  // 不满足过滤条件的节点仍用于在图上导航, 只有满足条件的节点进入结果
+  int id_filter_count = nb_ / 2;
+  CreateAndWriteDiskAnnIndex(true, id_filter_count);
+  ReadIndexAndDefaultSearch();
+
+  {
+    // IdFilter 判定全为不感兴趣的，返回值应全为 -1
+    class DerivedIdFilter : public IdFilter {
+     public:
+      bool IsMember(idx_t id) const override { return false; }
+      ~DerivedIdFilter() override = default;
+    } id_filter;
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(std::all_of(result_ids_.data(), result_ids_.data() + nq_ * k_,
+                            [](int64_t element) { return element == -1; }));
+  }
+
+  {
+    // RangeIdFilter 只对前 id_filter_count 个 ids 感兴趣
+    RangeIdFilter id_filter(0, id_filter_count, false);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+
+  {
+    // 过滤比例很高时, 候选列表不断扩大直到找到 k 个满足条件的节点
+    int selective_filter_count = nb_ / 20;
+    InitAccurateQueryResult(true, selective_filter_count);
+    RangeIdFilter id_filter(0, selective_filter_count, false);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(std::all_of(result_ids_.data(), result_ids_.data() + nq_ * k_,
+                            [&](int64_t id) { return id >= 0 && id < selective_filter_count; }));
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(DiskAnnSearcherTest, RangeSearch_Check_DiskAnn_IsWork) {
+  CreateAndWriteDiskAnnIndex(false);
+  ReadIndexAndDefaultSearch();
+
+  std::vector<float> distances(k_);
+  std::vector<int64_t> ids(k_);
+  ann_searcher_->AnnSearch(query_view_[0], k_, ids.data(),
+                           reinterpret_cast<uint8_t*>(distances.data()));
+
+  // 以第 k 近邻的距离为半径，范围查询应返回相同的结果
+  std::vector<int64_t> range_ids;
+  std::vector<float> range_distances;
+  ann_searcher_->RangeSearch(query_view_[0], distances[k_ - 1], k_,
+                             AnnSearcher::ResultOrder::kAscending, &range_ids, &range_distances);
+  EXPECT_EQ(range_ids, ids);
+  EXPECT_TRUE(std::is_sorted(range_distances.begin(), range_distances.end()));
+}
+
+}  // namespace tenann
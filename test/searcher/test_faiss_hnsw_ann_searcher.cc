@@ -19,11 +19,19 @@
 
 #include <sys/time.h>
 
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <iostream>
 #include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "faiss/IndexHNSW.h"
+#include "faiss/IndexIDMap.h"
+#include "tenann/index/internal/mmap_hnsw.h"
+#include "tenann/index/internal/tombstone.h"
 #include "tenann/index/parameters.h"
 #include "test/faiss_test_base.h"
 
@@ -179,6 +187,359 @@ TEST_F(FaissHnswAnnSearcherTest, AnnSearch_Check_ID_Filter_IsWork) {
   }
 }
 
+TEST_F(FaissHnswAnnSearcherTest, AnnSearch_Check_MmapLayout_IsWork) {
+  faiss_hnsw_meta().index_writer_options()[IndexWriterOptions::use_mmap_layout_key] = true;
+  faiss_hnsw_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_hnsw_meta_);
+  CreateAndWriteFaissHnswIndex(true, id_filter_count_);
+
+  {
+    ReadIndexAndDefaultSearch();
+    EXPECT_EQ(ann_searcher_->index_ref()->index_type(), IndexType::kFaissHnswMmap);
+  }
+
+  {
+    // 只对[0, id_filter_count_)范围的 ids 感兴趣
+    RangeIdFilter id_filter(0, id_filter_count_, false);
+    result_ids_.clear();
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+
+  {
+    // the mmap layout cannot be written again
+    auto index_writer = IndexFactory::CreateWriterFromMeta(faiss_hnsw_meta());
+    EXPECT_THROW(index_writer->WriteIndexFile(ann_searcher_->index_ref(), index_path()), Error);
+  }
+}
+
+TEST_F(FaissHnswAnnSearcherTest, AnnSearch_Check_MmapLayout_InnerProduct_IsWork) {
+  // 以内存中的 faiss 内积索引的结果作为基准
+  faiss_hnsw_meta().common_params()["metric_type"] = MetricType::kInnerProduct;
+  faiss_hnsw_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_hnsw_meta_);
+  CreateAndWriteFaissHnswIndex(true);
+  ReadIndexAndDefaultSearch();
+  EXPECT_EQ(ann_searcher_->index_ref()->index_type(), IndexType::kFaissHnsw);
+  std::vector<int64_t> faiss_result_ids = result_ids_;
+
+  faiss_hnsw_meta().index_writer_options()[IndexWriterOptions::use_mmap_layout_key] = true;
+  faiss_hnsw_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_hnsw_meta_);
+  CreateAndWriteFaissHnswIndex(true);
+  accurate_query_result_ids_ = faiss_result_ids;
+  ReadIndexAndDefaultSearch();
+  auto* mmap_hnsw = static_cast<const MmapHnsw*>(ann_searcher_->index_ref()->index_raw());
+  EXPECT_EQ(mmap_hnsw->metric_type(), faiss::METRIC_INNER_PRODUCT);
+  EXPECT_TRUE(RecallCheckResult_80Percent());
+
+  // 度量与索引元数据不一致时加载失败
+  for (auto metric_type : {MetricType::kL2Distance, MetricType::kCosineSimilarity}) {
+    auto meta = faiss_hnsw_meta();
+    meta.common_params()["metric_type"] = metric_type;
+    meta.common_params()["is_vector_normed"] = true;
+    auto ann_searcher = AnnSearcherFactory::CreateSearcherFromMeta(meta);
+    EXPECT_THROW(ann_searcher->ReadIndex(index_with_primary_key_path_), Error);
+  }
+}
+
+TEST_F(FaissHnswAnnSearcherTest, Insert_Check_Concurrent_Search_IsWork) {
+  // 先用前一半数据建索引，加载后再插入后一半数据
+  InitAccurateQueryResult(false, INT_MAX);
+  faiss_hnsw_index_builder_->EnableCustomRowId()
+      .Open(index_with_primary_key_path_)
+      .Add({base_view1_}, ids_.data(), nullptr)
+      .Flush()
+      .Close();
+
+  faiss_hnsw_meta().index_reader_options()[IndexReaderOptions::cache_index_file_key] = true;
+  faiss_hnsw_meta().index_reader_options()["custom_cache_key"] = "test_insert";
+  faiss_hnsw_meta().index_reader_options()[IndexReaderOptions::force_read_and_overwrite_cache_key] =
+      true;
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(faiss_hnsw_meta());
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  auto* index_cache = ann_searcher_->index_reader()->index_cache();
+  auto usage_before_insert = index_cache->memory_usage();
+
+  // 插入的同时并发查询
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> search_threads;
+  for (int t = 0; t < 4; t++) {
+    search_threads.emplace_back([&]() {
+      std::vector<int64_t> ids(k_);
+      while (!stop) {
+        for (int i = 0; i < nq_; i++) {
+          ann_searcher_->AnnSearch(query_view_[i], k_, ids.data());
+        }
+      }
+    });
+  }
+
+  for (size_t i = nb_ / 2; i < nb_; i++) {
+    auto one_vector = ArraySeqView{.data = reinterpret_cast<uint8_t*>(base_.data() + i * d_),
+                                   .dim = d_,
+                                   .size = 1,
+                                   .elem_type = PrimitiveType::kFloatType};
+    ann_searcher_->Insert(one_vector, ids_.data() + i);
+  }
+  stop = true;
+  for (auto& thread : search_threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw())->ntotal, nb_);
+  EXPECT_GT(index_cache->memory_usage(), usage_before_insert);
+
+  result_ids_.resize(nq_ * k_);
+  for (int i = 0; i < nq_; i++) {
+    ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+  }
+  EXPECT_TRUE(RecallCheckResult_80Percent());
+
+  // 使用自定义 row id 构建的索引，插入时必须提供 row id
+  EXPECT_THROW(ann_searcher_->Insert(base_view2_), Error);
+}
+
+TEST_F(FaissHnswAnnSearcherTest, Delete_Check_Tombstone_And_Consolidate_IsWork) {
+  auto tombstone_path = Tombstone::PathOf(index_with_primary_key_path_);
+  std::remove(tombstone_path.c_str());
+  faiss_hnsw_index_builder_->EnableCustomRowId()
+      .Open(index_with_primary_key_path_)
+      .Add({base_view_}, ids_.data(), nullptr)
+      .Flush()
+      .Close();
+  meta_ = faiss_hnsw_meta_;
+  meta_.index_reader_options()[IndexReaderOptions::consolidate_threshold_key] = 0;
+
+  // 删除后一半数据，结果中不应再出现被删除的行
+  InitAccurateQueryResult(false, nb_ / 2);
+  std::vector<int64_t> deleted_ids(ids_.begin() + nb_ / 2, ids_.end());
+  auto search_and_check = [&]() {
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    for (auto id : result_ids_) {
+      EXPECT_LT(id, nb_ / 2);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  };
+
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  ann_searcher_->Delete(deleted_ids.data(), deleted_ids.size());
+  search_and_check();
+
+  // 用户过滤条件与删除标记同时生效
+  {
+    RangeIdFilter id_filter(nb_ / 4, nb_);
+    std::vector<int64_t> filtered_ids(k_);
+    ann_searcher_->AnnSearch(query_view_[0], k_, filtered_ids.data(), &id_filter);
+    for (auto id : filtered_ids) {
+      EXPECT_TRUE(id == -1 || (id >= nb_ / 4 && id < nb_ / 2)) << id;
+    }
+  }
+
+  // 删除标记持久化在索引文件旁边，重新加载后依然生效
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  ASSERT_NE(ann_searcher_->index_ref()->tombstone(), nullptr);
+  EXPECT_EQ(ann_searcher_->index_ref()->tombstone()->num_deleted(), nb_ - nb_ / 2);
+  search_and_check();
+
+  // 物理删除后索引只保留未删除的行
+  auto faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  ann_searcher_->Consolidate();
+  EXPECT_EQ(faiss_index->ntotal, nb_ / 2);
+  EXPECT_EQ(ann_searcher_->index_ref()->tombstone(), nullptr);
+  search_and_check();
+
+  // 物理删除的结果写回索引文件，删除标记文件被移除，重新加载后无需再次物理删除
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  EXPECT_EQ(faiss_index->ntotal, nb_ / 2);
+  EXPECT_EQ(ann_searcher_->index_ref()->tombstone(), nullptr);
+  search_and_check();
+
+  // 被物理删除的行重新插入后可以被查到
+  {
+    ArraySeqView reinserted{.data = reinterpret_cast<uint8_t*>(base_.data() + (nb_ - 1) * d_),
+                            .dim = d_,
+                            .size = 1,
+                            .elem_type = PrimitiveType::kFloatType};
+    ann_searcher_->Insert(reinserted, &ids_[nb_ - 1]);
+    PrimitiveSeqView query{.data = reinserted.data,
+                           .size = static_cast<uint32_t>(d_),
+                           .elem_type = PrimitiveType::kFloatType};
+    int64_t result_id = -1;
+    ann_searcher_->AnnSearch(query, 1, &result_id);
+    EXPECT_EQ(result_id, ids_[nb_ - 1]);
+  }
+
+  // 超过阈值后在后台物理删除
+  meta_.index_reader_options()[IndexReaderOptions::consolidate_threshold_key] = 0.2;
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  auto index_ref = ann_searcher_->index_ref();
+  std::vector<int64_t> more_deleted_ids(ids_.begin() + nb_ / 4, ids_.begin() + nb_ / 2);
+  ann_searcher_->Delete(more_deleted_ids.data(), more_deleted_ids.size());
+  // the searcher waits for the background consolidation when destroyed
+  ann_searcher_.reset();
+  EXPECT_EQ(static_cast<faiss::Index*>(index_ref->index_raw())->ntotal, nb_ / 4);
+
+  std::remove(tombstone_path.c_str());
+}
+
+TEST_F(FaissHnswAnnSearcherTest, Delete_Check_Reinsert_Before_Consolidate_IsWork) {
+  auto tombstone_path = Tombstone::PathOf(index_with_primary_key_path_);
+  std::remove(tombstone_path.c_str());
+  faiss_hnsw_index_builder_->EnableCustomRowId()
+      .Open(index_with_primary_key_path_)
+      .Add({base_view_}, ids_.data(), nullptr)
+      .Flush()
+      .Close();
+  meta_ = faiss_hnsw_meta_;
+  meta_.index_reader_options()[IndexReaderOptions::consolidate_threshold_key] = 0;
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+
+  auto vector_of = [&](size_t i) {
+    return PrimitiveSeqView{.data = reinterpret_cast<uint8_t*>(base_.data() + i * d_),
+                            .size = static_cast<uint32_t>(d_),
+                            .elem_type = PrimitiveType::kFloatType};
+  };
+  auto search = [&](AnnSearcher* searcher, size_t i, int64_t k) {
+    std::vector<int64_t> result_ids(k);
+    searcher->AnnSearch(vector_of(i), k, result_ids.data());
+    return result_ids;
+  };
+  auto contains = [](const std::vector<int64_t>& ids, int64_t id) {
+    return std::find(ids.begin(), ids.end(), id) != ids.end();
+  };
+
+  // 删除 row id 后用另一个向量重新插入同一个 row id (upsert)
+  int64_t row_id = ids_[0];
+  ann_searcher_->Delete(&row_id, 1);
+  EXPECT_FALSE(contains(search(ann_searcher_.get(), 0, 1), row_id));
+  ArraySeqView new_vector{.data = reinterpret_cast<uint8_t*>(base_.data() + (nb_ - 1) * d_),
+                          .dim = d_,
+                          .size = 1,
+                          .elem_type = PrimitiveType::kFloatType};
+  ann_searcher_->Insert(new_vector, &row_id);
+
+  // 新插入的行可以被查到, 旧的行仍然被删除
+  auto check_upserted = [&](AnnSearcher* searcher) {
+    EXPECT_TRUE(contains(search(searcher, nb_ - 1, 2), row_id));
+    EXPECT_NE(search(searcher, 0, 1)[0], row_id);
+  };
+  check_upserted(ann_searcher_.get());
+
+  // 插入的行在物理删除前不会写入索引文件, 重新加载后旧的行依然被删除
+  {
+    auto reloaded = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+    reloaded->ReadIndex(index_with_primary_key_path_);
+    EXPECT_NE(search(reloaded.get(), 0, 1)[0], row_id);
+  }
+
+  // 物理删除只丢弃旧的行
+  auto faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  ann_searcher_->Consolidate();
+  EXPECT_EQ(faiss_index->ntotal, nb_);
+  check_upserted(ann_searcher_.get());
+
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  check_upserted(ann_searcher_.get());
+
+  std::remove(tombstone_path.c_str());
+}
+
+TEST_F(FaissHnswAnnSearcherTest, Consolidate_Check_GraphLevels_IsWork) {
+  auto tombstone_path = Tombstone::PathOf(index_with_primary_key_path_);
+  std::remove(tombstone_path.c_str());
+  faiss_hnsw_index_builder_->EnableCustomRowId()
+      .Open(index_with_primary_key_path_)
+      .Add({base_view_}, ids_.data(), nullptr)
+      .Flush()
+      .Close();
+  meta_ = faiss_hnsw_meta_;
+  meta_.index_reader_options()[IndexReaderOptions::consolidate_threshold_key] = 0;
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+
+  auto* faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  auto* id_map = dynamic_cast<faiss::IndexIDMap*>(faiss_index);
+  ASSERT_NE(id_map, nullptr);
+  auto* index_hnsw = dynamic_cast<faiss::IndexHNSW*>(id_map->index);
+  ASSERT_NE(index_hnsw, nullptr);
+  const faiss::HNSW& hnsw = index_hnsw->hnsw;
+  auto neighbors_of = [&](int64_t v, int level) {
+    size_t begin, end;
+    hnsw.neighbor_range(v, level, &begin, &end);
+    std::vector<int64_t> row_ids;
+    for (size_t i = begin; i < end && hnsw.neighbors[i] >= 0; i++) {
+      row_ids.push_back(id_map->id_map[hnsw.neighbors[i]]);
+    }
+    return row_ids;
+  };
+
+  // 记录物理删除前每个节点各层的邻居, 以 row id 表示
+  std::unordered_map<int64_t, std::vector<std::vector<int64_t>>> graph_before;
+  for (int64_t v = 0; v < index_hnsw->ntotal; v++) {
+    auto& levels = graph_before[id_map->id_map[v]];
+    for (int level = 0; level < hnsw.levels[v]; level++) {
+      levels.push_back(neighbors_of(v, level));
+    }
+  }
+
+  std::vector<int64_t> deleted_ids;
+  for (size_t i = 0; i < nb_; i += 3) {
+    deleted_ids.push_back(ids_[i]);
+  }
+  std::unordered_set<int64_t> deleted_set(deleted_ids.begin(), deleted_ids.end());
+  ann_searcher_->Delete(deleted_ids.data(), deleted_ids.size());
+  ann_searcher_->Consolidate();
+  ASSERT_EQ(index_hnsw->ntotal, nb_ - deleted_ids.size());
+
+  // 每层的邻居都留在本层的槽位内, 且是本层存在的节点
+  size_t num_upper_level_links = 0;
+  for (int64_t v = 0; v < index_hnsw->ntotal; v++) {
+    int64_t row_id = id_map->id_map[v];
+    EXPECT_EQ(deleted_set.count(row_id), 0);
+    const auto& levels_before = graph_before.at(row_id);
+    ASSERT_EQ(hnsw.levels[v], static_cast<int>(levels_before.size()));
+    for (int level = 0; level < hnsw.levels[v]; level++) {
+      size_t begin, end;
+      hnsw.neighbor_range(v, level, &begin, &end);
+      bool list_ended = false;
+      for (size_t i = begin; i < end; i++) {
+        auto u = hnsw.neighbors[i];
+        if (u < 0) {
+          list_ended = true;
+          continue;
+        }
+        EXPECT_FALSE(list_ended) << "node " << v << " level " << level;
+        ASSERT_LT(u, index_hnsw->ntotal);
+        EXPECT_GT(hnsw.levels[u], level);
+      }
+
+      // 没有邻居被删除的列表保持不变
+      auto neighbors = neighbors_of(v, level);
+      const auto& neighbors_before = levels_before[level];
+      if (std::none_of(neighbors_before.begin(), neighbors_before.end(),
+                       [&](int64_t id) { return deleted_set.count(id) > 0; })) {
+        EXPECT_EQ(neighbors, neighbors_before) << "node " << v << " level " << level;
+      }
+      if (level > 0) {
+        num_upper_level_links += neighbors.size();
+      }
+    }
+  }
+  EXPECT_GT(num_upper_level_links, 0);
+
+  std::remove(tombstone_path.c_str());
+}
+
 TEST_F(FaissHnswAnnSearcherTest, AnnSearch_Check_IndexHNSW_IsWork) {
   CreateAndWriteFaissHnswIndex(false);
 
@@ -188,4 +549,31 @@ TEST_F(FaissHnswAnnSearcherTest, AnnSearch_Check_IndexHNSW_IsWork) {
   }
 }
 
+TEST_F(FaissHnswAnnSearcherTest, ReadIndex_Check_ParallelLoading_IsWork) {
+  CreateAndWriteFaissHnswIndex(false);
+  meta_.index_reader_options()[IndexReaderOptions::load_parallelism_key] = 4;
+
+  // 仅设置并发度时仍然由 faiss 映射文件
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  auto* profile = ann_searcher_->index_reader()->EnableProfile().profile();
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  EXPECT_EQ(profile->get_counter("ReadFileTime")->value(), 0);
+  EXPECT_GT(profile->get_counter("DeserializeTime")->value(), 0);
+
+  meta_.index_reader_options()[IndexReaderOptions::read_hnsw_file_up_front_key] = true;
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  profile = ann_searcher_->index_reader()->EnableProfile().profile();
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  // 先并发读取整个文件, 再反序列化
+  EXPECT_GT(profile->get_counter("ReadFileTime")->value(), 0);
+  EXPECT_GT(profile->get_counter("DeserializeTime")->value(), 0);
+  EXPECT_EQ(profile->get_counter("MapFileTime")->value(), 0);
+
+  result_ids_.resize(nq_ * k_);
+  for (int i = 0; i < nq_; i++) {
+    ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+  }
+  EXPECT_TRUE(RecallCheckResult_80Percent());
+}
+
 }  // namespace tenann
\ No newline at end of file
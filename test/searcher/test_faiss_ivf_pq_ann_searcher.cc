@@ -19,12 +19,23 @@
 
 #include <sys/time.h>
 
+#include <atomic>
 #include <cmath>
 #include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <numeric>
 #include <random>
+#include <thread>
+#include <unordered_set>
 
+#include "faiss/IndexIVF.h"
+#include "faiss/IndexPreTransform.h"
+#include "tenann/index/index_ivfpq_reader.h"
+#include "tenann/index/internal/tombstone.h"
 #include "tenann/index/parameters.h"
+#include "tenann/searcher/faiss_ivf_pq_ann_searcher.h"
+#include "tenann/util/io_backend.h"
 #include "test/faiss_test_base.h"
 
 namespace tenann {
@@ -256,8 +267,12 @@ TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_IndexIvfPq_BlockCache_IsWork)
 
   {
     std::string before_cache_status = IndexCache::GetGlobalInstance()->status().dump();
+    auto* read_requests = IoBackend::GetInstance()->profile()->get_counter("ReadRequests");
+    int64_t read_requests_before = read_requests->value();
     ReadIndexAndDefaultSearch(500 * 1024);  // limit 500KB
     EXPECT_TRUE(RecallCheckResult_80Percent());
+    // 未命中缓存的倒排链通过 io backend 读取
+    EXPECT_GT(read_requests->value(), read_requests_before);
     T_LOG(INFO) << "before: " << before_cache_status << "\nafter: "<< IndexCache::GetGlobalInstance()->status().dump();
   }
 
@@ -294,4 +309,438 @@ TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_IndexIvfPq_BlockCache_IsWork)
   }
 }
 
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_BlockCache_SingleFlight_IsWork) {
+  faiss_ivf_pq_meta_.index_reader_options()["cache_index_block"] = true;
+  CreateAndWriteFaissIvfPqIndex(false);
+
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  auto* index_cache = ann_searcher_->index_reader()->index_cache();
+  index_cache->SetCapacity(1024 * 1024 * 1024);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  size_t nprobe = 4;
+  ann_searcher_->SetSearchParamItem(FaissIvfPqSearchParams::nprobe_key, nprobe);
+
+  // 统计所有查询探测到的不同 block 数
+  auto* faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  std::vector<float> queries = query_;
+  if (auto* index_pt = dynamic_cast<faiss::IndexPreTransform*>(faiss_index)) {
+    const float* transformed = index_pt->apply_chain(nq_, query_.data());
+    queries.assign(transformed, transformed + nq_ * index_pt->index->d);
+    if (transformed != query_.data()) delete[] transformed;
+    faiss_index = index_pt->index;
+  }
+  auto* index_ivf = dynamic_cast<faiss::IndexIVF*>(faiss_index);
+  ASSERT_NE(index_ivf, nullptr);
+  auto* block_cache_lists = dynamic_cast<faiss::BlockCacheInvertedLists*>(index_ivf->invlists);
+  ASSERT_NE(block_cache_lists, nullptr);
+  std::vector<float> distances(nq_ * nprobe);
+  std::vector<faiss::Index::idx_t> list_nos(nq_ * nprobe);
+  index_ivf->quantizer->search(nq_, queries.data(), nprobe, distances.data(), list_nos.data());
+  std::unordered_set<size_t> probed_blocks;
+  for (auto list_no : list_nos) {
+    if (list_no >= 0 && block_cache_lists->list_size(list_no) > 0) {
+      probed_blocks.insert(block_cache_lists->list_blocks[list_no]);
+    }
+  }
+
+  // 多个查询同时按相同顺序扫描相同的倒排链, 每个 block 最多从磁盘读取一次
+  auto* read_requests = IoBackend::GetInstance()->profile()->get_counter("ReadRequests");
+  int64_t read_requests_before = read_requests->value();
+  uint64_t coalesced_misses_before = index_cache->coalesced_miss_count();
+  constexpr int kNumThreads = 8;
+  std::atomic<int> num_ready = 0;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([this, &num_ready]() {
+      num_ready++;
+      while (num_ready < kNumThreads) {
+        std::this_thread::yield();
+      }
+      std::vector<int64_t> result_ids(k_);
+      for (int i = 0; i < nq_; i++) {
+        ann_searcher_->AnnSearch(query_view_[i], k_, result_ids.data());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_GT(index_cache->coalesced_miss_count() - coalesced_misses_before, 0);
+  EXPECT_LE(read_requests->value() - read_requests_before, probed_blocks.size());
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_BlockCache_Superblock_IsWork) {
+  // 整个索引的倒排链都能放进一个 superblock
+  faiss_ivf_pq_meta_.index_reader_options()["cache_index_block"] = true;
+  faiss_ivf_pq_meta_.index_reader_options()["block_cache_superblock_size"] = 1024 * 1024;
+  CreateAndWriteFaissIvfPqIndex(false);
+
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->index_reader()->index_cache()->SetCapacity(1024 * 1024 * 1024);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  ann_searcher_->SetSearchParamItem(FaissIvfPqSearchParams::nprobe_key, size_t(4 * sqrt(nb_)));
+
+  auto* read_requests = IoBackend::GetInstance()->profile()->get_counter("ReadRequests");
+  int64_t read_requests_before = read_requests->value();
+  result_ids_.resize(nq_ * k_);
+  for (int i = 0; i < nq_; i++) {
+    ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+  }
+  EXPECT_TRUE(RecallCheckResult_80Percent());
+  EXPECT_LE(read_requests->value() - read_requests_before, 1);
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_SplitCodesAndIds_IsWork) {
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::split_codes_and_ids_key] = true;
+  faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+  CreateAndWriteFaissIvfPqIndex(true);
+
+  for (bool cache_index_block : {false, true}) {
+    meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    ReadIndexAndDefaultSearch();
+    ann_searcher_->SetSearchParamItem(FaissIvfPqSearchParams::nprobe_key, size_t(4 * sqrt(nb_)));
+
+    // 先扫描 codes, 再只读取结果的 ids
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+
+    // 有 id filter 时扫描需要 ids
+    RangeIdFilter id_filter(0, INT64_MAX, false);
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_CompressIds_IsWork) {
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::compress_ids_key] = true;
+  faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+  CreateAndWriteFaissIvfPqIndex(true);
+
+  for (bool cache_index_block : {false, true}) {
+    meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    ReadIndexAndDefaultSearch();
+    ann_searcher_->SetSearchParamItem(FaissIvfPqSearchParams::nprobe_key, size_t(4 * sqrt(nb_)));
+
+    // 只解码结果的 ids
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+
+    // 有 id filter 时解码整个 list 的 ids
+    RangeIdFilter id_filter(0, INT64_MAX, false);
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_, &id_filter);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_PrecomputedTable_IsWork) {
+  // 持久化的 table, 以及懒计算并共享的 table
+  for (bool write_precomputed_table : {true, false}) {
+    faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::write_precomputed_table_key] =
+        write_precomputed_table;
+    faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+    CreateAndWriteFaissIvfPqIndex(false);
+    meta_.index_reader_options()[IndexReaderOptions::lazy_precompute_table_key] =
+        !write_precomputed_table;
+    meta_.index_reader_options()[IndexReaderOptions::share_precomputed_table_key] = true;
+
+    ReadIndexAndDefaultSearch();
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, EstimateMemoryUsage_Check_Breakdown_IsWork) {
+  // 内存中的倒排链和 block cache 的倒排链分别统计
+  for (bool cache_index_block : {false, true}) {
+    faiss_ivf_pq_meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    CreateAndWriteFaissIvfPqIndex(false);
+    ReadIndexAndDefaultSearch();
+
+    auto breakdown = ann_searcher_->index_ref()->MemoryUsageBreakdown();
+    size_t sum = 0;
+    for (const auto& [component, size] : breakdown.items()) {
+      if (component != "total") {
+        sum += size.get<size_t>();
+      }
+    }
+    EXPECT_EQ(sum, breakdown["total"].get<size_t>());
+    EXPECT_EQ(ann_searcher_->index_ref()->EstimateMemoryUsage(), sum);
+    EXPECT_GT(breakdown["quantizer"].get<size_t>(), 0);
+    EXPECT_GT(breakdown["pq"].get<size_t>(), 0);
+    if (cache_index_block) {
+      EXPECT_GT(breakdown["invlists.block_cache_bookkeeping"].get<size_t>(), 0);
+      EXPECT_FALSE(breakdown.contains("invlists.codes"));
+    } else {
+      // 编码至少占用 nb * M 字节 (nbits = 8)
+      size_t m = faiss_ivf_pq_meta_.index_params()["M"].get<size_t>();
+      EXPECT_GE(breakdown["invlists.codes"].get<size_t>(), nb_ * m);
+    }
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, BlockCache_Check_WarmUp_IsWork) {
+  faiss_ivf_pq_meta_.index_reader_options()["cache_index_block"] = true;
+  CreateAndWriteFaissIvfPqIndex(false);
+  size_t nlist = faiss_ivf_pq_meta_.index_params()["nlist"].get<size_t>();
+  auto* index_cache = IndexCache::GetGlobalInstance();
+  index_cache->SetCapacity(1024 * 1024 * 1024);
+  auto* read_requests = IoBackend::GetInstance()->profile()->get_counter("ReadRequests");
+  auto hot_keys_path = std::string(index_with_primary_key_path_) + ".hot_keys";
+
+  // 查询过的倒排链被当前索引引用, 其余的缓存项都被清理
+  ReadIndexAndDefaultSearch();
+  index_cache->EvictTo(0);
+  size_t hot_usage = index_cache->memory_usage();
+  ASSERT_GT(hot_usage, 0);
+  index_cache->SaveHotKeys(hot_keys_path, 1000000);
+
+  // 模拟重启: 缓存为空, 预热后同样的查询不再读取磁盘
+  auto restart_and_check_warmed_up = [&](const std::function<void()>& warm_up) {
+    ann_searcher_.reset();
+    index_cache->EvictTo(0);
+    EXPECT_EQ(index_cache->memory_usage(), 0);
+
+    ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+    ann_searcher_->ReadIndex(index_with_primary_key_path_);
+    warm_up();
+    // 预热在后台进行
+    for (int i = 0; i < 1000 && index_cache->memory_usage() < hot_usage; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_GE(index_cache->memory_usage(), hot_usage);
+
+    int64_t read_requests_before = read_requests->value();
+    result_ids_.assign(nq_ * k_, -1);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_EQ(read_requests->value(), read_requests_before);
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  };
+
+  // 1. 读取索引时预热上次保存的热点倒排链
+  EXPECT_GT(index_cache->LoadWarmUpPlan(hot_keys_path, 1024 * 1024 * 1024), 0);
+  restart_and_check_warmed_up([]() {});
+  EXPECT_EQ(index_cache->warm_up_status()["pending_keys"].get<size_t>(), 0);
+
+  // 2. 查询向量附近的倒排链
+  restart_and_check_warmed_up([this]() {
+    auto* searcher = dynamic_cast<FaissIvfPqAnnSearcher*>(ann_searcher_.get());
+    ASSERT_NE(searcher, nullptr);
+    PrimitiveSeqView queries = {reinterpret_cast<const uint8_t*>(query_.data()),
+                                static_cast<uint32_t>(query_.size()), PrimitiveType::kFloatType};
+    searcher->WarmUp(queries);
+  });
+
+  // 3. 最大的 nlist 个倒排链, 即全部倒排链
+  faiss_ivf_pq_meta_.index_reader_options()["warm_up_largest_lists"] = nlist;
+  meta_ = faiss_ivf_pq_meta_;
+  restart_and_check_warmed_up([]() {});
+
+  // I/O 预算用完后不再预热
+  index_cache->SetWarmUpPlan(index_cache->HotKeys(1000000), 0);
+  faiss_ivf_pq_meta_.index_reader_options()["warm_up_largest_lists"] = 0;
+  meta_ = faiss_ivf_pq_meta_;
+  ann_searcher_.reset();
+  index_cache->EvictTo(0);
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  EXPECT_EQ(index_cache->memory_usage(), 0);
+  remove(hot_keys_path.c_str());
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_ReadIndexFromBuffer_IsWork) {
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::compress_ids_key] = true;
+  faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+  CreateAndWriteFaissIvfPqIndex(true);
+
+  // 将索引写入内存 buffer
+  auto index = IndexFactory::CreateReaderFromMeta(meta_)->ReadIndex(index_with_primary_key_path_);
+  std::vector<uint8_t> buffer;
+  IndexFactory::CreateWriterFromMeta(meta_)->WriteIndexBuffer(index, &buffer);
+  std::vector<uint8_t> streamed;
+  IndexFactory::CreateWriterFromMeta(meta_)->WriteIndexStream(
+      index, [&](const void* data, size_t size) {
+        streamed.insert(streamed.end(), static_cast<const uint8_t*>(data),
+                        static_cast<const uint8_t*>(data) + size);
+      });
+  EXPECT_EQ(buffer, streamed);
+
+  // 从 buffer 读取索引, 开启 block cache 时按需从 buffer 读取倒排列表
+  for (bool cache_index_block : {false, true}) {
+    meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    auto name = "ivfpq_buffer_" + std::to_string(cache_index_block);
+    ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+    ann_searcher_->ReadIndexSource(
+        RandomAccessSource::FromBuffer(name, buffer.data(), buffer.size()));
+    // 没有对应的索引文件, 无法持久化删除标记和物理删除的结果
+    EXPECT_TRUE(ann_searcher_->index_path().empty());
+    EXPECT_THROW(ann_searcher_->Delete(ids_.data(), 1), Error);
+    EXPECT_THROW(ann_searcher_->Consolidate(), Error);
+
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, AnnSearch_Check_SectionedFile_IsWork) {
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::sectioned_file_key] = true;
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::compress_ids_key] = true;
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::write_precomputed_table_key] = true;
+  faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+  CreateAndWriteFaissIvfPqIndex(true);
+
+  // block cache 只读取 list directory, list data 按需读取
+  for (bool cache_index_block : {false, true}) {
+    meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    ReadIndexAndDefaultSearch();
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, ReadIndex_Check_StreamFormatProfile_IsWork) {
+  CreateAndWriteFaissIvfPqIndex(true);
+
+  // 非分段格式按顺序读取, 每个阶段同样单独计时
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  auto* profile = ann_searcher_->index_reader()->EnableProfile().profile();
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  for (auto* name : {"ReadHeaderTime", "ReadQuantizerTime", "ReadCodebookTime",
+                     "ReadInvertedListsTime"}) {
+    EXPECT_GT(profile->get_counter(name)->value(), 0) << name;
+  }
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, ReadIndex_Check_ParallelLoading_IsWork) {
+  faiss_ivf_pq_meta_.index_writer_options()[IndexWriterOptions::sectioned_file_key] = true;
+  faiss_ivf_pq_index_builder_ = IndexFactory::CreateBuilderFromMeta(faiss_ivf_pq_meta_);
+  CreateAndWriteFaissIvfPqIndex(true);
+  meta_.index_reader_options()[IndexReaderOptions::load_parallelism_key] = 4;
+
+  auto search_and_check = [this]() {
+    result_ids_.clear();
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+  };
+
+  // 各 section 并发读取, 每个阶段单独计时
+  for (bool cache_index_block : {false, true}) {
+    meta_.index_reader_options()["cache_index_block"] = cache_index_block;
+    ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+    auto* profile = ann_searcher_->index_reader()->EnableProfile().profile();
+    ann_searcher_->ReadIndex(index_with_primary_key_path_);
+    for (auto* name : {"ReadIndexTotalTime", "ReadHeaderTime", "ReadQuantizerTime",
+                       "ReadCodebookTime", "ReadInvertedListsTime",
+                       "ReadReconstructionErrorsTime"}) {
+      EXPECT_GT(profile->get_counter(name)->value(), 0) << name;
+    }
+    search_and_check();
+  }
+
+  // 批量打开多个索引, 读取失败的索引为 nullptr 并返回错误信息
+  std::vector<std::string> paths(8, index_with_primary_key_path_);
+  paths.push_back("not_exist_path");
+  std::vector<std::string> errors;
+  auto searchers =
+      AnnSearcherFactory::CreateSearchersAndReadIndexes(meta_, paths, 4, &errors, true);
+  ASSERT_EQ(searchers.size(), paths.size());
+  ASSERT_EQ(errors.size(), paths.size());
+  for (size_t i = 0; i + 1 < paths.size(); i++) {
+    ASSERT_NE(searchers[i], nullptr) << errors[i];
+    EXPECT_TRUE(errors[i].empty());
+    EXPECT_NE(searchers[i]->index_reader()->profile(), nullptr);
+  }
+  EXPECT_EQ(searchers.back(), nullptr);
+  EXPECT_FALSE(errors.back().empty());
+
+  ann_searcher_ = searchers.front();
+  search_and_check();
+}
+
+TEST_F(FaissIvfPqAnnSearcherTest, Delete_Check_Tombstone_And_Consolidate_IsWork) {
+  auto tombstone_path = Tombstone::PathOf(index_with_primary_key_path_);
+  std::remove(tombstone_path.c_str());
+  CreateAndWriteFaissIvfPqIndex();
+  meta_.index_reader_options()[IndexReaderOptions::consolidate_threshold_key] = 0;
+
+  // 删除后一半数据
+  InitAccurateQueryResult(false, nb_ / 2);
+  std::vector<int64_t> deleted_ids(nb_ - nb_ / 2);
+  std::iota(deleted_ids.begin(), deleted_ids.end(), nb_ / 2);
+
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  ann_searcher_->Delete(deleted_ids.data(), deleted_ids.size());
+
+  auto search_and_check = [&]() {
+    result_ids_.resize(nq_ * k_);
+    for (int i = 0; i < nq_; i++) {
+      ann_searcher_->AnnSearch(query_view_[i], k_, result_ids_.data() + i * k_);
+    }
+    for (auto id : result_ids_) {
+      EXPECT_LT(id, nb_ / 2);
+    }
+    EXPECT_TRUE(RecallCheckResult_80Percent());
+
+    // 范围查询同样跳过被删除的行
+    std::vector<int64_t> range_result_ids;
+    std::vector<float> range_result_distances;
+    ann_searcher_->RangeSearch(query_view_[0], 1e10, -1, AnnSearcher::ResultOrder::kAscending,
+                               &range_result_ids, &range_result_distances);
+    EXPECT_EQ(range_result_ids.size(), nb_ / 2);
+    for (auto id : range_result_ids) {
+      EXPECT_LT(id, nb_ / 2);
+    }
+  };
+  search_and_check();
+
+  // 用户过滤条件与删除标记同时生效
+  {
+    RangeIdFilter id_filter(nb_ / 4, nb_);
+    std::vector<int64_t> filtered_ids(k_);
+    ann_searcher_->AnnSearch(query_view_[0], k_, filtered_ids.data(), &id_filter);
+    for (auto id : filtered_ids) {
+      EXPECT_TRUE(id == -1 || (id >= nb_ / 4 && id < nb_ / 2)) << id;
+    }
+  }
+
+  auto faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  ann_searcher_->Consolidate();
+  EXPECT_EQ(faiss_index->ntotal, nb_ / 2);
+  search_and_check();
+
+  // 物理删除的结果被写回索引文件，删除标记文件同时被移除
+  ann_searcher_ = AnnSearcherFactory::CreateSearcherFromMeta(meta_);
+  ann_searcher_->ReadIndex(index_with_primary_key_path_);
+  faiss_index = static_cast<faiss::Index*>(ann_searcher_->index_ref()->index_raw());
+  EXPECT_EQ(faiss_index->ntotal, nb_ / 2);
+  EXPECT_EQ(ann_searcher_->index_ref()->tombstone(), nullptr);
+  EXPECT_FALSE(std::ifstream(tombstone_path).good());
+  search_and_check();
+
+  std::remove(tombstone_path.c_str());
+}
+
 }  // namespace tenann
\ No newline at end of file
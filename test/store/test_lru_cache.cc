@@ -17,6 +17,12 @@
  * under the License.
  */
 
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+
 #include "tenann/index/parameters.h"
 #include "tenann/store/lru_cache.h"
 #include "test/faiss_test_base.h"
@@ -67,6 +73,29 @@ TEST_F(ShardedLRUCacheTest, Erase) {
   EXPECT_EQ(lookup_handle, nullptr);
 }
 
+TEST_F(ShardedLRUCacheTest, EraseHandle) {
+  // Test erasing the entry of a handle, keeping the entry inserted since under the same key.
+  auto key = tenann::CacheKey{std::string("test_key")};
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  auto old_handle = cache_->insert(key, new int(42), sizeof(int), deleter);
+  auto new_handle = cache_->insert(key, new int(43), sizeof(int), deleter);
+  cache_->release(new_handle);
+
+  cache_->erase(old_handle);
+  EXPECT_EQ(*static_cast<int*>(cache_->value(old_handle)), 42);
+  cache_->release(old_handle);
+  auto lookup_handle = cache_->lookup(key);
+  ASSERT_NE(lookup_handle, nullptr);
+  EXPECT_EQ(*static_cast<int*>(cache_->value(lookup_handle)), 43);
+
+  cache_->erase(lookup_handle);
+  cache_->release(lookup_handle);
+  EXPECT_EQ(cache_->lookup(key), nullptr);
+  EXPECT_EQ(cache_->get_memory_usage(), 0);
+}
+
 TEST_F(ShardedLRUCacheTest, NewId) {
   // Test getting a new ID.
   auto id1 = cache_->new_id();
@@ -145,4 +174,386 @@ TEST_F(ShardedLRUCacheTest, GetLookupCount) {
   EXPECT_EQ(cache_->get_lookup_count(), 1);
   EXPECT_EQ(cache_->get_hit_count(), 1);
 }
-}  // namespace tenann
\ No newline at end of file
+
+TEST_F(ShardedLRUCacheTest, UpdateCharge) {
+  // Test updating the charge of an entry whose value grows in place.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  for (int i = 0; i < 8; i++) {
+    auto key = tenann::CacheKey{"test_key" + std::to_string(i)};
+    cache_->release(cache_->insert(key, new int(i), 10, deleter));
+  }
+  EXPECT_EQ(cache_->get_memory_usage(), 80);
+
+  auto key = tenann::CacheKey{std::string("test_key_grow")};
+  auto handle = cache_->insert(key, new int(42), 100, deleter);
+  EXPECT_EQ(cache_->get_memory_usage(), 180);
+
+  cache_->update_charge(handle, 200);
+  EXPECT_EQ(cache_->get_memory_usage(), 280);
+
+  // grow beyond the shard capacity, the unreferenced entries in the same shard are evicted
+  // while the referenced one is kept
+  cache_->update_charge(handle, 600);
+  EXPECT_LE(cache_->get_memory_usage(), 600 + 80 - 10);
+  EXPECT_EQ(*static_cast<int*>(cache_->value(handle)), 42);
+  cache_->release(handle);
+}
+
+TEST_F(ShardedLRUCacheTest, TinyLfu_ScanResistant) {
+  // A full scan over cold entries evicts all hot entries from LRU but not from TINY_LFU.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  const size_t charge = tenann::LRUCache::kSketchAverageCharge;
+  auto access = [&](tenann::Cache* cache, const std::string& key_str) {
+    auto key = tenann::CacheKey{key_str};
+    auto* handle = cache->lookup(key);
+    bool hit = handle != nullptr;
+    if (!hit) {
+      handle = cache->insert(key, new int(0), charge, deleter);
+    }
+    cache->release(handle);
+    return hit;
+  };
+
+  for (auto policy : {tenann::CacheEvictionPolicy::LRU, tenann::CacheEvictionPolicy::TINY_LFU}) {
+    std::unique_ptr<tenann::Cache> cache(tenann::new_lru_cache(200 * charge, policy));
+    EXPECT_EQ(cache->get_eviction_policy(), policy);
+    for (int round = 0; round < 10; round++) {
+      for (int i = 0; i < 50; i++) {
+        access(cache.get(), "hot_" + std::to_string(i));
+      }
+    }
+    for (int i = 0; i < 500; i++) {
+      access(cache.get(), "cold_" + std::to_string(i));
+    }
+    int hot_hits = 0;
+    for (int i = 0; i < 50; i++) {
+      hot_hits += access(cache.get(), "hot_" + std::to_string(i));
+    }
+    EXPECT_LE(cache->get_memory_usage(), 200 * charge);
+
+    json status;
+    cache->get_policy_status(&status);
+    auto name = tenann::cache_eviction_policy_name(policy);
+    EXPECT_EQ(status["eviction_policy"], name);
+    EXPECT_EQ(status[name]["lookup_count"], 10 * 50 + 500 + 50);
+    if (policy == tenann::CacheEvictionPolicy::LRU) {
+      EXPECT_EQ(hot_hits, 0);
+      EXPECT_EQ(status["tiny_lfu"]["lookup_count"], 0);
+    } else {
+      EXPECT_GE(hot_hits, 45);
+      // the cold entries beyond the free space are not admitted
+      EXPECT_GE(status["tiny_lfu"]["rejected_count"].get<uint64_t>(), 300);
+      EXPECT_EQ(status["lru"]["lookup_count"], 0);
+    }
+  }
+}
+
+TEST_F(ShardedLRUCacheTest, SetEvictionPolicy) {
+  // Switching the policy keeps the cached entries and counts hits per policy.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  cache_->set_eviction_policy(tenann::CacheEvictionPolicy::TINY_LFU);
+  std::vector<tenann::Cache::Handle*> handles;
+  for (int i = 0; i < 8; i++) {
+    auto key_str = "test_key" + std::to_string(i);
+    auto* handle = cache_->insert(tenann::CacheKey{key_str}, new int(i), 10, deleter);
+    if (i % 2 == 0) {
+      cache_->release(handle);
+    } else {
+      handles.push_back(handle);
+    }
+  }
+  EXPECT_EQ(cache_->get_memory_usage(), 80);
+
+  cache_->set_eviction_policy(tenann::CacheEvictionPolicy::LRU);
+  EXPECT_EQ(cache_->get_eviction_policy(), tenann::CacheEvictionPolicy::LRU);
+  for (auto* handle : handles) {
+    cache_->release(handle);
+  }
+  EXPECT_EQ(cache_->get_memory_usage(), 80);
+  for (int i = 0; i < 8; i++) {
+    auto key_str = "test_key" + std::to_string(i);
+    auto* handle = cache_->lookup(tenann::CacheKey{key_str});
+    ASSERT_NE(handle, nullptr);
+    EXPECT_EQ(*static_cast<int*>(cache_->value(handle)), i);
+    cache_->release(handle);
+  }
+
+  // the window entries are evicted like any other entry under LRU
+  cache_->set_capacity(40);
+  EXPECT_LE(cache_->get_memory_usage(), 40);
+  cache_->set_capacity(0);
+  EXPECT_EQ(cache_->get_memory_usage(), 0);
+
+  json status;
+  cache_->get_policy_status(&status);
+  EXPECT_EQ(status["lru"]["hit_count"], 8);
+  EXPECT_EQ(status["tiny_lfu"]["hit_count"], 0);
+}
+
+TEST_F(ShardedLRUCacheTest, NumShardBits) {
+  // The capacity is split evenly across 2^num_shard_bits shards.
+  for (int num_shard_bits : {0, 4, 20}) {
+    tenann::ShardedLRUCache cache(1600, tenann::CacheEvictionPolicy::LRU, num_shard_bits);
+    json status;
+    cache.get_cache_status(&status);
+    size_t num_shards = size_t{1} << std::min(num_shard_bits, tenann::kMaxNumShardBits);
+    EXPECT_EQ(status.size(), num_shards);
+    EXPECT_EQ(status[0]["capacity"], (1600 + num_shards - 1) / num_shards);
+  }
+}
+
+TEST_F(ShardedLRUCacheTest, ConcurrentLookupRelease) {
+  // Hits on referenced entries take the shared lock, while unreferenced entries move in and out
+  // of the LRU list and other keys are inserted and erased concurrently.
+  static std::atomic<int> num_deleted{0};
+  num_deleted = 0;
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+    num_deleted++;
+  };
+  tenann::ShardedLRUCache cache(1000, tenann::CacheEvictionPolicy::LRU, 2);
+  std::vector<tenann::Cache::Handle*> pinned;
+  for (int i = 0; i < 8; i++) {
+    auto key_str = "hot" + std::to_string(i);
+    auto* handle = cache.insert(tenann::CacheKey{key_str}, new int(i), 10, deleter);
+    if (i % 2 == 0) {
+      pinned.push_back(handle);
+    } else {
+      cache.release(handle);
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::atomic<int> num_errors{0};
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < 20000; i++) {
+        auto key_str = "hot" + std::to_string((i + t) % 8);
+        auto* handle = cache.lookup(tenann::CacheKey{key_str});
+        if (handle == nullptr || *static_cast<int*>(cache.value(handle)) != (i + t) % 8) {
+          num_errors++;
+        }
+        cache.release(handle);
+      }
+    });
+  }
+  threads.emplace_back([&]() {
+    for (int i = 0; i < 20000; i++) {
+      auto key_str = "cold" + std::to_string(i % 16);
+      cache.release(cache.insert(tenann::CacheKey{key_str}, new int(i), 10, deleter));
+      if (i % 3 == 0) {
+        cache.erase(tenann::CacheKey{key_str});
+      }
+    }
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(num_errors, 0);
+
+  for (auto* handle : pinned) {
+    cache.release(handle);
+  }
+  cache.prune();
+  EXPECT_EQ(cache.get_memory_usage(), 0);
+  EXPECT_EQ(num_deleted, 8 + 20000);
+  EXPECT_EQ(cache.get_hit_count(), 8 * 20000);
+}
+
+TEST_F(ShardedLRUCacheTest, GetHotKeys) {
+  // Referenced entries come first, then the released ones from the most recently used.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  tenann::ShardedLRUCache cache(1000, tenann::CacheEvictionPolicy::LRU, 0);
+  std::vector<std::string> key_strs = {"a", "b", "c", "d"};
+  std::vector<tenann::Cache::Handle*> handles;
+  for (size_t i = 0; i < key_strs.size(); i++) {
+    handles.push_back(cache.insert(tenann::CacheKey{key_strs[i]}, new int(i), 10, deleter));
+  }
+  cache.release(handles[0]);
+  cache.release(handles[1]);
+  cache.release(handles[2]);
+  // "a" becomes the most recently used
+  cache.release(cache.lookup(tenann::CacheKey{key_strs[0]}));
+
+  EXPECT_EQ(cache.get_hot_keys(10), (std::vector<std::string>{"d", "a", "c", "b"}));
+  EXPECT_EQ(cache.get_hot_keys(2), (std::vector<std::string>{"d", "a"}));
+  cache.release(handles[3]);
+
+  // the keys of every shard are returned
+  tenann::ShardedLRUCache sharded_cache(1 << 20, tenann::CacheEvictionPolicy::LRU, 4);
+  for (int i = 0; i < 100; i++) {
+    auto key_str = std::to_string(i);
+    sharded_cache.release(sharded_cache.insert(tenann::CacheKey{key_str}, new int(i), 10, deleter));
+  }
+  auto hot_keys = sharded_cache.get_hot_keys(1000);
+  EXPECT_EQ(hot_keys.size(), 100);
+  EXPECT_EQ(std::set<std::string>(hot_keys.begin(), hot_keys.end()).size(), 100);
+  EXPECT_EQ(sharded_cache.get_hot_keys(10).size(), 10);
+}
+
+TEST_F(ShardedLRUCacheTest, CacheKey128) {
+  // Fixed-size keys of consecutive blocks are told apart and spread over the shards.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  tenann::ShardedLRUCache cache(1 << 20, tenann::CacheEvictionPolicy::LRU, 4);
+  tenann::CacheKey128 base{0x1234567890abcdefULL, 1700000000, 0};
+  for (uint32_t block_id = 0; block_id < 1000; block_id++) {
+    cache.release(cache.insert(base.with_block_id(block_id), new int(block_id), 10, deleter));
+  }
+  EXPECT_EQ(cache.get_memory_usage(), 10000);
+
+  for (uint32_t block_id = 0; block_id < 1000; block_id++) {
+    auto* handle = cache.lookup(base.with_block_id(block_id));
+    ASSERT_NE(handle, nullptr);
+    EXPECT_EQ(*static_cast<int*>(cache.value(handle)), block_id);
+    cache.release(handle);
+  }
+  // another generation of the same file misses
+  tenann::CacheKey128 rewritten = base;
+  rewritten.generation += 1;
+  EXPECT_EQ(cache.lookup(rewritten), nullptr);
+
+  // the same 16 bytes as a string key find the entry
+  tenann::CacheKey128 key = base.with_block_id(7);
+  std::string bytes(reinterpret_cast<const char*>(&key), sizeof(key));
+  auto* handle = cache.lookup(tenann::CacheKey{bytes});
+  ASSERT_NE(handle, nullptr);
+  EXPECT_EQ(*static_cast<int*>(cache.value(handle)), 7);
+  cache.release(handle);
+
+  json status;
+  cache.get_cache_status(&status);
+  for (const auto& shard : status) {
+    EXPECT_GT(shard["usage"].get<size_t>(), 0);
+  }
+}
+
+TEST_F(ShardedLRUCacheTest, EvictGroup) {
+  // Only the released entries of the group are evicted, the oldest first.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  auto insert = [&](tenann::Cache* cache, int i) {
+    cache->release(cache->insert(tenann::CacheKey{std::to_string(i)}, new int(i), 10, deleter,
+                                 tenann::CachePriority::NORMAL, i % 2));
+  };
+  tenann::ShardedLRUCache cache(1000, tenann::CacheEvictionPolicy::LRU, 0);
+  for (int i = 0; i < 10; i++) {
+    insert(&cache, i);
+  }
+  auto* referenced = cache.lookup(tenann::CacheKey{std::string("1")});
+
+  EXPECT_EQ(cache.evict_group(1, 20), 20);
+  EXPECT_EQ(cache.lookup(tenann::CacheKey{std::string("3")}), nullptr);
+  EXPECT_EQ(cache.lookup(tenann::CacheKey{std::string("5")}), nullptr);
+  auto* handle = cache.lookup(tenann::CacheKey{std::string("7")});
+  EXPECT_NE(handle, nullptr);
+  cache.release(handle);
+
+  // the referenced entry stays
+  EXPECT_EQ(cache.evict_group(1, 1000), 20);
+  EXPECT_EQ(cache.get_memory_usage(), 60);
+  EXPECT_EQ(*static_cast<int*>(cache.value(referenced)), 1);
+  // nothing of the group can be evicted while it is referenced, nor of an unknown group
+  EXPECT_EQ(cache.evict_group(1, 1000), 0);
+  EXPECT_EQ(cache.evict_group(7, 1000), 0);
+  cache.release(referenced);
+  EXPECT_EQ(cache.evict_group(1, 1000), 10);
+
+  // every shard gives up the entries of the group
+  tenann::ShardedLRUCache sharded_cache(1 << 20, tenann::CacheEvictionPolicy::LRU, 4);
+  for (int i = 0; i < 100; i++) {
+    insert(&sharded_cache, i);
+  }
+  EXPECT_EQ(sharded_cache.evict_group(1, 300), 300);
+  EXPECT_EQ(sharded_cache.evict_group(1, 1000), 200);
+  EXPECT_EQ(sharded_cache.get_memory_usage(), 500);
+}
+
+TEST_F(ShardedLRUCacheTest, EvictionListener) {
+  // Only the entries evicted by the cache are passed to the listener, not the erased or replaced
+  // ones, nor the ones freed with the cache.
+  static std::set<int> evicted;
+  evicted.clear();
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  {
+    tenann::ShardedLRUCache cache(30, tenann::CacheEvictionPolicy::LRU, 0);
+    cache.set_eviction_listener([](const tenann::CacheKey& key, void* value) {
+      evicted.insert(*static_cast<int*>(value));
+    });
+    for (int i = 0; i < 3; i++) {
+      cache.release(cache.insert(tenann::CacheKey{std::to_string(i)}, new int(i), 10, deleter));
+    }
+    cache.erase(tenann::CacheKey{std::string("0")});
+    cache.release(cache.insert(tenann::CacheKey{std::string("1")}, new int(10), 10, deleter));
+    EXPECT_TRUE(evicted.empty());
+
+    // "2" is the least recently used
+    cache.release(cache.insert(tenann::CacheKey{std::string("3")}, new int(3), 10, deleter));
+    cache.release(cache.insert(tenann::CacheKey{std::string("4")}, new int(4), 10, deleter));
+    EXPECT_EQ(evicted, std::set<int>({2}));
+    cache.evict_to(10);
+    EXPECT_EQ(evicted, std::set<int>({2, 10, 3}));
+  }
+  EXPECT_EQ(evicted, std::set<int>({2, 10, 3}));
+}
+
+TEST_F(ShardedLRUCacheTest, DISABLED_Benchmark_LookupsPerSecond) {
+  // Lookups per second on a few hot entries that are held by other handles, like whole indexes
+  // used by running searchers, versus the number of threads. Run it with
+  // --gtest_also_run_disabled_tests, the results are recorded as test properties.
+  auto deleter = [](const tenann::CacheKey& key, void* value) {
+    delete static_cast<int*>(value);
+  };
+  constexpr int kNumHotKeys = 4;
+  constexpr int kLookupsPerThread = 100000;
+  for (int num_shard_bits : {1, 4}) {
+    tenann::ShardedLRUCache cache(1 << 20, tenann::CacheEvictionPolicy::LRU, num_shard_bits);
+    std::vector<tenann::Cache::Handle*> pinned;
+    for (int i = 0; i < kNumHotKeys; i++) {
+      auto key_str = "index" + std::to_string(i);
+      pinned.push_back(cache.insert(tenann::CacheKey{key_str}, new int(i), 100, deleter));
+    }
+
+    for (int num_threads = 1; num_threads <= 64; num_threads *= 2) {
+      std::vector<std::thread> threads;
+      auto start = std::chrono::steady_clock::now();
+      for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&cache, t]() {
+          std::string key_str = "index" + std::to_string(t % kNumHotKeys);
+          tenann::CacheKey key{key_str};
+          for (int i = 0; i < kLookupsPerThread; i++) {
+            cache.release(cache.lookup(key));
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      auto seconds =
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      auto lookups_per_second = static_cast<int64_t>(num_threads * kLookupsPerThread / seconds);
+      RecordProperty("lookups_per_second_shard_bits_" + std::to_string(num_shard_bits) +
+                         "_threads_" + std::to_string(num_threads),
+                     std::to_string(lookups_per_second));
+    }
+
+    EXPECT_EQ(cache.get_hit_count(), cache.get_lookup_count());
+    for (auto* handle : pinned) {
+      cache.release(handle);
+    }
+  }
+}
+
+}  // namespace tenann
@@ -0,0 +1,360 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "tenann/index/index_cache.h"
+#include "tenann/store/spill_cache.h"
+#include "tenann/util/memory_tracker.h"
+#include "tenann/util/memory_usage.h"
+
+namespace tenann {
+
+class SpillCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = "/tmp/tenann_spill_cache_test";
+    std::filesystem::remove_all(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  static size_t CountSpillFiles(const std::string& dir) {
+    size_t n = 0;
+    for (const auto& file : std::filesystem::directory_iterator(dir)) {
+      n += file.path().extension() == SpillCache::kFileSuffix;
+    }
+    return n;
+  }
+
+  /// Insert a block of [size] bytes filled with [c] under [key].
+  static void InsertBlock(IndexCache* cache, const std::string& key, size_t size, char c) {
+    auto buffer = std::make_shared<std::string>(size, c);
+    auto block = std::make_shared<Index>(buffer->data(), IndexType::kFaissIvfPqOneInvertedList,
+                                         [buffer](void* /* block */) {});
+    block->SetBlockSize(size);
+    IndexCacheHandle handle;
+    cache->Insert(key, block, &handle, [size]() { return size; });
+  }
+
+  std::string dir_;
+};
+
+TEST_F(SpillCacheTest, PutGetErase) {
+  SpillCache cache(dir_, 1000);
+  std::string value(100, 'a');
+  EXPECT_TRUE(cache.Put("k1", value.data(), value.size()));
+  EXPECT_TRUE(cache.Contains("k1"));
+  EXPECT_EQ(cache.usage(), 100);
+  EXPECT_EQ(CountSpillFiles(dir_), 1);
+
+  std::string data;
+  EXPECT_TRUE(cache.Get("k1", &data));
+  EXPECT_EQ(data, value);
+  EXPECT_FALSE(cache.Get("k2", &data));
+  EXPECT_EQ(cache.lookup_count(), 2);
+  EXPECT_EQ(cache.hit_count(), 1);
+
+  // 覆盖写入
+  value.assign(50, 'b');
+  EXPECT_TRUE(cache.Put("k1", value.data(), value.size()));
+  EXPECT_TRUE(cache.Get("k1", &data));
+  EXPECT_EQ(data, value);
+  EXPECT_EQ(cache.usage(), 50);
+  EXPECT_EQ(CountSpillFiles(dir_), 1);
+
+  cache.Erase("k1");
+  EXPECT_FALSE(cache.Contains("k1"));
+  EXPECT_EQ(cache.usage(), 0);
+  EXPECT_EQ(CountSpillFiles(dir_), 0);
+
+  // 大于容量的值不缓存
+  value.assign(1001, 'c');
+  EXPECT_FALSE(cache.Put("k3", value.data(), value.size()));
+  EXPECT_FALSE(cache.Contains("k3"));
+}
+
+TEST_F(SpillCacheTest, EvictLeastRecentlyUsed) {
+  SpillCache cache(dir_, 300);
+  std::string value(100, 'a');
+  for (auto key : {"k1", "k2", "k3"}) {
+    EXPECT_TRUE(cache.Put(key, value.data(), value.size()));
+  }
+  std::string data;
+  EXPECT_TRUE(cache.Get("k1", &data));
+
+  // k2 是最久未访问的
+  EXPECT_TRUE(cache.Put("k4", value.data(), value.size()));
+  EXPECT_TRUE(cache.Contains("k1"));
+  EXPECT_FALSE(cache.Contains("k2"));
+  EXPECT_TRUE(cache.Contains("k3"));
+  EXPECT_TRUE(cache.Contains("k4"));
+  EXPECT_EQ(cache.status()["evict_count"], 1);
+
+  cache.SetCapacity(100);
+  EXPECT_EQ(cache.usage(), 100);
+  EXPECT_TRUE(cache.Contains("k4"));
+  EXPECT_EQ(CountSpillFiles(dir_), 1);
+}
+
+TEST_F(SpillCacheTest, ReserveAndCommit) {
+  SpillCache cache(dir_, 1000);
+  std::string value(100, 'a');
+
+  // 写入完成前不可见
+  uint64_t ticket = cache.Reserve("k1", false);
+  EXPECT_NE(ticket, 0);
+  EXPECT_FALSE(cache.Contains("k1"));
+  EXPECT_EQ(cache.Reserve("k1", false), 0);
+  EXPECT_TRUE(cache.Commit("k1", ticket, value.data(), value.size()));
+  EXPECT_TRUE(cache.Contains("k1"));
+  EXPECT_EQ(cache.Reserve("k1", false), 0);
+
+  // Erase 取消未完成的写入
+  ticket = cache.Reserve("k2", false);
+  cache.Erase("k2");
+  EXPECT_FALSE(cache.Commit("k2", ticket, value.data(), value.size()));
+  EXPECT_FALSE(cache.Contains("k2"));
+
+  // 新的写入覆盖未完成的写入
+  uint64_t stale_ticket = cache.Reserve("k3", true);
+  ticket = cache.Reserve("k3", true);
+  EXPECT_TRUE(cache.Commit("k3", ticket, value.data(), value.size()));
+  EXPECT_FALSE(cache.Commit("k3", stale_ticket, value.data(), 10));
+  std::string data;
+  EXPECT_TRUE(cache.Get("k3", &data));
+  EXPECT_EQ(data, value);
+
+  // 放弃写入
+  ticket = cache.Reserve("k4", false);
+  EXPECT_FALSE(cache.Commit("k4", ticket, nullptr, 0));
+  EXPECT_NE(cache.Reserve("k4", false), 0);
+  EXPECT_EQ(CountSpillFiles(dir_), 2);
+}
+
+TEST_F(SpillCacheTest, CommitStream) {
+  SpillCache cache(dir_, 1000);
+  std::string value(300, '\0');
+  for (size_t i = 0; i < value.size(); i++) {
+    value[i] = static_cast<char>(i);
+  }
+
+  // 分块流式写入的值与一次写入的相同
+  uint64_t ticket = cache.Reserve("k1", false);
+  EXPECT_TRUE(cache.CommitStream("k1", ticket, [&](const SpillCache::ChunkWriter& write) {
+    for (size_t offset = 0; offset < value.size(); offset += 64) {
+      if (!write(value.data() + offset, std::min<size_t>(64, value.size() - offset))) {
+        return false;
+      }
+    }
+    return true;
+  }));
+  std::string data;
+  EXPECT_TRUE(cache.Get("k1", &data));
+  EXPECT_EQ(data, value);
+  EXPECT_EQ(cache.usage(), value.size());
+
+  // 写入超过容量时中途放弃, 不留下文件
+  ticket = cache.Reserve("k2", false);
+  size_t num_chunks = 0;
+  EXPECT_FALSE(cache.CommitStream("k2", ticket, [&](const SpillCache::ChunkWriter& write) {
+    for (int i = 0; i < 10; i++) {
+      if (!write(value.data(), value.size())) {
+        return false;
+      }
+      num_chunks++;
+    }
+    return true;
+  }));
+  EXPECT_EQ(num_chunks, 3);
+  EXPECT_FALSE(cache.Contains("k2"));
+  EXPECT_EQ(CountSpillFiles(dir_), 1);
+}
+
+TEST_F(SpillCacheTest, CorruptedFileIsMiss) {
+  {
+    SpillCache cache(dir_, 1000);
+    std::string value(100, 'a');
+    EXPECT_TRUE(cache.Put("k1", value.data(), value.size()));
+    auto path = std::filesystem::directory_iterator(dir_)->path().string();
+    int fd = open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(pwrite(fd, "b", 1, std::filesystem::file_size(path) - 1), 1);
+    close(fd);
+
+    std::string data;
+    EXPECT_FALSE(cache.Get("k1", &data));
+    EXPECT_FALSE(cache.Contains("k1"));
+    EXPECT_EQ(CountSpillFiles(dir_), 0);
+    EXPECT_TRUE(cache.Put("k1", value.data(), value.size()));
+  }
+
+  // 析构时删除所有文件, 启动时清理残留文件
+  EXPECT_EQ(CountSpillFiles(dir_), 0);
+  FILE* stale = fopen((dir_ + "/1" + SpillCache::kFileSuffix).c_str(), "w");
+  ASSERT_NE(stale, nullptr);
+  fclose(stale);
+  SpillCache cache(dir_, 1000);
+  EXPECT_EQ(CountSpillFiles(dir_), 0);
+}
+
+TEST_F(SpillCacheTest, IndexCache_SpillEvictedBlocks) {
+  IndexCache cache(1000);
+  cache.EnableSpill(dir_, 1000);
+  InsertBlock(&cache, "b1", 100, 'a');
+  InsertBlock(&cache, "b2", 100, 'b');
+  // 从内存淘汰的块写入 SSD
+  cache.SetCapacity(0);
+  cache.WaitForPendingSpills();
+  EXPECT_TRUE(cache.spill_cache()->Contains("b1"));
+  EXPECT_TRUE(cache.spill_cache()->Contains("b2"));
+  EXPECT_EQ(cache.spill_status()["write_count"], 2);
+  cache.SetCapacity(1000);
+
+  // 内存未命中时从 SSD 读取并放回内存
+  {
+    IndexCacheHandle handle;
+    ASSERT_TRUE(cache.Lookup("b1", &handle));
+    auto* data = static_cast<const char*>(handle.index_ref()->index_raw());
+    EXPECT_EQ(std::string(data, 100), std::string(100, 'a'));
+    EXPECT_EQ(handle.index_ref()->index_type(), IndexType::kFaissIvfPqOneInvertedList);
+  }
+  EXPECT_EQ(cache.memory_usage(), 100);
+
+  // 块是不可变的, SSD 上的副本保留, 再次淘汰时不重复写入
+  EXPECT_TRUE(cache.spill_cache()->Contains("b1"));
+  cache.SetCapacity(0);
+  cache.WaitForPendingSpills();
+  EXPECT_EQ(cache.spill_status()["write_count"], 2);
+  cache.SetCapacity(1000);
+
+  // 强制覆盖时丢弃 SSD 上的旧数据
+  InsertBlock(&cache, "b1", 100, 'x');
+  EXPECT_FALSE(cache.spill_cache()->Contains("b1"));
+
+  // 无法写入 SSD 的类型不落盘
+  auto index = std::make_shared<Index>(new int(0), IndexType::kFaissIvfPq,
+                                       [](void* index) { delete static_cast<int*>(index); });
+  {
+    IndexCacheHandle handle;
+    cache.Insert("index", index, &handle, []() { return 200; });
+  }
+  cache.SetCapacity(0);
+  cache.WaitForPendingSpills();
+  EXPECT_FALSE(cache.spill_cache()->Contains("index"));
+  IndexCacheHandle handle;
+  EXPECT_FALSE(cache.Lookup("index", &handle));
+  EXPECT_EQ(cache.memory_usage(), 0);
+
+  cache.DisableSpill();
+  EXPECT_EQ(cache.spill_cache(), nullptr);
+  EXPECT_TRUE(cache.spill_status().is_null());
+  EXPECT_FALSE(cache.Lookup("b2", &handle));
+}
+
+TEST_F(SpillCacheTest, IndexCache_SpillOnlyEvictedBlocks) {
+  IndexCache cache(1000);
+  cache.EnableSpill(dir_, 1000);
+
+  // 被替换的块不落盘
+  InsertBlock(&cache, "b1", 100, 'a');
+  InsertBlock(&cache, "b1", 100, 'b');
+  cache.WaitForPendingSpills();
+  EXPECT_FALSE(cache.spill_cache()->Contains("b1"));
+
+  // 超过硬配额而绕过缓存的块, 在调用方释放后也不落盘
+  CacheNamespaceOptions options;
+  options.hard_quota = 50;
+  CacheNamespaceId ns = cache.SetNamespaceOptions("small", options);
+  {
+    auto buffer = std::make_shared<std::string>(100, 'c');
+    auto block = std::make_shared<Index>(buffer->data(), IndexType::kFaissIvfPqOneInvertedList,
+                                         [buffer](void* /* block */) {});
+    block->SetBlockSize(buffer->size());
+    IndexCacheHandle handle;
+    cache.Insert("bypassed", block, &handle, []() { return 100; }, ns);
+  }
+  cache.WaitForPendingSpills();
+  EXPECT_FALSE(cache.spill_cache()->Contains("bypassed"));
+  EXPECT_EQ(cache.spill_status()["write_count"], 0);
+
+  // 只有淘汰的块落盘
+  cache.SetCapacity(0);
+  cache.WaitForPendingSpills();
+  EXPECT_TRUE(cache.spill_cache()->Contains("b1"));
+  EXPECT_EQ(cache.spill_status()["write_count"], 1);
+}
+
+TEST_F(SpillCacheTest, IndexCache_SpillBlocksRoundTrip) {
+  // 块的 charge 包含分配开销, 大于块本身; 写入 SSD 的只能是块的字节
+  std::filesystem::create_directories(dir_);
+  std::string path = dir_ + "/blocks.bin";
+  std::string file_data(1000, '\0');
+  std::mt19937 rng(123);
+  for (auto& c : file_data) {
+    c = static_cast<char>(rng());
+  }
+  std::ofstream(path, std::ios::binary).write(file_data.data(), file_data.size());
+
+  IndexCache cache(10000);
+  cache.EnableSpill(dir_ + "/spill", 10000);
+  std::vector<std::pair<size_t, size_t>> blocks = {{0, 100}, {100, 333}, {433, 567}};
+  for (size_t i = 0; i < blocks.size(); i++) {
+    auto [offset, size] = blocks[i];
+    // 按块大小精确分配, 越界读取会被 ASan 发现
+    auto* data = static_cast<char*>(malloc(size));
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(offset);
+    file.read(data, size);
+    auto block = std::make_shared<Index>(data, IndexType::kFaissIvfPqOneInvertedList,
+                                         [](void* block) { free(block); });
+    block->SetBlockSize(size);
+    size_t charge = AllocationSize(size) + AllocationSize(sizeof(Index));
+    IndexCacheHandle handle;
+    cache.Insert("b" + std::to_string(i), block, &handle, [charge]() { return charge; });
+  }
+  // 写入 SSD 期间被淘汰的块仍计入内存, 写完后全部释放
+  auto tracker = std::make_shared<CountingMemoryTracker>();
+  cache.SetMemoryTracker(tracker);
+  cache.SetCapacity(0);
+  cache.WaitForPendingSpills();
+  EXPECT_EQ(tracker->consumption(), 0);
+  cache.SetCapacity(10000);
+
+  for (size_t i = 0; i < blocks.size(); i++) {
+    auto [offset, size] = blocks[i];
+    IndexCacheHandle handle;
+    ASSERT_TRUE(cache.Lookup("b" + std::to_string(i), &handle));
+    auto index = handle.index_ref();
+    EXPECT_EQ(index->block_size(), size);
+    EXPECT_EQ(std::string(static_cast<const char*>(index->index_raw()), size),
+              file_data.substr(offset, size));
+  }
+}
+
+}  // namespace tenann
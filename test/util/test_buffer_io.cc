@@ -0,0 +1,169 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "faiss/impl/FaissException.h"
+#include "gtest/gtest.h"
+#include "tenann/util/buffer_io.h"
+
+namespace tenann {
+
+class BufferIoTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    data_.resize(10000);
+    std::iota(data_.begin(), data_.end(), 0);
+  }
+
+  std::vector<uint8_t> data_;
+};
+
+TEST_F(BufferIoTest, FromBuffer_Read) {
+  auto source = RandomAccessSource::FromBuffer("buf", data_.data(), data_.size());
+  EXPECT_EQ(source->name(), "buf");
+  EXPECT_EQ(source->size(), data_.size());
+
+  std::vector<uint8_t> a(100), b(100);
+  IoRequest requests[2];
+  requests[0].buf = a.data();
+  requests[0].size = a.size();
+  requests[0].offset = 300;
+  // 越过末尾的请求只读到末尾
+  requests[1].buf = b.data();
+  requests[1].size = b.size();
+  requests[1].offset = data_.size() - 40;
+  source->Read(requests, 2);
+
+  EXPECT_EQ(requests[0].result, 100);
+  EXPECT_TRUE(std::equal(a.begin(), a.end(), data_.begin() + 300));
+  EXPECT_EQ(requests[1].result, 40);
+  EXPECT_TRUE(std::equal(b.begin(), b.begin() + 40, data_.end() - 40));
+}
+
+TEST_F(BufferIoTest, ReadAt_ShortReadsAndErrors) {
+  // 每次最多返回 7 个字节, 读请求应循环直到读满
+  RandomAccessSource source("short", data_.size(), [&](void* buf, size_t n, uint64_t offset) {
+    n = std::min<size_t>({n, 7, data_.size() - offset});
+    memcpy(buf, data_.data() + offset, n);
+    return static_cast<int64_t>(n);
+  });
+  std::vector<uint8_t> out(1000);
+  IoRequest request{out.data(), out.size(), 123, 0};
+  source.Read(&request, 1);
+  EXPECT_EQ(request.result, 1000);
+  EXPECT_TRUE(std::equal(out.begin(), out.end(), data_.begin() + 123));
+
+  RandomAccessSource failing("failing", data_.size(),
+                             [](void*, size_t, uint64_t) -> int64_t { return -EIO; });
+  failing.Read(&request, 1);
+  EXPECT_EQ(request.result, -EIO);
+}
+
+TEST_F(BufferIoTest, FromFile_ReadAll) {
+  std::string path = "/tmp/tenann_test_buffer_io.bin";
+  FILE* file = fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  ASSERT_EQ(fwrite(data_.data(), 1, data_.size(), file), data_.size());
+  fclose(file);
+
+  auto source = RandomAccessSource::FromFile(path);
+  EXPECT_EQ(source->name(), path);
+  EXPECT_EQ(source->size(), data_.size());
+  // 最后一个 chunk 不满
+  EXPECT_EQ(source->ReadAll(4, 999), data_);
+  EXPECT_EQ(source->ReadAll(1), data_);
+  std::remove(path.c_str());
+
+  EXPECT_THROW(RandomAccessSource::FromFile(path), faiss::FaissException);
+}
+
+TEST_F(BufferIoTest, SourceIOReader_BufferedAndDirectReads) {
+  auto source = RandomAccessSource::FromBuffer("buf", data_.data(), data_.size());
+  int num_reads = 0;
+  auto counted = std::make_shared<RandomAccessSource>(
+      "counted", source->size(), [&](void* buf, size_t n, uint64_t offset) {
+        num_reads++;
+        IoRequest request{buf, n, offset, 0};
+        source->Read(&request, 1);
+        return request.result;
+      });
+  SourceIOReader reader(counted, 256);
+  EXPECT_EQ(reader.name, "counted");
+
+  // 小读取由预读缓冲提供
+  std::vector<uint8_t> out(10);
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(reader(out.data(), 1, out.size()), out.size());
+    ASSERT_TRUE(std::equal(out.begin(), out.end(), data_.begin() + i * 10));
+  }
+  EXPECT_EQ(num_reads, 1);
+  EXPECT_EQ(reader.position(), 200);
+
+  // 大读取先取完缓冲中剩余的字节, 其余直接读取
+  std::vector<uint8_t> large(1000);
+  ASSERT_EQ(reader(large.data(), 1, large.size()), large.size());
+  EXPECT_TRUE(std::equal(large.begin(), large.end(), data_.begin() + 200));
+  EXPECT_EQ(num_reads, 2);
+
+  reader.Seek(5000);
+  uint32_t value;
+  ASSERT_EQ(reader(&value, sizeof(value), 1), 1);
+  EXPECT_EQ(memcmp(&value, data_.data() + 5000, sizeof(value)), 0);
+  EXPECT_EQ(reader.position(), 5004);
+  EXPECT_THROW(reader.Seek(data_.size() + 1), faiss::FaissException);
+}
+
+TEST_F(BufferIoTest, SourceIOReader_EndOfSource) {
+  auto source = RandomAccessSource::FromBuffer("buf", data_.data(), data_.size());
+  SourceIOReader reader(source, 256);
+  reader.Seek(data_.size() - 10);
+
+  // 只返回完整的 item
+  uint32_t values[4];
+  EXPECT_EQ(reader(values, sizeof(uint32_t), 4), 2);
+  EXPECT_EQ(reader.position(), data_.size() - 2);
+  reader.Seek(data_.size());
+  EXPECT_EQ(reader(values, 1, 1), 0);
+}
+
+TEST_F(BufferIoTest, CallbackIOWriter) {
+  std::vector<uint8_t> written;
+  CallbackIOWriter writer([&](const void* data, size_t size) {
+    auto* bytes = static_cast<const uint8_t*>(data);
+    written.insert(written.end(), bytes, bytes + size);
+  });
+  EXPECT_EQ(writer(data_.data(), 4, 100), 100);
+  EXPECT_EQ(writer(data_.data() + 400, 1, 600), 600);
+  ASSERT_EQ(written.size(), 1000);
+  EXPECT_TRUE(std::equal(written.begin(), written.end(), data_.begin()));
+
+  auto source = RandomAccessSource::FromBuffer("written", written.data(), written.size());
+  SourceIOReader reader(source);
+  std::vector<uint8_t> out(written.size());
+  EXPECT_EQ(reader(out.data(), 1, out.size()), out.size());
+  EXPECT_EQ(out, written);
+}
+
+}  // namespace tenann
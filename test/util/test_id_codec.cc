@@ -0,0 +1,105 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tenann/common/error.h"
+#include "tenann/util/id_codec.h"
+
+namespace tenann {
+
+class IdCodecTest : public ::testing::Test {
+ protected:
+  // 编码后逐个随机访问并整体解码, 检查与原始 ids 一致
+  void CheckRoundTrip(const std::vector<int64_t>& ids, IdCodec::Encoding expected) {
+    std::vector<uint8_t> encoded;
+    IdCodec::Encode(ids.data(), ids.size(), &encoded);
+    EXPECT_EQ(encoded[0], expected);
+    EXPECT_EQ(IdCodec::EncodedSize(encoded.data(), ids.size()), encoded.size());
+
+    std::vector<int64_t> decoded(ids.size());
+    IdCodec::Decode(encoded.data(), ids.size(), decoded.data());
+    EXPECT_EQ(decoded, ids);
+    for (size_t i = 0; i < ids.size(); i++) {
+      ASSERT_EQ(IdCodec::DecodeAt(encoded.data(), ids.size(), i), ids[i]);
+    }
+  }
+};
+
+TEST_F(IdCodecTest, Empty) { CheckRoundTrip({}, IdCodec::kRaw); }
+
+TEST_F(IdCodecTest, SortedIdsAreDeltaPacked) {
+  std::mt19937 rng(0);
+  std::vector<int64_t> ids;
+  int64_t id = int64_t(1) << 40;
+  for (int i = 0; i < 1000; i++) {
+    id += rng() % 100;
+    ids.push_back(id);
+  }
+  CheckRoundTrip(ids, IdCodec::kDeltaPacked);
+
+  std::vector<uint8_t> encoded;
+  IdCodec::Encode(ids.data(), ids.size(), &encoded);
+  // 每个 delta 不超过 7 bit
+  EXPECT_LT(encoded.size(), ids.size());
+}
+
+TEST_F(IdCodecTest, DuplicatedAndWideDeltas) {
+  // 含重复 id (delta 为 0) 以及跨越整个 int64 取值范围的 delta
+  std::vector<int64_t> ids = {-5, -5, -5, 0, 0, std::numeric_limits<int64_t>::max()};
+  std::vector<uint8_t> encoded;
+  IdCodec::Encode(ids.data(), ids.size(), IdCodec::kDeltaPacked, &encoded);
+  std::vector<int64_t> decoded(ids.size());
+  IdCodec::Decode(encoded.data(), ids.size(), decoded.data());
+  EXPECT_EQ(decoded, ids);
+  EXPECT_EQ(IdCodec::DecodeAt(encoded.data(), ids.size(), 5), ids[5]);
+  EXPECT_EQ(IdCodec::EncodedSize(encoded.data(), ids.size()), encoded.size());
+
+  std::vector<int64_t> same(300, 42);
+  CheckRoundTrip(same, IdCodec::kDeltaPacked);
+}
+
+TEST_F(IdCodecTest, UnsortedIdsUseBase32) {
+  std::mt19937 rng(1);
+  std::vector<int64_t> ids;
+  for (int i = 0; i < 500; i++) {
+    ids.push_back((int64_t(7) << 40) + rng());
+  }
+  CheckRoundTrip(ids, IdCodec::kBase32);
+}
+
+TEST_F(IdCodecTest, WideUnsortedIdsStayRaw) {
+  std::vector<int64_t> ids = {int64_t(1) << 50, 3, int64_t(1) << 45, -1};
+  CheckRoundTrip(ids, IdCodec::kRaw);
+}
+
+TEST_F(IdCodecTest, InapplicableEncodingThrows) {
+  std::vector<int64_t> ids = {3, 1, 2};
+  std::vector<uint8_t> encoded;
+  EXPECT_THROW(IdCodec::Encode(ids.data(), ids.size(), IdCodec::kDeltaPacked, &encoded), Error);
+
+  std::vector<int64_t> wide = {0, int64_t(1) << 33};
+  encoded.clear();
+  EXPECT_THROW(IdCodec::Encode(wide.data(), wide.size(), IdCodec::kBase32, &encoded), Error);
+}
+
+}  // namespace tenann
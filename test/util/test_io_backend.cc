@@ -0,0 +1,140 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tenann/util/io_backend.h"
+
+namespace tenann {
+
+class IoBackendTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = "/tmp/tenann_test_io_backend.bin";
+    data_.resize(1 << 20);
+    for (size_t i = 0; i < data_.size(); i++) {
+      data_[i] = static_cast<uint8_t>(i * 31 + 7);
+    }
+    FILE* f = fopen(path_.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    ASSERT_EQ(fwrite(data_.data(), 1, data_.size(), f), data_.size());
+    fclose(f);
+    fd_ = open(path_.c_str(), O_RDONLY);
+    ASSERT_NE(fd_, -1);
+  }
+
+  void TearDown() override {
+    close(fd_);
+    remove(path_.c_str());
+  }
+
+  // 读取 [num_requests] 个不相交的块并检查内容, 最后一个块跨过文件末尾
+  void CheckRead(IoBackend* backend, size_t num_requests, size_t seed) {
+    size_t block = data_.size() / num_requests;
+    std::vector<std::vector<uint8_t>> buffers(num_requests, std::vector<uint8_t>(block + 100));
+    std::vector<IoRequest> requests(num_requests);
+    for (size_t i = 0; i < num_requests; i++) {
+      size_t j = (i + seed) % num_requests;
+      requests[i].buf = buffers[i].data();
+      requests[i].size = j == num_requests - 1 ? block + 100 : block;
+      requests[i].offset = j * block;
+    }
+    backend->Read(fd_, requests.data(), requests.size());
+
+    for (size_t i = 0; i < num_requests; i++) {
+      size_t expected = std::min(requests[i].size, data_.size() - requests[i].offset);
+      ASSERT_EQ(requests[i].result, expected);
+      EXPECT_EQ(memcmp(buffers[i].data(), data_.data() + requests[i].offset, expected), 0);
+    }
+  }
+
+  void CheckBackend(IoBackend* backend) {
+    CheckRead(backend, 1, 0);
+    CheckRead(backend, 64, 3);
+
+    // 并发读取
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 8; t++) {
+      threads.emplace_back([this, backend, t]() {
+        for (size_t round = 0; round < 10; round++) {
+          CheckRead(backend, 32, t + round);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    // 读取失败时通过 result 返回错误码
+    uint8_t buffer[16];
+    IoRequest bad_request{buffer, sizeof(buffer), 0};
+    backend->Read(-1, &bad_request, 1);
+    EXPECT_EQ(bad_request.result, -EBADF);
+
+    auto* profile = backend->profile();
+    int64_t num_requests = 1 + 64 + 8 * 10 * 32 + 1;
+    EXPECT_EQ(profile->get_counter("ReadRequests")->value(), num_requests);
+    EXPECT_EQ(profile->get_counter("ReadBytes")->value(), data_.size() * (2 + 8 * 10));
+    EXPECT_GE(profile->get_counter("SubmitCalls")->value(), 1);
+    EXPECT_LE(profile->get_counter("SubmitCalls")->value(), num_requests);
+    auto* queue_depth = static_cast<RuntimeProfile::HighWaterMarkCounter*>(
+        profile->get_counter("QueueDepth"));
+    EXPECT_EQ(queue_depth->current_value(), 0);
+    EXPECT_GE(queue_depth->value(), 1);
+    EXPECT_GT(profile->get_counter("ReadLatency")->value(), 0);
+  }
+
+  std::string path_;
+  std::vector<uint8_t> data_;
+  int fd_ = -1;
+};
+
+TEST_F(IoBackendTest, test_pread) {
+  auto backend = IoBackend::CreatePread();
+  EXPECT_EQ(backend->max_batch_size(), 1);
+  CheckBackend(backend.get());
+}
+
+TEST_F(IoBackendTest, test_io_uring) {
+  auto backend = IoBackend::CreateIoUring(8);
+  if (backend == nullptr) {
+    GTEST_SKIP() << "io_uring is not available";
+  }
+  EXPECT_GE(backend->max_batch_size(), 8);
+  CheckBackend(backend.get());
+  // 同一批请求只需要少量的系统调用
+  EXPECT_LT(backend->profile()->get_counter("SubmitCalls")->value(),
+            backend->profile()->get_counter("ReadRequests")->value());
+}
+
+TEST_F(IoBackendTest, test_get_instance) {
+  auto* backend = IoBackend::GetInstance();
+  ASSERT_NE(backend, nullptr);
+  EXPECT_EQ(backend, IoBackend::GetInstance());
+  CheckRead(backend, 16, 1);
+}
+
+}  // namespace tenann
@@ -0,0 +1,150 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "tenann/index/index_cache.h"
+#include "tenann/util/memory_tracker.h"
+
+namespace tenann {
+
+TEST(MemoryTrackerTest, CountingTracker) {
+  auto parent = std::make_shared<CountingMemoryTracker>();
+  CountingMemoryTracker tracker(parent);
+  tracker.Consume(100);
+  tracker.Consume(50);
+  tracker.Release(120);
+  EXPECT_EQ(tracker.consumption(), 30);
+  EXPECT_EQ(tracker.peak_consumption(), 150);
+  // 子 tracker 的消耗同时计入父 tracker
+  EXPECT_EQ(parent->consumption(), 30);
+  EXPECT_EQ(parent->peak_consumption(), 150);
+}
+
+TEST(MemoryTrackerTest, TrackedMemory) {
+  auto tracker = std::make_shared<CountingMemoryTracker>();
+  {
+    TrackedMemory memory(tracker, 100);
+    EXPECT_EQ(tracker->consumption(), 100);
+    memory.Resize(300);
+    EXPECT_EQ(tracker->consumption(), 300);
+    memory.Resize(200);
+    EXPECT_EQ(tracker->consumption(), 200);
+
+    // 移动后由新对象负责释放
+    TrackedMemory moved(std::move(memory));
+    EXPECT_EQ(moved.bytes(), 200);
+    EXPECT_EQ(memory.bytes(), 0);
+    memory = TrackedMemory(tracker, 10);
+    EXPECT_EQ(tracker->consumption(), 210);
+  }
+  EXPECT_EQ(tracker->consumption(), 0);
+  EXPECT_EQ(tracker->peak_consumption(), 300);
+
+  // 没有 tracker 时不做任何事
+  TrackedMemory untracked(nullptr, 100);
+  EXPECT_EQ(untracked.bytes(), 0);
+}
+
+class IndexCacheMemoryTrackerTest : public ::testing::Test {
+ protected:
+  /// Insert a block of [size] bytes under [key], and keep it referenced by [handle] if given.
+  static void InsertBlock(IndexCache* cache, const std::string& key, size_t size,
+                          IndexCacheHandle* handle = nullptr) {
+    auto buffer = std::make_shared<std::string>(size, 'x');
+    auto block = std::make_shared<Index>(buffer->data(), IndexType::kFaissIvfPqOneInvertedList,
+                                         [buffer](void* /* block */) {});
+    IndexCacheHandle local_handle;
+    cache->Insert(key, block, handle != nullptr ? handle : &local_handle,
+                  [size]() { return size; });
+  }
+};
+
+TEST_F(IndexCacheMemoryTrackerTest, ChargeAndRelease) {
+  auto tracker = std::make_shared<CountingMemoryTracker>();
+  IndexCache cache(1000);
+  // 设置 tracker 之前缓存的条目转移到 tracker 上
+  InsertBlock(&cache, "b0", 100);
+  cache.SetMemoryTracker(tracker);
+  EXPECT_EQ(tracker->consumption(), 100);
+
+  InsertBlock(&cache, "b1", 200);
+  InsertBlock(&cache, "b2", 300);
+  EXPECT_EQ(tracker->consumption(), cache.memory_usage());
+
+  // 覆盖已有的 key 时释放旧条目
+  InsertBlock(&cache, "b1", 50);
+  EXPECT_EQ(tracker->consumption(), 450);
+
+  // 条目原地增长
+  {
+    IndexCacheHandle handle;
+    ASSERT_TRUE(cache.Lookup("b2", &handle));
+    handle.UpdateCharge(400);
+  }
+  EXPECT_EQ(tracker->consumption(), 550);
+  EXPECT_EQ(tracker->consumption(), cache.memory_usage());
+
+  // 淘汰的条目全部释放
+  cache.SetCapacity(0);
+  EXPECT_EQ(cache.memory_usage(), 0);
+  EXPECT_EQ(tracker->consumption(), 0);
+  // 覆盖时新条目先于旧条目计入
+  EXPECT_EQ(tracker->peak_consumption(), 650);
+
+  // 替换 tracker 后, 旧 tracker 不再收到通知
+  cache.SetCapacity(1000);
+  InsertBlock(&cache, "b3", 100);
+  auto other_tracker = std::make_shared<CountingMemoryTracker>();
+  cache.SetMemoryTracker(other_tracker);
+  EXPECT_EQ(tracker->consumption(), 0);
+  EXPECT_EQ(other_tracker->consumption(), 100);
+  EXPECT_EQ(cache.memory_tracker(), other_tracker);
+}
+
+TEST_F(IndexCacheMemoryTrackerTest, EvictTo) {
+  auto tracker = std::make_shared<CountingMemoryTracker>();
+  IndexCache cache(10000);
+  cache.SetMemoryTracker(tracker);
+  IndexCacheHandle pinned;
+  InsertBlock(&cache, "pinned", 1000, &pinned);
+  for (int i = 0; i < 20; i++) {
+    InsertBlock(&cache, "b" + std::to_string(i), 200);
+  }
+  EXPECT_EQ(cache.memory_usage(), 5000);
+
+  // 内存压力下淘汰到目标值, 容量不变
+  size_t evicted = cache.EvictTo(2000);
+  EXPECT_LE(cache.memory_usage(), 2000);
+  EXPECT_EQ(evicted, 5000 - cache.memory_usage());
+  EXPECT_EQ(cache.capacity(), 10000);
+  EXPECT_EQ(tracker->consumption(), cache.memory_usage());
+
+  // 被引用的条目不会被淘汰
+  size_t usage = cache.memory_usage();
+  EXPECT_EQ(cache.EvictTo(0), usage - 1000);
+  EXPECT_EQ(cache.memory_usage(), 1000);
+  IndexCacheHandle handle;
+  EXPECT_TRUE(cache.Lookup("pinned", &handle));
+  EXPECT_EQ(cache.EvictTo(5000), 0);
+}
+
+}  // namespace tenann
@@ -0,0 +1,69 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tenann/util/memory_usage.h"
+
+namespace tenann {
+
+TEST(MemoryUsageTest, AllocationSize) {
+  EXPECT_EQ(AllocationSize(size_t{0}), 0);
+  EXPECT_EQ(AllocationSize(size_t{1}), 16);
+  EXPECT_EQ(AllocationSize(size_t{17}), 32);
+  EXPECT_EQ(AllocationSize(size_t{128}), 128);
+  // 128 字节以上每个 2 的幂区间分为 4 档
+  EXPECT_EQ(AllocationSize(size_t{129}), 160);
+  EXPECT_EQ(AllocationSize(size_t{256}), 256);
+  EXPECT_EQ(AllocationSize(size_t{257}), 320);
+  EXPECT_EQ(AllocationSize(size_t{4097}), 5120);
+  EXPECT_EQ(AllocationSize(size_t{1} << 30), size_t{1} << 30);
+
+  for (size_t size = 1; size < 100000; size += 7) {
+    ASSERT_GE(AllocationSize(size), size);
+    ASSERT_LE(AllocationSize(size), size + size / 4 + 16);
+  }
+}
+
+TEST(MemoryUsageTest, AllocationSizeOfString) {
+  // 短字符串保存在对象内部, 不占用堆内存
+  EXPECT_EQ(AllocationSize(std::string("abc")), 0);
+  std::string s(100, 'x');
+  EXPECT_EQ(AllocationSize(s), AllocationSize(s.capacity() + 1));
+}
+
+TEST(MemoryUsageTest, Components) {
+  MemoryUsage usage;
+  std::vector<float> v(100);
+  usage.AddVector("vectors", v);
+  usage.AddAllocation("nodes", 24, 10);
+  usage.AddBytes("shared", 1000);
+  usage.AddVector("vectors", std::vector<int>());
+
+  EXPECT_EQ(usage.total(), AllocationSize(v.capacity() * sizeof(float)) + 32 * 10 + 1000);
+  auto doc = usage.ToJson();
+  EXPECT_EQ(doc["vectors"].get<size_t>(), AllocationSize(v.capacity() * sizeof(float)));
+  EXPECT_EQ(doc["nodes"].get<size_t>(), 320);
+  EXPECT_EQ(doc["shared"].get<size_t>(), 1000);
+  EXPECT_EQ(doc["total"].get<size_t>(), usage.total());
+}
+
+}  // namespace tenann
@@ -0,0 +1,75 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tenann/util/thread_pool.h"
+
+TEST(ThreadPoolTest, test_submit) {
+  tenann::ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+
+  std::vector<std::future<int>> futures;
+  for (int i = 0; i < 100; i++) {
+    futures.push_back(pool.Submit([i]() { return i * i; }));
+  }
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(futures[i].get(), i * i);
+  }
+
+  auto failed = pool.Submit([]() -> int { throw std::runtime_error("failed"); });
+  EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(ThreadPoolTest, test_drain_on_destruction) {
+  std::atomic<int> count = 0;
+  {
+    tenann::ThreadPool pool(2);
+    for (int i = 0; i < 100; i++) {
+      pool.Submit([&count]() { count++; });
+    }
+  }
+  EXPECT_EQ(count, 100);
+}
+
+TEST(ThreadPoolTest, test_parallel_for) {
+  tenann::ThreadPool pool(4);
+  std::vector<int> squares(1000);
+  pool.ParallelFor(squares.size(), 8, [&squares](size_t i) { squares[i] = i * i; });
+  for (size_t i = 0; i < squares.size(); i++) {
+    EXPECT_EQ(squares[i], i * i);
+  }
+
+  // nothing to run, and a single thread runs on the caller only
+  pool.ParallelFor(0, 4, [](size_t) { FAIL(); });
+  std::thread::id caller = std::this_thread::get_id();
+  pool.ParallelFor(10, 1, [caller](size_t) { EXPECT_EQ(std::this_thread::get_id(), caller); });
+
+  std::atomic<int> count = 0;
+  EXPECT_THROW(pool.ParallelFor(1000, 4,
+                                [&count](size_t i) {
+                                  count++;
+                                  if (i == 10) throw std::runtime_error("failed");
+                                }),
+               std::runtime_error);
+  EXPECT_LT(count, 1000);
+}
@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "tenann/common/error.h"
+#include "tenann/util/vector_convert.h"
+
+namespace tenann {
+
+TEST(VectorConvertTest, Fp16) {
+  EXPECT_EQ(FloatToFp16(0.0f), 0x0000);
+  EXPECT_EQ(FloatToFp16(-0.0f), 0x8000);
+  EXPECT_EQ(FloatToFp16(1.0f), 0x3c00);
+  EXPECT_EQ(FloatToFp16(-2.0f), 0xc000);
+  EXPECT_EQ(FloatToFp16(65504.0f), 0x7bff);
+  // 超出范围变为无穷
+  EXPECT_EQ(FloatToFp16(65520.0f), 0x7c00);
+  EXPECT_EQ(FloatToFp16(-1e10f), 0xfc00);
+  EXPECT_EQ(FloatToFp16(std::numeric_limits<float>::infinity()), 0x7c00);
+  EXPECT_TRUE(std::isnan(Fp16ToFloat(FloatToFp16(std::numeric_limits<float>::quiet_NaN()))));
+  // 非规格化数
+  EXPECT_EQ(FloatToFp16(std::ldexp(1.0f, -24)), 0x0001);
+  EXPECT_EQ(Fp16ToFloat(0x0001), std::ldexp(1.0f, -24));
+  EXPECT_EQ(Fp16ToFloat(0x03ff), std::ldexp(1023.0f, -24));
+  // 舍入到最近的偶数
+  EXPECT_EQ(FloatToFp16(1.0f + std::ldexp(1.0f, -11)), 0x3c00);
+  EXPECT_EQ(FloatToFp16(1.0f + 3 * std::ldexp(1.0f, -11)), 0x3c02);
+
+  // 所有有限的 fp16 往返不变
+  for (uint32_t h = 0; h < 0x10000; h++) {
+    if ((h & 0x7c00) == 0x7c00) {
+      continue;
+    }
+    ASSERT_EQ(FloatToFp16(Fp16ToFloat(h)), h) << h;
+  }
+}
+
+TEST(VectorConvertTest, Bf16) {
+  EXPECT_EQ(FloatToBf16(1.0f), 0x3f80);
+  EXPECT_EQ(Bf16ToFloat(0x3f80), 1.0f);
+  EXPECT_EQ(Bf16ToFloat(0xc000), -2.0f);
+  // 舍入到最近的偶数
+  EXPECT_EQ(FloatToBf16(1.0f + std::ldexp(1.0f, -8)), 0x3f80);
+  EXPECT_EQ(FloatToBf16(1.0f + 3 * std::ldexp(1.0f, -8)), 0x3f82);
+  EXPECT_TRUE(std::isnan(Bf16ToFloat(FloatToBf16(std::numeric_limits<float>::quiet_NaN()))));
+}
+
+TEST(VectorConvertTest, ConvertToFloat) {
+  // 长度不是向量宽度的倍数, 覆盖 SIMD 和标量两部分
+  constexpr size_t n = 77;
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-100, 100);
+  std::vector<float> expected(n);
+  std::vector<uint16_t> fp16(n), bf16(n);
+  std::vector<int8_t> int8(n);
+  std::vector<uint8_t> uint8(n);
+  for (size_t i = 0; i < n; i++) {
+    fp16[i] = FloatToFp16(dist(rng));
+    bf16[i] = FloatToBf16(dist(rng));
+    int8[i] = static_cast<int8_t>(rng());
+    uint8[i] = static_cast<uint8_t>(rng());
+  }
+
+  std::vector<float> out(n);
+  ConvertToFloat(PrimitiveType::kFloat16Type, reinterpret_cast<uint8_t*>(fp16.data()), n,
+                 out.data());
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(out[i], Fp16ToFloat(fp16[i]));
+  }
+  ConvertToFloat(PrimitiveType::kBFloat16Type, reinterpret_cast<uint8_t*>(bf16.data()), n,
+                 out.data());
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(out[i], Bf16ToFloat(bf16[i]));
+  }
+  ConvertToFloat(PrimitiveType::kInt8Type, reinterpret_cast<uint8_t*>(int8.data()), n,
+                 out.data());
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(out[i], int8[i]);
+  }
+  ConvertToFloat(PrimitiveType::kUInt8Type, uint8.data(), n, out.data());
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(out[i], uint8[i]);
+  }
+
+  EXPECT_THROW(ConvertToFloat(PrimitiveType::kDoubleType, uint8.data(), 1, out.data()), Error);
+}
+
+TEST(VectorConvertTest, VectorAsFloat) {
+  std::vector<float> floats = {1, 2, 3, 4};
+  std::vector<float> buffer;
+  PrimitiveSeqView float_view{.data = reinterpret_cast<uint8_t*>(floats.data()),
+                              .size = 4,
+                              .elem_type = PrimitiveType::kFloatType};
+  // float 不拷贝
+  EXPECT_EQ(VectorAsFloat(float_view, &buffer), floats.data());
+  EXPECT_TRUE(buffer.empty());
+
+  std::vector<uint16_t> halves = {FloatToFp16(1), FloatToFp16(2), FloatToFp16(3),
+                                  FloatToFp16(4)};
+  ArraySeqView half_view{.data = reinterpret_cast<uint8_t*>(halves.data()),
+                         .dim = 2,
+                         .size = 2,
+                         .elem_type = PrimitiveType::kFloat16Type};
+  const float* converted = VectorAsFloat(half_view, &buffer);
+  EXPECT_EQ(std::vector<float>(converted, converted + 4), floats);
+
+  float_view.elem_type = PrimitiveType::kInt32Type;
+  EXPECT_THROW(VectorAsFloat(float_view, &buffer), Error);
+}
+
+}  // namespace tenann